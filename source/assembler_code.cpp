@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 #include <string.h>
 
@@ -14,6 +15,22 @@
         return 0;                                                                     \
     }
 
+// offsets in the assembly file where the code of a source line starts,
+// turned into the _lines.txt table once the file is written
+struct AssemblyLineMark
+{
+    long offset;
+    int  line;
+};
+
+static AssemblyLineMark *LineMarks         = NULL;
+static int               LineMarksCount    = 0;
+static int               LineMarksCapacity = 0;
+static int               CurrentSourceLine = 0;
+
+static int assemblyMarkLine(int line, FILE *f);
+static int writeLineTable  (const char *assemblyName, const char *tableName);
+
 
 int createAssemblerCodeFile(Evaluator *eval, const char *fileInName)
 {
@@ -25,13 +42,90 @@ int createAssemblerCodeFile(Evaluator *eval, const char *fileInName)
 
     if (!f) return MEMORY_ERROR;
 
+    LineMarksCount    = 0;
+    CurrentSourceLine = 0;
+
     convertToAssemblyCode(eval, eval->tree.root, f);
 
     fprintf(f, "\nhlt\n");
 
     fclose(f);
+
+    char *tableName = getFileName(fileInName, "_lines.txt");
+    if (tableName) writeLineTable(fileName, tableName);
+
+    free(tableName);
     free(fileName);
 
+    free(LineMarks);
+    LineMarks         = NULL;
+    LineMarksCount    = 0;
+    LineMarksCapacity = 0;
+
+    return EXIT_SUCCESS;
+}
+
+static int assemblyMarkLine(int line, FILE *f)
+{
+    assert(f);
+
+    CurrentSourceLine = line;
+
+    if (LineMarksCount == LineMarksCapacity)
+    {
+        int               capacity = LineMarksCapacity ? LineMarksCapacity * 2 : 64;
+        AssemblyLineMark *marks    = (AssemblyLineMark *)realloc(LineMarks, (size_t)capacity * sizeof(AssemblyLineMark));
+        if (!marks) return MEMORY_ERROR;
+
+        LineMarks         = marks;
+        LineMarksCapacity = capacity;
+    }
+
+    LineMarks[LineMarksCount].offset = ftell(f);
+    LineMarks[LineMarksCount].line   = line;
+    LineMarksCount++;
+
+    return EXIT_SUCCESS;
+}
+
+// "<assembly line> <source line>", each entry holds until the next one
+static int writeLineTable(const char *assemblyName, const char *tableName)
+{
+    assert(assemblyName);
+    assert(tableName);
+
+    FILE *assembly = fopen(assemblyName, "rb");
+    if (!assembly) return EXIT_FAILURE;
+
+    FILE *table = fopen(tableName, "w");
+    if (!table) { fclose(assembly); return EXIT_FAILURE; }
+
+    fprintf(table, "# assembly line -> source line\n");
+
+    long offset       = 0;
+    int  assemblyLine = 1;
+    int  lastLine     = 0;
+
+    for (int i = 0; i < LineMarksCount; i++)
+    {
+        for ( ; offset < LineMarks[i].offset; offset++)
+        {
+            int c = getc(assembly);
+            if (c == EOF) break;
+            if (c == '\n') assemblyLine++;
+        }
+
+        // only the last of the marks at one offset counts
+        if (i + 1 < LineMarksCount && LineMarks[i + 1].offset == LineMarks[i].offset) continue;
+        if (LineMarks[i].line == lastLine) continue;
+
+        fprintf(table, "%d %d\n", assemblyLine, LineMarks[i].line);
+        lastLine = LineMarks[i].line;
+    }
+
+    fclose(assembly);
+    fclose(table);
+
     return EXIT_SUCCESS;
 }
 
@@ -60,6 +154,20 @@ int convertToAssemblyCode(Evaluator *eval, Node *root, FILE *f)
 
     if (!root) return EXIT_SUCCESS;
 
+    if (root->line && root->line != CurrentSourceLine)
+    {
+        int outerLine = CurrentSourceLine;
+
+        assemblyMarkLine(root->line, f);
+        int error = convertToAssemblyCode(eval, root, f);
+
+        // the rest of the enclosing statement (end labels, the loop jump) is its own line again,
+        // code outside of any statement goes to line 0
+        assemblyMarkLine(outerLine, f);
+
+        return error;
+    }
+
     switch (root->type)
     {
         case EXP_TREE_NOTHING:  return EXIT_SUCCESS;
@@ -199,7 +307,7 @@ int printCaseIf(Evaluator *eval, Node *root, FILE *f)
     {
          printJmpOperator(node->data.operatorNum, prefix, ifNumber, f);
     }
-    else fprintf(f, "jn :%s%d\n\n", prefix, ifNumber);
+    else fprintf(f, "je :%s%d\n\n", prefix, ifNumber);
     
     ifStaticNumber++;
     convertToAssemblyCode(eval, root->right,  f);
@@ -232,7 +340,7 @@ int printCaseWhile(Evaluator *eval, Node *root, FILE *f)
     {
          printJmpOperator(node->data.operatorNum, prefixEnd, whileNumber, f);
     }
-    else fprintf(f, "jn :%s%d\n\n", prefixEnd, whileNumber);
+    else fprintf(f, "je :%s%d\n\n", prefixEnd, whileNumber);
     
     whileStaticNumber++;
     convertToAssemblyCode(eval, root->right,  f);
@@ -262,7 +370,8 @@ int printJmpOperator(int oper, const char *labelPrefix, int labelNum,  FILE *f)
         case NOT_EQUAL: fprintf(f, "je :%s%d\n\n", labelPrefix, labelNum);
                         break;
 
-        default:        fprintf(f, "jn :%s%d\n\n", labelPrefix, labelNum);
+        // any other value is true when it is not zero
+        default:        fprintf(f, "je :%s%d\n\n", labelPrefix, labelNum);
                         break;
     }
 
@@ -0,0 +1,547 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <float.h>
+#include <time.h>
+#include <immintrin.h>
+
+#include "tree_of_expressions.h"
+#include "html_logfile.h"
+#include "batch_evaluate.h"
+
+#define CHECK_POISON_PTR(ptr) \
+    if (ptr == PtrPoison)     \
+    {                         \
+        LOG("ERROR: PoisonPtr detected in %s(%d) %s\n", __FILE__, __LINE__, __func__);\
+        return BAD_NODE_TYPE;                                                            \
+    }
+
+//-------------------------------------------------------------------------------------------------
+// Column evaluation: the tree is walked once per block of BatchBlockRows rows, every operator
+// node runs one kernel over the whole block. Operands live in per-depth scratch buffers,
+// variables are read straight from the input columns.
+//-------------------------------------------------------------------------------------------------
+
+const double BatchTwoOverPi    = 6.36619772367581382433e-01;
+const double BatchPiOver2Part1 = 1.57079632673412561417e+00;
+const double BatchPiOver2Part2 = 6.07710050630396597660e-11;
+const double BatchPiOver2Part3 = 2.02226624879595063154e-21;
+const double BatchTrigLimit    = 1e5;
+
+const double BatchSqrt2        = 1.41421356237309504880;
+const double BatchLn2Hi        = 6.93147180369123816490e-01;
+const double BatchLn2Lo        = 1.90821492927058770002e-10;
+const double BatchMinNormal    = DBL_MIN;
+const double BatchMaxFinite    = DBL_MAX;
+
+const double BatchSinCoeffs[] = { -1.66666666666666324348e-01,  8.33333333332248946124e-03,
+                                  -1.98412698298579493134e-04,  2.75573137070700676789e-06,
+                                  -2.50507602534068634195e-08,  1.58969099521155010221e-10 };
+
+const double BatchCosCoeffs[] = {  4.16666666666666019037e-02, -1.38888888888741095749e-03,
+                                   2.48015872894767294178e-05, -2.75573143513906633035e-07,
+                                   2.08757232129817482790e-09, -1.13596475577881948265e-11 };
+
+const double BatchLnCoeffs[]  = {  6.666666666666735130e-01,    3.999999999940941908e-01,
+                                   2.857142874366239149e-01,    2.222219843214978396e-01,
+                                   1.818357216161805012e-01,    1.531383769920937332e-01,
+                                   1.479819860511658591e-01 };
+
+const int BatchSinCoeffsCount = sizeof(BatchSinCoeffs) / sizeof(BatchSinCoeffs[0]);
+const int BatchCosCoeffsCount = sizeof(BatchCosCoeffs) / sizeof(BatchCosCoeffs[0]);
+const int BatchLnCoeffsCount  = sizeof(BatchLnCoeffs)  / sizeof(BatchLnCoeffs[0]);
+
+const long long BatchExponentMagic = 0x4330000000000000LL;   // bits of 2^52
+const long long BatchMantissaMask  = 0x000FFFFFFFFFFFFFLL;
+const long long BatchOneBits       = 0x3FF0000000000000LL;
+const double    BatchExponentBias  = 4503599627370496.0 + 1023;
+
+static BatchKernel  BatchKernels[BatchKernelsCount] = {};
+static const char  *BatchIsa = NULL;
+
+static void   batchKernelsInit(void);
+static int    batchTreeHeight(Node *node);
+static int    batchEvaluateNode(BatchEvaluator *batch, Node *node, int depth, const double **values);
+static double batchScalarCalculate(ExpTreeOperators oper, double left, double right, unsigned char *flag);
+static double batchReferenceEvaluate(Node *node, const double *row, unsigned char *flag);
+
+
+static double batchScalarCalculate(ExpTreeOperators oper, double left, double right, unsigned char *flag)
+{
+    ExpTreeErrors error = TREE_NO_ERROR;
+
+    double value = NodeCalculate(left, right, oper, &error);
+
+    switch (error)
+    {
+        case TREE_NO_ERROR:     return value;
+
+        case DIVISION_BY_ZERO:  *flag |= BATCH_DIVISION_BY_ZERO;
+                                return value;
+
+        case LOG_NEGATIVE_ARG:
+        case LOG_BAD_BASE:      *flag |= BATCH_LOG_DOMAIN;
+                                return value;
+
+        case UNKNOWN_OPERATOR:  case NODE_TYPE_NOTHING:
+        case MEMORY_ERROR:      case BAD_NODE_TYPE:
+        case BAD_VAR_INDEX:
+        default:                LOG("ERROR: %s: unexpected error %d\n", __func__, error);
+                                return value;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// scalar fallback
+//-------------------------------------------------------------------------------------------------
+
+#define SCALAR_KERNEL(name, oper)                                                       \
+    static void batchScalar##name(const double *left, const double *right, double *out, \
+                                  unsigned char *flags, int rows)                       \
+    {                                                                                   \
+        for (int i = 0; i < rows; i++)                                                  \
+        {                                                                               \
+            out[i] = batchScalarCalculate(oper, left ? left[i] : 0, right[i], &flags[i]); \
+        }                                                                               \
+    }
+
+SCALAR_KERNEL(Add,      ADD)
+SCALAR_KERNEL(Sub,      SUB)
+SCALAR_KERNEL(Mul,      MUL)
+SCALAR_KERNEL(Div,      DIV)
+SCALAR_KERNEL(Sqrt,     SQRT)
+SCALAR_KERNEL(Sin,      SIN)
+SCALAR_KERNEL(Cos,      COS)
+SCALAR_KERNEL(Ln,       LN)
+SCALAR_KERNEL(Logar,    LOGAR)
+SCALAR_KERNEL(Pow,      POW)
+SCALAR_KERNEL(Below,    BELOW)
+SCALAR_KERNEL(Above,    ABOVE)
+SCALAR_KERNEL(Equal,    EQUAL)
+SCALAR_KERNEL(NotEqual, NOT_EQUAL)
+
+#undef SCALAR_KERNEL
+
+static void batchScalarTableFill(BatchKernel *table)
+{
+    table[ADD]       = batchScalarAdd;
+    table[SUB]       = batchScalarSub;
+    table[MUL]       = batchScalarMul;
+    table[DIV]       = batchScalarDiv;
+    table[SQRT]      = batchScalarSqrt;
+    table[SIN]       = batchScalarSin;
+    table[COS]       = batchScalarCos;
+    table[LN]        = batchScalarLn;
+    table[LOGAR]     = batchScalarLogar;
+    table[POW]       = batchScalarPow;
+    table[BELOW]     = batchScalarBelow;
+    table[ABOVE]     = batchScalarAbove;
+    table[EQUAL]     = batchScalarEqual;
+    table[NOT_EQUAL] = batchScalarNotEqual;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+
+//-------------------------------------------------------------------------------------------------
+// AVX2 + FMA, 4 lanes
+//-------------------------------------------------------------------------------------------------
+
+#define VEC               __m256d
+#define VMASK             __m256d
+#define LANES             4
+#define BATCH_NAME(name)  batchAvx2##name
+#define SIMD_ATTR         __attribute__((target("avx2,fma")))
+#define SIMD_FN           static inline __attribute__((always_inline, target("avx2,fma")))
+
+#define VLOAD(p)          _mm256_loadu_pd(p)
+#define VSTORE(p, v)      _mm256_storeu_pd(p, v)
+#define VSET1(x)          _mm256_set1_pd(x)
+#define VADD(a, b)        _mm256_add_pd(a, b)
+#define VSUB(a, b)        _mm256_sub_pd(a, b)
+#define VMUL(a, b)        _mm256_mul_pd(a, b)
+#define VDIV(a, b)        _mm256_div_pd(a, b)
+#define VSQRT(a)          _mm256_sqrt_pd(a)
+#define VFMA(a, b, c)     _mm256_fmadd_pd(a, b, c)
+#define VROUND(a)         _mm256_round_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)
+#define VFLOOR(a)         _mm256_floor_pd(a)
+#define VABS(a)           _mm256_andnot_pd(_mm256_set1_pd(-0.0), a)
+
+#define VLT(a, b)         _mm256_cmp_pd(a, b, _CMP_LT_OQ)
+#define VGT(a, b)         _mm256_cmp_pd(a, b, _CMP_GT_OQ)
+#define VEQ(a, b)         _mm256_cmp_pd(a, b, _CMP_EQ_OQ)
+#define VBAD(a)           _mm256_cmp_pd(a, a, _CMP_UNORD_Q)
+#define VBLEND(m, a, b)   _mm256_blendv_pd(a, b, m)
+#define VMASK_OR(a, b)    _mm256_or_pd(a, b)
+#define VMASK_BITS(m)     _mm256_movemask_pd(m)
+
+#define VEXPONENT(a)      _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(                       \
+                                            _mm256_srli_epi64(_mm256_castpd_si256(a), 52),         \
+                                            _mm256_set1_epi64x(BatchExponentMagic))),              \
+                                        _mm256_set1_pd(BatchExponentBias))
+#define VMANTISSA(a)      _mm256_castsi256_pd(_mm256_or_si256(                                     \
+                                            _mm256_and_si256(_mm256_castpd_si256(a),               \
+                                                             _mm256_set1_epi64x(BatchMantissaMask)), \
+                                            _mm256_set1_epi64x(BatchOneBits)))
+
+#include "batch_kernels.h"
+
+#undef VEC
+#undef VMASK
+#undef LANES
+#undef BATCH_NAME
+#undef SIMD_ATTR
+#undef SIMD_FN
+#undef VLOAD
+#undef VSTORE
+#undef VSET1
+#undef VADD
+#undef VSUB
+#undef VMUL
+#undef VDIV
+#undef VSQRT
+#undef VFMA
+#undef VROUND
+#undef VFLOOR
+#undef VABS
+#undef VLT
+#undef VGT
+#undef VEQ
+#undef VBAD
+#undef VBLEND
+#undef VMASK_OR
+#undef VMASK_BITS
+#undef VEXPONENT
+#undef VMANTISSA
+
+//-------------------------------------------------------------------------------------------------
+// AVX-512F, 8 lanes
+//-------------------------------------------------------------------------------------------------
+
+#define VEC               __m512d
+#define VMASK             __mmask8
+#define LANES             8
+#define BATCH_NAME(name)  batchAvx512##name
+#define SIMD_ATTR         __attribute__((target("avx512f")))
+#define SIMD_FN           static inline __attribute__((always_inline, target("avx512f")))
+
+#define VLOAD(p)          _mm512_loadu_pd(p)
+#define VSTORE(p, v)      _mm512_storeu_pd(p, v)
+#define VSET1(x)          _mm512_set1_pd(x)
+#define VADD(a, b)        _mm512_add_pd(a, b)
+#define VSUB(a, b)        _mm512_sub_pd(a, b)
+#define VMUL(a, b)        _mm512_mul_pd(a, b)
+#define VDIV(a, b)        _mm512_div_pd(a, b)
+#define VSQRT(a)          _mm512_sqrt_pd(a)
+#define VFMA(a, b, c)     _mm512_fmadd_pd(a, b, c)
+#define VROUND(a)         _mm512_roundscale_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)
+#define VFLOOR(a)         _mm512_roundscale_pd(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC)
+#define VABS(a)           _mm512_abs_pd(a)
+
+#define VLT(a, b)         _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ)
+#define VGT(a, b)         _mm512_cmp_pd_mask(a, b, _CMP_GT_OQ)
+#define VEQ(a, b)         _mm512_cmp_pd_mask(a, b, _CMP_EQ_OQ)
+#define VBAD(a)           _mm512_cmp_pd_mask(a, a, _CMP_UNORD_Q)
+#define VBLEND(m, a, b)   _mm512_mask_blend_pd(m, a, b)
+#define VMASK_OR(a, b)    ((__mmask8)((a) | (b)))
+#define VMASK_BITS(m)     ((int)(m))
+
+#define VEXPONENT(a)      _mm512_sub_pd(_mm512_castsi512_pd(_mm512_or_si512(                       \
+                                            _mm512_srli_epi64(_mm512_castpd_si512(a), 52),         \
+                                            _mm512_set1_epi64(BatchExponentMagic))),               \
+                                        _mm512_set1_pd(BatchExponentBias))
+#define VMANTISSA(a)      _mm512_castsi512_pd(_mm512_or_si512(                                     \
+                                            _mm512_and_si512(_mm512_castpd_si512(a),               \
+                                                             _mm512_set1_epi64(BatchMantissaMask)), \
+                                            _mm512_set1_epi64(BatchOneBits)))
+
+#include "batch_kernels.h"
+
+#undef VEC
+#undef VMASK
+#undef LANES
+#undef BATCH_NAME
+#undef SIMD_ATTR
+#undef SIMD_FN
+#undef VLOAD
+#undef VSTORE
+#undef VSET1
+#undef VADD
+#undef VSUB
+#undef VMUL
+#undef VDIV
+#undef VSQRT
+#undef VFMA
+#undef VROUND
+#undef VFLOOR
+#undef VABS
+#undef VLT
+#undef VGT
+#undef VEQ
+#undef VBAD
+#undef VBLEND
+#undef VMASK_OR
+#undef VMASK_BITS
+#undef VEXPONENT
+#undef VMANTISSA
+
+#endif
+
+static void batchKernelsInit(void)
+{
+    if (BatchIsa) return;
+
+    batchScalarTableFill(BatchKernels);
+    const char *isa = "scalar";
+
+#if defined(__x86_64__) && defined(__GNUC__)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        batchAvx512TableFill(BatchKernels);
+        isa = "avx512f";
+    }
+    else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        batchAvx2TableFill(BatchKernels);
+        isa = "avx2";
+    }
+#endif
+
+    BatchIsa = isa;
+    LOG("batch evaluation: %s kernels\n", BatchIsa);
+}
+
+const char *batchInstructionSet(void)
+{
+    batchKernelsInit();
+
+    return BatchIsa;
+}
+
+static int batchTreeHeight(Node *node)
+{
+    if (!node || node == PtrPoison) return 0;
+
+    int left  = batchTreeHeight(node->left);
+    int right = batchTreeHeight(node->right);
+
+    return 1 + (left > right ? left : right);
+}
+
+int expTreeEvaluateBatch(Evaluator *eval, Node *root, const double *const *columns, int rows,
+                         double *result, unsigned char *errors)
+{
+    assert(eval);
+    assert(columns);
+    assert(result);
+    assert(errors);
+    CHECK_POISON_PTR(root);
+
+    batchKernelsInit();
+
+    int height = batchTreeHeight(root);
+
+    BatchEvaluator batch = {};
+    batch.eval    = eval;
+    batch.columns = columns;
+    batch.kernels = BatchKernels;
+    batch.buffers = (double *)calloc((size_t)(height + 1) * BatchBlockRows, sizeof(double));
+    if (!batch.buffers) return MEMORY_ERROR;
+
+    memset(errors, 0, (size_t)rows);
+
+    int error = EXIT_SUCCESS;
+
+    for (int offset = 0; offset < rows && !error; offset += BatchBlockRows)
+    {
+        batch.offset = offset;
+        batch.rows   = rows - offset < BatchBlockRows ? rows - offset : BatchBlockRows;
+        batch.flags  = errors + offset;
+
+        const double *values = NULL;
+        error = batchEvaluateNode(&batch, root, 0, &values);
+
+        if (!error) memcpy(result + offset, values, (size_t)batch.rows * sizeof(double));
+    }
+
+    for (int i = 0; i < rows && !error; i++)
+    {
+        if (errors[i]) result[i] = DataPoison;
+    }
+
+    free(batch.buffers);
+
+    if (error) LOG("ERROR: %s: couldn't evaluate batch: %d\n", __func__, error);
+
+    return error;
+}
+
+static int batchEvaluateNode(BatchEvaluator *batch, Node *node, int depth, const double **values)
+{
+    assert(batch);
+    assert(values);
+    CHECK_POISON_PTR(node);
+
+    double *out = batch->buffers + depth * BatchBlockRows;
+    *values = out;
+
+    if (!node)
+    {
+        memset(out, 0, (size_t)batch->rows * sizeof(double));
+        return EXIT_SUCCESS;
+    }
+
+    switch (node->type)
+    {
+        case EXP_TREE_NUMBER:
+        {
+            for (int i = 0; i < batch->rows; i++) out[i] = node->data.number;
+
+            return EXIT_SUCCESS;
+        }
+
+        case EXP_TREE_VARIABLE:
+        {
+            int index = node->data.variableNum;
+            if (index < 0 || index >= batch->eval->names.count) return BAD_VAR_INDEX;
+
+            if (batch->columns[index])
+            {
+                *values = batch->columns[index] + batch->offset;
+                return EXIT_SUCCESS;
+            }
+
+            double value = batch->eval->names.table[index].value;
+            for (int i = 0; i < batch->rows; i++) out[i] = value;
+
+            return EXIT_SUCCESS;
+        }
+
+        case EXP_TREE_OPERATOR: break;
+
+        case EXP_TREE_NOTHING:
+        case EXP_TREE_IDENTIF:
+        default:                return BAD_NODE_TYPE;
+    }
+
+    ExpTreeOperators oper = node->data.operatorNum;
+    if (oper < 0 || oper >= BatchKernelsCount || !batch->kernels[oper]) return UNKNOWN_OPERATOR;
+
+    const double *left  = NULL;
+    const double *right = NULL;
+
+    int error = batchEvaluateNode(batch, node->left, depth, &left);
+    if (!error) error = batchEvaluateNode(batch, node->right, depth + 1, &right);
+    if (error) return error;
+
+    batch->kernels[oper](left, right, out, batch->flags, batch->rows);
+    *values = out;
+
+    return EXIT_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+// benchmark against row-at-a-time evaluation
+//-------------------------------------------------------------------------------------------------
+
+static double batchReferenceEvaluate(Node *node, const double *row, unsigned char *flag)
+{
+    if (!node)                           return 0;
+    if (node->type == EXP_TREE_NUMBER)   return node->data.number;
+    if (node->type == EXP_TREE_VARIABLE) return row[node->data.variableNum];
+
+    double left  = batchReferenceEvaluate(node->left,  row, flag);
+    double right = batchReferenceEvaluate(node->right, row, flag);
+
+    return batchScalarCalculate(node->data.operatorNum, left, right, flag);
+}
+
+int batchBenchmark(Evaluator *eval, Node *expression, int rows, int runs, FILE *f)
+{
+    assert(eval);
+    assert(f);
+    CHECK_POISON_PTR(expression);
+
+    int varsCount = eval->names.count;
+
+    double        *data      = (double *)       calloc((size_t)(varsCount + 1) * rows, sizeof(double));
+    double        *result    = (double *)       calloc((size_t)rows, sizeof(double));
+    double        *reference = (double *)       calloc((size_t)rows, sizeof(double));
+    unsigned char *errors    = (unsigned char *)calloc((size_t)rows, sizeof(unsigned char));
+    unsigned char *refErrors = (unsigned char *)calloc((size_t)rows, sizeof(unsigned char));
+
+    const double *columns[NamesNumber] = {};
+    double        row[NamesNumber]     = {};
+
+    int error = (data && result && reference && errors && refErrors) ? EXIT_SUCCESS : MEMORY_ERROR;
+
+    for (int j = 0; j < varsCount && !error; j++)
+    {
+        double *column = data + (size_t)j * rows;
+        for (int i = 0; i < rows; i++) column[i] = 10.0 * rand() / RAND_MAX - 2.0;
+
+        columns[j] = column;
+    }
+
+    clock_t start = clock();
+
+    for (int run = 0; run < runs && !error; run++)
+    {
+        for (int i = 0; i < rows; i++)
+        {
+            for (int j = 0; j < varsCount; j++) row[j] = columns[j][i];
+
+            refErrors[i] = 0;
+            reference[i] = batchReferenceEvaluate(expression, row, &refErrors[i]);
+        }
+    }
+
+    double scalarTime = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    start = clock();
+
+    for (int run = 0; run < runs && !error; run++)
+    {
+        error = expTreeEvaluateBatch(eval, expression, columns, rows, result, errors);
+    }
+
+    double batchTime = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    if (!error)
+    {
+        double maxDiff    = 0;
+        int    errorRows  = 0;
+        int    mismatches = 0;
+
+        for (int i = 0; i < rows; i++)
+        {
+            if (errors[i]) errorRows++;
+            if (errors[i] != refErrors[i]) { mismatches++; continue; }
+            if (errors[i] || isnan(reference[i])) continue;
+
+            double diff = fabs(result[i] - reference[i]) / (fabs(reference[i]) > 1 ? fabs(reference[i]) : 1);
+            if (diff > maxDiff) maxDiff = diff;
+        }
+
+        double rowsDone = (double)rows * runs;
+
+        fprintf(f, "kernels:        %s\n", batchInstructionSet());
+        fprintf(f, "rows x runs:    %d x %d\n", rows, runs);
+        fprintf(f, "row at a time:  %lg s (%lg Mrows/s)\n", scalarTime, scalarTime > 0 ? rowsDone / scalarTime / 1e6 : 0);
+        fprintf(f, "batch:          %lg s (%lg Mrows/s)\n", batchTime,  batchTime  > 0 ? rowsDone / batchTime  / 1e6 : 0);
+        if (batchTime > 0) fprintf(f, "speedup:        %lg\n", scalarTime / batchTime);
+        fprintf(f, "max rel diff:   %lg\n", maxDiff);
+        fprintf(f, "error rows:     %d (flag mismatches %d)\n", errorRows, mismatches);
+    }
+
+    free(data);
+    free(result);
+    free(reference);
+    free(errors);
+    free(refErrors);
+
+    return error;
+}
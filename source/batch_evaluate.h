@@ -0,0 +1,40 @@
+#ifndef  __BATCH_EVALUATE_H__
+#define  __BATCH_EVALUATE_H__
+
+#include <stdio.h>
+
+#include "tree_of_expressions.h"
+
+enum BatchErrorFlags
+{
+    BATCH_NO_ERROR         = 0,
+    BATCH_DIVISION_BY_ZERO = 1,
+    BATCH_LOG_DOMAIN       = 2,
+};
+
+typedef void (*BatchKernel)(const double *left, const double *right, double *out,
+                            unsigned char *flags, int rows);
+
+const int BatchBlockRows = 256;
+const int BatchKernelsCount = NEW_VAR + 1;
+
+struct BatchEvaluator
+{
+    Evaluator           *eval;
+    const double *const *columns;
+    BatchKernel         *kernels;
+
+    double              *buffers;
+    unsigned char       *flags;
+    int                  offset;
+    int                  rows;
+};
+
+int expTreeEvaluateBatch(Evaluator *eval, Node *root, const double *const *columns, int rows,
+                         double *result, unsigned char *errors);
+
+const char *batchInstructionSet(void);
+
+int batchBenchmark(Evaluator *eval, Node *expression, int rows, int runs, FILE *f);
+
+#endif //__BATCH_EVALUATE_H__
@@ -0,0 +1,257 @@
+//-------------------------------------------------------------------------------------------------
+// Per-operator SIMD kernels for batch_evaluate.cpp.
+//
+// No include guard on purpose: batch_evaluate.cpp includes this file once per instruction set
+// after defining the vector macros below, so every kernel body is written once and compiled
+// for AVX2 and AVX-512 separately:
+//   VEC, VMASK, LANES, BATCH_NAME(name), SIMD_FN (inline helper), SIMD_ATTR (kernel target)
+//   VLOAD, VSTORE, VSET1, VADD, VSUB, VMUL, VDIV, VSQRT, VFMA, VROUND, VFLOOR, VABS
+//   VLT, VGT, VEQ, VBAD, VBLEND(mask, ifFalse, ifTrue), VMASK_OR, VMASK_BITS
+//   VEXPONENT(x) - unbiased binary exponent as double, VMANTISSA(x) - mantissa in [1, 2)
+//-------------------------------------------------------------------------------------------------
+
+SIMD_FN VEC BATCH_NAME(VecPoly)(VEC z, const double *coeffs, int count)
+{
+    VEC result = VSET1(coeffs[count - 1]);
+
+    for (int i = count - 2; i >= 0; i--) result = VFMA(result, z, VSET1(coeffs[i]));
+
+    return result;
+}
+
+// sin(r), cos(r) for |r| <= pi/4, fdlibm kernel coefficients
+SIMD_FN VEC BATCH_NAME(VecSinKernel)(VEC r)
+{
+    VEC z = VMUL(r, r);
+    VEC p = BATCH_NAME(VecPoly)(z, BatchSinCoeffs, BatchSinCoeffsCount);
+
+    return VFMA(VMUL(r, z), p, r);
+}
+
+SIMD_FN VEC BATCH_NAME(VecCosKernel)(VEC r)
+{
+    VEC z = VMUL(r, r);
+    VEC p = BATCH_NAME(VecPoly)(z, BatchCosCoeffs, BatchCosCoeffsCount);
+
+    return VFMA(VMUL(z, z), p, VFMA(z, VSET1(-0.5), VSET1(1)));
+}
+
+// quadrantShift = 0 for sin, 1 for cos (cos x = sin(x + pi/2))
+static VEC BATCH_NAME(VecSinCos)(VEC x, double quadrantShift) SIMD_ATTR;
+static VEC BATCH_NAME(VecSinCos)(VEC x, double quadrantShift)
+{
+    VEC k = VROUND(VMUL(x, VSET1(BatchTwoOverPi)));
+
+    VEC r = VFMA(k, VSET1(-BatchPiOver2Part1), x);
+    r     = VFMA(k, VSET1(-BatchPiOver2Part2), r);
+    r     = VFMA(k, VSET1(-BatchPiOver2Part3), r);
+
+    VEC q = VADD(k, VSET1(quadrantShift));
+    q     = VSUB(q, VMUL(VSET1(4), VFLOOR(VMUL(q, VSET1(0.25)))));
+
+    VEC sinR = BATCH_NAME(VecSinKernel)(r);
+    VEC cosR = BATCH_NAME(VecCosKernel)(r);
+
+    VMASK odd    = VEQ(VSUB(q, VMUL(VSET1(2), VFLOOR(VMUL(q, VSET1(0.5))))), VSET1(1));
+    VMASK negate = VGT(q, VSET1(1.5));
+
+    VEC result = VBLEND(odd, sinR, cosR);
+
+    return VBLEND(negate, result, VSUB(VSET1(0), result));
+}
+
+// ln(x) for positive normal finite x, fdlibm __ieee754_log reduction
+static VEC BATCH_NAME(VecLn)(VEC x) SIMD_ATTR;
+static VEC BATCH_NAME(VecLn)(VEC x)
+{
+    VEC e = VEXPONENT(x);
+    VEC m = VMANTISSA(x);
+
+    VMASK big = VGT(m, VSET1(BatchSqrt2));
+    m = VBLEND(big, m, VMUL(m, VSET1(0.5)));
+    e = VBLEND(big, e, VADD(e, VSET1(1)));
+
+    VEC f    = VSUB(m, VSET1(1));
+    VEC s    = VDIV(f, VADD(f, VSET1(2)));
+    VEC z    = VMUL(s, s);
+    VEC hfsq = VMUL(VSET1(0.5), VMUL(f, f));
+    VEC R    = VMUL(z, BATCH_NAME(VecPoly)(z, BatchLnCoeffs, BatchLnCoeffsCount));
+
+    VEC tail = VFMA(s, VADD(hfsq, R), VMUL(e, VSET1(BatchLn2Lo)));
+
+    return VFMA(e, VSET1(BatchLn2Hi), VSUB(f, VSUB(hfsq, tail)));
+}
+
+#define SCALAR_FIXUP(mask, oper)                                                        \
+    {                                                                                   \
+        int bits = VMASK_BITS(mask);                                                    \
+        for (int lane = 0; bits; lane++, bits >>= 1)                                    \
+        {                                                                               \
+            if (bits & 1) out[i + lane] = batchScalarCalculate(oper, left  ? left[i + lane] : 0, \
+                                                                     right[i + lane], &flags[i + lane]); \
+        }                                                                               \
+    }
+
+#define KERNEL_TAIL(oper)                                                               \
+    for ( ; i < rows; i++)                                                              \
+    {                                                                                   \
+        out[i] = batchScalarCalculate(oper, left ? left[i] : 0, right[i], &flags[i]);   \
+    }
+
+#define SET_FLAGS(mask, flag)                                                           \
+    {                                                                                   \
+        int bits = VMASK_BITS(mask);                                                    \
+        for (int lane = 0; bits; lane++, bits >>= 1)                                    \
+        {                                                                               \
+            if (bits & 1) flags[i + lane] |= flag;                                      \
+        }                                                                               \
+    }
+
+#define BINARY_KERNEL(name, oper, expression)                                           \
+    static void BATCH_NAME(name)(const double *left, const double *right, double *out,  \
+                                 unsigned char *flags, int rows) SIMD_ATTR;             \
+    static void BATCH_NAME(name)(const double *left, const double *right, double *out,  \
+                                 unsigned char *flags, int rows)                        \
+    {                                                                                   \
+        int i = 0;                                                                      \
+        for ( ; i + LANES <= rows; i += LANES)                                          \
+        {                                                                               \
+            VEC a = VLOAD(left  + i);                                                   \
+            VEC b = VLOAD(right + i);                                                   \
+            VSTORE(out + i, expression);                                                \
+        }                                                                               \
+        KERNEL_TAIL(oper);                                                              \
+    }
+
+BINARY_KERNEL(Add, ADD, VADD(a, b))
+BINARY_KERNEL(Sub, SUB, VSUB(a, b))
+BINARY_KERNEL(Mul, MUL, VMUL(a, b))
+
+BINARY_KERNEL(Below,    BELOW,     VBLEND(VLT(a, b), VSET1(0), VSET1(1)))
+BINARY_KERNEL(Above,    ABOVE,     VBLEND(VGT(a, b), VSET1(0), VSET1(1)))
+BINARY_KERNEL(Equal,    EQUAL,     VBLEND(VLT(VABS(VSUB(a, b)), VSET1(PrecisionConst)), VSET1(0), VSET1(1)))
+BINARY_KERNEL(NotEqual, NOT_EQUAL, VBLEND(VLT(VABS(VSUB(a, b)), VSET1(PrecisionConst)), VSET1(1), VSET1(0)))
+
+#undef BINARY_KERNEL
+
+static void BATCH_NAME(Div)(const double *left, const double *right, double *out,
+                            unsigned char *flags, int rows) SIMD_ATTR;
+static void BATCH_NAME(Div)(const double *left, const double *right, double *out,
+                            unsigned char *flags, int rows)
+{
+    int i = 0;
+    for ( ; i + LANES <= rows; i += LANES)
+    {
+        VEC a = VLOAD(left  + i);
+        VEC b = VLOAD(right + i);
+
+        VSTORE(out + i, VDIV(a, b));
+
+        VMASK zero = VLT(VABS(b), VSET1(PrecisionConst));
+        SET_FLAGS(zero, BATCH_DIVISION_BY_ZERO);
+    }
+    KERNEL_TAIL(DIV);
+}
+
+static void BATCH_NAME(Sqrt)(const double *left, const double *right, double *out,
+                             unsigned char *flags, int rows) SIMD_ATTR;
+static void BATCH_NAME(Sqrt)(const double *left, const double *right, double *out,
+                             unsigned char *flags, int rows)
+{
+    int i = 0;
+    for ( ; i + LANES <= rows; i += LANES) VSTORE(out + i, VSQRT(VLOAD(right + i)));
+
+    KERNEL_TAIL(SQRT);
+}
+
+#define TRIG_KERNEL(name, oper, shift)                                                  \
+    static void BATCH_NAME(name)(const double *left, const double *right, double *out,  \
+                                 unsigned char *flags, int rows) SIMD_ATTR;             \
+    static void BATCH_NAME(name)(const double *left, const double *right, double *out,  \
+                                 unsigned char *flags, int rows)                        \
+    {                                                                                   \
+        int i = 0;                                                                      \
+        for ( ; i + LANES <= rows; i += LANES)                                          \
+        {                                                                               \
+            VEC x = VLOAD(right + i);                                                   \
+            VSTORE(out + i, BATCH_NAME(VecSinCos)(x, shift));                           \
+                                                                                        \
+            VMASK fixup = VMASK_OR(VGT(VABS(x), VSET1(BatchTrigLimit)), VBAD(x));       \
+            SCALAR_FIXUP(fixup, oper);                                                  \
+        }                                                                               \
+        KERNEL_TAIL(oper);                                                              \
+    }
+
+TRIG_KERNEL(Sin, SIN, 0)
+TRIG_KERNEL(Cos, COS, 1)
+
+#undef TRIG_KERNEL
+
+static void BATCH_NAME(Ln)(const double *left, const double *right, double *out,
+                           unsigned char *flags, int rows) SIMD_ATTR;
+static void BATCH_NAME(Ln)(const double *left, const double *right, double *out,
+                           unsigned char *flags, int rows)
+{
+    int i = 0;
+    for ( ; i + LANES <= rows; i += LANES)
+    {
+        VEC x = VLOAD(right + i);
+        VSTORE(out + i, BATCH_NAME(VecLn)(x));
+
+        VMASK fixup = VMASK_OR(VLT(x, VSET1(BatchMinNormal)), VMASK_OR(VGT(x, VSET1(BatchMaxFinite)), VBAD(x)));
+        SCALAR_FIXUP(fixup, LN);
+    }
+    KERNEL_TAIL(LN);
+}
+
+static void BATCH_NAME(Logar)(const double *left, const double *right, double *out,
+                              unsigned char *flags, int rows) SIMD_ATTR;
+static void BATCH_NAME(Logar)(const double *left, const double *right, double *out,
+                              unsigned char *flags, int rows)
+{
+    int i = 0;
+    for ( ; i + LANES <= rows; i += LANES)
+    {
+        VEC base = VLOAD(left  + i);
+        VEC x    = VLOAD(right + i);
+
+        VSTORE(out + i, VDIV(BATCH_NAME(VecLn)(x), BATCH_NAME(VecLn)(base)));
+
+        VMASK fixup = VMASK_OR(VMASK_OR(VLT(x,    VSET1(BatchMinNormal)), VGT(x,    VSET1(BatchMaxFinite))),
+                               VMASK_OR(VLT(base, VSET1(BatchMinNormal)), VGT(base, VSET1(BatchMaxFinite))));
+        fixup = VMASK_OR(fixup, VMASK_OR(VBAD(x), VBAD(base)));
+        fixup = VMASK_OR(fixup, VLT(VABS(VSUB(base, VSET1(1))), VSET1(PrecisionConst)));
+
+        SCALAR_FIXUP(fixup, LOGAR);
+    }
+    KERNEL_TAIL(LOGAR);
+}
+
+static void BATCH_NAME(Pow)(const double *left, const double *right, double *out,
+                            unsigned char *flags, int rows)
+{
+    int i = 0;
+    KERNEL_TAIL(POW);
+}
+
+#undef SCALAR_FIXUP
+#undef KERNEL_TAIL
+#undef SET_FLAGS
+
+static void BATCH_NAME(TableFill)(BatchKernel *table)
+{
+    table[ADD]       = BATCH_NAME(Add);
+    table[SUB]       = BATCH_NAME(Sub);
+    table[MUL]       = BATCH_NAME(Mul);
+    table[DIV]       = BATCH_NAME(Div);
+    table[SQRT]      = BATCH_NAME(Sqrt);
+    table[SIN]       = BATCH_NAME(Sin);
+    table[COS]       = BATCH_NAME(Cos);
+    table[LN]        = BATCH_NAME(Ln);
+    table[LOGAR]     = BATCH_NAME(Logar);
+    table[POW]       = BATCH_NAME(Pow);
+    table[BELOW]     = BATCH_NAME(Below);
+    table[ABOVE]     = BATCH_NAME(Above);
+    table[EQUAL]     = BATCH_NAME(Equal);
+    table[NOT_EQUAL] = BATCH_NAME(NotEqual);
+}
@@ -0,0 +1,371 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <math.h>
+
+#include "tree_of_expressions.h"
+#include "html_logfile.h"
+#include "assembler_code.h"
+#include "fast_math.h"
+#include "c_code.h"
+
+#define CHECK_POISON_PTR(ptr) \
+    if (ptr == PtrPoison)     \
+    {                         \
+        LOG("ERROR: PoisonPtr detected in %s(%d) %s\n", __FILE__, __LINE__, __func__);\
+        return BAD_NODE_TYPE;                                                            \
+    }
+
+#define C_WRITE(...) fprintf(f, __VA_ARGS__)
+
+static int printCIndent(int indent, FILE *f);
+static int printCPrologue(Evaluator *eval, FILE *f);
+static int printCCondition(Evaluator *eval, Node *node, FILE *f);
+static int printCNumber(double number, FILE *f);
+
+
+int createCCodeFile(Evaluator *eval, const char *fileInName, bool compile)
+{
+    assert(eval);
+    assert(fileInName);
+
+    char *cName   = getFileName(fileInName, "_gen.c");
+    char *exeName = getFileName(fileInName, "_c");
+
+    FILE *f = fopen(cName, "w");
+    if (!f) { free(cName); free(exeName); return MEMORY_ERROR; }
+
+    int error = convertToCCode(eval, eval->tree.root, f);
+    fclose(f);
+
+    if (!error && compile)
+    {
+        char *command = NULL;
+
+        __mingw_asprintf(&command, "cc -O2 -o %s %s -lm", exeName, cName);
+        LOG("c backend: %s\n", command);
+        if (system(command) != 0) error = EXIT_FAILURE;
+        free(command);
+
+        if (error) printf("ERROR: couldn't compile %s\n", cName);
+        else       printf("c executable: %s\n", exeName);
+    }
+
+    free(cName);
+    free(exeName);
+
+    return error;
+}
+
+int convertToCCode(Evaluator *eval, Node *root, FILE *f)
+{
+    assert(eval);
+    assert(f);
+
+    printCPrologue(eval, f);
+
+    C_WRITE("int main(void)\n{\n");
+
+    for (int i = 0; i < eval->names.count; i++)
+    {
+        C_WRITE("    double v_%s = %lg;\n", eval->names.table[i].name, DefaultVarValue);
+    }
+    C_WRITE("\n");
+
+    int error = printCStatement(eval, root, 1, f);
+
+    C_WRITE("\n    return 0;\n}\n");
+
+    if (error) LOG("ERROR: %s: couldn't generate C code: %d\n", __func__, error);
+
+    return error;
+}
+
+static int printCPrologue(Evaluator *eval, FILE *f)
+{
+    assert(eval);
+    assert(f);
+
+    C_WRITE("/* generated from the expression tree */\n\n");
+    C_WRITE("#include <stdio.h>\n");
+    C_WRITE("#include <stdlib.h>\n");
+    C_WRITE("#include <math.h>\n\n");
+
+    fastMathPrintC(f);
+
+    bool fast = FastMath != FAST_MATH_OFF;
+    C_WRITE("static inline double mathSin(double x) { return %s(x); }\n", fast ? "fastSin" : "sin");
+    C_WRITE("static inline double mathCos(double x) { return %s(x); }\n", fast ? "fastCos" : "cos");
+    C_WRITE("static inline double mathLn (double x) { return %s(x); }\n", fast ? "fastLn"  : "log");
+    C_WRITE("static inline double mathPow(double x, double y) { return %s(x, y); }\n\n", fast ? "fastPow" : "pow");
+
+    C_WRITE("static void programError(int error)\n{\n");
+    C_WRITE("    printf(\"ERROR: program finished with error %%d\\n\", error);\n");
+    C_WRITE("    exit(1);\n}\n\n");
+
+    C_WRITE("static inline int equalDouble(double a, double b)\n{\n");
+    C_WRITE("    return fabs(a - b) < %.17g;\n}\n\n", PrecisionConst);
+
+    C_WRITE("static inline double checkedDiv(double a, double b)\n{\n");
+    C_WRITE("    if (equalDouble(b, 0)) programError(%d);\n", DIVISION_BY_ZERO);
+    C_WRITE("    return a / b;\n}\n\n");
+
+    C_WRITE("static inline double checkedLn(double a)\n{\n");
+    C_WRITE("    if (a < 0) programError(%d);\n", LOG_NEGATIVE_ARG);
+    C_WRITE("    return mathLn(a);\n}\n\n");
+
+    C_WRITE("static inline double checkedLogar(double base, double a)\n{\n");
+    C_WRITE("    if (a < 0) programError(%d);\n", LOG_NEGATIVE_ARG);
+    C_WRITE("    if (base < 0 || equalDouble(base, 1)) programError(%d);\n", LOG_BAD_BASE);
+    C_WRITE("    return mathLn(a) / mathLn(base);\n}\n\n");
+
+    C_WRITE("static inline double programInput(void)\n{\n");
+    C_WRITE("    double value = %lg;\n", DefaultVarValue);
+    C_WRITE("    if (scanf(\"%%lg\", &value) != 1) fprintf(stderr, \"ERROR: couldn't read input value\\n\");\n");
+    C_WRITE("    return value;\n}\n\n");
+
+    C_WRITE("static inline void programOutput(double value)\n{\n");
+    C_WRITE("    printf(\"%%lg\\n\", value);\n}\n\n");
+
+    return EXIT_SUCCESS;
+}
+
+static int printCIndent(int indent, FILE *f)
+{
+    for (int i = 0; i < indent; i++) C_WRITE("    ");
+
+    return EXIT_SUCCESS;
+}
+
+int printCVariable(Evaluator *eval, Node *node, FILE *f)
+{
+    assert(eval);
+    assert(f);
+
+    if (!node || node->type != EXP_TREE_VARIABLE) return BAD_NODE_TYPE;
+
+    int index = node->data.variableNum;
+    if (index < 0 || index >= eval->names.count) return BAD_VAR_INDEX;
+
+    C_WRITE("v_%s", eval->names.table[index].name);
+
+    return EXIT_SUCCESS;
+}
+
+int printCStatement(Evaluator *eval, Node *node, int indent, FILE *f)
+{
+    assert(eval);
+    assert(f);
+    CHECK_POISON_PTR(node);
+
+    if (!node) return EXIT_SUCCESS;
+    if (node->type != EXP_TREE_OPERATOR) return BAD_NODE_TYPE;
+
+    int error = EXIT_SUCCESS;
+
+    switch (node->data.operatorNum)
+    {
+        case INSTR_END:
+        {
+            for ( ; node && !error; node = node->right)
+            {
+                if (node->type != EXP_TREE_OPERATOR || node->data.operatorNum != INSTR_END)
+                {
+                    return printCStatement(eval, node, indent, f);
+                }
+
+                error = printCStatement(eval, node->left, indent, f);
+            }
+
+            return error;
+        }
+
+        case ASSIGN:
+        {
+            printCIndent(indent, f);
+            error = printCVariable(eval, node->right, f);
+            C_WRITE(" = ");
+            if (!error) error = printCExpression(eval, node->left, f);
+            C_WRITE(";\n");
+
+            return error;
+        }
+
+        case IN:
+        {
+            printCIndent(indent, f);
+            error = printCVariable(eval, node->right, f);
+            C_WRITE(" = programInput();\n");
+
+            return error;
+        }
+
+        case OUT:
+        {
+            printCIndent(indent, f);
+            C_WRITE("programOutput(");
+            error = printCExpression(eval, node->right, f);
+            C_WRITE(");\n");
+
+            return error;
+        }
+
+        case IF: case WHILE:
+        {
+            printCIndent(indent, f);
+            C_WRITE(node->data.operatorNum == IF ? "if (" : "while (");
+            error = printCCondition(eval, node->left, f);
+            C_WRITE(")\n");
+
+            printCIndent(indent, f);
+            C_WRITE("{\n");
+            if (!error) error = printCStatement(eval, node->right, indent + 1, f);
+            printCIndent(indent, f);
+            C_WRITE("}\n");
+
+            return error;
+        }
+
+        case ADD:    case SUB:
+        case MUL:    case DIV:
+        case LN:     case LOGAR:
+        case POW:    case SIN:
+        case COS:    case SQRT:
+        case BELOW:  case ABOVE:
+        case EQUAL:  case NOT_EQUAL:
+        case OPEN_F: case CLOSE_F:
+        case THEN:   case NEW_VAR:
+        case L_BRACKET: case R_BRACKET:
+        case NOT_OPER:
+        default:     LOG("ERROR: %s: operator %d is not a statement\n", __func__, node->data.operatorNum);
+                     return UNKNOWN_OPERATOR;
+    }
+}
+
+#define PRINT_BINARY(prefix, separator, suffix)              \
+    {                                                        \
+        C_WRITE(prefix);                                     \
+        error = printCExpression(eval, node->left, f);       \
+        C_WRITE(separator);                                  \
+        if (!error) error = printCExpression(eval, node->right, f); \
+        C_WRITE(suffix);                                     \
+        return error;                                        \
+    }
+
+#define PRINT_UNARY(prefix)                                  \
+    {                                                        \
+        C_WRITE(prefix);                                     \
+        error = printCExpression(eval, node->right, f);      \
+        C_WRITE(")");                                        \
+        return error;                                        \
+    }
+
+static int printCCondition(Evaluator *eval, Node *node, FILE *f)
+{
+    CHECK_POISON_PTR(node);
+    if (!node) return BAD_NODE_TYPE;
+
+    if (node->type == EXP_TREE_OPERATOR)
+    {
+        int error = EXIT_SUCCESS;
+
+        switch (node->data.operatorNum)
+        {
+            case BELOW:     PRINT_BINARY("(", " < ", ")");
+            case ABOVE:     PRINT_BINARY("(", " > ", ")");
+            case EQUAL:     PRINT_BINARY("equalDouble(", ", ", ")");
+            case NOT_EQUAL: PRINT_BINARY("!equalDouble(", ", ", ")");
+
+            case NOT_OPER:  case ADD:
+            case SUB:       case MUL:
+            case DIV:       case LN:
+            case LOGAR:     case POW:
+            case SIN:       case COS:
+            case R_BRACKET: case L_BRACKET:
+            case ASSIGN:    case IF:
+            case INSTR_END: case OPEN_F:
+            case CLOSE_F:   case WHILE:
+            case IN:        case OUT:
+            case THEN:      case SQRT:
+            case NEW_VAR:
+            default:        break;
+        }
+    }
+
+    C_WRITE("!equalDouble(");
+    int error = printCExpression(eval, node, f);
+    C_WRITE(", 0)");
+
+    return error;
+}
+
+// "%g" writes inf and nan, which are no C constants, the simplifier folds them from ln(0) and the like
+static int printCNumber(double number, FILE *f)
+{
+    assert(f);
+
+    if      (isnan(number))                 C_WRITE("NAN");
+    else if (isinf(number) && number > 0)   C_WRITE("HUGE_VAL");
+    else if (isinf(number))                 C_WRITE("(-HUGE_VAL)");
+    else                                    C_WRITE("%.17g", number);
+
+    return EXIT_SUCCESS;
+}
+
+int printCExpression(Evaluator *eval, Node *node, FILE *f)
+{
+    assert(eval);
+    assert(f);
+    CHECK_POISON_PTR(node);
+
+    if (!node) return BAD_NODE_TYPE;
+
+    switch (node->type)
+    {
+        case EXP_TREE_NUMBER:   return printCNumber(node->data.number, f);
+
+        case EXP_TREE_VARIABLE: return printCVariable(eval, node, f);
+
+        case EXP_TREE_OPERATOR: break;
+
+        case EXP_TREE_NOTHING:
+        case EXP_TREE_IDENTIF:
+        default:                return BAD_NODE_TYPE;
+    }
+
+    int error = EXIT_SUCCESS;
+
+    switch (node->data.operatorNum)
+    {
+        case ADD:       PRINT_BINARY("(", " + ", ")");
+        case SUB:       PRINT_BINARY("(", " - ", ")");
+        case MUL:       PRINT_BINARY("(", " * ", ")");
+        case DIV:       PRINT_BINARY("checkedDiv(", ", ", ")");
+        case POW:       PRINT_BINARY("mathPow(", ", ", ")");
+        case LOGAR:     PRINT_BINARY("checkedLogar(", ", ", ")");
+
+        case BELOW:     PRINT_BINARY("(double)(", " < ", ")");
+        case ABOVE:     PRINT_BINARY("(double)(", " > ", ")");
+        case EQUAL:     PRINT_BINARY("(double)equalDouble(", ", ", ")");
+        case NOT_EQUAL: PRINT_BINARY("(double)!equalDouble(", ", ", ")");
+
+        case LN:        PRINT_UNARY("checkedLn(");
+        case SIN:       PRINT_UNARY("mathSin(");
+        case COS:       PRINT_UNARY("mathCos(");
+        case SQRT:      PRINT_UNARY("sqrt(");
+
+        case ASSIGN: case IF:
+        case WHILE:  case IN:
+        case OUT:    case INSTR_END:
+        case OPEN_F: case CLOSE_F:
+        case THEN:   case NEW_VAR:
+        case L_BRACKET: case R_BRACKET:
+        case NOT_OPER:
+        default:     LOG("ERROR: %s: operator %d is not an expression\n", __func__, node->data.operatorNum);
+                     return UNKNOWN_OPERATOR;
+    }
+}
+
+#undef PRINT_BINARY
+#undef PRINT_UNARY
+#undef C_WRITE
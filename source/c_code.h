@@ -0,0 +1,16 @@
+#ifndef  __C_CODE_H__
+#define  __C_CODE_H__
+
+#include <stdio.h>
+
+#include "tree_of_expressions.h"
+
+int createCCodeFile(Evaluator *eval, const char *fileInName, bool compile);
+
+int convertToCCode(Evaluator *eval, Node *root, FILE *f);
+
+int printCStatement (Evaluator *eval, Node *node, int indent, FILE *f);
+int printCExpression(Evaluator *eval, Node *node, FILE *f);
+int printCVariable  (Evaluator *eval, Node *node, FILE *f);
+
+#endif //__C_CODE_H__
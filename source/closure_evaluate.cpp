@@ -0,0 +1,418 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <time.h>
+
+#include "tree_of_expressions.h"
+#include "html_logfile.h"
+#include "fast_math.h"
+#include "recursive_descent_reading.h"
+#include "closure_evaluate.h"
+
+#define CHECK_POISON_PTR(ptr) \
+    if (ptr == PtrPoison)     \
+    {                         \
+        LOG("ERROR: PoisonPtr detected in %s(%d) %s\n", __FILE__, __LINE__, __func__);\
+        return BAD_NODE_TYPE;                                                            \
+    }
+
+//-------------------------------------------------------------------------------------------------
+// closurePrepare() flattens the tree into ops in evaluation order. Leaves are not ops: numbers and
+// variables are bound into the operands of their parent, and every op points to the step
+// instantiated for its operator and operand kinds, so evaluation is a loop over calls with no
+// switches left in it. Every op writes its own slot.
+//-------------------------------------------------------------------------------------------------
+
+const int ClosureStartCapacity = 32;
+
+// the values of the variables in the order they first appear in the formula
+struct ClosureCheckCase
+{
+    const char *formula;
+    double      vars[NamesNumber];
+};
+
+static const ClosureCheckCase ClosureCheckCases[] =
+{
+    {"x plus y",                            {1, 2}},
+    {"ln(x delit y)",                       {1, 0}},
+    {"ln(x delit y) plus ln(0 minus x)",    {1, 0}},
+    {"ln(0 minus x) plus x delit y",        {1, 0}},
+    {"x delit y umnozhit ln(0 minus x)",    {1, 0}},
+    {"koreshok(x) umnozhit y",              {-1, 2}},
+};
+
+const int ClosureCheckCasesCount = (int)(sizeof(ClosureCheckCases) / sizeof(ClosureCheckCases[0]));
+
+static ClosureFunction ClosureTable[NEW_VAR + 1][ClosureKinds][ClosureKinds] = {};
+static bool            ClosureTableReady = false;
+
+static void closureTableInit(void);
+static bool closureCheckCase(const ClosureCheckCase *check, FILE *f);
+static int  closurePrepareNode(ClosureProgram *program, Evaluator *eval, Node *node, ClosureOperand *operand);
+
+
+template <ExpTreeOperators Oper>
+static inline double closureApply(double left, double right, ExpTreeErrors *error)
+{
+    switch (Oper)
+    {
+        case ADD:       return left + right;
+        case SUB:       return left - right;
+        case MUL:       return left * right;
+
+        case DIV:       if (fabs(right) < PrecisionConst) { *error = DIVISION_BY_ZERO; return DataPoison; }
+                        return left / right;
+
+        case LN:        if (right < 0) { *error = LOG_NEGATIVE_ARG; return DataPoison; }
+                        return mathLn(right);
+
+        case LOGAR:     if (right < 0) { *error = LOG_NEGATIVE_ARG; return DataPoison; }
+                        if (left  < 0 || fabs(left - 1) < PrecisionConst) { *error = LOG_BAD_BASE; return DataPoison; }
+                        return mathLn(right) / mathLn(left);
+
+        case POW:       return mathPow(left, right);
+        case SIN:       return mathSin(right);
+        case COS:       return mathCos(right);
+        case SQRT:      return sqrt(right);
+
+        case BELOW:     return left < right;
+        case ABOVE:     return left > right;
+        case EQUAL:     return fabs(left - right) <  PrecisionConst;
+        case NOT_EQUAL: return fabs(left - right) >= PrecisionConst;
+
+        case L_BRACKET: case R_BRACKET:
+        case ASSIGN:    case IF:
+        case OPEN_F:    case CLOSE_F:
+        case INSTR_END: case WHILE:
+        case IN:        case OUT:
+        case THEN:      case NEW_VAR:
+                        return 0;
+
+        case NOT_OPER:
+        default:        *error = UNKNOWN_OPERATOR;
+                        return DataPoison;
+    }
+}
+
+template <ClosureOperandKind Kind>
+static inline double closureOperand(const ClosureOperand *operand, const double *slots, const double *vars)
+{
+    switch (Kind)
+    {
+        case CLOSURE_SLOT:  return slots[operand->index];
+        case CLOSURE_VAR:   return vars [operand->index];
+        case CLOSURE_CONST: return operand->constant;
+        default:            return 0;
+    }
+}
+
+template <ExpTreeOperators Oper, ClosureOperandKind Left, ClosureOperandKind Right>
+static void closureStep(const ClosureOp *op, double *slots, const double *vars, ExpTreeErrors *error)
+{
+    double left  = closureOperand<Left> (&op->left,  slots, vars);
+    double right = closureOperand<Right>(&op->right, slots, vars);
+
+    slots[op->target] = closureApply<Oper>(left, right, error);
+}
+
+template <ExpTreeOperators Oper>
+static void closureFillShapes(ClosureFunction table[ClosureKinds][ClosureKinds])
+{
+    table[CLOSURE_SLOT] [CLOSURE_SLOT]  = closureStep<Oper, CLOSURE_SLOT,  CLOSURE_SLOT>;
+    table[CLOSURE_SLOT] [CLOSURE_VAR]   = closureStep<Oper, CLOSURE_SLOT,  CLOSURE_VAR>;
+    table[CLOSURE_SLOT] [CLOSURE_CONST] = closureStep<Oper, CLOSURE_SLOT,  CLOSURE_CONST>;
+    table[CLOSURE_VAR]  [CLOSURE_SLOT]  = closureStep<Oper, CLOSURE_VAR,   CLOSURE_SLOT>;
+    table[CLOSURE_VAR]  [CLOSURE_VAR]   = closureStep<Oper, CLOSURE_VAR,   CLOSURE_VAR>;
+    table[CLOSURE_VAR]  [CLOSURE_CONST] = closureStep<Oper, CLOSURE_VAR,   CLOSURE_CONST>;
+    table[CLOSURE_CONST][CLOSURE_SLOT]  = closureStep<Oper, CLOSURE_CONST, CLOSURE_SLOT>;
+    table[CLOSURE_CONST][CLOSURE_VAR]   = closureStep<Oper, CLOSURE_CONST, CLOSURE_VAR>;
+    table[CLOSURE_CONST][CLOSURE_CONST] = closureStep<Oper, CLOSURE_CONST, CLOSURE_CONST>;
+}
+
+static void closureTableInit(void)
+{
+    if (ClosureTableReady) return;
+
+    closureFillShapes<ADD>      (ClosureTable[ADD]);
+    closureFillShapes<SUB>      (ClosureTable[SUB]);
+    closureFillShapes<MUL>      (ClosureTable[MUL]);
+    closureFillShapes<DIV>      (ClosureTable[DIV]);
+    closureFillShapes<LN>       (ClosureTable[LN]);
+    closureFillShapes<LOGAR>    (ClosureTable[LOGAR]);
+    closureFillShapes<POW>      (ClosureTable[POW]);
+    closureFillShapes<SIN>      (ClosureTable[SIN]);
+    closureFillShapes<COS>      (ClosureTable[COS]);
+    closureFillShapes<SQRT>     (ClosureTable[SQRT]);
+    closureFillShapes<BELOW>    (ClosureTable[BELOW]);
+    closureFillShapes<ABOVE>    (ClosureTable[ABOVE]);
+    closureFillShapes<EQUAL>    (ClosureTable[EQUAL]);
+    closureFillShapes<NOT_EQUAL>(ClosureTable[NOT_EQUAL]);
+
+    ClosureTableReady = true;
+}
+
+int closurePrepare(Evaluator *eval, Node *root, ClosureProgram *program)
+{
+    assert(eval);
+    assert(program);
+    CHECK_POISON_PTR(root);
+
+    closureTableInit();
+
+    program->opsCount    = 0;
+    program->opsCapacity = ClosureStartCapacity;
+    program->ops         = (ClosureOp *)calloc((size_t)program->opsCapacity, sizeof(ClosureOp));
+    program->slots       = NULL;
+    if (!program->ops) return MEMORY_ERROR;
+
+    int error = closurePrepareNode(program, eval, root, &program->result);
+
+    if (!error)
+    {
+        program->slots = (double *)calloc((size_t)program->opsCount + 1, sizeof(double));
+        if (!program->slots) error = MEMORY_ERROR;
+    }
+
+    if (error) LOG("ERROR: %s: couldn't prepare the tree: %d\n", __func__, error);
+
+    return error;
+}
+
+int closureProgramDtor(ClosureProgram *program)
+{
+    assert(program);
+
+    free(program->ops);
+    free(program->slots);
+
+    program->ops         = NULL;
+    program->slots       = NULL;
+    program->opsCount    = 0;
+    program->opsCapacity = 0;
+
+    return EXIT_SUCCESS;
+}
+
+static int closurePrepareNode(ClosureProgram *program, Evaluator *eval, Node *node, ClosureOperand *operand)
+{
+    assert(program);
+    assert(eval);
+    assert(operand);
+    CHECK_POISON_PTR(node);
+
+    *operand = {};
+
+    if (!node)
+    {
+        operand->kind     = CLOSURE_CONST;
+        operand->constant = 0;
+        return EXIT_SUCCESS;
+    }
+
+    switch (node->type)
+    {
+        case EXP_TREE_NUMBER:   operand->kind     = CLOSURE_CONST;
+                                operand->constant = node->data.number;
+                                return EXIT_SUCCESS;
+
+        case EXP_TREE_VARIABLE: if (node->data.variableNum < 0 || node->data.variableNum >= eval->names.count)
+                                {
+                                    return BAD_VAR_INDEX;
+                                }
+                                operand->kind  = CLOSURE_VAR;
+                                operand->index = node->data.variableNum;
+                                return EXIT_SUCCESS;
+
+        case EXP_TREE_OPERATOR: break;
+
+        case EXP_TREE_NOTHING:
+        case EXP_TREE_IDENTIF:
+        default:                return BAD_NODE_TYPE;
+    }
+
+    ExpTreeOperators oper = node->data.operatorNum;
+    if (oper < 0 || oper > NEW_VAR || !ClosureTable[oper][CLOSURE_SLOT][CLOSURE_SLOT]) return UNKNOWN_OPERATOR;
+
+    ClosureOp op = {};
+    op.oper = oper;
+
+    int error = closurePrepareNode(program, eval, node->left, &op.left);
+    if (!error) error = closurePrepareNode(program, eval, node->right, &op.right);
+    if (error) return error;
+
+    if (program->opsCount == program->opsCapacity)
+    {
+        ClosureOp *ops = (ClosureOp *)realloc(program->ops, (size_t)program->opsCapacity * 2 * sizeof(ClosureOp));
+        if (!ops) return MEMORY_ERROR;
+
+        program->ops          = ops;
+        program->opsCapacity *= 2;
+    }
+
+    op.target   = program->opsCount;
+    op.function = ClosureTable[oper][op.left.kind][op.right.kind];
+
+    program->ops[program->opsCount++] = op;
+
+    operand->kind  = CLOSURE_SLOT;
+    operand->index = op.target;
+
+    return EXIT_SUCCESS;
+}
+
+double closureEvaluate(ClosureProgram *program, const double *vars, ExpTreeErrors *error)
+{
+    assert(program);
+    assert(error);
+
+    ExpTreeErrors stepError = TREE_NO_ERROR;
+
+    const ClosureOp *ops   = program->ops;
+    double          *slots = program->slots;
+
+    // the first error is the one the tree walk reports, what comes after it is not evaluated
+    for (int i = 0; i < program->opsCount && !stepError; i++) ops[i].function(&ops[i], slots, vars, &stepError);
+
+    if (stepError)
+    {
+        *error = stepError;
+        return DataPoison;
+    }
+
+    switch (program->result.kind)
+    {
+        case CLOSURE_SLOT:  return slots[program->result.index];
+        case CLOSURE_VAR:   return vars [program->result.index];
+        case CLOSURE_CONST: return program->result.constant;
+        default:            return DataPoison;
+    }
+}
+
+double closureEvaluateNames(ClosureProgram *program, NameTable *names, ExpTreeErrors *error)
+{
+    assert(program);
+    assert(names);
+    assert(error);
+
+    double vars[NamesNumber] = {};
+    for (int i = 0; i < names->count; i++) vars[i] = names->table[i].value;
+
+    return closureEvaluate(program, vars, error);
+}
+
+int closureBenchmark(Evaluator *eval, Node *expression, int runs, FILE *f)
+{
+    assert(eval);
+    assert(f);
+    CHECK_POISON_PTR(expression);
+
+    ClosureProgram program = {};
+
+    clock_t start = clock();
+    int error = closurePrepare(eval, expression, &program);
+    double prepareTime = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    if (error) { closureProgramDtor(&program); return error; }
+
+    ExpTreeErrors treeError = TREE_NO_ERROR;
+    double        treeValue = 0;
+
+    start = clock();
+    for (int i = 0; i < runs; i++)
+    {
+        treeError = TREE_NO_ERROR;
+        treeValue = expTreeEvaluate(eval, expression, &treeError);
+    }
+    double treeTime = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    ExpTreeErrors closureError = TREE_NO_ERROR;
+    double        closureValue = 0;
+
+    start = clock();
+    for (int i = 0; i < runs; i++)
+    {
+        closureError = TREE_NO_ERROR;
+        closureValue = closureEvaluateNames(&program, &eval->names, &closureError);
+    }
+    double closureTime = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    fprintf(f, "ops:            %d\n", program.opsCount);
+    fprintf(f, "runs:           %d\n", runs);
+    fprintf(f, "prepare:        %lg s\n", prepareTime);
+    fprintf(f, "tree walk:      %lg s\n", treeTime);
+    fprintf(f, "closures:       %lg s\n", closureTime);
+    if (closureTime > 0) fprintf(f, "speedup:        %lg\n", treeTime / closureTime);
+    fprintf(f, "check:          " ElemNumberFormat " vs " ElemNumberFormat " (errors %d, %d)\n",
+               closureValue, treeValue, closureError, treeError);
+
+    closureProgramDtor(&program);
+
+    return EXIT_SUCCESS;
+}
+
+int closureCheck(FILE *f)
+{
+    assert(f);
+
+    int failed = 0;
+
+    for (int i = 0; i < ClosureCheckCasesCount; i++)
+    {
+        if (!closureCheckCase(&ClosureCheckCases[i], f)) failed++;
+    }
+
+    fprintf(f, "closure check: %d of %d failed\n", failed, ClosureCheckCasesCount);
+
+    return failed;
+}
+
+static bool closureCheckCase(const ClosureCheckCase *check, FILE *f)
+{
+    assert(check);
+    assert(f);
+
+    Evaluator      eval    = {};
+    ClosureProgram program = {};
+    evaluatorCtor(&eval);
+
+    bool  passed = false;
+    Node *root   = getFormula(&eval, check->formula);
+
+    if (root != PtrPoison)
+    {
+        eval.tree.root = root;
+
+        for (int i = 0; i < eval.names.count; i++) eval.names.table[i].value = check->vars[i];
+
+        ExpTreeErrors treeError = TREE_NO_ERROR;
+        double        treeValue = expTreeEvaluate(&eval, root, &treeError);
+
+        ExpTreeErrors closureError = TREE_NO_ERROR;
+        double        closureValue = DataPoison;
+
+        if (closurePrepare(&eval, root, &program) == EXIT_SUCCESS)
+        {
+            closureValue = closureEvaluateNames(&program, &eval.names, &closureError);
+
+            // nan is not equal to itself, but it is the same answer
+            passed = closureError == treeError &&
+                     (treeError || memcmp(&closureValue, &treeValue, sizeof(double)) == 0 ||
+                      (isnan(closureValue) && isnan(treeValue)));
+        }
+
+        if (!passed)
+        {
+            fprintf(f, "FAILED %s: closure " ElemNumberFormat " (error %d), tree " ElemNumberFormat " (error %d)\n",
+                       check->formula, closureValue, closureError, treeValue, treeError);
+        }
+    }
+    else fprintf(f, "FAILED %s: syntax error\n", check->formula);
+
+    closureProgramDtor(&program);
+    evaluatorDtor(&eval);
+
+    return passed;
+}
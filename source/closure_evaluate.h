@@ -0,0 +1,58 @@
+#ifndef  __CLOSURE_EVALUATE_H__
+#define  __CLOSURE_EVALUATE_H__
+
+#include <stdio.h>
+
+#include "tree_of_expressions.h"
+
+enum ClosureOperandKind
+{
+    CLOSURE_SLOT  = 0,
+    CLOSURE_VAR   = 1,
+    CLOSURE_CONST = 2,
+};
+
+const int ClosureKinds = 3;
+
+struct ClosureOperand
+{
+    ClosureOperandKind kind;
+    int                index;
+    double             constant;
+};
+
+struct ClosureOp;
+
+typedef void (*ClosureFunction)(const ClosureOp *op, double *slots, const double *vars, ExpTreeErrors *error);
+
+struct ClosureOp
+{
+    ClosureFunction  function;
+    ClosureOperand   left;
+    ClosureOperand   right;
+    int              target;
+    ExpTreeOperators oper;
+};
+
+struct ClosureProgram
+{
+    ClosureOp     *ops;
+    int            opsCount;
+    int            opsCapacity;
+
+    double        *slots;
+    ClosureOperand result;
+};
+
+int closurePrepare    (Evaluator *eval, Node *root, ClosureProgram *program);
+int closureProgramDtor(ClosureProgram *program);
+
+double closureEvaluate     (ClosureProgram *program, const double *vars, ExpTreeErrors *error);
+double closureEvaluateNames(ClosureProgram *program, NameTable *names,   ExpTreeErrors *error);
+
+int closureBenchmark(Evaluator *eval, Node *expression, int runs, FILE *f);
+
+// the closures against the tree walk on formulas that fail and ones that don't, returns the mismatches
+int closureCheck(FILE *f);
+
+#endif //__CLOSURE_EVALUATE_H__
@@ -0,0 +1,569 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "tree_of_expressions.h"
+#include "html_logfile.h"
+#include "simplify_rules.h"
+#include "egraph.h"
+#include "cse.h"
+
+#define CHECK_POISON_PTR(ptr) \
+    if (ptr == PtrPoison)     \
+    {                         \
+        LOG("ERROR: PoisonPtr detected in %s(%d) %s\n", __FILE__, __LINE__, __func__);\
+        return 0;                                                                     \
+    }
+
+//-------------------------------------------------------------------------------------------------
+// Common subexpression elimination by value numbering over the statements of a block. An
+// expression that is computed again later, before any of its variables is assigned, is stored
+// once in a compiler temporary (a new variable "_tN" assigned right before the statement that
+// computes it first) and every later occurrence reads the temporary instead. The available
+// expressions flow into the body of koli and pokuda, a pokuda first forgets everything its
+// loop assigns, and nothing defined inside a body outlives it. vvedi assigns its variable.
+// A temporary costs a pop and a push per use, so it is made only when that does not cost
+// more than computing the expression every time (egraphTreeCost). The number of temporaries
+// is limited by the free slots of the name table.
+//-------------------------------------------------------------------------------------------------
+
+#define IS_OPER(node, oper) ((node) && (node)->type == EXP_TREE_OPERATOR && (node)->data.operatorNum == (oper))
+#define VAR_BIT(node)       ((node) && (node)->type == EXP_TREE_VARIABLE ? 1u << (node)->data.variableNum : 0u)
+
+const unsigned CseHashBasis = 2166136261u;
+const unsigned CseHashPrime = 16777619u;
+
+// what a lookahead for a candidate has seen so far
+struct CseScan
+{
+    Node    *candidate;
+    unsigned hash;
+    unsigned vars;
+    unsigned killed;       // variables assigned since the candidate was computed
+    bool     stopped;      // one of the candidate's variables was assigned
+};
+
+static int  cseBlock    (CsePass *cse, Node **link);
+static int  cseStatement(CsePass *cse, Node *item);
+static int  cseBody     (CsePass *cse, Node **body);
+
+static int  cseReplace(CsePass *cse, Node **slot);
+static int  cseDefine (CsePass *cse, Node **slot, Node **expr, Node *item);
+static int  cseNewTemp(CsePass *cse, Node **slot, Node **expr, Node *item);
+static int  cseKill   (CsePass *cse, unsigned vars);
+static int  cseFind   (CsePass *cse, Node *node, unsigned hash, unsigned killed);
+
+static int      cseCountChain    (CsePass *cse, Node *chain, CseScan *scan);
+static int      cseCountStatement(CsePass *cse, Node *stmt,  CseScan *scan);
+static unsigned cseCountIn       (CsePass *cse, Node *node,  CseScan *scan, int *count);
+
+static bool     cseIsCandidate(Node *node);
+static unsigned cseHash       (Node *node);
+static unsigned cseCombine    (Node *node, unsigned left, unsigned right);
+static unsigned cseVars       (Node *node);
+static unsigned cseAssigned   (Node *node);
+static Node    *cseCopy       (Node *node);
+
+
+int cseOptimize(Evaluator *eval, Node **root, CseStats *stats)
+{
+    assert(eval);
+    assert(root);
+    CHECK_POISON_PTR(*root);
+
+    CsePass cse = {};
+    cse.eval    = eval;
+
+    cse.entries = (CseEntry *)calloc(CseStartEntries, sizeof(CseEntry));
+    if (!cse.entries) return MEMORY_ERROR;
+
+    cse.entriesCapacity = CseStartEntries;
+
+    // a temporary is made for the biggest repeated expression only, what repeats inside of its
+    // value is found by the next round, which sees the assignment as an ordinary statement
+    int error = EXIT_SUCCESS;
+    int temps = -1;
+
+    for (int round = 0; !error && round < CseMaxRounds && temps != cse.stats.temps; round++)
+    {
+        temps = cse.stats.temps;
+        error = cseBody(&cse, root);
+    }
+
+    free(cse.entries);
+
+    LOG("%s: %d temporaries, %d expressions reused\n", __func__, cse.stats.temps, cse.stats.reused);
+
+    if (stats) *stats = cse.stats;
+
+    return error;
+}
+
+// a body of koli or pokuda is a block or a single statement, the latter is made a block of one
+// so that assignments can be inserted in front of it
+static int cseBody(CsePass *cse, Node **body)
+{
+    assert(cse);
+    assert(body);
+
+    if (!*body) return EXIT_SUCCESS;
+
+    if (!IS_OPER(*body, INSTR_END))
+    {
+        Node *block = createNode(EXP_TREE_OPERATOR, createNodeData(EXP_TREE_OPERATOR, INSTR_END), *body, NULL);
+        if (!block) return MEMORY_ERROR;
+
+        *body = block;
+    }
+
+    int   entriesCount = cse->entriesCount;
+    Node **outerLink   = cse->link;
+
+    int error = cseBlock(cse, body);
+
+    // what the body has computed is not known to be computed after it
+    for (int i = entriesCount; i < cse->entriesCount; i++) subTreeDtor(cse->entries[i].expr);
+    cse->entriesCount = entriesCount;
+    cse->link         = outerLink;
+
+    return error;
+}
+
+static int cseBlock(CsePass *cse, Node **link)
+{
+    assert(cse);
+    assert(link);
+
+    while (IS_OPER(*link, INSTR_END))
+    {
+        Node *item = *link;
+
+        cse->link = link;
+
+        int error = cseStatement(cse, item);
+        if (error) return error;
+
+        link = &item->right;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int cseStatement(CsePass *cse, Node *item)
+{
+    assert(cse);
+    assert(item);
+
+    Node *stmt = item->left;
+    if (!stmt || stmt->type != EXP_TREE_OPERATOR) return EXIT_SUCCESS;
+
+    int error = EXIT_SUCCESS;
+
+    switch (stmt->data.operatorNum)
+    {
+        case ASSIGN:    cseReplace(cse, &stmt->left);
+                        error = cseDefine(cse, &stmt->left, &stmt->left, item);
+                        cseKill(cse, VAR_BIT(stmt->right));
+                        return error;
+
+        case OUT:       cseReplace(cse, &stmt->right);
+                        return cseDefine(cse, &stmt->right, &stmt->right, item);
+
+        case IN:        cseKill(cse, VAR_BIT(stmt->right));
+                        return EXIT_SUCCESS;
+
+        case IF:        cseReplace(cse, &stmt->left);
+                        error = cseDefine(cse, &stmt->left, &stmt->left, item);
+                        if (!error) error = cseBody(cse, &stmt->right);
+
+                        cseKill(cse, cseAssigned(stmt->right));
+                        return error;
+
+        // the condition runs again after every pass of the body, a temporary assigned in front
+        // of the loop would go stale, so it only reuses what is already there
+        case WHILE:     cseKill(cse, cseAssigned(stmt));
+                        cseReplace(cse, &stmt->left);
+                        return cseBody(cse, &stmt->right);
+
+        case INSTR_END: {
+                        Node **link = cse->link;
+
+                        error = cseBlock(cse, &item->left);
+
+                        cse->link = link;
+                        return error;
+                        }
+
+        case NOT_OPER:  case ADD:       case SUB:       case MUL:
+        case DIV:       case LN:        case LOGAR:     case POW:
+        case SIN:       case COS:       case R_BRACKET: case L_BRACKET:
+        case BELOW:     case ABOVE:     case OPEN_F:    case CLOSE_F:
+        case THEN:      case EQUAL:     case NOT_EQUAL: case SQRT:
+        case NEW_VAR:
+        default:        return EXIT_SUCCESS;
+    }
+}
+
+// top-down, so that the biggest available expression is the one reused
+static int cseReplace(CsePass *cse, Node **slot)
+{
+    assert(cse);
+    assert(slot);
+
+    Node *node = *slot;
+    if (!node || node->type != EXP_TREE_OPERATOR) return 0;
+
+    if (cseIsCandidate(node))
+    {
+        int entry = cseFind(cse, node, cseHash(node), 0);
+
+        if (entry != IndexPoison)
+        {
+            *slot = createNode(EXP_TREE_VARIABLE, createNodeData(EXP_TREE_VARIABLE, cse->entries[entry].temp), NULL, NULL);
+            if (!*slot)
+            {
+                *slot = node;
+                return 0;
+            }
+
+            subTreeDtor(node);
+            cse->stats.reused++;
+
+            return 1;
+        }
+    }
+
+    return cseReplace(cse, &node->left) + cseReplace(cse, &node->right);
+}
+
+// looks for a subexpression of *slot worth a temporary, counting its occurrences from the
+// statement item on, the statement itself included; expr is the whole expression of it
+static int cseDefine(CsePass *cse, Node **slot, Node **expr, Node *item)
+{
+    assert(cse);
+    assert(slot);
+    assert(expr);
+    assert(item);
+
+    Node *node = *slot;
+    if (!node || node->type != EXP_TREE_OPERATOR) return EXIT_SUCCESS;
+
+    if (cseIsCandidate(node))
+    {
+        CseScan scan   = {};
+        scan.candidate = node;
+        scan.hash      = cseHash(node);
+        scan.vars      = cseVars(node);
+
+        int    count = cseCountChain(cse, item, &scan);
+        double cost  = egraphTreeCost(node);
+
+        // computed count times against once plus a pop and count pushes
+        if (count >= 2 && count * cost >= cost + 1 + count) return cseNewTemp(cse, slot, expr, item);
+    }
+
+    int error = cseDefine(cse, &node->left, expr, item);
+    if (!error) error = cseDefine(cse, &node->right, expr, item);
+
+    return error;
+}
+
+static int cseNewTemp(CsePass *cse, Node **slot, Node **expr, Node *item)
+{
+    assert(cse);
+    assert(slot);
+    assert(expr);
+    assert(item);
+
+    if (cse->entriesCount == cse->entriesCapacity)
+    {
+        int       capacity = cse->entriesCapacity * 2;
+        CseEntry *entries  = (CseEntry *)realloc(cse->entries, (size_t)capacity * sizeof(CseEntry));
+        if (!entries) return MEMORY_ERROR;
+
+        cse->entries         = entries;
+        cse->entriesCapacity = capacity;
+    }
+
+    int temp = nameTableAddTemp(&cse->eval->names, CseTempPrefix);
+    if (temp == IndexPoison) return EXIT_SUCCESS;     // no free names left, not an error
+
+    Node *value  = cseCopy(*slot);
+    Node *saved  = cseCopy(*slot);
+    Node *var    = createNode(EXP_TREE_VARIABLE, createNodeData(EXP_TREE_VARIABLE, temp), NULL, NULL);
+    Node *assign = createNode(EXP_TREE_OPERATOR, createNodeData(EXP_TREE_OPERATOR, ASSIGN), value, var);
+    Node *define = createNode(EXP_TREE_OPERATOR, createNodeData(EXP_TREE_OPERATOR, INSTR_END), assign, *cse->link);
+
+    if (!value || !saved || !var || !assign || !define)
+    {
+        if (define) destroyNode(&define);
+        if (assign) destroyNode(&assign);
+
+        subTreeDtor(value);
+        subTreeDtor(saved);
+        subTreeDtor(var);
+
+        return MEMORY_ERROR;
+    }
+
+    assign->line = item->left ? item->left->line : 0;
+
+    CseEntry entry = {};
+    entry.expr  = saved;
+    entry.hash  = cseHash(saved);
+    entry.vars  = cseVars(saved);
+    entry.temp  = temp;
+    entry.valid = true;
+
+    cse->entries[cse->entriesCount++] = entry;
+    cse->stats.temps++;
+
+    LOG("%s: %s is a temporary for a subexpression of line %d\n", __func__, cse->eval->names.table[temp].name, assign->line);
+
+    // in front of the statement, which keeps being the current one
+    *cse->link = define;
+    cse->link  = &define->right;
+
+    cseReplace(cse, expr);
+
+    return EXIT_SUCCESS;
+}
+
+static int cseKill(CsePass *cse, unsigned vars)
+{
+    assert(cse);
+
+    int killed = 0;
+
+    for (int i = 0; i < cse->entriesCount; i++)
+    {
+        if (cse->entries[i].valid && (cse->entries[i].vars & vars))
+        {
+            cse->entries[i].valid = false;
+            killed++;
+        }
+    }
+
+    return killed;
+}
+
+// an entry still valid after the variables in killed are assigned
+static int cseFind(CsePass *cse, Node *node, unsigned hash, unsigned killed)
+{
+    assert(cse);
+    assert(node);
+
+    for (int i = cse->entriesCount - 1; i >= 0; i--)
+    {
+        CseEntry *entry = &cse->entries[i];
+
+        if (entry->valid && !(entry->vars & killed) && entry->hash == hash && ruleTreesEqual(entry->expr, node)) return i;
+    }
+
+    return IndexPoison;
+}
+
+//-------------------------------------------------------------------------------------------------
+// The lookahead follows what the pass itself will do later: occurrences inside an expression
+// that is already available are not counted (they will read that temporary instead), a body
+// is looked into only if it does not assign the candidate's variables, and the scan stops at
+// the first statement that does.
+//-------------------------------------------------------------------------------------------------
+
+static int cseCountChain(CsePass *cse, Node *chain, CseScan *scan)
+{
+    assert(cse);
+    assert(scan);
+
+    int count = 0;
+
+    for (Node *item = chain; IS_OPER(item, INSTR_END) && !scan->stopped; item = item->right)
+    {
+        count += cseCountStatement(cse, item->left, scan);
+    }
+
+    return count;
+}
+
+static int cseCountStatement(CsePass *cse, Node *stmt, CseScan *scan)
+{
+    assert(cse);
+    assert(scan);
+
+    if (!stmt || stmt->type != EXP_TREE_OPERATOR) return 0;
+
+    int      count    = 0;
+    unsigned assigned = 0;
+
+    switch (stmt->data.operatorNum)
+    {
+        case INSTR_END: return cseCountChain(cse, stmt, scan);
+
+        case ASSIGN:    cseCountIn(cse, stmt->left, scan, &count);
+                        assigned = VAR_BIT(stmt->right);
+                        break;
+
+        case OUT:       cseCountIn(cse, stmt->right, scan, &count);
+                        break;
+
+        case IN:        assigned = VAR_BIT(stmt->right);
+                        break;
+
+        case IF:        cseCountIn(cse, stmt->left, scan, &count);
+                        assigned = cseAssigned(stmt->right);
+
+                        if (!(assigned & scan->vars))
+                        {
+                            if (IS_OPER(stmt->right, INSTR_END)) count += cseCountChain    (cse, stmt->right, scan);
+                            else                                 count += cseCountStatement(cse, stmt->right, scan);
+                        }
+                        break;
+
+        case WHILE:     assigned = cseAssigned(stmt);
+                        scan->killed |= assigned;
+
+                        if (!(assigned & scan->vars))
+                        {
+                            cseCountIn(cse, stmt->left, scan, &count);
+
+                            if (IS_OPER(stmt->right, INSTR_END)) count += cseCountChain    (cse, stmt->right, scan);
+                            else                                 count += cseCountStatement(cse, stmt->right, scan);
+                        }
+                        break;
+
+        case NOT_OPER:  case ADD:       case SUB:       case MUL:
+        case DIV:       case LN:        case LOGAR:     case POW:
+        case SIN:       case COS:       case R_BRACKET: case L_BRACKET:
+        case BELOW:     case ABOVE:     case OPEN_F:    case CLOSE_F:
+        case THEN:      case EQUAL:     case NOT_EQUAL: case SQRT:
+        case NEW_VAR:
+        default:        break;
+    }
+
+    scan->killed |= assigned;
+    if (assigned & scan->vars) scan->stopped = true;
+
+    return count;
+}
+
+// post-order, returns the hash of node
+static unsigned cseCountIn(CsePass *cse, Node *node, CseScan *scan, int *count)
+{
+    assert(cse);
+    assert(scan);
+    assert(count);
+
+    if (!node || node == PtrPoison) return 0;
+
+    int      inside = 0;
+    unsigned left   = cseCountIn(cse, node->left,  scan, &inside);
+    unsigned right  = cseCountIn(cse, node->right, scan, &inside);
+    unsigned hash   = cseCombine(node, left, right);
+
+    if (hash == scan->hash && ruleTreesEqual(node, scan->candidate))
+    {
+        (*count)++;
+    }
+    else if (!cseIsCandidate(node) || cseFind(cse, node, hash, scan->killed) == IndexPoison)
+    {
+        *count += inside;
+    }
+
+    return hash;
+}
+
+static bool cseIsCandidate(Node *node)
+{
+    if (!node || node->type != EXP_TREE_OPERATOR) return false;
+
+    switch (node->data.operatorNum)
+    {
+        case ADD: case SUB: case MUL: case DIV: case POW:
+        case LN:  case LOGAR: case SIN: case COS: case SQRT:
+                        return true;
+
+        case NOT_OPER:  case R_BRACKET: case L_BRACKET: case ASSIGN:
+        case BELOW:     case ABOVE:     case IF:        case INSTR_END:
+        case OPEN_F:    case CLOSE_F:   case WHILE:     case IN:
+        case OUT:       case THEN:      case EQUAL:     case NOT_EQUAL:
+        case NEW_VAR:
+        default:        return false;
+    }
+}
+
+static unsigned cseHash(Node *node)
+{
+    if (!node || node == PtrPoison) return 0;
+
+    return cseCombine(node, cseHash(node->left), cseHash(node->right));
+}
+
+static unsigned cseCombine(Node *node, unsigned left, unsigned right)
+{
+    assert(node);
+
+    unsigned data = 0;
+
+    switch (node->type)
+    {
+        case EXP_TREE_NUMBER:
+        {
+            double value = node->data.number;
+            if (!(value < 0) && !(value > 0)) value = 0;     // -0 and 0
+
+            unsigned long long bits = 0;
+            memcpy(&bits, &value, sizeof(bits));
+
+            data = (unsigned)(bits ^ (bits >> 32));
+            break;
+        }
+
+        case EXP_TREE_OPERATOR: data = (unsigned)node->data.operatorNum;
+                                break;
+
+        case EXP_TREE_VARIABLE: data = (unsigned)node->data.variableNum;
+                                break;
+
+        case EXP_TREE_IDENTIF:  data = (unsigned)node->data.idNum;
+                                break;
+
+        case EXP_TREE_NOTHING:
+        default:                break;
+    }
+
+    unsigned hash = (CseHashBasis ^ (unsigned)node->type) * CseHashPrime;
+
+    hash = (hash ^ data)  * CseHashPrime;
+    hash = (hash ^ left)  * CseHashPrime;
+    hash = (hash ^ right) * CseHashPrime;
+
+    return hash;
+}
+
+static unsigned cseVars(Node *node)
+{
+    if (!node || node == PtrPoison) return 0;
+
+    return VAR_BIT(node) | cseVars(node->left) | cseVars(node->right);
+}
+
+// variables that the statements in node assign
+static unsigned cseAssigned(Node *node)
+{
+    if (!node || node == PtrPoison || node->type != EXP_TREE_OPERATOR) return 0;
+
+    if (IS_OPER(node, ASSIGN) || IS_OPER(node, IN)) return VAR_BIT(node->right);
+
+    return cseAssigned(node->left) | cseAssigned(node->right);
+}
+
+static Node *cseCopy(Node *node)
+{
+    if (!node || node == PtrPoison) return NULL;
+
+    Node *copy = createNode(node->type, node->data, cseCopy(node->left), cseCopy(node->right));
+    if (copy) copy->line = node->line;
+
+    return copy;
+}
@@ -0,0 +1,42 @@
+#ifndef  __CSE_H__
+#define  __CSE_H__
+
+#include <stdio.h>
+
+#include "tree_of_expressions.h"
+
+const int  CseStartEntries = 16;
+const int  CseMaxRounds    = 8;
+const char CseTempPrefix[] = "_t";
+
+struct CseEntry
+{
+    Node    *expr;         // a copy of the expression the temporary holds
+    unsigned hash;
+    unsigned vars;         // bit mask of the variables it reads
+    int      temp;         // variable index of the temporary
+    bool     valid;        // false once one of its variables is assigned
+};
+
+struct CseStats
+{
+    int temps;
+    int reused;
+};
+
+struct CsePass
+{
+    Evaluator *eval;
+
+    CseEntry  *entries;    // available expressions, the innermost block last
+    int        entriesCount;
+    int        entriesCapacity;
+
+    Node     **link;       // where the assignments of new temporaries are inserted
+
+    CseStats   stats;
+};
+
+int cseOptimize(Evaluator *eval, Node **root, CseStats *stats);
+
+#endif //__CSE_H__
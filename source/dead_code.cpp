@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "tree_of_expressions.h"
+#include "html_logfile.h"
+#include "program_run.h"
+#include "dead_code.h"
+
+#define CHECK_POISON_PTR(ptr) \
+    if (ptr == PtrPoison)     \
+    {                         \
+        LOG("ERROR: PoisonPtr detected in %s(%d) %s\n", __FILE__, __LINE__, __func__);\
+        return 0;                                                                     \
+    }
+
+//-------------------------------------------------------------------------------------------------
+// Dead code elimination over the statements, run after folding, so a condition that does not
+// depend on anything is a number by now. A koli with a false condition is removed and one with
+// a true condition is replaced by its body, a pokuda that never runs is removed, and whatever
+// follows a pokuda that never stops is unreachable. Empty statements (every perem leaves one)
+// and nested blocks are spliced out, so every block is one flat chain of INSTR_END.
+// A koli whose body is gone is removed too, unless its condition may fail at run time.
+//-------------------------------------------------------------------------------------------------
+
+#define IS_OPER(node, oper) ((node) && (node)->type == EXP_TREE_OPERATOR && (node)->data.operatorNum == (oper))
+#define IS_NUMBER(node)     ((node) && (node)->type == EXP_TREE_NUMBER)
+
+static int  deadBlock    (Node **link);
+static int  deadStatement(Node **slot);
+static bool deadRunsForever(Node *stmt);
+static bool deadCanFail    (Node *node);
+
+
+int deadCodeEliminate(Evaluator *eval, Node **root)
+{
+    assert(eval);
+    assert(root);
+    CHECK_POISON_PTR(*root);
+
+    int removed = deadStatement(root);
+
+    // an empty program is still a block
+    if (!*root) *root = createNode(EXP_TREE_OPERATOR, createNodeData(EXP_TREE_OPERATOR, INSTR_END), NULL, NULL);
+
+    LOG("%s: %d statements removed\n", __func__, removed);
+
+    return removed;
+}
+
+static int deadBlock(Node **link)
+{
+    assert(link);
+
+    int removed = 0;
+
+    while (IS_OPER(*link, INSTR_END))
+    {
+        Node *item = *link;
+
+        removed += deadStatement(&item->left);
+
+        // a nested block is spliced in, and its first statement looked at again
+        if (IS_OPER(item->left, INSTR_END))
+        {
+            Node *last = item->left;
+            while (IS_OPER(last->right, INSTR_END)) last = last->right;
+
+            last->right = item->right;
+            *link       = item->left;
+
+            destroyNode(&item);
+            continue;
+        }
+
+        if (!item->left)
+        {
+            *link = item->right;
+
+            destroyNode(&item);
+            removed++;
+            continue;
+        }
+
+        if (deadRunsForever(item->left) && item->right)
+        {
+            LOG("%s: the code after line %d is unreachable\n", __func__, item->left->line);
+
+            subTreeDtor(item->right);
+            item->right = NULL;
+            removed++;
+        }
+
+        link = &item->right;
+    }
+
+    return removed;
+}
+
+// *slot becomes what is left of the statement, NULL if nothing
+static int deadStatement(Node **slot)
+{
+    assert(slot);
+
+    Node *stmt = *slot;
+    if (!stmt || stmt->type != EXP_TREE_OPERATOR) return 0;
+
+    if (IS_OPER(stmt, INSTR_END)) return deadBlock(slot);
+
+    if (!IS_OPER(stmt, IF) && !IS_OPER(stmt, WHILE)) return 0;
+
+    int removed = deadStatement(&stmt->right);
+
+    bool isIf = IS_OPER(stmt, IF);
+
+    if (IS_NUMBER(stmt->left))
+    {
+        if (!programCondition(stmt->left->data.number))
+        {
+            LOG("%s: the body of line %d never runs\n", __func__, stmt->line);
+
+            subTreeDtor(stmt);
+            *slot = NULL;
+
+            return removed + 1;
+        }
+
+        if (isIf)
+        {
+            *slot = stmt->right;
+
+            subTreeDtor(stmt->left);
+            destroyNode(&stmt);
+
+            return removed + 1;
+        }
+    }
+
+    if (isIf && !stmt->right && !deadCanFail(stmt->left))
+    {
+        subTreeDtor(stmt);
+        *slot = NULL;
+
+        return removed + 1;
+    }
+
+    return removed;
+}
+
+static bool deadRunsForever(Node *stmt)
+{
+    return IS_OPER(stmt, WHILE) && IS_NUMBER(stmt->left) && programCondition(stmt->left->data.number);
+}
+
+// an operator that reports an error for some arguments
+static bool deadCanFail(Node *node)
+{
+    if (!node || node->type != EXP_TREE_OPERATOR) return false;
+
+    switch (node->data.operatorNum)
+    {
+        case DIV:   case LN:
+        case LOGAR: case POW:
+        case SQRT:  return true;
+
+        case NOT_OPER:  case ADD:
+        case SUB:       case MUL:
+        case SIN:       case COS:
+        case R_BRACKET: case L_BRACKET:
+        case ASSIGN:    case BELOW:
+        case ABOVE:     case IF:
+        case INSTR_END: case OPEN_F:
+        case CLOSE_F:   case WHILE:
+        case IN:        case OUT:
+        case THEN:      case EQUAL:
+        case NOT_EQUAL: case NEW_VAR:
+        default:        return deadCanFail(node->left) || deadCanFail(node->right);
+    }
+}
@@ -0,0 +1,8 @@
+#ifndef  __DEAD_CODE_H__
+#define  __DEAD_CODE_H__
+
+#include "tree_of_expressions.h"
+
+int deadCodeEliminate(Evaluator *eval, Node **root);
+
+#endif //__DEAD_CODE_H__
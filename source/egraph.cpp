@@ -0,0 +1,774 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <time.h>
+
+#include "tree_of_expressions.h"
+#include "html_logfile.h"
+#include "simplify_rules.h"
+#include "egraph.h"
+
+#define CHECK_POISON_PTR(ptr) \
+    if (ptr == PtrPoison)     \
+    {                         \
+        LOG("ERROR: PoisonPtr detected in %s(%d) %s\n", __FILE__, __LINE__, __func__);\
+        return 0;                                                                     \
+    }
+
+//-------------------------------------------------------------------------------------------------
+// Equality saturation. An e-class is a set of equivalent expressions, an e-node is an operator
+// over e-classes, so one graph holds every form the rewrites have found so far at once, and
+// nothing is ever rewritten away. Each iteration indexes the classes, applies every rule to
+// every node (adding the right-hand side and merging it with the matched class), and then
+// restores hash-consing: nodes that became equal after the merges are merged as well.
+// Saturation stops when an iteration finds nothing new or the node or iteration budget runs out
+// (a time budget is only used if asked for, as it makes the output depend on the machine load),
+// and the cheapest tree is extracted using the cost of the instructions it compiles to.
+//-------------------------------------------------------------------------------------------------
+
+const int    EGraphStartNodes = 256;
+const double EGraphPushCost   = 1;
+const double EGraphInfinity   = 1e300;
+
+#define OPER_DATA(oper)      createNodeData(EXP_TREE_OPERATOR, oper)
+#define NEW_OPER(oper, l, r) egraphAddNode(graph, EXP_TREE_OPERATOR, OPER_DATA(oper), l, r)
+#define NEW_NUMBER(value)    egraphAddNode(graph, EXP_TREE_NUMBER, createNodeData(EXP_TREE_NUMBER, value), \
+                                           IndexPoison, IndexPoison)
+
+#define IS_NUMBER(eclass, value) (graph->hasNumber[eclass] && equalDouble(graph->number[eclass], value))
+
+#define FOR_CLASS_NODES(node, eclass) \
+    for (int node = graph->classHead[eclass]; node != IndexPoison; node = graph->nodeNext[node])
+
+#define NODE_IS(node, oper) (graph->nodes[node].type == EXP_TREE_OPERATOR && \
+                             graph->nodes[node].data.operatorNum == oper)
+
+#define CHILD_L(node) egraphFind(graph, graph->nodes[node].left)
+#define CHILD_R(node) egraphFind(graph, graph->nodes[node].right)
+
+static int  egraphGrow   (EGraph *graph);
+static int  egraphAddNode(EGraph *graph, ExpTreeNodeType type, ExpTreeData data, int left, int right);
+static bool egraphUnion  (EGraph *graph, int a, int b);
+
+static unsigned long long egraphHash   (ENode *node);
+static bool               egraphSameKey(ENode *a, ENode *b);
+static int                egraphLookup (EGraph *graph, ENode *key);
+static int                egraphInsert (EGraph *graph, int index);
+static int                egraphRehash (EGraph *graph, int tableSize);
+static int                egraphRebuild(EGraph *graph);
+static void               egraphIndex  (EGraph *graph);
+
+static int egraphApplyRules(EGraph *graph, int index);
+static int egraphRulesAdd  (EGraph *graph, int eclass, int a, int b);
+static int egraphRulesSub  (EGraph *graph, int eclass, int a, int b);
+static int egraphRulesMul  (EGraph *graph, int eclass, int a, int b);
+static int egraphRulesOther(EGraph *graph, int eclass, int oper, int a, int b);
+
+static void   egraphCosts       (EGraph *graph);
+static double egraphOperatorCost(int oper);
+static bool   egraphIsArithmetic(int oper);
+static bool   egraphWalk        (Node *node, int *improved);
+static double egraphTime        (void);
+
+
+int egraphCtor(EGraph *graph, int maxNodes)
+{
+    assert(graph);
+
+    *graph = {};
+    graph->maxNodes = maxNodes > 0 ? maxNodes : EGraphMaxNodes;
+
+    int error = egraphGrow(graph);
+    if (!error) error = egraphRehash(graph, EGraphStartNodes * 4);
+    if (error) egraphDtor(graph);
+
+    return error;
+}
+
+int egraphDtor(EGraph *graph)
+{
+    assert(graph);
+
+    free(graph->nodes);
+    free(graph->parent);
+    free(graph->table);
+    free(graph->classHead);
+    free(graph->nodeNext);
+    free(graph->hasNumber);
+    free(graph->number);
+    free(graph->cost);
+    free(graph->best);
+
+    *graph = {};
+
+    return EXIT_SUCCESS;
+}
+
+// every array is indexed by node, a class is named by the node that created it
+static int egraphGrow(EGraph *graph)
+{
+    assert(graph);
+
+    size_t capacity = graph->nodesCapacity ? (size_t)graph->nodesCapacity * 2 : (size_t)EGraphStartNodes;
+
+    ENode  *nodes     = (ENode  *)realloc(graph->nodes,     capacity * sizeof(ENode));
+    if (nodes)     graph->nodes     = nodes;
+    int    *parent    = (int    *)realloc(graph->parent,    capacity * sizeof(int));
+    if (parent)    graph->parent    = parent;
+    int    *classHead = (int    *)realloc(graph->classHead, capacity * sizeof(int));
+    if (classHead) graph->classHead = classHead;
+    int    *nodeNext  = (int    *)realloc(graph->nodeNext,  capacity * sizeof(int));
+    if (nodeNext)  graph->nodeNext  = nodeNext;
+    bool   *hasNumber = (bool   *)realloc(graph->hasNumber, capacity * sizeof(bool));
+    if (hasNumber) graph->hasNumber = hasNumber;
+    double *number    = (double *)realloc(graph->number,    capacity * sizeof(double));
+    if (number)    graph->number    = number;
+    double *cost      = (double *)realloc(graph->cost,      capacity * sizeof(double));
+    if (cost)      graph->cost      = cost;
+    int    *best      = (int    *)realloc(graph->best,      capacity * sizeof(int));
+    if (best)      graph->best      = best;
+
+    if (!nodes || !parent || !classHead || !nodeNext || !hasNumber || !number || !cost || !best) return MEMORY_ERROR;
+
+    // classes made after the last index have no members and no number yet
+    for (size_t i = (size_t)graph->nodesCapacity; i < capacity; i++)
+    {
+        graph->classHead[i] = IndexPoison;
+        graph->nodeNext [i] = IndexPoison;
+        graph->hasNumber[i] = false;
+    }
+
+    graph->nodesCapacity = (int)capacity;
+
+    return EXIT_SUCCESS;
+}
+
+int egraphFind(EGraph *graph, int eclass)
+{
+    assert(graph);
+
+    if (eclass == IndexPoison) return IndexPoison;
+
+    while (graph->parent[eclass] != eclass)
+    {
+        graph->parent[eclass] = graph->parent[graph->parent[eclass]];
+        eclass = graph->parent[eclass];
+    }
+
+    return eclass;
+}
+
+static bool egraphUnion(EGraph *graph, int a, int b)
+{
+    assert(graph);
+
+    a = egraphFind(graph, a);
+    b = egraphFind(graph, b);
+
+    if (a == IndexPoison || b == IndexPoison || a == b) return false;
+
+    // the older class stays the root, its index entry is the most complete one
+    if (a > b) { int temp = a; a = b; b = temp; }
+
+    graph->parent[b] = a;
+    graph->stats.unions++;
+
+    if (graph->hasNumber[b] && !graph->hasNumber[a])
+    {
+        graph->hasNumber[a] = true;
+        graph->number   [a] = graph->number[b];
+    }
+
+    return true;
+}
+
+static unsigned long long egraphHash(ENode *node)
+{
+    assert(node);
+
+    unsigned long long hash = (unsigned long long)node->type * 0x9E3779B97F4A7C15ULL;
+    unsigned long long data = 0;
+
+    if      (node->type == EXP_TREE_NUMBER)   memcpy(&data, &node->data.number, sizeof(double));
+    else if (node->type == EXP_TREE_OPERATOR) data = (unsigned long long)node->data.operatorNum;
+    else                                      data = (unsigned long long)node->data.variableNum;
+
+    hash ^= data + 0x9E3779B97F4A7C15ULL + (hash << 6) + (hash >> 2);
+    hash ^= (unsigned long long)(node->left  + 2) * 0xC2B2AE3D27D4EB4FULL;
+    hash ^= (unsigned long long)(node->right + 2) * 0x165667B19E3779F9ULL;
+    hash ^= hash >> 29;
+
+    return hash;
+}
+
+static bool egraphSameKey(ENode *a, ENode *b)
+{
+    assert(a);
+    assert(b);
+
+    if (a->type != b->type || a->left != b->left || a->right != b->right) return false;
+
+    if (a->type == EXP_TREE_NUMBER)   return memcmp(&a->data.number, &b->data.number, sizeof(double)) == 0;
+    if (a->type == EXP_TREE_OPERATOR) return a->data.operatorNum == b->data.operatorNum;
+
+    return a->data.variableNum == b->data.variableNum;
+}
+
+static int egraphLookup(EGraph *graph, ENode *key)
+{
+    assert(graph);
+    assert(key);
+
+    int mask = graph->tableSize - 1;
+
+    for (int slot = (int)(egraphHash(key) & (unsigned long long)mask); graph->table[slot] != IndexPoison;
+             slot = (slot + 1) & mask)
+    {
+        if (egraphSameKey(&graph->nodes[graph->table[slot]], key)) return graph->table[slot];
+    }
+
+    return IndexPoison;
+}
+
+static int egraphInsert(EGraph *graph, int index)
+{
+    assert(graph);
+
+    if ((graph->nodesCount + 1) * 2 > graph->tableSize)
+    {
+        int error = egraphRehash(graph, graph->tableSize * 2);
+        if (error) return error;
+    }
+
+    int mask = graph->tableSize - 1;
+    int slot = (int)(egraphHash(&graph->nodes[index]) & (unsigned long long)mask);
+
+    while (graph->table[slot] != IndexPoison) slot = (slot + 1) & mask;
+
+    graph->table[slot] = index;
+
+    return EXIT_SUCCESS;
+}
+
+static int egraphRehash(EGraph *graph, int tableSize)
+{
+    assert(graph);
+
+    int *table = (int *)realloc(graph->table, (size_t)tableSize * sizeof(int));
+    if (!table) return MEMORY_ERROR;
+
+    graph->table     = table;
+    graph->tableSize = tableSize;
+
+    for (int i = 0; i < tableSize; i++) graph->table[i] = IndexPoison;
+
+    int mask = tableSize - 1;
+
+    for (int i = 0; i < graph->nodesCount; i++)
+    {
+        if (graph->nodes[i].dead) continue;
+
+        int slot = (int)(egraphHash(&graph->nodes[i]) & (unsigned long long)mask);
+        while (graph->table[slot] != IndexPoison) slot = (slot + 1) & mask;
+
+        graph->table[slot] = i;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// returns the class of the node, a new one only if no equal node is there yet
+static int egraphAddNode(EGraph *graph, ExpTreeNodeType type, ExpTreeData data, int left, int right)
+{
+    assert(graph);
+
+    ENode key  = {};
+    key.type   = type;
+    key.data   = data;
+    key.left   = egraphFind(graph, left);
+    key.right  = egraphFind(graph, right);
+
+    int found = egraphLookup(graph, &key);
+    if (found != IndexPoison) return egraphFind(graph, graph->nodes[found].eclass);
+
+    if (graph->nodesCount == graph->nodesCapacity && egraphGrow(graph)) return IndexPoison;
+
+    int index = graph->nodesCount;
+
+    key.eclass = index;
+    graph->nodes [index] = key;
+    graph->parent[index] = index;
+
+    if (type == EXP_TREE_NUMBER)
+    {
+        graph->hasNumber[index] = true;
+        graph->number   [index] = data.number;
+    }
+
+    if (egraphInsert(graph, index)) return IndexPoison;
+    graph->nodesCount++;
+
+    return index;
+}
+
+int egraphAddTree(EGraph *graph, Node *node)
+{
+    assert(graph);
+
+    if (!node || node == PtrPoison) return IndexPoison;
+
+    int left  = egraphAddTree(graph, node->left);
+    int right = egraphAddTree(graph, node->right);
+
+    if ((node->left && left == IndexPoison) || (node->right && right == IndexPoison)) return IndexPoison;
+
+    ExpTreeData data = node->data;
+    if (node->type == EXP_TREE_OPERATOR) data = OPER_DATA(node->data.operatorNum);
+
+    return egraphAddNode(graph, node->type, data, left, right);
+}
+
+// merges the nodes that became congruent, until nothing changes
+static int egraphRebuild(EGraph *graph)
+{
+    assert(graph);
+
+    bool changed = true;
+
+    while (changed)
+    {
+        changed = false;
+
+        for (int i = 0; i < graph->tableSize; i++) graph->table[i] = IndexPoison;
+
+        for (int i = 0; i < graph->nodesCount; i++)
+        {
+            ENode *node = &graph->nodes[i];
+            if (node->dead) continue;
+
+            node->left  = egraphFind(graph, node->left);
+            node->right = egraphFind(graph, node->right);
+
+            int found = egraphLookup(graph, node);
+            if (found == i) continue;
+            if (found == IndexPoison)
+            {
+                int error = egraphInsert(graph, i);
+                if (error) return error;
+                continue;
+            }
+
+            node->dead = true;
+            if (egraphUnion(graph, node->eclass, graph->nodes[found].eclass)) changed = true;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static void egraphIndex(EGraph *graph)
+{
+    assert(graph);
+
+    for (int i = 0; i < graph->nodesCount; i++)
+    {
+        graph->classHead[i] = IndexPoison;
+        graph->hasNumber[i] = false;
+    }
+
+    for (int i = 0; i < graph->nodesCount; i++)
+    {
+        ENode *node = &graph->nodes[i];
+        if (node->dead) continue;
+
+        int eclass = egraphFind(graph, node->eclass);
+
+        graph->nodeNext [i]      = graph->classHead[eclass];
+        graph->classHead[eclass] = i;
+
+        if (node->type == EXP_TREE_NUMBER)
+        {
+            graph->hasNumber[eclass] = true;
+            graph->number   [eclass] = node->data.number;
+        }
+    }
+}
+
+int egraphSaturate(EGraph *graph, int iterations, double seconds)
+{
+    assert(graph);
+
+    bool   timed    = seconds > 0;
+    double deadline = timed ? egraphTime() + seconds : 0;
+
+    graph->stats.saturated = false;
+
+    for (int iteration = 0; iteration < iterations; iteration++)
+    {
+        egraphIndex(graph);
+
+        int nodesBefore  = graph->nodesCount;
+        int unionsBefore = graph->stats.unions;
+        int error        = EXIT_SUCCESS;
+
+        for (int i = 0; i < nodesBefore && !error; i++)
+        {
+            if (graph->nodesCount >= graph->maxNodes) break;
+
+            error = egraphApplyRules(graph, i);
+        }
+
+        if (!error) error = egraphRebuild(graph);
+        if (error) return error;
+
+        graph->stats.iterations++;
+
+        if (graph->nodesCount == nodesBefore && graph->stats.unions == unionsBefore)
+        {
+            graph->stats.saturated = true;
+            break;
+        }
+
+        if (graph->nodesCount >= graph->maxNodes || (timed && egraphTime() > deadline)) break;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int egraphApplyRules(EGraph *graph, int index)
+{
+    assert(graph);
+
+    ENode *node = &graph->nodes[index];
+    if (node->dead || node->type != EXP_TREE_OPERATOR) return EXIT_SUCCESS;
+
+    ExpTreeOperators oper = node->data.operatorNum;
+
+    int eclass = egraphFind(graph, node->eclass);
+    int a      = egraphFind(graph, node->left);
+    int b      = egraphFind(graph, node->right);
+
+    // constant folding
+    if ((a == IndexPoison || graph->hasNumber[a]) && graph->hasNumber[b] && !graph->hasNumber[eclass])
+    {
+        ExpTreeErrors error = TREE_NO_ERROR;
+        double value = NodeCalculate(a == IndexPoison ? 0 : graph->number[a], graph->number[b],
+                                     oper, &error);
+
+        if (!error) egraphUnion(graph, eclass, NEW_NUMBER(value));
+        return EXIT_SUCCESS;
+    }
+
+    if (oper == ADD) return egraphRulesAdd(graph, eclass, a, b);
+    if (oper == SUB) return egraphRulesSub(graph, eclass, a, b);
+    if (oper == MUL) return egraphRulesMul(graph, eclass, a, b);
+
+    return egraphRulesOther(graph, eclass, oper, a, b);
+}
+
+static int egraphRulesAdd(EGraph *graph, int eclass, int a, int b)
+{
+    assert(graph);
+
+    egraphUnion(graph, eclass, NEW_OPER(ADD, b, a));
+
+    if (IS_NUMBER(b, 0)) egraphUnion(graph, eclass, a);
+    if (a == b)          egraphUnion(graph, eclass, NEW_OPER(MUL, a, NEW_NUMBER(2)));
+
+    FOR_CLASS_NODES(k, b)
+    {
+        // a + a * y = a * (y + 1)
+        if (NODE_IS(k, MUL) && CHILD_L(k) == a) egraphUnion(graph, eclass, NEW_OPER(MUL, a, NEW_OPER(ADD, CHILD_R(k), NEW_NUMBER(1))));
+    }
+
+    FOR_CLASS_NODES(m, a)
+    {
+        // (x + y) + b = x + (y + b)
+        if (NODE_IS(m, ADD)) egraphUnion(graph, eclass, NEW_OPER(ADD, CHILD_L(m), NEW_OPER(ADD, CHILD_R(m), b)));
+
+        FOR_CLASS_NODES(k, b)
+        {
+            // x * y + x * z = x * (y + z)
+            if (NODE_IS(m, MUL) && NODE_IS(k, MUL) && CHILD_L(m) == CHILD_L(k))
+            {
+                egraphUnion(graph, eclass, NEW_OPER(MUL, CHILD_L(m), NEW_OPER(ADD, CHILD_R(m), CHILD_R(k))));
+            }
+
+            // x / z + y / z = (x + y) / z
+            if (NODE_IS(m, DIV) && NODE_IS(k, DIV) && CHILD_R(m) == CHILD_R(k))
+            {
+                egraphUnion(graph, eclass, NEW_OPER(DIV, NEW_OPER(ADD, CHILD_L(m), CHILD_L(k)), CHILD_R(m)));
+            }
+        }
+    }
+
+    FOR_CLASS_NODES(k, b)
+    {
+        // a + (0 - y) = a - y
+        if (NODE_IS(k, SUB) && IS_NUMBER(CHILD_L(k), 0)) egraphUnion(graph, eclass, NEW_OPER(SUB, a, CHILD_R(k)));
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int egraphRulesSub(EGraph *graph, int eclass, int a, int b)
+{
+    assert(graph);
+
+    if (a == b)          egraphUnion(graph, eclass, NEW_NUMBER(0));
+    if (IS_NUMBER(b, 0)) egraphUnion(graph, eclass, a);
+
+    FOR_CLASS_NODES(k, b)
+    {
+        // 0 - (0 - y) = y
+        if (IS_NUMBER(a, 0) && NODE_IS(k, SUB) && IS_NUMBER(CHILD_L(k), 0)) egraphUnion(graph, eclass, CHILD_R(k));
+
+        FOR_CLASS_NODES(m, a)
+        {
+            // x * y - x * z = x * (y - z)
+            if (NODE_IS(m, MUL) && NODE_IS(k, MUL) && CHILD_L(m) == CHILD_L(k))
+            {
+                egraphUnion(graph, eclass, NEW_OPER(MUL, CHILD_L(m), NEW_OPER(SUB, CHILD_R(m), CHILD_R(k))));
+            }
+
+            // x / z - y / z = (x - y) / z
+            if (NODE_IS(m, DIV) && NODE_IS(k, DIV) && CHILD_R(m) == CHILD_R(k))
+            {
+                egraphUnion(graph, eclass, NEW_OPER(DIV, NEW_OPER(SUB, CHILD_L(m), CHILD_L(k)), CHILD_R(m)));
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int egraphRulesMul(EGraph *graph, int eclass, int a, int b)
+{
+    assert(graph);
+
+    egraphUnion(graph, eclass, NEW_OPER(MUL, b, a));
+
+    if (IS_NUMBER(b, 1)) egraphUnion(graph, eclass, a);
+    if (IS_NUMBER(b, 0)) egraphUnion(graph, eclass, NEW_NUMBER(0));
+
+    FOR_CLASS_NODES(m, a)
+    {
+        // (x * y) * b = x * (y * b)
+        if (NODE_IS(m, MUL)) egraphUnion(graph, eclass, NEW_OPER(MUL, CHILD_L(m), NEW_OPER(MUL, CHILD_R(m), b)));
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int egraphRulesOther(EGraph *graph, int eclass, int oper, int a, int b)
+{
+    assert(graph);
+
+    if (oper == DIV)
+    {
+        if (IS_NUMBER(b, 1)) egraphUnion(graph, eclass, a);
+
+        // a / 2^k = a * 2^-k exactly
+        int exponent = 0;
+        if (graph->hasNumber[b] && !equalDouble(graph->number[b], 0) && equalDouble(frexp(graph->number[b], &exponent), 0.5))
+        {
+            egraphUnion(graph, eclass, NEW_OPER(MUL, a, NEW_NUMBER(1 / graph->number[b])));
+        }
+    }
+
+    if (oper == POW)
+    {
+        if (IS_NUMBER(b, 1)) egraphUnion(graph, eclass, a);
+        if (IS_NUMBER(b, 0)) egraphUnion(graph, eclass, NEW_NUMBER(1));
+        if (IS_NUMBER(b, 2)) egraphUnion(graph, eclass, NEW_OPER(MUL, a, a));
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// weighted instructions of the stack machine: every push costs one, the operators what they run
+static double egraphOperatorCost(int oper)
+{
+    if (oper == ADD || oper == SUB || oper == MUL) return 1;
+    if (oper == DIV)                               return 2;
+    if (oper == SQRT)                              return 4;
+
+    return 8;
+}
+
+static void egraphCosts(EGraph *graph)
+{
+    assert(graph);
+
+    for (int i = 0; i < graph->nodesCount; i++)
+    {
+        graph->cost[i] = EGraphInfinity;
+        graph->best[i] = IndexPoison;
+    }
+
+    bool changed = true;
+
+    while (changed)
+    {
+        changed = false;
+
+        for (int i = 0; i < graph->nodesCount; i++)
+        {
+            ENode *node = &graph->nodes[i];
+            if (node->dead) continue;
+
+            double cost = EGraphPushCost;
+
+            if (node->type == EXP_TREE_OPERATOR)
+            {
+                int left  = egraphFind(graph, node->left);
+                int right = egraphFind(graph, node->right);
+
+                cost = egraphOperatorCost(node->data.operatorNum);
+                if (left  != IndexPoison) cost += graph->cost[left];
+                if (right != IndexPoison) cost += graph->cost[right];
+            }
+
+            int eclass = egraphFind(graph, node->eclass);
+
+            if (cost < graph->cost[eclass])
+            {
+                graph->cost[eclass] = cost;
+                graph->best[eclass] = i;
+                changed = true;
+            }
+        }
+    }
+}
+
+static Node *egraphBuild(EGraph *graph, int eclass)
+{
+    assert(graph);
+
+    if (eclass == IndexPoison) return NULL;
+
+    int best = graph->best[egraphFind(graph, eclass)];
+    if (best == IndexPoison) return PtrPoison;
+
+    ENode *node  = &graph->nodes[best];
+    Node  *left  = egraphBuild(graph, node->left);
+    Node  *right = egraphBuild(graph, node->right);
+
+    if (left == PtrPoison || right == PtrPoison) return PtrPoison;
+
+    return createNode(node->type, node->data, left, right);
+}
+
+Node *egraphExtract(EGraph *graph, int eclass)
+{
+    assert(graph);
+
+    egraphCosts(graph);
+
+    Node *tree = egraphBuild(graph, eclass);
+
+    return tree == PtrPoison ? NULL : tree;
+}
+
+double egraphTreeCost(Node *node)
+{
+    if (!node || node == PtrPoison) return 0;
+
+    if (node->type != EXP_TREE_OPERATOR) return EGraphPushCost;
+
+    double cost = egraphOperatorCost(node->data.operatorNum) + egraphTreeCost(node->left);
+
+    return cost + egraphTreeCost(node->right);
+}
+
+int egraphOptimizeExpression(Node *node, EGraphStats *stats)
+{
+    CHECK_POISON_PTR(node);
+    if (!node) return 0;
+
+    EGraph graph = {};
+    if (egraphCtor(&graph, EGraphMaxNodes)) return 0;
+
+    int improved = 0;
+    int root     = egraphAddTree(&graph, node);
+
+    if (root != IndexPoison && !egraphSaturate(&graph, EGraphIterations, EGraphNoTimeLimit))
+    {
+        Node *best = egraphExtract(&graph, root);
+
+        if (best && egraphTreeCost(best) < egraphTreeCost(node))
+        {
+            subTreeDtor(node->left);
+            subTreeDtor(node->right);
+
+            int line = node->line;
+            *node = *best;
+            node->line = line;
+
+            destroyNode(&best);
+            improved = 1;
+        }
+        else if (best) subTreeDtor(best);
+    }
+
+    if (stats) *stats = graph.stats;
+
+    egraphDtor(&graph);
+
+    return improved;
+}
+
+static bool egraphIsArithmetic(int oper)
+{
+    return oper == ADD || oper == SUB || oper == MUL || oper == DIV || oper == POW ||
+           oper == LN  || oper == LOGAR || oper == SIN || oper == COS || oper == SQRT;
+}
+
+// true for a pure arithmetic subtree, those are optimised whole by the first node above them
+// that is not arithmetic
+static bool egraphWalk(Node *node, int *improved)
+{
+    assert(improved);
+
+    if (!node || node == PtrPoison) return true;
+
+    if (node->type == EXP_TREE_NUMBER || node->type == EXP_TREE_VARIABLE) return true;
+    if (node->type != EXP_TREE_OPERATOR) return false;
+
+    bool left  = egraphWalk(node->left,  improved);
+    bool right = egraphWalk(node->right, improved);
+
+    if (left && right && egraphIsArithmetic(node->data.operatorNum)) return true;
+
+    if (left  && node->left  && node->left->type  == EXP_TREE_OPERATOR) *improved += egraphOptimizeExpression(node->left,  NULL);
+    if (right && node->right && node->right->type == EXP_TREE_OPERATOR) *improved += egraphOptimizeExpression(node->right, NULL);
+
+    return false;
+}
+
+int egraphOptimize(Evaluator *eval, Node *root)
+{
+    assert(eval);
+    CHECK_POISON_PTR(root);
+
+    int improved = 0;
+
+    if (egraphWalk(root, &improved) && root && root->type == EXP_TREE_OPERATOR)
+    {
+        improved += egraphOptimizeExpression(root, NULL);
+    }
+
+    LOG("%s: %d expressions improved\n", __func__, improved);
+
+    return improved;
+}
+
+static double egraphTime(void)
+{
+    timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
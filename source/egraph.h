@@ -0,0 +1,67 @@
+#ifndef  __EGRAPH_H__
+#define  __EGRAPH_H__
+
+#include <stdio.h>
+
+#include "tree_of_expressions.h"
+
+const int    EGraphMaxNodes    = 20000;
+const int    EGraphIterations  = 32;
+const double EGraphNoTimeLimit = 0;       // saturation is bounded by the nodes and iterations only
+
+struct ENode
+{
+    ExpTreeNodeType type;
+    ExpTreeData     data;
+    int             left;      // classes of the children, IndexPoison if there is none
+    int             right;
+
+    int             eclass;
+    bool            dead;      // a congruent copy of another node
+};
+
+struct EGraphStats
+{
+    int  iterations;
+    int  unions;
+    bool saturated;
+};
+
+struct EGraph
+{
+    ENode  *nodes;
+    int     nodesCount;
+    int     nodesCapacity;
+    int     maxNodes;
+
+    int    *parent;            // union-find over classes, a class is named by its first node
+
+    int    *table;             // hash-consing, node indices
+    int     tableSize;
+
+    int    *classHead;         // nodes of every class, rebuilt at each iteration
+    int    *nodeNext;
+    bool   *hasNumber;
+    double *number;
+
+    double *cost;              // extraction
+    int    *best;
+
+    EGraphStats stats;
+};
+
+int egraphCtor(EGraph *graph, int maxNodes);
+int egraphDtor(EGraph *graph);
+
+int egraphAddTree (EGraph *graph, Node *node);
+int egraphFind    (EGraph *graph, int eclass);
+// seconds > 0 also stops it after that much time, then the result depends on the machine load
+int egraphSaturate(EGraph *graph, int iterations, double seconds);
+
+Node  *egraphExtract (EGraph *graph, int eclass);
+double egraphTreeCost(Node *node);
+
+int egraphOptimizeExpression(Node *node, EGraphStats *stats);
+int egraphOptimize          (Evaluator *eval, Node *root);
+
+#endif //__EGRAPH_H__
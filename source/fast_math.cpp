@@ -0,0 +1,477 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <float.h>
+#include <time.h>
+
+#include "tree_of_expressions.h"
+#include "html_logfile.h"
+#include "fast_math.h"
+
+//-------------------------------------------------------------------------------------------------
+// Both accuracy levels share the reductions and the coefficients (fdlibm minimax for sin, cos
+// and ln, Taylor for exp); FAST_MATH_7 just stops the polynomials earlier. Everything is
+// straight-line double arithmetic without table lookups, so loops over it vectorise. Arguments
+// outside the reduced ranges (huge trig arguments, subnormals, inf, nan) go to libm.
+//-------------------------------------------------------------------------------------------------
+
+FastMathMode FastMath = FAST_MATH_OFF;
+
+const double FastRoundMagic   = 6755399441055744.0;        // 1.5 * 2^52
+const double FastPi           = 3.14159265358979323846;
+const double FastTwoOverPi    = 6.36619772367581382433e-01;
+const double FastPiOver2Part1 = 1.57079632673412561417e+00;
+const double FastPiOver2Part2 = 6.07710050630396597660e-11;
+const double FastPiOver2Part3 = 2.02226624879595063154e-21;
+const double FastSqrt2        = 1.41421356237309504880;
+const double FastLn2Hi        = 6.93147180369123816490e-01;
+const double FastLn2Lo        = 1.90821492927058770002e-10;
+const double FastInvLn2       = 1.44269504088896338700e+00;
+const double FastExpMin       = -708;
+const double FastExpMax       =  709;
+
+const unsigned long long FastMantissaMask = 0x000FFFFFFFFFFFFFULL;
+const unsigned long long FastOneBits      = 0x3FF0000000000000ULL;
+
+const double FastSinCoeffs[] = { -1.66666666666666324348e-01,  8.33333333332248946124e-03,
+                                 -1.98412698298579493134e-04,  2.75573137070700676789e-06,
+                                 -2.50507602534068634195e-08,  1.58969099521155010221e-10 };
+
+const double FastCosCoeffs[] = {  4.16666666666666019037e-02, -1.38888888888741095749e-03,
+                                  2.48015872894767294178e-05, -2.75573143513906633035e-07,
+                                  2.08757232129817482790e-09, -1.13596475577881948265e-11 };
+
+const double FastLnCoeffs[]  = {  6.666666666666735130e-01,    3.999999999940941908e-01,
+                                  2.857142874366239149e-01,    2.222219843214978396e-01,
+                                  1.818357216161805012e-01,    1.531383769920937332e-01,
+                                  1.479819860511658591e-01 };
+
+const double FastExpCoeffs[] = { 1.0,                   1.0,                   1.0 / 2,
+                                 1.0 / 6,               1.0 / 24,              1.0 / 120,
+                                 1.0 / 720,             1.0 / 5040,            1.0 / 40320,
+                                 1.0 / 362880,          1.0 / 3628800,         1.0 / 39916800 };
+
+// polynomial lengths, [0] for FAST_MATH_7 and [1] for FAST_MATH_12
+const int FastSinLength[] = {4, 6};
+const int FastCosLength[] = {3, 6};
+const int FastLnLength [] = {4, 7};
+const int FastExpLength[] = {8, 12};
+
+static inline double fastRound(double x);
+static inline double fastPoly (double z, const double *coeffs, int count);
+static inline bool   fastIsInteger(double x);
+
+template <bool Precise> static inline double fastSinCore(double x, int shift);
+template <bool Precise> static inline double fastLnCore (double x);
+template <bool Precise> static inline double fastExpCore(double x);
+template <bool Precise> static inline double fastPowCore(double x, double y);
+
+
+int fastMathSetMode(FastMathMode mode)
+{
+    FastMath = mode;
+    LOG("fast math mode: %d\n", mode);
+
+    return EXIT_SUCCESS;
+}
+
+int fastMathParseMode(const char *text, FastMathMode *mode)
+{
+    assert(text);
+    assert(mode);
+
+    if      (strcmp(text, "off")   == 0) *mode = FAST_MATH_OFF;
+    else if (strcmp(text, "1e-7")  == 0) *mode = FAST_MATH_7;
+    else if (strcmp(text, "1e-12") == 0) *mode = FAST_MATH_12;
+    else return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
+
+static inline double fastRound(double x)
+{
+    return (x + FastRoundMagic) - FastRoundMagic;
+}
+
+static inline double fastPoly(double z, const double *coeffs, int count)
+{
+    double result = coeffs[count - 1];
+
+    for (int i = count - 2; i >= 0; i--) result = result * z + coeffs[i];
+
+    return result;
+}
+
+static inline bool fastIsInteger(double x)
+{
+    return !(x > floor(x));
+}
+
+// shift = 0 for sin, 1 for cos
+template <bool Precise>
+static inline double fastSinCore(double x, int shift)
+{
+    if (!(fabs(x) <= FastTrigLimit)) return shift ? cos(x) : sin(x);
+
+    double k = fastRound(x * FastTwoOverPi);
+    double r = x - k * FastPiOver2Part1;
+    r -= k * FastPiOver2Part2;
+    r -= k * FastPiOver2Part3;
+
+    long long quadrant = (long long)k + shift;
+    double    z        = r * r;
+    double    result   = 0;
+
+    if (quadrant & 1) result = 1 - 0.5 * z + z * z * fastPoly(z, FastCosCoeffs, FastCosLength[Precise]);
+    else              result = r + r * z * fastPoly(z, FastSinCoeffs, FastSinLength[Precise]);
+
+    return (quadrant & 2) ? -result : result;
+}
+
+template <bool Precise>
+static inline double fastLnCore(double x)
+{
+    if (!(x >= DBL_MIN && x <= DBL_MAX)) return log(x);
+
+    unsigned long long bits = 0;
+    memcpy(&bits, &x, sizeof(double));
+
+    double e = (double)((int)(bits >> 52) - 1023);
+    bits = (bits & FastMantissaMask) | FastOneBits;
+
+    double m = 0;
+    memcpy(&m, &bits, sizeof(double));
+
+    if (m > FastSqrt2) { m *= 0.5; e += 1; }
+
+    double f    = m - 1;
+    double s    = f / (2 + f);
+    double z    = s * s;
+    double hfsq = 0.5 * f * f;
+    double R    = z * fastPoly(z, FastLnCoeffs, FastLnLength[Precise]);
+
+    return e * FastLn2Hi - ((hfsq - (s * (hfsq + R) + e * FastLn2Lo)) - f);
+}
+
+template <bool Precise>
+static inline double fastExpCore(double x)
+{
+    if (!(x > FastExpMin && x < FastExpMax)) return exp(x);
+
+    double k = fastRound(x * FastInvLn2);
+    double r = x - k * FastLn2Hi - k * FastLn2Lo;
+
+    unsigned long long bits = (unsigned long long)((long long)k + 1023) << 52;
+    double scale = 0;
+    memcpy(&scale, &bits, sizeof(double));
+
+    return fastPoly(r, FastExpCoeffs, FastExpLength[Precise]) * scale;
+}
+
+double fastPowInteger(double x, double n)
+{
+    unsigned long long exponent = (unsigned long long)fabs(n);
+    double             result   = 1;
+
+    for ( ; exponent; exponent >>= 1)
+    {
+        if (exponent & 1) result *= x;
+        x *= x;
+    }
+
+    return n < 0 ? 1 / result : result;
+}
+
+template <bool Precise>
+static inline double fastPowCore(double x, double y)
+{
+    if (fastIsInteger(y) && fabs(y) <= FastPowMaxInteger) return fastPowInteger(x, y);
+
+    if (x > 0 && x <= DBL_MAX) return fastExpCore<Precise>(y * fastLnCore<Precise>(x));
+
+    return pow(x, y);
+}
+
+double fastSin7 (double x) { return fastSinCore<false>(x, 0); }
+double fastSin12(double x) { return fastSinCore<true> (x, 0); }
+double fastCos7 (double x) { return fastSinCore<false>(x, 1); }
+double fastCos12(double x) { return fastSinCore<true> (x, 1); }
+double fastLn7  (double x) { return fastLnCore <false>(x);    }
+double fastLn12 (double x) { return fastLnCore <true> (x);    }
+double fastExp7 (double x) { return fastExpCore<false>(x);    }
+double fastExp12(double x) { return fastExpCore<true> (x);    }
+
+double fastPow7 (double x, double y) { return fastPowCore<false>(x, y); }
+double fastPow12(double x, double y) { return fastPowCore<true> (x, y); }
+
+#define MATH_DISPATCH(libm, fast7, fast12)  \
+    switch (FastMath)                       \
+    {                                       \
+        case FAST_MATH_7:   return fast7;   \
+        case FAST_MATH_12:  return fast12;  \
+        case FAST_MATH_OFF:                 \
+        default:            return libm;    \
+    }
+
+double mathSin(double x)           { MATH_DISPATCH(sin(x),    fastSin7(x),    fastSin12(x)) }
+double mathCos(double x)           { MATH_DISPATCH(cos(x),    fastCos7(x),    fastCos12(x)) }
+double mathLn (double x)           { MATH_DISPATCH(log(x),    fastLn7(x),     fastLn12(x))  }
+double mathPow(double x, double y) { MATH_DISPATCH(pow(x, y), fastPow7(x, y), fastPow12(x, y)) }
+
+#undef MATH_DISPATCH
+
+const void *fastMathFunction(ExpTreeOperators oper)
+{
+    bool low = FastMath == FAST_MATH_7;
+    bool off = FastMath == FAST_MATH_OFF;
+
+    switch (oper)
+    {
+        case SIN:   return off ? (const void *)(MathUnary) sin : low ? (const void *) fastSin7 : (const void *) fastSin12;
+        case COS:   return off ? (const void *)(MathUnary) cos : low ? (const void *) fastCos7 : (const void *) fastCos12;
+        case LN:    return off ? (const void *)(MathUnary) log : low ? (const void *) fastLn7  : (const void *) fastLn12;
+        case POW:   return off ? (const void *)(MathBinary)pow : low ? (const void *) fastPow7 : (const void *) fastPow12;
+
+        case NOT_OPER:  case ADD:
+        case SUB:       case MUL:
+        case DIV:       case LOGAR:
+        case R_BRACKET: case L_BRACKET:
+        case ASSIGN:    case BELOW:
+        case ABOVE:     case IF:
+        case INSTR_END: case OPEN_F:
+        case CLOSE_F:   case WHILE:
+        case IN:        case OUT:
+        case THEN:      case EQUAL:
+        case NOT_EQUAL: case SQRT:
+        case NEW_VAR:
+        default:        return NULL;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// the same functions as C source for the C backend
+//-------------------------------------------------------------------------------------------------
+
+#define C_WRITE(...) fprintf(f, __VA_ARGS__)
+
+static void fastMathPrintArray(const char *name, const double *coeffs, int count, FILE *f)
+{
+    C_WRITE("static const double %s[] = {", name);
+    for (int i = 0; i < count; i++) C_WRITE(i ? ", %.21g" : "%.21g", coeffs[i]);
+    C_WRITE("};\n");
+}
+
+int fastMathPrintC(FILE *f)
+{
+    assert(f);
+
+    if (FastMath == FAST_MATH_OFF) return EXIT_SUCCESS;
+
+    int precise = FastMath == FAST_MATH_12;
+
+    C_WRITE("/* fast math, %s relative error */\n", FastMath == FAST_MATH_7 ? "1e-7" : "1e-12");
+    C_WRITE("#include <string.h>\n#include <float.h>\n\n");
+
+    fastMathPrintArray("fastSinCoeffs", FastSinCoeffs, FastSinLength[precise], f);
+    fastMathPrintArray("fastCosCoeffs", FastCosCoeffs, FastCosLength[precise], f);
+    fastMathPrintArray("fastLnCoeffs",  FastLnCoeffs,  FastLnLength [precise], f);
+    fastMathPrintArray("fastExpCoeffs", FastExpCoeffs, FastExpLength[precise], f);
+
+    C_WRITE("\nstatic inline double fastRound(double x) { return (x + %.17g) - %.17g; }\n\n",
+            FastRoundMagic, FastRoundMagic);
+
+    C_WRITE("static inline double fastPoly(double z, const double *c, int n)\n{\n"
+            "    double r = c[n - 1];\n"
+            "    for (int i = n - 2; i >= 0; i--) r = r * z + c[i];\n"
+            "    return r;\n}\n\n");
+
+    C_WRITE("static double fastSinCore(double x, int shift)\n{\n"
+            "    if (!(fabs(x) <= %.17g)) return shift ? cos(x) : sin(x);\n"
+            "    double k = fastRound(x * %.21g);\n"
+            "    double r = x - k * %.21g;\n"
+            "    r -= k * %.21g;\n"
+            "    r -= k * %.21g;\n"
+            "    long long q = (long long)k + shift;\n"
+            "    double z = r * r;\n"
+            "    double v = (q & 1) ? 1 - 0.5 * z + z * z * fastPoly(z, fastCosCoeffs, %d)\n"
+            "                       : r + r * z * fastPoly(z, fastSinCoeffs, %d);\n"
+            "    return (q & 2) ? -v : v;\n}\n\n",
+            FastTrigLimit, FastTwoOverPi, FastPiOver2Part1, FastPiOver2Part2, FastPiOver2Part3,
+            FastCosLength[precise], FastSinLength[precise]);
+
+    C_WRITE("static inline double fastSin(double x) { return fastSinCore(x, 0); }\n"
+            "static inline double fastCos(double x) { return fastSinCore(x, 1); }\n\n");
+
+    C_WRITE("static double fastLn(double x)\n{\n"
+            "    if (!(x >= DBL_MIN && x <= DBL_MAX)) return log(x);\n"
+            "    unsigned long long bits;\n"
+            "    memcpy(&bits, &x, sizeof(double));\n"
+            "    double e = (double)((int)(bits >> 52) - 1023);\n"
+            "    bits = (bits & 0x000FFFFFFFFFFFFFULL) | 0x3FF0000000000000ULL;\n"
+            "    double m;\n"
+            "    memcpy(&m, &bits, sizeof(double));\n"
+            "    if (m > %.21g) { m *= 0.5; e += 1; }\n"
+            "    double f = m - 1, s = f / (2 + f), z = s * s, h = 0.5 * f * f;\n"
+            "    double R = z * fastPoly(z, fastLnCoeffs, %d);\n"
+            "    return e * %.21g - ((h - (s * (h + R) + e * %.21g)) - f);\n}\n\n",
+            FastSqrt2, FastLnLength[precise], FastLn2Hi, FastLn2Lo);
+
+    C_WRITE("static double fastExp(double x)\n{\n"
+            "    if (!(x > %.17g && x < %.17g)) return exp(x);\n"
+            "    double k = fastRound(x * %.21g);\n"
+            "    double r = x - k * %.21g - k * %.21g;\n"
+            "    unsigned long long bits = (unsigned long long)((long long)k + 1023) << 52;\n"
+            "    double scale;\n"
+            "    memcpy(&scale, &bits, sizeof(double));\n"
+            "    return fastPoly(r, fastExpCoeffs, %d) * scale;\n}\n\n",
+            FastExpMin, FastExpMax, FastInvLn2, FastLn2Hi, FastLn2Lo, FastExpLength[precise]);
+
+    C_WRITE("static double fastPow(double x, double y)\n{\n"
+            "    if (!(y > floor(y)) && fabs(y) <= %.17g)\n"
+            "    {\n"
+            "        unsigned long long n = (unsigned long long)fabs(y);\n"
+            "        double r = 1, b = x;\n"
+            "        for ( ; n; n >>= 1) { if (n & 1) r *= b; b *= b; }\n"
+            "        return y < 0 ? 1 / r : r;\n"
+            "    }\n"
+            "    if (x > 0 && x <= DBL_MAX) return fastExp(y * fastLn(x));\n"
+            "    return pow(x, y);\n}\n\n",
+            FastPowMaxInteger);
+
+    return EXIT_SUCCESS;
+}
+
+#undef C_WRITE
+
+//-------------------------------------------------------------------------------------------------
+// accuracy harness
+//-------------------------------------------------------------------------------------------------
+
+struct FastMathCheck
+{
+    const char *name;
+    MathUnary   reference;
+    MathUnary   fast7;
+    MathUnary   fast12;
+    double      from;
+    double      to;
+    bool        logScale;
+};
+
+static double fastRandom(unsigned long long *state)
+{
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+
+    return (double)(*state >> 11) / (double)(1ULL << 53);
+}
+
+static double fastUlpError(double value, double reference)
+{
+    if (isnan(reference) || isinf(reference)) return isnan(value) == isnan(reference) ? 0 : INFINITY;
+
+    double ulp = nextafter(fabs(reference), INFINITY) - fabs(reference);
+
+    return fabs(value - reference) / ulp;
+}
+
+static double fastRelError(double value, double reference)
+{
+    if (isnan(reference) || isinf(reference)) return 0;
+
+    return fabs(value - reference) / (fabs(reference) > DBL_MIN ? fabs(reference) : DBL_MIN);
+}
+
+static double fastMathSample(const FastMathCheck *check, unsigned long long *state)
+{
+    double u = fastRandom(state);
+
+    if (check->logScale) return exp(check->from + (check->to - check->from) * u);
+
+    return check->from + (check->to - check->from) * u;
+}
+
+static double fastMathTime(MathUnary func, const double *xs, int samples, double *sum)
+{
+    clock_t start = clock();
+
+    for (int i = 0; i < samples; i++) *sum += func(xs[i]);
+
+    return (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / samples;
+}
+
+static double fastPowReference(double y) { return pow(1.7, y); }
+static double fastPowSample7  (double y) { return fastPow7 (1.7, y); }
+static double fastPowSample12 (double y) { return fastPow12(1.7, y); }
+static double fastPowIntRef   (double x) { return pow(x, 13); }
+static double fastPowInt      (double x) { return fastPowInteger(x, 13); }
+static double fastPowRootRef  (double x) { return pow(x, 0.37); }
+static double fastPowRoot7    (double x) { return fastPow7 (x, 0.37); }
+static double fastPowRoot12   (double x) { return fastPow12(x, 0.37); }
+
+int fastMathAccuracy(int samples, FILE *f)
+{
+    assert(f);
+
+    const FastMathCheck checks[] =
+    {
+        {"sin",         sin,              fastSin7,        fastSin12,        -FastPi,   FastPi,   false},
+        {"sin",         sin,              fastSin7,        fastSin12,        -1e4,     1e4,    false},
+        {"cos",         cos,              fastCos7,        fastCos12,        -FastPi,   FastPi,   false},
+        {"cos",         cos,              fastCos7,        fastCos12,        -1e4,     1e4,    false},
+        {"ln",          log,              fastLn7,         fastLn12,          0.5,     2,      false},
+        {"ln",          log,              fastLn7,         fastLn12,         -700,     700,    true},
+        {"exp",         exp,              fastExp7,        fastExp12,        -700,     700,    false},
+        {"pow 1.7^y",   fastPowReference, fastPowSample7,  fastPowSample12,  -300,     300,    false},
+        {"pow x^0.37",  fastPowRootRef,   fastPowRoot7,    fastPowRoot12,    -700,     700,    true},
+        {"pow x^13",    fastPowIntRef,    fastPowInt,      fastPowInt,       -40,      40,     false},
+    };
+    const int checksCount = (int)(sizeof(checks) / sizeof(checks[0]));
+
+    double *xs = (double *)calloc((size_t)samples, sizeof(double));
+    if (!xs) return MEMORY_ERROR;
+
+    double sum = 0;
+
+    fprintf(f, "%-12s %-22s %14s %14s %14s %14s %9s %9s %9s\n", "function", "domain",
+               "max ulp 1e-7", "max rel 1e-7", "max ulp 1e-12", "max rel 1e-12", "libm ns", "ns 1e-7", "ns 1e-12");
+
+    for (int c = 0; c < checksCount; c++)
+    {
+        const FastMathCheck *check = &checks[c];
+        unsigned long long   state = 12345 + (unsigned long long)c;
+
+        for (int i = 0; i < samples; i++) xs[i] = fastMathSample(check, &state);
+
+        double ulp7 = 0, rel7 = 0, ulp12 = 0, rel12 = 0;
+
+        for (int i = 0; i < samples; i++)
+        {
+            double reference = check->reference(xs[i]);
+            double value7    = check->fast7    (xs[i]);
+            double value12   = check->fast12   (xs[i]);
+
+            ulp7  = fmax(ulp7,  fastUlpError(value7,  reference));
+            rel7  = fmax(rel7,  fastRelError(value7,  reference));
+            ulp12 = fmax(ulp12, fastUlpError(value12, reference));
+            rel12 = fmax(rel12, fastRelError(value12, reference));
+        }
+
+        double libmTime   = fastMathTime(check->reference, xs, samples, &sum);
+        double fast7Time  = fastMathTime(check->fast7,     xs, samples, &sum);
+        double fast12Time = fastMathTime(check->fast12,    xs, samples, &sum);
+
+        char domain[WordLength] = "";
+        snprintf(domain, WordLength, check->logScale ? "[e^%lg, e^%lg]" : "[%lg, %lg]", check->from, check->to);
+
+        fprintf(f, "%-12s %-22s %14.4lg %14.4lg %14.4lg %14.4lg %9.3lg %9.3lg %9.3lg\n", check->name, domain,
+                   ulp7, rel7, ulp12, rel12, libmTime, fast7Time, fast12Time);
+    }
+
+    LOG("fast math accuracy checksum %lg\n", sum);
+
+    free(xs);
+
+    return EXIT_SUCCESS;
+}
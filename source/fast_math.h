@@ -0,0 +1,50 @@
+#ifndef  __FAST_MATH_H__
+#define  __FAST_MATH_H__
+
+#include <stdio.h>
+
+#include "tree_of_expressions.h"
+
+enum FastMathMode
+{
+    FAST_MATH_OFF = 0,
+    FAST_MATH_7   = 1,   // ~1e-7  relative error
+    FAST_MATH_12  = 2,   // ~1e-12 relative error
+};
+
+typedef double (*MathUnary) (double x);
+typedef double (*MathBinary)(double x, double y);
+
+extern FastMathMode FastMath;
+
+const double FastTrigLimit     = 1e5;
+const double FastPowMaxInteger = 1 << 30;
+
+int fastMathSetMode(FastMathMode mode);
+int fastMathParseMode(const char *text, FastMathMode *mode);
+
+double mathSin(double x);
+double mathCos(double x);
+double mathLn (double x);
+double mathPow(double x, double y);
+
+double fastSin7 (double x);
+double fastSin12(double x);
+double fastCos7 (double x);
+double fastCos12(double x);
+double fastLn7  (double x);
+double fastLn12 (double x);
+double fastExp7 (double x);
+double fastExp12(double x);
+double fastPow7 (double x, double y);
+double fastPow12(double x, double y);
+
+double fastPowInteger(double x, double n);
+
+const void *fastMathFunction(ExpTreeOperators oper);
+
+int fastMathPrintC(FILE *f);
+
+int fastMathAccuracy(int samples, FILE *f);
+
+#endif //__FAST_MATH_H__
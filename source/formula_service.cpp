@@ -0,0 +1,704 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "tree_of_expressions.h"
+#include "html_logfile.h"
+#include "recursive_descent_reading.h"
+#include "tree_simplify.h"
+#include "closure_evaluate.h"
+#include "batch_evaluate.h"
+#include "formula_service.h"
+
+//-------------------------------------------------------------------------------------------------
+// Line protocol, one request per line:
+//      <formula> | <name>=<value> <name>=<value> ...
+// answered in the same order with a number or "ERROR syntax", "ERROR binding", "ERROR <code>".
+// "#stats" prints the cache counters. Every identifier of a formula is a variable and has to be
+// bound. Formulas are parsed, simplified and closure-compiled once and kept in an LRU cache keyed
+// by their text (failed ones too). All complete lines that arrived with one read() form a batch:
+// requests of a batch with the same formula share one lookup, and big groups are evaluated with
+// the column-wise batch evaluator.
+//-------------------------------------------------------------------------------------------------
+
+const int ServiceBacklog         = 16;
+const int ServiceCheckLineLength = 128;
+
+struct ServiceCheckCase
+{
+    const char *request;
+    const char *answer;
+};
+
+// the top node of most of them is a chain reassociation rebuilds
+static const ServiceCheckCase ServiceCheckCases[] =
+{
+    {"x plus y | x=1 y=2",                  "3"},
+    {"a minus b minus c | a=1 b=2 c=3",     "-4"},
+    {"x umnozhit 2 umnozhit y | x=3 y=4",   "24"},
+    {"x delit 2 delit y | x=1 y=0",         "ERROR -1"},
+    {"koreshok(0 minus 1) umnozhit b | b=2", "nan"},
+    {"b umnozhit 0 umnozhit ln(0) | b=2",   "nan"},
+    {"a plus b | a=2 b=5",                  "7"},
+    {"a delit b | a=1 b=4",                 "0.25"},
+    {"a delit b | a=1 b=0",                 "ERROR -1"},
+    {"a delit 0.0000001 | a=1",             "ERROR -1"},
+    {"ln(x delit y) | x=1 y=0",             "ERROR -1"},
+    {"x plus y | x=2",                      "ERROR binding"},
+    {"x plus | x=2",                        "ERROR syntax"},
+};
+
+const int ServiceCheckCasesCount = (int)(sizeof(ServiceCheckCases) / sizeof(ServiceCheckCases[0]));
+
+static unsigned long long serviceHash(const char *text);
+static char              *serviceTrim(char *str);
+
+static ServiceFormula *serviceFind        (FormulaService *service, const char *text, unsigned long long hash);
+static ServiceFormula *serviceLookupHashed(FormulaService *service, const char *text, unsigned long long hash);
+static ServiceFormula *servicePrepare     (const char *text, unsigned long long hash);
+static void            serviceTouch       (FormulaService *service, ServiceFormula *formula);
+static void            serviceUnlink      (FormulaService *service, ServiceFormula *formula);
+static void            serviceEvict       (FormulaService *service);
+static void            serviceFormulaDtor (ServiceFormula *formula);
+
+static int  serviceParseLine    (char *line, ServiceRequest *request);
+static int  serviceBind         (ServiceFormula *formula, ServiceRequest *request);
+static void serviceEvaluateGroup(FormulaService *service, ServiceFormula *formula, int count);
+static int  serviceProcessBatch (FormulaService *service, int count, FILE *out);
+static int  serviceCommand      (FormulaService *service, const char *line, FILE *out);
+static void serviceAnswer       (ServiceRequest *request, FILE *out);
+
+
+int formulaServiceCtor(FormulaService *service, int capacity)
+{
+    assert(service);
+
+    service->capacity     = capacity > 0 ? capacity : ServiceCacheSize;
+    service->cached       = 0;
+    service->head         = NULL;
+    service->tail         = NULL;
+    service->stats        = {};
+
+    service->bucketsCount = 1;
+    while (service->bucketsCount < service->capacity * 2) service->bucketsCount *= 2;
+
+    service->buckets  = (ServiceFormula **)calloc((size_t)service->bucketsCount, sizeof(ServiceFormula *));
+    service->requests = (ServiceRequest *) calloc((size_t)ServiceBatchLines, sizeof(ServiceRequest));
+    service->columns  = (double *)         calloc((size_t)ServiceBatchLines * NamesNumber, sizeof(double));
+    service->results  = (double *)         calloc((size_t)ServiceBatchLines, sizeof(double));
+    service->errors   = (unsigned char *)  calloc((size_t)ServiceBatchLines, sizeof(unsigned char));
+    service->group    = (int *)            calloc((size_t)ServiceBatchLines, sizeof(int));
+
+    if (!service->buckets || !service->requests || !service->columns ||
+        !service->results || !service->errors   || !service->group)
+    {
+        formulaServiceDtor(service);
+        return MEMORY_ERROR;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int formulaServiceDtor(FormulaService *service)
+{
+    assert(service);
+
+    while (service->head)
+    {
+        ServiceFormula *formula = service->head;
+        service->head = formula->next;
+
+        serviceFormulaDtor(formula);
+    }
+
+    free(service->buckets);
+    free(service->requests);
+    free(service->columns);
+    free(service->results);
+    free(service->errors);
+    free(service->group);
+
+    service->buckets  = NULL;
+    service->requests = NULL;
+    service->columns  = NULL;
+    service->results  = NULL;
+    service->errors   = NULL;
+    service->group    = NULL;
+    service->tail     = NULL;
+    service->cached   = 0;
+
+    return EXIT_SUCCESS;
+}
+
+static unsigned long long serviceHash(const char *text)
+{
+    assert(text);
+
+    unsigned long long hash = 14695981039346656037ull;
+
+    for ( ; *text; text++) hash = (hash ^ (unsigned char)*text) * 1099511628211ull;
+
+    return hash;
+}
+
+static char *serviceTrim(char *str)
+{
+    assert(str);
+
+    while (isspace((unsigned char)*str)) str++;
+
+    char *end = str + strlen(str);
+    while (end > str && isspace((unsigned char)end[-1])) end--;
+    *end = '\0';
+
+    return str;
+}
+
+ServiceFormula *formulaServiceLookup(FormulaService *service, const char *text)
+{
+    assert(service);
+    assert(text);
+
+    return serviceLookupHashed(service, text, serviceHash(text));
+}
+
+static ServiceFormula *serviceLookupHashed(FormulaService *service, const char *text, unsigned long long hash)
+{
+    assert(service);
+    assert(text);
+
+    ServiceFormula *formula = serviceFind(service, text, hash);
+
+    if (formula)
+    {
+        service->stats.hits++;
+        serviceTouch(service, formula);
+
+        return formula;
+    }
+
+    service->stats.misses++;
+
+    formula = servicePrepare(text, hash);
+    if (!formula) return NULL;
+
+    if (service->cached == service->capacity) serviceEvict(service);
+
+    ServiceFormula **bucket = &service->buckets[hash & (unsigned long long)(service->bucketsCount - 1)];
+    formula->chain = *bucket;
+    *bucket = formula;
+
+    formula->prev = NULL;
+    formula->next = service->head;
+    if (service->head) service->head->prev = formula;
+    service->head = formula;
+    if (!service->tail) service->tail = formula;
+
+    service->cached++;
+
+    return formula;
+}
+
+static ServiceFormula *serviceFind(FormulaService *service, const char *text, unsigned long long hash)
+{
+    assert(service);
+    assert(text);
+
+    ServiceFormula *formula = service->buckets[hash & (unsigned long long)(service->bucketsCount - 1)];
+
+    for ( ; formula; formula = formula->chain)
+    {
+        if (formula->hash == hash && strcmp(formula->text, text) == 0) return formula;
+    }
+
+    return NULL;
+}
+
+static ServiceFormula *servicePrepare(const char *text, unsigned long long hash)
+{
+    assert(text);
+
+    ServiceFormula *formula = (ServiceFormula *)calloc(1, sizeof(ServiceFormula));
+    if (!formula) return NULL;
+
+    formula->text = strdup(text);
+    formula->hash = hash;
+
+    if (!formula->text)
+    {
+        free(formula);
+        return NULL;
+    }
+
+    evaluatorCtor(&formula->eval);
+
+    Node *root = getFormula(&formula->eval, text);
+    if (root == PtrPoison) return formula;
+
+    formula->eval.tree.root = root;
+    expTreeSimplify(&formula->eval, root);
+
+    formula->valid = closurePrepare(&formula->eval, root, &formula->program) == EXIT_SUCCESS;
+
+    return formula;
+}
+
+static void serviceFormulaDtor(ServiceFormula *formula)
+{
+    assert(formula);
+
+    closureProgramDtor(&formula->program);
+    evaluatorDtor(&formula->eval);
+
+    free(formula->text);
+    free(formula);
+}
+
+static void serviceUnlink(FormulaService *service, ServiceFormula *formula)
+{
+    assert(service);
+    assert(formula);
+
+    if (formula->prev) formula->prev->next = formula->next;
+    else               service->head       = formula->next;
+
+    if (formula->next) formula->next->prev = formula->prev;
+    else               service->tail       = formula->prev;
+
+    formula->prev = NULL;
+    formula->next = NULL;
+}
+
+static void serviceTouch(FormulaService *service, ServiceFormula *formula)
+{
+    assert(service);
+    assert(formula);
+
+    if (service->head == formula) return;
+
+    serviceUnlink(service, formula);
+
+    formula->next = service->head;
+    if (service->head) service->head->prev = formula;
+    service->head = formula;
+    if (!service->tail) service->tail = formula;
+}
+
+static void serviceEvict(FormulaService *service)
+{
+    assert(service);
+
+    ServiceFormula *victim = service->tail;
+    if (!victim) return;
+
+    serviceUnlink(service, victim);
+
+    ServiceFormula **link = &service->buckets[victim->hash & (unsigned long long)(service->bucketsCount - 1)];
+    while (*link != victim) link = &(*link)->chain;
+    *link = victim->chain;
+
+    serviceFormulaDtor(victim);
+
+    service->cached--;
+    service->stats.evictions++;
+}
+
+int formulaServiceRun(FormulaService *service, int inFd, FILE *out)
+{
+    assert(service);
+    assert(out);
+
+    int   capacity = ServiceReadChunk;
+    int   size     = 0;
+    char *buffer   = (char *)calloc((size_t)capacity + 1, sizeof(char));
+    if (!buffer) return MEMORY_ERROR;
+
+    bool finished = false;
+    int  error    = EXIT_SUCCESS;
+
+    while (!finished && !error)
+    {
+        if (size == capacity)
+        {
+            char *bigger = (char *)realloc(buffer, (size_t)capacity * 2 + 1);
+            if (!bigger) { error = MEMORY_ERROR; break; }
+
+            buffer    = bigger;
+            capacity *= 2;
+        }
+
+        ssize_t got = read(inFd, buffer + size, (size_t)(capacity - size));
+        if (got < 0 && errno == EINTR) continue;
+
+        if (got <= 0)
+        {
+            // the last line may come without '\n'
+            finished = true;
+            if (size > 0) buffer[size++] = '\n';
+        }
+        else size += (int)got;
+
+        int start = 0;
+        int count = 0;
+
+        for (int i = 0; i < size && !error; i++)
+        {
+            if (buffer[i] != '\n') continue;
+
+            buffer[i] = '\0';
+            char *line = serviceTrim(buffer + start);
+            start = i + 1;
+
+            if (*line == '\0') continue;
+
+            if (*line == '#')
+            {
+                error = serviceProcessBatch(service, count, out);
+                count = 0;
+
+                if (!error) error = serviceCommand(service, line, out);
+                continue;
+            }
+
+            if (serviceParseLine(line, &service->requests[count])) continue;
+
+            if (++count == ServiceBatchLines)
+            {
+                error = serviceProcessBatch(service, count, out);
+                count = 0;
+            }
+        }
+
+        if (!error) error = serviceProcessBatch(service, count, out);
+
+        memmove(buffer, buffer + start, (size_t)(size - start));
+        size -= start;
+    }
+
+    free(buffer);
+
+    if (error) LOG("ERROR: %s: service stopped: %d\n", __func__, error);
+
+    return error;
+}
+
+static int serviceParseLine(char *line, ServiceRequest *request)
+{
+    assert(line);
+    assert(request);
+
+    char *bar = strchr(line, '|');
+    if (bar) *bar = '\0';
+
+    request->formula  = serviceTrim(line);
+    request->bindings = bar ? serviceTrim(bar + 1) : bar;
+    request->hash     = serviceHash(request->formula);
+    request->status   = SERVICE_OK;
+    request->error    = TREE_NO_ERROR;
+    request->value    = DataPoison;
+    request->done     = false;
+
+    return EXIT_SUCCESS;
+}
+
+static int serviceCommand(FormulaService *service, const char *line, FILE *out)
+{
+    assert(service);
+    assert(line);
+    assert(out);
+
+    if (strcmp(line, "#stats") == 0) formulaServiceStats(service, out);
+    else fprintf(out, "ERROR command\n");
+
+    fflush(out);
+
+    return EXIT_SUCCESS;
+}
+
+static int serviceProcessBatch(FormulaService *service, int count, FILE *out)
+{
+    assert(service);
+    assert(out);
+
+    ServiceRequest *requests = service->requests;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (requests[i].done) continue;
+
+        ServiceFormula *formula = serviceLookupHashed(service, requests[i].formula, requests[i].hash);
+        if (!formula) return MEMORY_ERROR;
+
+        int groupCount = 0;
+
+        for (int j = i; j < count; j++)
+        {
+            ServiceRequest *request = &requests[j];
+
+            if (request->done || request->hash != requests[i].hash ||
+                strcmp(request->formula, requests[i].formula) != 0) continue;
+
+            request->done = true;
+            if (j != i) service->stats.hits++;
+
+            if      (!formula->valid)              request->status = SERVICE_SYNTAX_ERROR;
+            else if (serviceBind(formula, request)) request->status = SERVICE_BINDING_ERROR;
+            else    service->group[groupCount++] = j;
+        }
+
+        serviceEvaluateGroup(service, formula, groupCount);
+    }
+
+    for (int i = 0; i < count; i++) serviceAnswer(&requests[i], out);
+
+    service->stats.requests += count;
+
+    fflush(out);
+
+    return EXIT_SUCCESS;
+}
+
+static int serviceBind(ServiceFormula *formula, ServiceRequest *request)
+{
+    assert(formula);
+    assert(request);
+
+    NameTable *names = &formula->eval.names;
+    bool       bound[NamesNumber] = {};
+
+    char *cursor = request->bindings;
+
+    while (cursor && *cursor)
+    {
+        while (*cursor == ',' || isspace((unsigned char)*cursor)) cursor++;
+        if (*cursor == '\0') break;
+
+        char *name = cursor;
+        while (*cursor && *cursor != '=' && *cursor != ',' && !isspace((unsigned char)*cursor)) cursor++;
+        if (*cursor != '=') return BAD_VAR_INDEX;
+
+        *cursor++ = '\0';
+
+        char  *end   = cursor;
+        double value = strtod(cursor, &end);
+        if (end == cursor) return BAD_VAR_INDEX;
+        cursor = end;
+
+        int index = nameTableFind(names, name);
+        if (index == IndexPoison) return BAD_VAR_INDEX;
+
+        request->vars[index] = value;
+        bound[index]         = true;
+    }
+
+    for (int i = 0; i < names->count; i++)
+    {
+        if (!bound[i]) return BAD_VAR_INDEX;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static void serviceEvaluateGroup(FormulaService *service, ServiceFormula *formula, int count)
+{
+    assert(service);
+    assert(formula);
+
+    ServiceRequest *requests  = service->requests;
+    int            *group     = service->group;
+    int             varsCount = formula->eval.names.count;
+
+    bool batched = false;
+
+    if (count >= ServiceBatchMinRows)
+    {
+        const double *columns[NamesNumber] = {};
+
+        for (int var = 0; var < varsCount; var++)
+        {
+            double *column = service->columns + var * ServiceBatchLines;
+
+            for (int i = 0; i < count; i++) column[i] = requests[group[i]].vars[var];
+
+            columns[var] = column;
+        }
+
+        batched = expTreeEvaluateBatch(&formula->eval, formula->eval.tree.root, columns, count,
+                                       service->results, service->errors) == EXIT_SUCCESS;
+        if (batched)
+        {
+            service->stats.batches++;
+            service->stats.batchedRows += count;
+        }
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        ServiceRequest *request = &requests[group[i]];
+
+        // the batch flags don't tell which error it was, the closure does
+        if (batched && !service->errors[i])
+        {
+            request->value = service->results[i];
+            continue;
+        }
+
+        ExpTreeErrors error = TREE_NO_ERROR;
+        request->value = closureEvaluate(&formula->program, request->vars, &error);
+        request->error = error;
+
+        if (error) request->status = SERVICE_EVAL_ERROR;
+    }
+}
+
+static void serviceAnswer(ServiceRequest *request, FILE *out)
+{
+    assert(request);
+    assert(out);
+
+    switch (request->status)
+    {
+        case SERVICE_OK:            fprintf(out, ServiceNumberFormat "\n", request->value);
+                                    break;
+
+        case SERVICE_SYNTAX_ERROR:  fprintf(out, "ERROR syntax\n");
+                                    break;
+
+        case SERVICE_BINDING_ERROR: fprintf(out, "ERROR binding\n");
+                                    break;
+
+        case SERVICE_EVAL_ERROR:    fprintf(out, "ERROR %d\n", request->error);
+                                    break;
+
+        default:                    fprintf(out, "ERROR %d\n", request->status);
+                                    break;
+    }
+}
+
+int formulaServiceStats(FormulaService *service, FILE *f)
+{
+    assert(service);
+    assert(f);
+
+    fprintf(f, "requests %lld hits %lld misses %lld evictions %lld cached %d batches %lld batched %lld\n",
+               service->stats.requests, service->stats.hits,    service->stats.misses,
+               service->stats.evictions, service->cached,
+               service->stats.batches,  service->stats.batchedRows);
+
+    return EXIT_SUCCESS;
+}
+
+// the requests are written to a pipe the service reads like any client, the answers go to a
+// temporary file and are compared line by line
+int formulaServiceCheck(FILE *f)
+{
+    assert(f);
+
+    int pipeFds[2] = {};
+    if (pipe(pipeFds) != 0) return EXIT_FAILURE;
+
+    for (int i = 0; i < ServiceCheckCasesCount; i++) dprintf(pipeFds[1], "%s\n", ServiceCheckCases[i].request);
+    close(pipeFds[1]);
+
+    FILE *answers = tmpfile();
+    if (!answers) { close(pipeFds[0]); return EXIT_FAILURE; }
+
+    FormulaService service = {};
+    int error = formulaServiceCtor(&service, ServiceCacheSize);
+
+    if (!error)
+    {
+        error = formulaServiceRun(&service, pipeFds[0], answers);
+        formulaServiceDtor(&service);
+    }
+
+    close(pipeFds[0]);
+
+    if (error) { fclose(answers); return error; }
+
+    rewind(answers);
+
+    int  failed = 0;
+    char line[ServiceCheckLineLength] = "";
+
+    for (int i = 0; i < ServiceCheckCasesCount; i++)
+    {
+        if (!fgets(line, sizeof(line), answers)) line[0] = '\0';
+        line[strcspn(line, "\n")] = '\0';
+
+        // the sign and the spelling of nan depend on the C library
+        if (strcmp(line, ServiceCheckCases[i].answer) == 0) continue;
+        if (strcmp(ServiceCheckCases[i].answer, "nan") == 0 && strstr(line, "nan")) continue;
+
+        fprintf(f, "FAILED %s: answered \"%s\", expected \"%s\"\n", ServiceCheckCases[i].request,
+                   line, ServiceCheckCases[i].answer);
+        failed++;
+    }
+
+    fclose(answers);
+
+    fprintf(f, "service check: %d of %d failed\n", failed, ServiceCheckCasesCount);
+
+    return failed;
+}
+
+// clients are served one after another, the cache lives as long as the service
+int formulaServiceListen(FormulaService *service, const char *socketPath)
+{
+    assert(service);
+    assert(socketPath);
+
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+
+    if (strlen(socketPath) >= sizeof(address.sun_path)) return EXIT_FAILURE;
+    strcpy(address.sun_path, socketPath);
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0) return EXIT_FAILURE;
+
+    // a client leaving early must not kill the service
+    signal(SIGPIPE, SIG_IGN);
+
+    unlink(socketPath);
+
+    if (bind(server, (struct sockaddr *)&address, sizeof(address)) || listen(server, ServiceBacklog))
+    {
+        LOG("ERROR: %s: couldn't listen on %s: %s\n", __func__, socketPath, strerror(errno));
+        close(server);
+        return EXIT_FAILURE;
+    }
+
+    int error = EXIT_SUCCESS;
+
+    while (!error)
+    {
+        int client = accept(server, NULL, NULL);
+        if (client < 0 && errno == EINTR) continue;
+        if (client < 0) { error = EXIT_FAILURE; break; }
+
+        int   outFd = dup(client);
+        FILE *out   = outFd < 0 ? NULL : fdopen(outFd, "w");
+
+        if (out)
+        {
+            error = formulaServiceRun(service, client, out);
+            fclose(out);
+        }
+        else if (outFd >= 0) close(outFd);
+
+        close(client);
+    }
+
+    close(server);
+    unlink(socketPath);
+
+    return error;
+}
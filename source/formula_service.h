@@ -0,0 +1,93 @@
+#ifndef  __FORMULA_SERVICE_H__
+#define  __FORMULA_SERVICE_H__
+
+#include <stdio.h>
+
+#include "tree_of_expressions.h"
+#include "closure_evaluate.h"
+
+#define ServiceNumberFormat "%.15lg"
+
+enum ServiceStatus
+{
+    SERVICE_OK            = 0,
+    SERVICE_SYNTAX_ERROR  = 1,
+    SERVICE_BINDING_ERROR = 2,
+    SERVICE_EVAL_ERROR    = 3,
+};
+
+const int ServiceCacheSize     = 128;
+const int ServiceBatchLines    = 256;
+const int ServiceBatchMinRows  = 16;
+const int ServiceReadChunk     = 65536;
+
+struct ServiceFormula
+{
+    char               *text;
+    unsigned long long  hash;
+
+    Evaluator           eval;
+    ClosureProgram      program;
+    bool                valid;
+
+    ServiceFormula     *prev;    // LRU list, head is the most recent
+    ServiceFormula     *next;
+    ServiceFormula     *chain;   // hash bucket
+};
+
+struct ServiceRequest
+{
+    char               *formula;
+    char               *bindings;
+    unsigned long long  hash;
+
+    double              vars[NamesNumber];
+    double              value;
+    ServiceStatus       status;
+    ExpTreeErrors       error;
+    bool                done;
+};
+
+struct ServiceStats
+{
+    long long requests;
+    long long hits;
+    long long misses;
+    long long evictions;
+    long long batches;
+    long long batchedRows;
+};
+
+struct FormulaService
+{
+    ServiceFormula  **buckets;
+    int               bucketsCount;
+
+    ServiceFormula   *head;
+    ServiceFormula   *tail;
+    int               cached;
+    int               capacity;
+
+    ServiceRequest   *requests;
+    double           *columns;     // NamesNumber columns of ServiceBatchLines rows
+    double           *results;
+    unsigned char    *errors;
+    int              *group;
+
+    ServiceStats      stats;
+};
+
+int formulaServiceCtor(FormulaService *service, int capacity);
+int formulaServiceDtor(FormulaService *service);
+
+ServiceFormula *formulaServiceLookup(FormulaService *service, const char *text);
+
+int formulaServiceRun   (FormulaService *service, int inFd, FILE *out);
+int formulaServiceListen(FormulaService *service, const char *socketPath);
+
+int formulaServiceStats(FormulaService *service, FILE *f);
+
+// runs known requests through a new service, returns the number of wrong answers
+int formulaServiceCheck(FILE *f);
+
+#endif //__FORMULA_SERVICE_H__
@@ -0,0 +1,347 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <time.h>
+
+#include "tree_of_expressions.h"
+#include "html_logfile.h"
+#include "incremental_evaluate.h"
+
+#define CHECK_POISON_PTR(ptr) \
+    if (ptr == PtrPoison)     \
+    {                         \
+        LOG("ERROR: PoisonPtr detected in %s(%d) %s\n", __FILE__, __LINE__, __func__);\
+        return BAD_NODE_TYPE;                                                            \
+    }
+
+//-------------------------------------------------------------------------------------------------
+// Every tree node gets a slot with its cached value, error and the mask of variables its subtree
+// reads. Changing a variable clears the slots whose mask contains it - exactly the paths from
+// the variable's leaves to the root - and the next evaluation recomputes only those slots.
+//-------------------------------------------------------------------------------------------------
+
+const int IncrementalStartCapacity = 64;
+
+static int    incrementalBuild     (IncrementalEvaluator *inc, Node *node, int *index);
+static double incrementalNodeValue (IncrementalEvaluator *inc, int index, ExpTreeErrors *error);
+static void   incrementalInvalidate(IncrementalEvaluator *inc, int index, IncrementalVarsMask mask);
+static void   incrementalSyncNames (IncrementalEvaluator *inc);
+
+static IncrementalVarsMask incrementalVarBit(int varIndex);
+
+
+int incrementalCtor(IncrementalEvaluator *inc, Evaluator *eval, Node *root)
+{
+    assert(inc);
+    assert(eval);
+    CHECK_POISON_PTR(root);
+
+    inc->eval          = eval;
+    inc->root          = root;
+    inc->nodesCount    = 0;
+    inc->nodesCapacity = IncrementalStartCapacity;
+    inc->recomputed    = 0;
+
+    inc->nodes = (IncrementalNode *)calloc((size_t)inc->nodesCapacity, sizeof(IncrementalNode));
+    if (!inc->nodes) return MEMORY_ERROR;
+
+    for (int i = 0; i < eval->names.count; i++) inc->seenValues[i] = eval->names.table[i].value;
+
+    int rootIndex = IndexPoison;
+    int error = incrementalBuild(inc, root, &rootIndex);
+
+    if (error) LOG("ERROR: %s: couldn't build the cache: %d\n", __func__, error);
+
+    return error;
+}
+
+int incrementalDtor(IncrementalEvaluator *inc)
+{
+    assert(inc);
+
+    free(inc->nodes);
+
+    inc->nodes         = NULL;
+    inc->nodesCount    = 0;
+    inc->nodesCapacity = 0;
+
+    return EXIT_SUCCESS;
+}
+
+static int incrementalBuild(IncrementalEvaluator *inc, Node *node, int *index)
+{
+    assert(inc);
+    assert(index);
+    CHECK_POISON_PTR(node);
+
+    *index = IndexPoison;
+    if (!node) return EXIT_SUCCESS;
+
+    if (inc->nodesCount == inc->nodesCapacity)
+    {
+        IncrementalNode *nodes = (IncrementalNode *)realloc(inc->nodes, (size_t)inc->nodesCapacity * 2 *
+                                                                        sizeof(IncrementalNode));
+        if (!nodes) return MEMORY_ERROR;
+
+        inc->nodes          = nodes;
+        inc->nodesCapacity *= 2;
+    }
+
+    int current = inc->nodesCount++;
+    *index = current;
+
+    IncrementalNode slot = {};
+    slot.node  = node;
+    slot.left  = IndexPoison;
+    slot.right = IndexPoison;
+    slot.valid = false;
+
+    if (node->type == EXP_TREE_VARIABLE)
+    {
+        if (node->data.variableNum < 0 || node->data.variableNum >= inc->eval->names.count) return BAD_VAR_INDEX;
+
+        slot.vars = incrementalVarBit(node->data.variableNum);
+    }
+
+    int error = incrementalBuild(inc, node->left, &slot.left);
+    if (!error) error = incrementalBuild(inc, node->right, &slot.right);
+
+    if (slot.left  != IndexPoison) slot.vars |= inc->nodes[slot.left].vars;
+    if (slot.right != IndexPoison) slot.vars |= inc->nodes[slot.right].vars;
+
+    inc->nodes[current] = slot;
+
+    return error;
+}
+
+static IncrementalVarsMask incrementalVarBit(int varIndex)
+{
+    const int maskBits = (int)sizeof(IncrementalVarsMask) * 8;
+
+    return varIndex < maskBits ? (IncrementalVarsMask)1 << varIndex : ~(IncrementalVarsMask)0;
+}
+
+double incrementalEvaluate(IncrementalEvaluator *inc, ExpTreeErrors *error)
+{
+    assert(inc);
+    assert(error);
+
+    incrementalSyncNames(inc);
+
+    inc->recomputed = 0;
+
+    if (inc->nodesCount == 0) return 0;
+
+    return incrementalNodeValue(inc, 0, error);
+}
+
+static double incrementalNodeValue(IncrementalEvaluator *inc, int index, ExpTreeErrors *error)
+{
+    assert(inc);
+    assert(error);
+
+    if (index == IndexPoison) return 0;
+
+    IncrementalNode *slot = &inc->nodes[index];
+
+    if (slot->valid)
+    {
+        if (slot->error) *error = slot->error;
+        return slot->value;
+    }
+
+    Node *node = slot->node;
+
+    ExpTreeErrors nodeError = TREE_NO_ERROR;
+    double        value     = 0;
+
+    switch (node->type)
+    {
+        case EXP_TREE_NUMBER:   value = node->data.number;
+                                break;
+
+        case EXP_TREE_VARIABLE: value = inc->eval->names.table[node->data.variableNum].value;
+                                break;
+
+        case EXP_TREE_OPERATOR:
+        {
+            int left  = slot->left;
+            int right = slot->right;
+
+            double leftValue  = incrementalNodeValue(inc, left,  &nodeError);
+            double rightValue = incrementalNodeValue(inc, right, &nodeError);
+
+            value = nodeError ? DataPoison : NodeCalculate(leftValue, rightValue, node->data.operatorNum, &nodeError);
+            break;
+        }
+
+        case EXP_TREE_NOTHING:
+        case EXP_TREE_IDENTIF:
+        default:                nodeError = BAD_NODE_TYPE;
+                                value     = DataPoison;
+                                break;
+    }
+
+    slot = &inc->nodes[index];
+    slot->value = value;
+    slot->error = nodeError;
+    slot->valid = true;
+
+    inc->recomputed++;
+
+    if (nodeError) *error = nodeError;
+
+    return value;
+}
+
+int incrementalSetValue(IncrementalEvaluator *inc, const char *name, double value)
+{
+    assert(inc);
+    assert(name);
+
+    int index = nameTableSetValue(&inc->eval->names, name, value);
+    if (index == IndexPoison) return IndexPoison;
+
+    inc->seenValues[index] = value;
+    incrementalInvalidateVar(inc, index);
+
+    return index;
+}
+
+int incrementalInvalidateVar(IncrementalEvaluator *inc, int varIndex)
+{
+    assert(inc);
+
+    if (varIndex < 0 || varIndex >= inc->eval->names.count) return BAD_VAR_INDEX;
+
+    if (inc->nodesCount > 0) incrementalInvalidate(inc, 0, incrementalVarBit(varIndex));
+
+    return EXIT_SUCCESS;
+}
+
+int incrementalInvalidateAll(IncrementalEvaluator *inc)
+{
+    assert(inc);
+
+    for (int i = 0; i < inc->nodesCount; i++) inc->nodes[i].valid = false;
+
+    return EXIT_SUCCESS;
+}
+
+bool incrementalDependsOn(IncrementalEvaluator *inc, int varIndex)
+{
+    assert(inc);
+
+    if (inc->nodesCount == 0) return false;
+
+    return (inc->nodes[0].vars & incrementalVarBit(varIndex)) != 0;
+}
+
+static void incrementalInvalidate(IncrementalEvaluator *inc, int index, IncrementalVarsMask mask)
+{
+    assert(inc);
+
+    while (index != IndexPoison && (inc->nodes[index].vars & mask))
+    {
+        IncrementalNode *slot = &inc->nodes[index];
+        slot->valid = false;
+
+        if (slot->left != IndexPoison && (inc->nodes[slot->left].vars & mask))
+        {
+            incrementalInvalidate(inc, slot->right, mask);
+            index = slot->left;
+        }
+        else index = slot->right;
+    }
+}
+
+// picks up values changed with nameTableSetValue behind our back
+static void incrementalSyncNames(IncrementalEvaluator *inc)
+{
+    assert(inc);
+
+    for (int i = 0; i < inc->eval->names.count; i++)
+    {
+        double value = inc->eval->names.table[i].value;
+
+        if (memcmp(&value, &inc->seenValues[i], sizeof(double)) != 0)
+        {
+            inc->seenValues[i] = value;
+            incrementalInvalidateVar(inc, i);
+        }
+    }
+}
+
+int incrementalBenchmark(Evaluator *eval, Node *expression, int updates, FILE *f)
+{
+    assert(eval);
+    assert(f);
+    CHECK_POISON_PTR(expression);
+
+    IncrementalEvaluator inc = {};
+    int error = incrementalCtor(&inc, eval, expression);
+    if (error) { incrementalDtor(&inc); return error; }
+
+    double savedValues[NamesNumber] = {};
+    int    usedVars   [NamesNumber] = {};
+    int    usedCount = 0;
+
+    for (int i = 0; i < eval->names.count; i++)
+    {
+        savedValues[i] = eval->names.table[i].value;
+        if (incrementalDependsOn(&inc, i)) usedVars[usedCount++] = i;
+    }
+
+    ExpTreeErrors evalError = TREE_NO_ERROR;
+    incrementalEvaluate(&inc, &evalError);
+
+    long long recomputed = 0;
+    clock_t   start      = clock();
+
+    for (int i = 0; i < updates && usedCount > 0; i++)
+    {
+        const char *name = eval->names.table[usedVars[rand() % usedCount]].name;
+        incrementalSetValue(&inc, name, 10.0 * rand() / RAND_MAX + 1);
+
+        evalError = TREE_NO_ERROR;
+        incrementalEvaluate(&inc, &evalError);
+        recomputed += inc.recomputed;
+    }
+
+    double incTime = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    evalError = TREE_NO_ERROR;
+    double incValue = incrementalEvaluate(&inc, &evalError);
+
+    start = clock();
+
+    for (int i = 0; i < updates; i++)
+    {
+        incrementalInvalidateAll(&inc);
+
+        evalError = TREE_NO_ERROR;
+        incrementalEvaluate(&inc, &evalError);
+    }
+
+    double fullTime = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    ExpTreeErrors treeError = TREE_NO_ERROR;
+    double treeValue = expTreeEvaluate(eval, expression, &treeError);
+
+    fprintf(f, "nodes:          %d, depends on %d variables\n", inc.nodesCount, usedCount);
+    fprintf(f, "updates:        %d\n", updates);
+    fprintf(f, "full:           %lg s\n", fullTime);
+    fprintf(f, "incremental:    %lg s (%lg nodes per update)\n", incTime,
+               updates > 0 ? (double)recomputed / updates : 0);
+    if (incTime > 0) fprintf(f, "speedup:        %lg\n", fullTime / incTime);
+    fprintf(f, "check:          " ElemNumberFormat " vs " ElemNumberFormat " (errors %d, %d)\n",
+               incValue, treeValue, evalError, treeError);
+
+    for (int i = 0; i < eval->names.count; i++) eval->names.table[i].value = savedValues[i];
+
+    incrementalDtor(&inc);
+
+    return EXIT_SUCCESS;
+}
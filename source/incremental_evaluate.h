@@ -0,0 +1,48 @@
+#ifndef  __INCREMENTAL_EVALUATE_H__
+#define  __INCREMENTAL_EVALUATE_H__
+
+#include <stdio.h>
+
+#include "tree_of_expressions.h"
+
+typedef unsigned long long IncrementalVarsMask;
+
+struct IncrementalNode
+{
+    Node               *node;
+    int                 left;
+    int                 right;
+
+    double              value;
+    ExpTreeErrors       error;
+    IncrementalVarsMask vars;
+    bool                valid;
+};
+
+struct IncrementalEvaluator
+{
+    Evaluator       *eval;
+    Node            *root;
+
+    IncrementalNode *nodes;
+    int              nodesCount;
+    int              nodesCapacity;
+
+    double           seenValues[NamesNumber];
+    int              recomputed;
+};
+
+int incrementalCtor(IncrementalEvaluator *inc, Evaluator *eval, Node *root);
+int incrementalDtor(IncrementalEvaluator *inc);
+
+double incrementalEvaluate(IncrementalEvaluator *inc, ExpTreeErrors *error);
+
+int incrementalSetValue     (IncrementalEvaluator *inc, const char *name, double value);
+int incrementalInvalidateVar(IncrementalEvaluator *inc, int varIndex);
+int incrementalInvalidateAll(IncrementalEvaluator *inc);
+
+bool incrementalDependsOn(IncrementalEvaluator *inc, int varIndex);
+
+int incrementalBenchmark(Evaluator *eval, Node *expression, int updates, FILE *f);
+
+#endif //__INCREMENTAL_EVALUATE_H__
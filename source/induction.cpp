@@ -0,0 +1,508 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <assert.h>
+
+#include "tree_of_expressions.h"
+#include "html_logfile.h"
+#include "induction.h"
+
+#define CHECK_POISON_PTR(ptr) \
+    if (ptr == PtrPoison)     \
+    {                         \
+        LOG("ERROR: PoisonPtr detected in %s(%d) %s\n", __FILE__, __LINE__, __func__);\
+        return 0;                                                                     \
+    }
+
+//-------------------------------------------------------------------------------------------------
+// Induction variables of pokuda loops and strength reduction. A basic induction variable is
+// assigned exactly once in the loop, by a statement of the body itself (not under a koli or a
+// nested loop) of the form i = i + c, i = c + i or i = i - c, and it holds a known value when
+// the loop starts. k * i with a number k is then a derived one: it grows by k * c each time i
+// grows by c, so a new variable "_ivN" starts at k * i0 before the loop, follows i right after
+// its assignment, and is read instead of computing the product.
+// When k * i is the only thing the loop reads i for, besides its own assignment and comparing
+// it to a number in the condition, and i is not read anywhere else in the program, i itself is
+// redundant: its assignment is turned into the one of the new variable and the condition
+// compares that to k times the number. Otherwise the new variable is made only when k * i is
+// used at least InductionMinUses times, as keeping both costs an assignment per iteration.
+// Doubles add up exactly only while they are integers, so the start value, c and k must be
+// integers (and values must stay below 2^53, which counting loops do).
+//-------------------------------------------------------------------------------------------------
+
+#define IS_OPER(node, oper) ((node) && (node)->type == EXP_TREE_OPERATOR && (node)->data.operatorNum == (oper))
+#define IS_VAR(node, var)   ((node) && (node)->type == EXP_TREE_VARIABLE && (node)->data.variableNum == (var))
+#define IS_NUMBER(node)     ((node) && (node)->type == EXP_TREE_NUMBER)
+
+static int  inductionStatement(InductionPass *pass, Node **slot, Node **link, InductionKnown *known);
+static int  inductionBlock    (InductionPass *pass, Node **link, InductionKnown *known);
+static int  inductionLoop     (InductionPass *pass, Node **slot, Node **link, InductionKnown *known);
+
+static bool inductionFindBasic (Node *loop, Node *stmt, Node *item, InductionKnown *known, InductionVar *iv);
+static void inductionFindUses  (InductionVar *iv, Node **slot);
+static void inductionAddProduct(InductionVar *iv, Node **slot, double factor);
+static int  inductionTransform (InductionPass *pass, Node *loop, InductionVar *iv, InductionKnown *known, Node ***tail);
+
+static Node    *inductionNewVar   (int var, int line);
+static Node    *inductionNewNumber(double number, int line);
+static bool     inductionIsInteger(Node *node);
+static void     inductionKill     (InductionKnown *known, unsigned vars);
+static unsigned inductionAssigned (Node *node);
+static int      inductionAssigns  (Node *node, int var);
+static int      inductionReads    (Node *node, int var, Node *skip);
+
+
+int inductionOptimize(Evaluator *eval, Node **root, InductionStats *stats)
+{
+    assert(eval);
+    assert(root);
+    CHECK_POISON_PTR(*root);
+
+    InductionPass pass = {};
+    pass.eval = eval;
+    pass.root = root;
+
+    // every variable starts as DefaultVarValue
+    InductionKnown known = {};
+    known.mask = (1u << NamesNumber) - 1;
+
+    for (int i = 0; i < NamesNumber; i++) known.values[i] = DefaultVarValue;
+
+    inductionStatement(&pass, root, NULL, &known);
+
+    LOG("%s: %d basic induction variables, %d products reduced, %d variables eliminated, error %d\n",
+        __func__, pass.stats.basic, pass.stats.reduced, pass.stats.eliminated, pass.error);
+
+    if (stats) *stats = pass.stats;
+
+    return pass.error;
+}
+
+// link: the INSTR_END item whose left is *slot, NULL if the statement is a bare body
+static int inductionStatement(InductionPass *pass, Node **slot, Node **link, InductionKnown *known)
+{
+    assert(pass);
+    assert(slot);
+    assert(known);
+
+    Node *stmt = *slot;
+    if (!stmt || stmt == PtrPoison || stmt->type != EXP_TREE_OPERATOR || pass->error) return pass->error;
+
+    switch (stmt->data.operatorNum)
+    {
+        case INSTR_END: return inductionBlock(pass, slot, known);
+
+        case ASSIGN:
+        {
+            if (!stmt->right || stmt->right->type != EXP_TREE_VARIABLE) return EXIT_SUCCESS;
+
+            int var = stmt->right->data.variableNum;
+            inductionKill(known, 1u << var);
+
+            if (IS_NUMBER(stmt->left))
+            {
+                known->values[var] = stmt->left->data.number;
+                known->mask       |= 1u << var;
+            }
+
+            return EXIT_SUCCESS;
+        }
+
+        case IN:        inductionKill(known, inductionAssigned(stmt));
+                        return EXIT_SUCCESS;
+
+        case IF:
+        {
+            InductionKnown body = *known;
+            inductionStatement(pass, &stmt->right, NULL, &body);
+
+            inductionKill(known, inductionAssigned(stmt));
+            return pass->error;
+        }
+
+        case WHILE:     inductionLoop(pass, slot, link, known);
+
+                        // *slot also holds the new variables if the loop is a bare body
+                        inductionKill(known, inductionAssigned(*slot));
+                        return pass->error;
+
+        case NOT_OPER:  case ADD:       case SUB:       case MUL:
+        case DIV:       case LN:        case LOGAR:     case POW:
+        case SIN:       case COS:       case R_BRACKET: case L_BRACKET:
+        case BELOW:     case ABOVE:     case OPEN_F:    case CLOSE_F:
+        case OUT:       case THEN:      case EQUAL:     case NOT_EQUAL:
+        case SQRT:      case NEW_VAR:
+        default:        return EXIT_SUCCESS;
+    }
+}
+
+static int inductionBlock(InductionPass *pass, Node **link, InductionKnown *known)
+{
+    assert(pass);
+    assert(link);
+    assert(known);
+
+    while (IS_OPER(*link, INSTR_END) && !pass->error)
+    {
+        Node *item = *link;
+
+        inductionStatement(pass, &item->left, link, known);
+
+        // the new variables start before item
+        link = &item->right;
+    }
+
+    return inductionStatement(pass, link, NULL, known);
+}
+
+static int inductionLoop(InductionPass *pass, Node **slot, Node **link, InductionKnown *known)
+{
+    assert(pass);
+    assert(slot);
+    assert(known);
+
+    Node *loop = *slot;
+
+    Node  *before = NULL;
+    Node **tail   = &before;
+
+    // the candidates are the statements of the body itself
+    Node *body = loop->right;
+
+    for (Node *item = body; item && !pass->error; item = IS_OPER(item, INSTR_END) ? item->right : NULL)
+    {
+        Node *stmt = IS_OPER(item, INSTR_END) ? item->left : item;
+
+        InductionVar iv = {};
+        if (!inductionFindBasic(loop, stmt, IS_OPER(item, INSTR_END) ? item : NULL, known, &iv)) continue;
+
+        pass->stats.basic++;
+
+        Node *cond = loop->left;
+
+        if ((IS_OPER(cond, BELOW) || IS_OPER(cond, ABOVE) || IS_OPER(cond, EQUAL) || IS_OPER(cond, NOT_EQUAL)) &&
+            ((IS_VAR(cond->left,  iv.var) && inductionIsInteger(cond->right)) ||
+             (IS_VAR(cond->right, iv.var) && inductionIsInteger(cond->left))))
+        {
+            iv.compare = cond;
+        }
+        else inductionFindUses(&iv, &loop->left);
+
+        inductionFindUses(&iv, &loop->right);
+
+        inductionTransform(pass, loop, &iv, known, &tail);
+    }
+
+    if (pass->error) return pass->error;
+
+    if (before)
+    {
+        if (link)
+        {
+            Node *item = *link;
+            assert(item->left == loop);
+
+            *tail = item;
+            *link = before;
+        }
+        else
+        {
+            Node *item = createNode(EXP_TREE_OPERATOR, createNodeData(EXP_TREE_OPERATOR, INSTR_END), loop, NULL);
+            if (!item) return pass->error = MEMORY_ERROR;
+
+            *tail = item;
+            *slot = before;
+        }
+    }
+
+    InductionKnown inner = *known;
+    inductionKill(&inner, inductionAssigned(loop));
+
+    return inductionStatement(pass, &loop->right, NULL, &inner);
+}
+
+// stmt is var = var + c, the only assignment of var in the loop
+static bool inductionFindBasic(Node *loop, Node *stmt, Node *item, InductionKnown *known, InductionVar *iv)
+{
+    assert(loop);
+    assert(known);
+    assert(iv);
+
+    if (!IS_OPER(stmt, ASSIGN) || !stmt->right || stmt->right->type != EXP_TREE_VARIABLE) return false;
+
+    int   var   = stmt->right->data.variableNum;
+    Node *value = stmt->left;
+
+    if (!(known->mask & (1u << var)) || !(fabs(known->values[var]) <= InductionMaxExact) ||
+        floor(known->values[var]) < known->values[var]) return false;
+
+    if (!IS_OPER(value, ADD) && !IS_OPER(value, SUB)) return false;
+
+    double step = 0;
+
+    if (IS_VAR(value->left, var) && inductionIsInteger(value->right))
+    {
+        step = IS_OPER(value, ADD) ? value->right->data.number : -value->right->data.number;
+    }
+    else if (IS_OPER(value, ADD) && IS_VAR(value->right, var) && inductionIsInteger(value->left))
+    {
+        step = value->left->data.number;
+    }
+    else return false;
+
+    if (inductionAssigns(loop, var) != 1) return false;
+
+    iv->var    = var;
+    iv->init   = known->values[var];
+    iv->step   = step;
+    iv->update = stmt;
+    iv->item   = item;
+
+    return true;
+}
+
+static void inductionFindUses(InductionVar *iv, Node **slot)
+{
+    assert(iv);
+    assert(slot);
+
+    Node *node = *slot;
+    if (!node || node == PtrPoison || node == iv->update) return;
+
+    if (IS_VAR(node, iv->var))
+    {
+        iv->otherUses++;
+        return;
+    }
+
+    if (IS_OPER(node, ASSIGN) || IS_OPER(node, IN))
+    {
+        // the variable on the right is written, not read
+        if (IS_OPER(node, ASSIGN)) inductionFindUses(iv, &node->left);
+        return;
+    }
+
+    if (IS_OPER(node, MUL))
+    {
+        if (IS_VAR(node->left,  iv->var) && inductionIsInteger(node->right))
+        {
+            inductionAddProduct(iv, slot, node->right->data.number);
+            return;
+        }
+
+        if (IS_VAR(node->right, iv->var) && inductionIsInteger(node->left))
+        {
+            inductionAddProduct(iv, slot, node->left->data.number);
+            return;
+        }
+    }
+
+    inductionFindUses(iv, &node->left);
+    inductionFindUses(iv, &node->right);
+}
+
+static void inductionAddProduct(InductionVar *iv, Node **slot, double factor)
+{
+    assert(iv);
+    assert(slot);
+
+    InductionProduct *product = NULL;
+
+    for (int i = 0; i < iv->productsCount; i++)
+    {
+        if (!(iv->products[i].factor < factor) && !(iv->products[i].factor > factor)) product = &iv->products[i];
+    }
+
+    if (!product && iv->productsCount < InductionMaxProducts)
+    {
+        product = &iv->products[iv->productsCount++];
+        product->factor = factor;
+    }
+
+    // too many to keep track of, they stay products
+    if (!product || product->count == InductionMaxUses)
+    {
+        iv->otherUses++;
+        return;
+    }
+
+    product->uses[product->count++] = slot;
+}
+
+// the assignments of the new variables are appended to *tail, they go before the loop,
+// and known gets their values at the start of the loop
+static int inductionTransform(InductionPass *pass, Node *loop, InductionVar *iv, InductionKnown *known, Node ***tail)
+{
+    assert(pass);
+    assert(loop);
+    assert(iv);
+    assert(known);
+    assert(tail);
+
+    bool eliminate = iv->productsCount == 1 && iv->otherUses == 0 && !inductionReads(*pass->root, iv->var, loop);
+
+    for (int p = 0; p < iv->productsCount && !pass->error; p++)
+    {
+        InductionProduct *product = &iv->products[p];
+        if (!product->count || (!eliminate && product->count < InductionMinUses)) continue;
+
+        double factor = product->factor;
+        int    line   = iv->update->line;
+
+        int temp = nameTableAddTemp(&pass->eval->names, InductionTempPrefix);
+        if (temp == IndexPoison) return EXIT_SUCCESS;     // no free names left, not an error
+
+        Node *start = createNode(EXP_TREE_OPERATOR, createNodeData(EXP_TREE_OPERATOR, ASSIGN),
+                                 inductionNewNumber(factor * iv->init, line), inductionNewVar(temp, line));
+        Node *item  = createNode(EXP_TREE_OPERATOR, createNodeData(EXP_TREE_OPERATOR, INSTR_END), start, NULL);
+        Node *next  = createNode(EXP_TREE_OPERATOR, createNodeData(EXP_TREE_OPERATOR, ADD),
+                                 inductionNewVar(temp, line), inductionNewNumber(factor * iv->step, line));
+
+        if (!start || !item || !next || !start->left || !start->right || !next->left || !next->right)
+        {
+            return pass->error = MEMORY_ERROR;
+        }
+
+        start->line = line;
+        **tail = item;
+        *tail  = &item->right;
+
+        known->values[temp] = factor * iv->init;
+        known->mask        |= 1u << temp;
+
+        for (int u = 0; u < product->count; u++)
+        {
+            subTreeDtor(*product->uses[u]);
+            *product->uses[u] = inductionNewVar(temp, line);
+        }
+
+        if (eliminate)
+        {
+            // var = var + step becomes temp = temp + factor * step
+            subTreeDtor(iv->update->left);
+            iv->update->left                    = next;
+            iv->update->right->data.variableNum = temp;
+
+            Node *cond = iv->compare;
+            if (cond)
+            {
+                bool  varLeft = IS_VAR(cond->left, iv->var);
+                Node *var     = varLeft ? cond->left  : cond->right;
+                Node *bound   = varLeft ? cond->right : cond->left;
+
+                var->data.variableNum = temp;
+                bound->data.number   *= factor;
+
+                if (factor < 0 && IS_OPER(cond, BELOW))      cond->data.operatorNum = ABOVE;
+                else if (factor < 0 && IS_OPER(cond, ABOVE)) cond->data.operatorNum = BELOW;
+            }
+
+            pass->stats.eliminated++;
+
+            LOG("%s: %s replaces the induction variable %s of line %d\n", __func__, pass->eval->names.table[temp].name,
+                pass->eval->names.table[iv->var].name, line);
+        }
+        else
+        {
+            Node *assign = createNode(EXP_TREE_OPERATOR, createNodeData(EXP_TREE_OPERATOR, ASSIGN), next,
+                                      inductionNewVar(temp, line));
+            if (!assign || !assign->right) return pass->error = MEMORY_ERROR;
+
+            assign->line = line;
+
+            // right after the assignment of var
+            if (iv->item)
+            {
+                Node *after = createNode(EXP_TREE_OPERATOR, createNodeData(EXP_TREE_OPERATOR, INSTR_END), assign, iv->item->right);
+                if (!after) return pass->error = MEMORY_ERROR;
+
+                iv->item->right = after;
+            }
+            else
+            {
+                Node *second = createNode(EXP_TREE_OPERATOR, createNodeData(EXP_TREE_OPERATOR, INSTR_END), assign, NULL);
+                Node *first  = createNode(EXP_TREE_OPERATOR, createNodeData(EXP_TREE_OPERATOR, INSTR_END), iv->update, second);
+                if (!second || !first) return pass->error = MEMORY_ERROR;
+
+                loop->right = first;
+                iv->item    = first;
+            }
+
+            pass->stats.reduced++;
+
+            LOG("%s: %s holds %lg * %s in the loop of line %d\n", __func__, pass->eval->names.table[temp].name, factor,
+                pass->eval->names.table[iv->var].name, loop->line);
+        }
+    }
+
+    return pass->error;
+}
+
+static Node *inductionNewVar(int var, int line)
+{
+    Node *node = createNode(EXP_TREE_VARIABLE, createNodeData(EXP_TREE_VARIABLE, var), NULL, NULL);
+    if (node) node->line = line;
+
+    return node;
+}
+
+static Node *inductionNewNumber(double number, int line)
+{
+    Node *node = createNode(EXP_TREE_NUMBER, createNodeData(EXP_TREE_NUMBER, number), NULL, NULL);
+    if (node) node->line = line;
+
+    return node;
+}
+
+static bool inductionIsInteger(Node *node)
+{
+    if (!IS_NUMBER(node)) return false;
+
+    double number = node->data.number;
+
+    return fabs(number) <= InductionMaxExact && !(floor(number) < number);
+}
+
+static void inductionKill(InductionKnown *known, unsigned vars)
+{
+    assert(known);
+
+    known->mask &= ~vars;
+}
+
+// bit mask of the variables that the statements in node assign
+static unsigned inductionAssigned(Node *node)
+{
+    if (!node || node == PtrPoison || node->type != EXP_TREE_OPERATOR) return 0;
+
+    if ((IS_OPER(node, ASSIGN) || IS_OPER(node, IN)) && node->right && node->right->type == EXP_TREE_VARIABLE)
+    {
+        return 1u << node->right->data.variableNum;
+    }
+
+    return inductionAssigned(node->left) | inductionAssigned(node->right);
+}
+
+// how many statements in node assign var, vvedi counts as many as there are
+static int inductionAssigns(Node *node, int var)
+{
+    if (!node || node == PtrPoison || node->type != EXP_TREE_OPERATOR) return 0;
+
+    if (IS_OPER(node, IN) && IS_VAR(node->right, var)) return NamesNumber;
+    if (IS_OPER(node, ASSIGN)) return IS_VAR(node->right, var) ? 1 : 0;
+
+    return inductionAssigns(node->left, var) + inductionAssigns(node->right, var);
+}
+
+// reads of var in node outside of skip
+static int inductionReads(Node *node, int var, Node *skip)
+{
+    if (!node || node == PtrPoison || node == skip) return 0;
+
+    if (IS_VAR(node, var)) return 1;
+
+    if (IS_OPER(node, IN))     return 0;
+    if (IS_OPER(node, ASSIGN)) return inductionReads(node->left, var, skip);
+
+    return inductionReads(node->left, var, skip) + inductionReads(node->right, var, skip);
+}
@@ -0,0 +1,59 @@
+#ifndef  __INDUCTION_H__
+#define  __INDUCTION_H__
+
+#include "tree_of_expressions.h"
+
+const char   InductionTempPrefix[]  = "_iv";
+const int    InductionMaxProducts   = 4;
+const int    InductionMaxUses       = 16;
+const int    InductionMinUses       = 3;        // a new variable costs push, push, add, pop per iteration
+const double InductionMaxExact      = 1 << 30;  // integers small enough for exact sums and products
+
+// variables whose value is a known number at some point
+struct InductionKnown
+{
+    double   values[NamesNumber];
+    unsigned mask;
+};
+
+// the uses of factor * var in a loop
+struct InductionProduct
+{
+    double  factor;
+    Node  **uses[InductionMaxUses];
+    int     count;
+};
+
+// a basic induction variable: assigned once in every iteration, var = var + step
+struct InductionVar
+{
+    int               var;
+    double            init;
+    double            step;
+    Node             *update;       // the assignment
+    Node             *item;         // the INSTR_END of the body holding it, NULL if it is the whole body
+
+    InductionProduct  products[InductionMaxProducts];
+    int               productsCount;
+    int               otherUses;
+    Node             *compare;      // the loop condition, var against an integer
+};
+
+struct InductionStats
+{
+    int basic;
+    int reduced;
+    int eliminated;
+};
+
+struct InductionPass
+{
+    Evaluator      *eval;
+    Node          **root;           // reads of a variable anywhere in the program
+    InductionStats  stats;
+    int             error;
+};
+
+int inductionOptimize(Evaluator *eval, Node **root, InductionStats *stats);
+
+#endif //__INDUCTION_H__
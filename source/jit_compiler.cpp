@@ -0,0 +1,1005 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include "tree_of_expressions.h"
+#include "html_logfile.h"
+#include "program_run.h"
+#include "jit_compiler.h"
+#include "fast_math.h"
+
+#define CHECK_POISON_PTR(ptr) \
+    if (ptr == PtrPoison)     \
+    {                         \
+        LOG("ERROR: PoisonPtr detected in %s(%d) %s\n", __FILE__, __LINE__, __func__);\
+        return BAD_NODE_TYPE;                                                            \
+    }
+
+//-------------------------------------------------------------------------------------------------
+// x86-64 encoding: every value lives in an xmm register as a scalar double.
+//   xmm0..xmm5  - expression temporaries (indexed by depth)
+//   xmm6, xmm7  - scratch for spilled operands and runtime checks
+//   xmm8..xmm15 - the first JitVarRegs program variables
+//   rbx = double *vars, r12 = ProgramIO *io, rbp = double *constants
+//-------------------------------------------------------------------------------------------------
+
+enum JitGpr
+{
+    RAX = 0,
+    RCX = 1,
+    RDX = 2,
+    RBX = 3,
+    RSP = 4,
+    RBP = 5,
+    RSI = 6,
+    RDI = 7,
+    R12 = 12,
+};
+
+#ifdef _WIN32
+const int JitArg0 = RCX;
+const int JitArg1 = RDX;
+#else
+const int JitArg0 = RDI;
+const int JitArg1 = RSI;
+#endif
+
+enum JitCondition
+{
+    JIT_JB  = 0x2,
+    JIT_JAE = 0x3,
+    JIT_JE  = 0x4,
+    JIT_JNE = 0x5,
+    JIT_JBE = 0x6,
+    JIT_JA  = 0x7,
+    JIT_JP  = 0xA,
+};
+
+const unsigned char SsePrefixSd = 0xF2;
+const unsigned char SsePrefixPd = 0x66;
+const unsigned char SsePrefixDq = 0xF3;
+
+const unsigned char SseMovLoad  = 0x10;
+const unsigned char SseMovStore = 0x11;
+const unsigned char SseSqrt     = 0x51;
+const unsigned char SseXor      = 0x57;
+const unsigned char SseAdd      = 0x58;
+const unsigned char SseMul      = 0x59;
+const unsigned char SseSub      = 0x5C;
+const unsigned char SseDiv      = 0x5E;
+const unsigned char SseUcomi    = 0x2E;
+const unsigned char SseDqLoad   = 0x6F;
+const unsigned char SseDqStore  = 0x7F;
+
+const int JitConstAbsEps = 0;
+const int JitConstOne    = 1;
+
+// the spill area is last, as deep as the deepest expression needs
+const int JitShadowSize   = 32;
+const int JitCallSaveBase = JitShadowSize;
+const int JitXmmSaveBase  = JitCallSaveBase + JitTempRegs * (int)sizeof(double);
+const int JitXmmSaved     = 10;
+const int JitSpillBase    = JitXmmSaveBase  + JitXmmSaved * 16;
+const int JitStackPage    = 4096;
+
+static int jitCompilerCtor(JitCompiler *c, int varsCount);
+static int jitCompilerDtor(JitCompiler *c);
+
+static void jitEmitByte (JitCompiler *c, int byte);
+static void jitEmitInt32(JitCompiler *c, int value);
+static void jitEmitPtr  (JitCompiler *c, const void *ptr);
+
+static void jitEmitRex  (JitCompiler *c, bool wide, int reg, int rm);
+static void jitEmitMem  (JitCompiler *c, int reg, int base, int disp);
+
+static void jitEmitSseRR(JitCompiler *c, unsigned char prefix, unsigned char op, int reg, int rm);
+static void jitEmitSseRM(JitCompiler *c, unsigned char prefix, unsigned char op, int reg, int base, int disp);
+
+static void jitEmitMovXmm  (JitCompiler *c, int dst, int src);
+static void jitEmitMovRR64 (JitCompiler *c, int dst, int src);
+static void jitEmitMovRM64 (JitCompiler *c, int dst, int base, int disp);
+static void jitEmitMovRImm (JitCompiler *c, int dst, const void *imm);
+static void jitEmitAbs     (JitCompiler *c, int xmm);
+static void jitEmitCall    (JitCompiler *c, const void *func);
+static void jitEmitCallIO  (JitCompiler *c, int offset);
+
+static int  jitNewLabel (JitCompiler *c);
+static void jitBindLabel(JitCompiler *c, int label);
+static void jitEmitJmp  (JitCompiler *c, int label);
+static void jitEmitJcc  (JitCompiler *c, JitCondition cond, int label);
+static int  jitErrorLabel(JitCompiler *c, ExpTreeErrors error);
+
+static int  jitAddConstant(JitCompiler *c, double value);
+
+static void jitLoadVar   (JitCompiler *c, int xmm, int index);
+static void jitStoreVar  (JitCompiler *c, int index, int xmm);
+static void jitSpillVars (JitCompiler *c);
+static void jitReloadVars(JitCompiler *c);
+
+static int jitGenStatement(JitCompiler *c, Node *node);
+static int jitGenExpr     (JitCompiler *c, Node *node, int depth);
+static int jitGenOperands (JitCompiler *c, Node *node, int depth, int *leftReg, int *rightReg);
+static int jitGenCall     (JitCompiler *c, const void *func, int depth, int leftReg, int rightReg);
+static int jitGenCondJump (JitCompiler *c, Node *node, int depth, int falseLabel);
+
+static void jitPatchFrame(JitCompiler *c);
+static int  jitFinalize  (JitCompiler *c, JitFunction *func);
+
+static double jitLogar(double base, double arg);
+
+
+static int jitCompilerCtor(JitCompiler *c, int varsCount)
+{
+    assert(c);
+
+    memset(c, 0, sizeof(*c));
+    c->varsCount = varsCount;
+
+    for (int i = 0; i < JitErrorKinds; i++) c->errorLabels[i] = IndexPoison;
+
+    jitAddConstant(c, PrecisionConst);
+    jitAddConstant(c, 1);
+
+    return c->error;
+}
+
+static int jitCompilerDtor(JitCompiler *c)
+{
+    assert(c);
+
+    free(c->code);
+    free(c->constants);
+    free(c->labels);
+    free(c->fixups);
+
+    memset(c, 0, sizeof(*c));
+
+    return EXIT_SUCCESS;
+}
+
+#define GROW_ARRAY(array, count, capacity, type)                                   \
+    if ((count) >= (capacity))                                                     \
+    {                                                                              \
+        int newCapacity = (capacity) ? 2 * (capacity) : 64;                        \
+        type *newArray  = (type *)realloc((array), newCapacity * sizeof(type));    \
+        if (!newArray) { c->error = MEMORY_ERROR; return; }                        \
+        (array)    = newArray;                                                     \
+        (capacity) = newCapacity;                                                  \
+    }
+
+static void jitEmitByte(JitCompiler *c, int byte)
+{
+    GROW_ARRAY(c->code, c->size, c->capacity, unsigned char);
+    c->code[c->size++] = (unsigned char) byte;
+}
+
+static void jitEmitInt32(JitCompiler *c, int value)
+{
+    unsigned int bits = (unsigned int) value;
+
+    for (int i = 0; i < 4; i++, bits >>= 8) jitEmitByte(c, (int)(bits & 0xFF));
+}
+
+static void jitEmitPtr(JitCompiler *c, const void *ptr)
+{
+    unsigned char bytes[sizeof(ptr)] = {};
+    memcpy(bytes, &ptr, sizeof(ptr));
+
+    for (size_t i = 0; i < sizeof(ptr); i++) jitEmitByte(c, bytes[i]);
+}
+
+static void jitEmitRex(JitCompiler *c, bool wide, int reg, int rm)
+{
+    int rex = 0x40 | (wide ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((rm & 8) ? 1 : 0);
+    if (rex != 0x40) jitEmitByte(c, rex);
+}
+
+static void jitEmitMem(JitCompiler *c, int reg, int base, int disp)
+{
+    jitEmitByte(c, 0x80 | ((reg & 7) << 3) | (base & 7));
+    if ((base & 7) == RSP) jitEmitByte(c, 0x24);
+
+    jitEmitInt32(c, disp);
+}
+
+static void jitEmitSseRR(JitCompiler *c, unsigned char prefix, unsigned char op, int reg, int rm)
+{
+    if (prefix) jitEmitByte(c, prefix);
+    jitEmitRex(c, false, reg, rm);
+    jitEmitByte(c, 0x0F);
+    jitEmitByte(c, op);
+    jitEmitByte(c, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+static void jitEmitSseRM(JitCompiler *c, unsigned char prefix, unsigned char op, int reg, int base, int disp)
+{
+    if (prefix) jitEmitByte(c, prefix);
+    jitEmitRex(c, false, reg, base);
+    jitEmitByte(c, 0x0F);
+    jitEmitByte(c, op);
+    jitEmitMem (c, reg, base, disp);
+}
+
+static void jitEmitMovXmm(JitCompiler *c, int dst, int src)
+{
+    if (dst != src) jitEmitSseRR(c, SsePrefixSd, SseMovLoad, dst, src);
+}
+
+static void jitEmitMovRR64(JitCompiler *c, int dst, int src)
+{
+    jitEmitRex (c, true, src, dst);
+    jitEmitByte(c, 0x89);
+    jitEmitByte(c, 0xC0 | ((src & 7) << 3) | (dst & 7));
+}
+
+static void jitEmitMovRM64(JitCompiler *c, int dst, int base, int disp)
+{
+    jitEmitRex (c, true, dst, base);
+    jitEmitByte(c, 0x8B);
+    jitEmitMem (c, dst, base, disp);
+}
+
+static void jitEmitMovRImm(JitCompiler *c, int dst, const void *imm)
+{
+    jitEmitRex (c, true, 0, dst);
+    jitEmitByte(c, 0xB8 + (dst & 7));
+    jitEmitPtr (c, imm);
+}
+
+static void jitEmitAbs(JitCompiler *c, int xmm)
+{
+    // movq rax, xmm; btr rax, 63; movq xmm, rax
+    jitEmitByte(c, 0x66); jitEmitRex(c, true, xmm, RAX);
+    jitEmitByte(c, 0x0F); jitEmitByte(c, 0x7E); jitEmitByte(c, 0xC0 | ((xmm & 7) << 3));
+
+    jitEmitByte(c, 0x48); jitEmitByte(c, 0x0F); jitEmitByte(c, 0xBA);
+    jitEmitByte(c, 0xF0); jitEmitByte(c, 63);
+
+    jitEmitByte(c, 0x66); jitEmitRex(c, true, xmm, RAX);
+    jitEmitByte(c, 0x0F); jitEmitByte(c, 0x6E); jitEmitByte(c, 0xC0 | ((xmm & 7) << 3));
+}
+
+static void jitEmitCall(JitCompiler *c, const void *func)
+{
+    jitEmitMovRImm(c, RAX, func);
+    jitEmitByte(c, 0xFF);
+    jitEmitByte(c, 0xD0);
+}
+
+static void jitEmitCallIO(JitCompiler *c, int offset)
+{
+    jitEmitMovRM64(c, RAX,     R12, offset);
+    jitEmitMovRM64(c, JitArg0, R12, (int) offsetof(ProgramIO, context));
+    jitEmitByte(c, 0xFF);
+    jitEmitByte(c, 0xD0);
+}
+
+static int jitNewLabel(JitCompiler *c)
+{
+    if (c->labelsCount >= c->labelsCapacity)
+    {
+        int newCapacity = c->labelsCapacity ? 2 * c->labelsCapacity : 64;
+        int *newLabels  = (int *)realloc(c->labels, newCapacity * sizeof(int));
+        if (!newLabels) { c->error = MEMORY_ERROR; return 0; }
+
+        c->labels         = newLabels;
+        c->labelsCapacity = newCapacity;
+    }
+
+    c->labels[c->labelsCount] = IndexPoison;
+    return c->labelsCount++;
+}
+
+static void jitBindLabel(JitCompiler *c, int label)
+{
+    if (c->error) return;
+
+    c->labels[label] = c->size;
+}
+
+static void jitAddFixup(JitCompiler *c, int label)
+{
+    GROW_ARRAY(c->fixups, c->fixupsCount, c->fixupsCapacity, JitLabelFixup);
+
+    c->fixups[c->fixupsCount].label    = label;
+    c->fixups[c->fixupsCount].position = c->size;
+    c->fixupsCount++;
+
+    jitEmitInt32(c, 0);
+}
+
+static void jitEmitJmp(JitCompiler *c, int label)
+{
+    jitEmitByte(c, 0xE9);
+    jitAddFixup(c, label);
+}
+
+static void jitEmitJcc(JitCompiler *c, JitCondition cond, int label)
+{
+    jitEmitByte(c, 0x0F);
+    jitEmitByte(c, 0x80 | cond);
+    jitAddFixup(c, label);
+}
+
+static int jitErrorLabel(JitCompiler *c, ExpTreeErrors error)
+{
+    int kind = -(int) error;
+    assert(0 < kind && kind < JitErrorKinds);
+
+    if (c->errorLabels[kind] == IndexPoison) c->errorLabels[kind] = jitNewLabel(c);
+
+    return c->errorLabels[kind];
+}
+
+#undef GROW_ARRAY
+
+static int jitAddConstant(JitCompiler *c, double value)
+{
+    for (int i = 0; i < c->constantsCount; i++)
+    {
+        if (memcmp(&c->constants[i], &value, sizeof(double)) == 0) return i;
+    }
+
+    if (c->constantsCount >= c->constantsCapacity)
+    {
+        int newCapacity = c->constantsCapacity ? 2 * c->constantsCapacity : 16;
+        double *newArr  = (double *)realloc(c->constants, newCapacity * sizeof(double));
+        if (!newArr) { c->error = MEMORY_ERROR; return 0; }
+
+        c->constants         = newArr;
+        c->constantsCapacity = newCapacity;
+    }
+
+    c->constants[c->constantsCount] = value;
+    return c->constantsCount++;
+}
+
+static void jitLoadVar(JitCompiler *c, int xmm, int index)
+{
+    if (index < JitVarRegs) jitEmitMovXmm(c, xmm, JitVarRegFirst + index);
+    else jitEmitSseRM(c, SsePrefixSd, SseMovLoad, xmm, RBX, index * (int)sizeof(double));
+}
+
+static void jitStoreVar(JitCompiler *c, int index, int xmm)
+{
+    if (index < JitVarRegs) jitEmitMovXmm(c, JitVarRegFirst + index, xmm);
+    else jitEmitSseRM(c, SsePrefixSd, SseMovStore, xmm, RBX, index * (int)sizeof(double));
+}
+
+static void jitSpillVars(JitCompiler *c)
+{
+    for (int i = 0; i < c->varsCount && i < JitVarRegs; i++)
+    {
+        jitEmitSseRM(c, SsePrefixSd, SseMovStore, JitVarRegFirst + i, RBX, i * (int)sizeof(double));
+    }
+}
+
+static void jitReloadVars(JitCompiler *c)
+{
+    for (int i = 0; i < c->varsCount && i < JitVarRegs; i++)
+    {
+        jitEmitSseRM(c, SsePrefixSd, SseMovLoad, JitVarRegFirst + i, RBX, i * (int)sizeof(double));
+    }
+}
+
+int jitCompile(Evaluator *eval, Node *root, JitFunction *func)
+{
+    assert(eval);
+    assert(func);
+
+    memset(func, 0, sizeof(*func));
+
+    JitCompiler c = {};
+    jitCompilerCtor(&c, eval->names.count);
+
+    // prologue
+    jitEmitByte(&c, 0x53);                                    // push rbx
+    jitEmitByte(&c, 0x55);                                    // push rbp
+    jitEmitByte(&c, 0x41); jitEmitByte(&c, 0x54);             // push r12
+
+    // the frame is made a page at a time, touching every page, as Windows only commits the
+    // stack page after the one touched last
+    int probeLabel = jitNewLabel(&c);
+    int frameLabel = jitNewLabel(&c);
+
+    c.probePatch = c.size + 1;
+    jitEmitByte(&c, 0xB8); jitEmitInt32(&c, 0);               // mov eax, pages
+
+    jitBindLabel(&c, probeLabel);
+    jitEmitByte(&c, 0x85); jitEmitByte(&c, 0xC0);             // test eax, eax
+    jitEmitJcc (&c, JIT_JE, frameLabel);
+    jitEmitByte(&c, 0x48); jitEmitByte(&c, 0x81); jitEmitByte(&c, 0xEC);
+    jitEmitInt32(&c, JitStackPage);                           // sub rsp, page
+    jitEmitByte(&c, 0x48); jitEmitByte(&c, 0x89);
+    jitEmitByte(&c, 0x04); jitEmitByte(&c, 0x24);             // mov [rsp], rax
+    jitEmitByte(&c, 0xFF); jitEmitByte(&c, 0xC8);             // dec eax
+    jitEmitJmp (&c, probeLabel);
+    jitBindLabel(&c, frameLabel);
+
+    c.framePatch = c.size + 3;
+    jitEmitByte(&c, 0x48); jitEmitByte(&c, 0x81); jitEmitByte(&c, 0xEC);
+    jitEmitInt32(&c, 0);                                      // sub rsp, rest of the frame
+
+    for (int i = 0; i < JitXmmSaved; i++)
+    {
+        jitEmitSseRM(&c, SsePrefixDq, SseDqStore, JitScratchReg + i, RSP, JitXmmSaveBase + 16 * i);
+    }
+
+    jitEmitMovRR64(&c, RBX, JitArg0);
+    jitEmitMovRR64(&c, R12, JitArg1);
+
+    c.constantsPatch = c.size + 2;
+    jitEmitMovRImm(&c, RBP, NULL);
+
+    jitReloadVars(&c);
+
+    c.exitLabel = jitNewLabel(&c);
+
+    int error = jitGenStatement(&c, root);
+    if (!error) error = c.error;
+
+    // epilogue
+    jitEmitByte(&c, 0x31); jitEmitByte(&c, 0xC0);             // xor eax, eax
+    jitBindLabel(&c, c.exitLabel);
+
+    jitSpillVars(&c);
+
+    for (int i = 0; i < JitXmmSaved; i++)
+    {
+        jitEmitSseRM(&c, SsePrefixDq, SseDqLoad, JitScratchReg + i, RSP, JitXmmSaveBase + 16 * i);
+    }
+
+    c.unframePatch = c.size + 3;
+    jitEmitByte(&c, 0x48); jitEmitByte(&c, 0x81); jitEmitByte(&c, 0xC4);
+    jitEmitInt32(&c, 0);                                      // add rsp, frame
+
+    jitEmitByte(&c, 0x41); jitEmitByte(&c, 0x5C);             // pop r12
+    jitEmitByte(&c, 0x5D);                                    // pop rbp
+    jitEmitByte(&c, 0x5B);                                    // pop rbx
+    jitEmitByte(&c, 0xC3);                                    // ret
+
+    for (int kind = 1; kind < JitErrorKinds; kind++)
+    {
+        if (c.errorLabels[kind] == IndexPoison) continue;
+
+        jitBindLabel(&c, c.errorLabels[kind]);
+        jitEmitByte (&c, 0xB8);
+        jitEmitInt32(&c, -kind);                              // mov eax, error
+        jitEmitJmp  (&c, c.exitLabel);
+    }
+
+    if (!error) error = c.error;
+    if (!error) jitPatchFrame(&c);
+    if (!error) error = jitFinalize(&c, func);
+
+    jitCompilerDtor(&c);
+
+    if (error) LOG("ERROR: %s: couldn't compile program: %d\n", __func__, error);
+
+    return error;
+}
+
+static void jitPatchFrame(JitCompiler *c)
+{
+    assert(c);
+
+    // rsp stays 16-byte aligned for the calls
+    int frameSize = JitSpillBase + (c->spillMax + 1) / 2 * 16;
+    int pages     = frameSize / JitStackPage;
+    int rest      = frameSize % JitStackPage;
+
+    memcpy(c->code + c->probePatch,   &pages,     sizeof(pages));
+    memcpy(c->code + c->framePatch,   &rest,      sizeof(rest));
+    memcpy(c->code + c->unframePatch, &frameSize, sizeof(frameSize));
+
+    LOG("jit: %d spill slots, frame of %d bytes\n", c->spillMax, frameSize);
+}
+
+static int jitFinalize(JitCompiler *c, JitFunction *func)
+{
+    assert(c);
+    assert(func);
+
+    for (int i = 0; i < c->fixupsCount; i++)
+    {
+        int target = c->labels[c->fixups[i].label];
+        if (target == IndexPoison) return EXIT_FAILURE;
+
+        int  rel   = target - (c->fixups[i].position + 4);
+        memcpy(c->code + c->fixups[i].position, &rel, sizeof(rel));
+    }
+
+    func->constants = (double *)calloc(c->constantsCount, sizeof(double));
+    if (!func->constants) return MEMORY_ERROR;
+
+    memcpy(func->constants, c->constants, c->constantsCount * sizeof(double));
+    func->constantsCount = c->constantsCount;
+
+    memcpy(c->code + c->constantsPatch, &func->constants, sizeof(func->constants));
+
+    func->memorySize = (size_t) c->size;
+
+#ifdef _WIN32
+    func->memory = VirtualAlloc(NULL, func->memorySize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (!func->memory) return MEMORY_ERROR;
+
+    memcpy(func->memory, c->code, func->memorySize);
+
+    DWORD oldProtect = 0;
+    if (!VirtualProtect(func->memory, func->memorySize, PAGE_EXECUTE_READ, &oldProtect)) return MEMORY_ERROR;
+#else
+    func->memory = mmap(NULL, func->memorySize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (func->memory == MAP_FAILED) { func->memory = NULL; return MEMORY_ERROR; }
+
+    memcpy(func->memory, c->code, func->memorySize);
+
+    if (mprotect(func->memory, func->memorySize, PROT_READ | PROT_EXEC) != 0) return MEMORY_ERROR;
+#endif
+
+    func->entry = (JitEntry) func->memory;
+
+    LOG("jit: compiled %d bytes of code, %d constants\n", c->size, c->constantsCount);
+
+    return EXIT_SUCCESS;
+}
+
+int jitFunctionDtor(JitFunction *func)
+{
+    assert(func);
+
+    if (func->memory)
+    {
+#ifdef _WIN32
+        VirtualFree(func->memory, 0, MEM_RELEASE);
+#else
+        munmap(func->memory, func->memorySize);
+#endif
+    }
+
+    free(func->constants);
+    memset(func, 0, sizeof(*func));
+
+    return EXIT_SUCCESS;
+}
+
+ExpTreeErrors jitRun(JitFunction *func, double *vars, ProgramIO *io)
+{
+    assert(func);
+    assert(vars);
+    assert(io);
+
+    if (!func->entry) return MEMORY_ERROR;
+
+    return (ExpTreeErrors) func->entry(vars, io);
+}
+
+static int jitGenStatement(JitCompiler *c, Node *node)
+{
+    CHECK_POISON_PTR(node);
+
+    if (!node) return EXIT_SUCCESS;
+    if (node->type != EXP_TREE_OPERATOR) return BAD_NODE_TYPE;
+
+    int error = EXIT_SUCCESS;
+
+    switch (node->data.operatorNum)
+    {
+        case INSTR_END:
+        {
+            for ( ; node && !error; node = node->right)
+            {
+                if (node->type != EXP_TREE_OPERATOR || node->data.operatorNum != INSTR_END)
+                {
+                    return jitGenStatement(c, node);
+                }
+
+                error = jitGenStatement(c, node->left);
+            }
+
+            return error;
+        }
+
+        case ASSIGN:
+        {
+            if (!node->right || node->right->type != EXP_TREE_VARIABLE) return BAD_NODE_TYPE;
+
+            error = jitGenExpr(c, node->left, 0);
+            jitStoreVar(c, node->right->data.variableNum, 0);
+
+            return error;
+        }
+
+        case IN:
+        {
+            if (!node->right || node->right->type != EXP_TREE_VARIABLE) return BAD_NODE_TYPE;
+
+            jitSpillVars (c);
+            jitEmitCallIO(c, (int) offsetof(ProgramIO, input));
+            jitReloadVars(c);
+            jitStoreVar  (c, node->right->data.variableNum, 0);
+
+            return EXIT_SUCCESS;
+        }
+
+        case OUT:
+        {
+            error = jitGenExpr(c, node->right, 0);
+
+            jitSpillVars (c);
+#ifdef _WIN32
+            jitEmitMovXmm(c, 1, 0);
+#endif
+            jitEmitCallIO(c, (int) offsetof(ProgramIO, output));
+            jitReloadVars(c);
+
+            return error;
+        }
+
+        case IF:
+        {
+            int endLabel = jitNewLabel(c);
+
+            error = jitGenCondJump(c, node->left, 0, endLabel);
+            if (!error) error = jitGenStatement(c, node->right);
+
+            jitBindLabel(c, endLabel);
+            return error;
+        }
+
+        case WHILE:
+        {
+            int beginLabel = jitNewLabel(c);
+            int endLabel   = jitNewLabel(c);
+
+            jitBindLabel(c, beginLabel);
+
+            error = jitGenCondJump(c, node->left, 0, endLabel);
+            if (!error) error = jitGenStatement(c, node->right);
+
+            jitEmitJmp  (c, beginLabel);
+            jitBindLabel(c, endLabel);
+            return error;
+        }
+
+        case ADD:    case SUB:
+        case MUL:    case DIV:
+        case LN:     case LOGAR:
+        case POW:    case SIN:
+        case COS:    case SQRT:
+        case BELOW:  case ABOVE:
+        case EQUAL:  case NOT_EQUAL:
+        case OPEN_F: case CLOSE_F:
+        case THEN:   case NEW_VAR:
+        case L_BRACKET: case R_BRACKET:
+        case NOT_OPER:
+        default:     LOG("ERROR: %s: operator %d is not a statement\n", __func__, node->data.operatorNum);
+                     return UNKNOWN_OPERATOR;
+    }
+}
+
+static int jitGenOperands(JitCompiler *c, Node *node, int depth, int *leftReg, int *rightReg)
+{
+    assert(leftReg);
+    assert(rightReg);
+
+    int error = jitGenExpr(c, node->left, depth);
+    if (error) return error;
+
+    *leftReg = depth;
+
+    if (depth + 1 < JitTempRegs)
+    {
+        *rightReg = depth + 1;
+        return jitGenExpr(c, node->right, depth + 1);
+    }
+
+    int slot = JitSpillBase + c->spillDepth * (int)sizeof(double);
+    c->spillDepth++;
+    if (c->spillDepth > c->spillMax) c->spillMax = c->spillDepth;
+
+    jitEmitSseRM(c, SsePrefixSd, SseMovStore, depth, RSP, slot);
+    error = jitGenExpr(c, node->right, depth);
+
+    jitEmitMovXmm(c, JitScratchReg, depth);
+    jitEmitSseRM (c, SsePrefixSd, SseMovLoad, depth, RSP, slot);
+    c->spillDepth--;
+
+    *rightReg = JitScratchReg;
+    return error;
+}
+
+static int jitGenCall(JitCompiler *c, const void *func, int depth, int leftReg, int rightReg)
+{
+    for (int i = 0; i < depth; i++)
+    {
+        jitEmitSseRM(c, SsePrefixSd, SseMovStore, i, RSP, JitCallSaveBase + i * (int)sizeof(double));
+    }
+
+    if (leftReg  != IndexPoison) jitEmitMovXmm(c, 0, leftReg);
+    if (rightReg != IndexPoison) jitEmitMovXmm(c, leftReg == IndexPoison ? 0 : 1, rightReg);
+
+    jitSpillVars (c);
+    jitEmitCall  (c, func);
+    jitReloadVars(c);
+
+    jitEmitMovXmm(c, depth, 0);
+
+    for (int i = 0; i < depth; i++)
+    {
+        jitEmitSseRM(c, SsePrefixSd, SseMovLoad, i, RSP, JitCallSaveBase + i * (int)sizeof(double));
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static void jitGenCheckNegative(JitCompiler *c, int xmm, ExpTreeErrors error)
+{
+    // 0 > xmm  ->  error
+    jitEmitSseRR(c, SsePrefixPd, SseXor,   JitCheckReg, JitCheckReg);
+    jitEmitSseRR(c, SsePrefixPd, SseUcomi, JitCheckReg, xmm);
+    jitEmitJcc  (c, JIT_JA, jitErrorLabel(c, error));
+}
+
+static void jitGenCheckNearZero(JitCompiler *c, int xmm, ExpTreeErrors error)
+{
+    // |xmm| < PrecisionConst  ->  error
+    int skipLabel = jitNewLabel(c);
+
+    jitEmitMovXmm(c, JitCheckReg, xmm);
+    jitEmitAbs   (c, JitCheckReg);
+    jitEmitSseRM (c, SsePrefixPd, SseUcomi, JitCheckReg, RBP, JitConstAbsEps * (int)sizeof(double));
+    jitEmitJcc   (c, JIT_JP, skipLabel);
+    jitEmitJcc   (c, JIT_JB, jitErrorLabel(c, error));
+    jitBindLabel (c, skipLabel);
+}
+
+static int jitGenExpr(JitCompiler *c, Node *node, int depth)
+{
+    CHECK_POISON_PTR(node);
+    if (!node) return BAD_NODE_TYPE;
+
+    assert(depth < JitTempRegs);
+
+    switch (node->type)
+    {
+        case EXP_TREE_NUMBER:
+        {
+            int index = jitAddConstant(c, node->data.number);
+            jitEmitSseRM(c, SsePrefixSd, SseMovLoad, depth, RBP, index * (int)sizeof(double));
+            return EXIT_SUCCESS;
+        }
+
+        case EXP_TREE_VARIABLE: jitLoadVar(c, depth, node->data.variableNum);
+                                return EXIT_SUCCESS;
+
+        case EXP_TREE_OPERATOR: break;
+
+        case EXP_TREE_NOTHING:
+        case EXP_TREE_IDENTIF:
+        default:                return BAD_NODE_TYPE;
+    }
+
+    int error    = EXIT_SUCCESS;
+    int leftReg  = IndexPoison;
+    int rightReg = IndexPoison;
+
+    ExpTreeOperators oper = node->data.operatorNum;
+
+    switch (oper)
+    {
+        case ADD: case SUB:
+        case MUL: case DIV:
+        {
+            error = jitGenOperands(c, node, depth, &leftReg, &rightReg);
+            if (error) return error;
+
+            unsigned char op = SseAdd;
+            if (oper == SUB) op = SseSub;
+            if (oper == MUL) op = SseMul;
+            if (oper == DIV) { op = SseDiv; jitGenCheckNearZero(c, rightReg, DIVISION_BY_ZERO); }
+
+            jitEmitSseRR(c, SsePrefixSd, op, leftReg, rightReg);
+            return EXIT_SUCCESS;
+        }
+
+        case POW:
+        {
+            error = jitGenOperands(c, node, depth, &leftReg, &rightReg);
+            if (error) return error;
+
+            return jitGenCall(c, fastMathFunction(POW), depth, leftReg, rightReg);
+        }
+
+        case LOGAR:
+        {
+            error = jitGenOperands(c, node, depth, &leftReg, &rightReg);
+            if (error) return error;
+
+            jitGenCheckNegative(c, rightReg, LOG_NEGATIVE_ARG);
+            jitGenCheckNegative(c, leftReg,  LOG_BAD_BASE);
+
+            jitEmitMovXmm(c, JitCheckReg, leftReg);
+            jitEmitSseRM (c, SsePrefixSd, SseSub, JitCheckReg, RBP, JitConstOne * (int)sizeof(double));
+            jitGenCheckNearZero(c, JitCheckReg, LOG_BAD_BASE);
+
+            return jitGenCall(c, (const void *) jitLogar, depth, leftReg, rightReg);
+        }
+
+        case SQRT:
+        {
+            error = jitGenExpr(c, node->right, depth);
+            jitEmitSseRR(c, SsePrefixSd, SseSqrt, depth, depth);
+            return error;
+        }
+
+        case LN:  case SIN:
+        case COS:
+        {
+            error = jitGenExpr(c, node->right, depth);
+            if (error) return error;
+
+            if (oper == LN) jitGenCheckNegative(c, depth, LOG_NEGATIVE_ARG);
+
+            return jitGenCall(c, fastMathFunction(oper), depth, depth, IndexPoison);
+        }
+
+        case BELOW: case ABOVE:
+        case EQUAL: case NOT_EQUAL:
+        {
+            int falseLabel = jitNewLabel(c);
+            int endLabel   = jitNewLabel(c);
+
+            error = jitGenCondJump(c, node, depth, falseLabel);
+
+            jitEmitSseRM(c, SsePrefixSd, SseMovLoad, depth, RBP, JitConstOne * (int)sizeof(double));
+            jitEmitJmp  (c, endLabel);
+            jitBindLabel(c, falseLabel);
+            jitEmitSseRR(c, SsePrefixPd, SseXor, depth, depth);
+            jitBindLabel(c, endLabel);
+
+            return error;
+        }
+
+        case ASSIGN: case IF:
+        case WHILE:  case IN:
+        case OUT:    case INSTR_END:
+        case OPEN_F: case CLOSE_F:
+        case THEN:   case NEW_VAR:
+        case L_BRACKET: case R_BRACKET:
+        case NOT_OPER:
+        default:     LOG("ERROR: %s: operator %d is not an expression\n", __func__, oper);
+                     return UNKNOWN_OPERATOR;
+    }
+}
+
+static int jitGenCondJump(JitCompiler *c, Node *node, int depth, int falseLabel)
+{
+    CHECK_POISON_PTR(node);
+    if (!node) return BAD_NODE_TYPE;
+
+    int leftReg  = IndexPoison;
+    int rightReg = IndexPoison;
+
+    ExpTreeOperators oper = NOT_OPER;
+    if (node->type == EXP_TREE_OPERATOR) oper = node->data.operatorNum;
+
+    if (oper != BELOW && oper != ABOVE && oper != EQUAL && oper != NOT_EQUAL)
+    {
+        int error = jitGenExpr(c, node, depth);
+        if (error) return error;
+
+        leftReg = depth;
+        oper    = NOT_EQUAL;
+    }
+    else
+    {
+        int error = jitGenOperands(c, node, depth, &leftReg, &rightReg);
+        if (error) return error;
+    }
+
+    if (oper == BELOW)
+    {
+        jitEmitSseRR(c, SsePrefixPd, SseUcomi, leftReg, rightReg);
+        jitEmitJcc  (c, JIT_JP,  falseLabel);
+        jitEmitJcc  (c, JIT_JAE, falseLabel);
+        return EXIT_SUCCESS;
+    }
+
+    if (oper == ABOVE)
+    {
+        jitEmitSseRR(c, SsePrefixPd, SseUcomi, leftReg, rightReg);
+        jitEmitJcc  (c, JIT_JBE, falseLabel);
+        return EXIT_SUCCESS;
+    }
+
+    if (rightReg != IndexPoison) jitEmitSseRR(c, SsePrefixSd, SseSub, leftReg, rightReg);
+
+    jitEmitAbs  (c, leftReg);
+    jitEmitSseRM(c, SsePrefixPd, SseUcomi, leftReg, RBP, JitConstAbsEps * (int)sizeof(double));
+
+    if (oper == EQUAL)
+    {
+        jitEmitJcc(c, JIT_JP,  falseLabel);
+        jitEmitJcc(c, JIT_JAE, falseLabel);
+        return EXIT_SUCCESS;
+    }
+
+    int trueLabel = jitNewLabel(c);
+
+    jitEmitJcc  (c, JIT_JP, trueLabel);
+    jitEmitJcc  (c, JIT_JB, falseLabel);
+    jitBindLabel(c, trueLabel);
+
+    return EXIT_SUCCESS;
+}
+
+static double jitLogar(double base, double arg)
+{
+    return mathLn(arg) / mathLn(base);
+}
+
+int jitBenchmark(Evaluator *eval, const double *inputs, int inputsCount, int runs, FILE *f)
+{
+    assert(eval);
+    assert(f);
+
+    ProgramIO         io    = {};
+    ProgramFixedInput fixed = {};
+
+    programIOFixedCtor(&io, &fixed, inputs, inputsCount);
+
+    clock_t start = clock();
+
+    for (int i = 0; i < runs; i++)
+    {
+        fixed.position = 0;
+        ExpTreeErrors error = programRun(eval, &io);
+        if (error) { fprintf(f, "tree evaluator: error %d\n", error); return error; }
+    }
+
+    double treeTime = (double)(clock() - start) / CLOCKS_PER_SEC;
+    double treeSum  = fixed.outputSum;
+
+    start = clock();
+
+    JitFunction func = {};
+    int error = jitCompile(eval, eval->tree.root, &func);
+    if (error) { fprintf(f, "jit: compilation error %d\n", error); return error; }
+
+    double compileTime = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    double vars[NamesNumber] = {};
+    programIOFixedCtor(&io, &fixed, inputs, inputsCount);
+
+    start = clock();
+
+    for (int i = 0; i < runs; i++)
+    {
+        fixed.position = 0;
+        for (int j = 0; j < NamesNumber; j++) vars[j] = DefaultVarValue;
+
+        ExpTreeErrors runError = jitRun(&func, vars, &io);
+        if (runError) { fprintf(f, "jit: error %d\n", runError); jitFunctionDtor(&func); return runError; }
+    }
+
+    double jitTime = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    fprintf(f, "runs:           %d\n", runs);
+    fprintf(f, "tree evaluator: %lg s (outputs sum " ElemNumberFormat ")\n", treeTime, treeSum);
+    fprintf(f, "jit compile:    %lg s (%d bytes)\n", compileTime, (int) func.memorySize);
+    fprintf(f, "jit:            %lg s (outputs sum " ElemNumberFormat ")\n", jitTime, fixed.outputSum);
+    if (jitTime > 0) fprintf(f, "speedup:        %lg\n", treeTime / jitTime);
+
+    jitFunctionDtor(&func);
+
+    return EXIT_SUCCESS;
+}
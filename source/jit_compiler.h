@@ -0,0 +1,72 @@
+#ifndef  __JIT_COMPILER_H__
+#define  __JIT_COMPILER_H__
+
+#include <stddef.h>
+
+#include "tree_of_expressions.h"
+#include "program_run.h"
+
+typedef int (*JitEntry)(double *vars, ProgramIO *io);
+
+struct JitFunction
+{
+    JitEntry entry;
+
+    void    *memory;
+    size_t   memorySize;
+
+    double  *constants;
+    int      constantsCount;
+};
+
+const int JitTempRegs    = 6;
+const int JitScratchReg  = 6;
+const int JitCheckReg    = 7;
+const int JitVarRegFirst = 8;
+const int JitVarRegs     = 8;
+const int JitErrorKinds  = 9;
+
+struct JitLabelFixup
+{
+    int label;
+    int position;
+};
+
+struct JitCompiler
+{
+    unsigned char *code;
+    int            size;
+    int            capacity;
+
+    double        *constants;
+    int            constantsCount;
+    int            constantsCapacity;
+
+    int           *labels;
+    int            labelsCount;
+    int            labelsCapacity;
+
+    JitLabelFixup *fixups;
+    int            fixupsCount;
+    int            fixupsCapacity;
+
+    int            constantsPatch;
+    int            probePatch;      // the pages of the frame, it is sized after the body is compiled
+    int            framePatch;      // the rest of it
+    int            unframePatch;    // all of it, for the epilogue
+    int            exitLabel;
+    int            spillDepth;
+    int            spillMax;
+    int            varsCount;
+    int            errorLabels[JitErrorKinds];
+    int            error;
+};
+
+int jitCompile     (Evaluator *eval, Node *root, JitFunction *func);
+int jitFunctionDtor(JitFunction *func);
+
+ExpTreeErrors jitRun(JitFunction *func, double *vars, ProgramIO *io);
+
+int jitBenchmark(Evaluator *eval, const double *inputs, int inputsCount, int runs, FILE *f);
+
+#endif //__JIT_COMPILER_H__
@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "tree_of_expressions.h"
+#include "html_logfile.h"
+#include "liveness.h"
+
+#define CHECK_POISON_PTR(ptr) \
+    if (ptr == PtrPoison)     \
+    {                         \
+        LOG("ERROR: PoisonPtr detected in %s(%d) %s\n", __FILE__, __LINE__, __func__);\
+        return 0;                                                                     \
+    }
+
+//-------------------------------------------------------------------------------------------------
+// Liveness of the variables, a backward dataflow pass over the statements. Nothing is live at
+// the end of the program, vivedi and the conditions read their variables, an assignment reads
+// its expression and kills its variable, and so does vvedi. A koli passes on what is live after
+// it together with what its body needs. A pokuda needs what its condition reads, what is live
+// after it and what its body needs at the start, and the body needs that again at its end, so
+// the body is walked until nothing more becomes live and then once more with the final set.
+// An assignment to a variable that is not live after it is a dead store. deadStoreEliminate
+// removes them, skipping them already while looking for the sets, so an assignment only read
+// by dead stores (the counter of an unrolled loop, a variable only feeding itself in a loop)
+// goes too. One whose expression may fail at run time stays, like deadCodeEliminate keeps such
+// conditions, and so does vvedi, as the input is taken anyway.
+// The statements left are numbered in program order and every variable gets the range of the
+// statements it is live at, for deciding which variables may share storage.
+//-------------------------------------------------------------------------------------------------
+
+#define IS_OPER(node, oper) ((node) && (node)->type == EXP_TREE_OPERATOR && (node)->data.operatorNum == (oper))
+
+static int      livenessRun      (Evaluator *eval, Node **root, Liveness *liveness, bool remove);
+static unsigned livenessStatement(LivenessPass *pass, Node **slot, unsigned live);
+static unsigned livenessBlock    (LivenessPass *pass, Node **link, unsigned live);
+static unsigned livenessLoop     (LivenessPass *pass, Node  *loop, unsigned live);
+static unsigned livenessAssign   (LivenessPass *pass, Node **slot, unsigned live);
+
+static void     livenessRecord (LivenessPass *pass, unsigned live);
+static unsigned livenessReads  (Node *node);
+static bool     livenessCanFail(Node *node);
+
+
+int livenessAnalyze(Evaluator *eval, Node *root, Liveness *liveness)
+{
+    assert(eval);
+    assert(liveness);
+    CHECK_POISON_PTR(root);
+
+    livenessRun(eval, &root, liveness, false);
+
+    return EXIT_SUCCESS;
+}
+
+int deadStoreEliminate(Evaluator *eval, Node **root, Liveness *liveness)
+{
+    assert(eval);
+    assert(root);
+    CHECK_POISON_PTR(*root);
+
+    Liveness result = {};
+    livenessRun(eval, root, &result, true);
+
+    // an empty program is still a block
+    if (!*root) *root = createNode(EXP_TREE_OPERATOR, createNodeData(EXP_TREE_OPERATOR, INSTR_END), NULL, NULL);
+
+    if (liveness) *liveness = result;
+
+    return result.stats.removed;
+}
+
+static int livenessRun(Evaluator *eval, Node **root, Liveness *liveness, bool remove)
+{
+    assert(eval);
+    assert(root);
+    assert(liveness);
+
+    *liveness = {};
+    for (int i = 0; i < NamesNumber; i++) liveness->ranges[i] = {IndexPoison, IndexPoison};
+
+    LivenessPass pass = {};
+    pass.eval     = eval;
+    pass.liveness = liveness;
+    pass.remove   = remove;
+    pass.final    = true;
+
+    liveness->liveIn     = livenessStatement(&pass, root, 0);
+    liveness->statements = pass.count;
+
+    // the statements were numbered from the end
+    for (int i = 0; i < NamesNumber; i++)
+    {
+        LiveRange *range = &liveness->ranges[i];
+        if (range->start == IndexPoison) continue;
+
+        int start = pass.count - 1 - range->end;
+        range->end   = pass.count - 1 - range->start;
+        range->start = start;
+
+        if (i < eval->names.count)
+        {
+            LOG("%s: %s is live at statements %d - %d\n", __func__, eval->names.table[i].name, range->start, range->end);
+        }
+    }
+
+    LOG("%s: %d statements, %d dead stores, %d removed, %d inputs never read\n", __func__, liveness->statements,
+        liveness->stats.deadStores, liveness->stats.removed, liveness->stats.deadInputs);
+
+    return EXIT_SUCCESS;
+}
+
+// returns the variables live before *slot, live is the set after it
+static unsigned livenessStatement(LivenessPass *pass, Node **slot, unsigned live)
+{
+    assert(pass);
+    assert(slot);
+
+    Node *stmt = *slot;
+    if (!stmt || stmt == PtrPoison || stmt->type != EXP_TREE_OPERATOR) return live;
+
+    unsigned before = live;
+
+    switch (stmt->data.operatorNum)
+    {
+        case INSTR_END: return livenessBlock(pass, slot, live);
+
+        case ASSIGN:    return livenessAssign(pass, slot, live);
+
+        case IN:
+        {
+            if (!stmt->right || stmt->right->type != EXP_TREE_VARIABLE) break;
+
+            unsigned var = 1u << stmt->right->data.variableNum;
+
+            if (!(live & var) && pass->final)
+            {
+                LOG("%s: the input of line %d is never read\n", __func__, stmt->line);
+                pass->liveness->stats.deadInputs++;
+            }
+
+            before = live & ~var;
+            break;
+        }
+
+        case OUT:       before = live | livenessReads(stmt->right);
+                        break;
+
+        case IF:        before = live | livenessStatement(pass, &stmt->right, live) | livenessReads(stmt->left);
+                        break;
+
+        case WHILE:     before = livenessLoop(pass, stmt, live);
+                        break;
+
+        case NOT_OPER:  case ADD:       case SUB:       case MUL:
+        case DIV:       case LN:        case LOGAR:     case POW:
+        case SIN:       case COS:       case R_BRACKET: case L_BRACKET:
+        case BELOW:     case ABOVE:     case OPEN_F:    case CLOSE_F:
+        case THEN:      case EQUAL:     case NOT_EQUAL: case SQRT:
+        case NEW_VAR:
+        default:        return live;
+    }
+
+    // the body of a koli or a pokuda is numbered already, so the statement comes before it
+    if (pass->final) livenessRecord(pass, before | live);
+
+    return before;
+}
+
+static unsigned livenessBlock(LivenessPass *pass, Node **link, unsigned live)
+{
+    assert(pass);
+    assert(link);
+
+    if (!IS_OPER(*link, INSTR_END)) return livenessStatement(pass, link, live);
+
+    Node *item = *link;
+
+    live = livenessBlock(pass, &item->right, live);
+
+    return livenessStatement(pass, &item->left, live);
+}
+
+static unsigned livenessLoop(LivenessPass *pass, Node *loop, unsigned live)
+{
+    assert(pass);
+    assert(loop);
+
+    unsigned head = live | livenessReads(loop->left);
+
+    // nothing is removed or numbered until the set at the start of the body is final
+    bool final  = pass->final;
+    pass->final = false;
+
+    for (;;)
+    {
+        unsigned next = head | livenessStatement(pass, &loop->right, head);
+        if (next == head) break;
+
+        head = next;
+    }
+
+    pass->final = final;
+    livenessStatement(pass, &loop->right, head);
+
+    return head;
+}
+
+static unsigned livenessAssign(LivenessPass *pass, Node **slot, unsigned live)
+{
+    assert(pass);
+    assert(slot);
+
+    Node *stmt = *slot;
+    if (!stmt->right || stmt->right->type != EXP_TREE_VARIABLE) return live | livenessReads(stmt->left);
+
+    unsigned var  = 1u << stmt->right->data.variableNum;
+    bool     dead = !(live & var);
+
+    if (dead && pass->final) pass->liveness->stats.deadStores++;
+
+    if (dead && pass->remove && !livenessCanFail(stmt->left))
+    {
+        if (pass->final)
+        {
+            LOG("%s: the assignment of %s in line %d is never read\n", __func__,
+                pass->eval->names.table[stmt->right->data.variableNum].name, stmt->line);
+
+            subTreeDtor(stmt);
+            *slot = NULL;
+
+            pass->liveness->stats.removed++;
+        }
+
+        return live;
+    }
+
+    unsigned before = (live & ~var) | livenessReads(stmt->left);
+
+    if (pass->final) livenessRecord(pass, before | live);
+
+    return before;
+}
+
+static void livenessRecord(LivenessPass *pass, unsigned live)
+{
+    assert(pass);
+
+    int statement = pass->count++;
+
+    for (int i = 0; i < NamesNumber; i++)
+    {
+        if (!(live & (1u << i))) continue;
+
+        LiveRange *range = &pass->liveness->ranges[i];
+
+        if (range->start == IndexPoison) range->start = statement;
+        range->end = statement;
+    }
+}
+
+// bit mask of the variables an expression reads
+static unsigned livenessReads(Node *node)
+{
+    if (!node || node == PtrPoison) return 0;
+
+    if (node->type == EXP_TREE_VARIABLE)
+    {
+        int var = node->data.variableNum;
+        return var >= 0 && var < NamesNumber ? 1u << var : 0;
+    }
+
+    return livenessReads(node->left) | livenessReads(node->right);
+}
+
+// an operator that reports an error for some arguments
+static bool livenessCanFail(Node *node)
+{
+    if (!node || node->type != EXP_TREE_OPERATOR) return false;
+
+    switch (node->data.operatorNum)
+    {
+        case DIV:   case LN:
+        case LOGAR: case POW:
+        case SQRT:  return true;
+
+        case NOT_OPER:  case ADD:
+        case SUB:       case MUL:
+        case SIN:       case COS:
+        case R_BRACKET: case L_BRACKET:
+        case ASSIGN:    case BELOW:
+        case ABOVE:     case IF:
+        case INSTR_END: case OPEN_F:
+        case CLOSE_F:   case WHILE:
+        case IN:        case OUT:
+        case THEN:      case EQUAL:
+        case NOT_EQUAL: case NEW_VAR:
+        default:        return livenessCanFail(node->left) || livenessCanFail(node->right);
+    }
+}
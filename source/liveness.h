@@ -0,0 +1,40 @@
+#ifndef  __LIVENESS_H__
+#define  __LIVENESS_H__
+
+#include "tree_of_expressions.h"
+
+// statements are numbered in program order from 0, a koli or a pokuda comes before its body
+struct LiveRange
+{
+    int start;          // the first statement the variable is live at, IndexPoison if none
+    int end;            // the last one
+};
+
+struct LivenessStats
+{
+    int deadStores;     // assignments whose value is never read
+    int removed;        // the ones removed, an expression that may fail at run time stays
+    int deadInputs;     // vvedi of a variable that is never read, the input is still taken
+};
+
+struct Liveness
+{
+    LiveRange     ranges[NamesNumber];
+    int           statements;
+    unsigned      liveIn;       // read before being assigned, so they hold DefaultVarValue
+    LivenessStats stats;
+};
+
+struct LivenessPass
+{
+    Evaluator *eval;
+    Liveness  *liveness;
+    bool       remove;          // skip dead stores, and remove them on the final walk
+    bool       final;           // the walk with the final sets of the enclosing loops
+    int        count;           // statements numbered so far, from the end
+};
+
+int livenessAnalyze   (Evaluator *eval, Node  *root, Liveness *liveness);
+int deadStoreEliminate(Evaluator *eval, Node **root, Liveness *liveness);
+
+#endif //__LIVENESS_H__
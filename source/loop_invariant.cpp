@@ -0,0 +1,421 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "tree_of_expressions.h"
+#include "html_logfile.h"
+#include "simplify_rules.h"
+#include "loop_invariant.h"
+
+#define CHECK_POISON_PTR(ptr) \
+    if (ptr == PtrPoison)     \
+    {                         \
+        LOG("ERROR: PoisonPtr detected in %s(%d) %s\n", __FILE__, __LINE__, __func__);\
+        return 0;                                                                     \
+    }
+
+//-------------------------------------------------------------------------------------------------
+// Loop-invariant code motion for pokuda. A subexpression in a loop that reads no variable the
+// loop assigns (with prisvoy or vvedi, anywhere in its condition or body) is computed once into
+// a new temporary "_invN" right before the loop, and the loop reads the temporary instead.
+// Loops are done outer first, so an expression invariant in both goes all the way out.
+// An expression that cannot fail is hoisted from anywhere in the loop: computing it once when
+// the loop does not run changes nothing. One that can fail (delit, ln, log, vozvesti, koreshok)
+// is hoisted only from the condition, which runs at least once, or from a statement that every
+// iteration runs before anything is read or printed. The latter go under a copy of the condition
+//     koli cond togda { _invN prisvoy expr slavsya_rus pokuda cond togda body }
+// so that they run only when the loop does. The free slots of the name table limit the number
+// of temporaries.
+//-------------------------------------------------------------------------------------------------
+
+#define IS_OPER(node, oper) ((node) && (node)->type == EXP_TREE_OPERATOR && (node)->data.operatorNum == (oper))
+
+static int   licmStatement    (LicmPass *pass, Node **slot, Node **link);
+static int   licmBlock        (LicmPass *pass, Node **link);
+static int   licmLoopStatement(LicmPass *pass, Node **slot, Node **link);
+
+static void  licmBody      (LicmPass *pass, LicmLoop *loop, Node *stmt, bool always);
+static void  licmExpression(LicmPass *pass, LicmLoop *loop, Node **slot, LicmPlace place);
+static bool  licmHoist     (LicmPass *pass, LicmLoop *loop, Node **slot, LicmPlace place, bool canFail);
+static Node *licmAppend    (LicmPass *pass, Node ***tail, Node *stmt);
+
+static bool     licmIsArithmetic(Node *node);
+static bool     licmCanFail     (Node *node);
+static bool     licmHasEffects  (Node *node);
+static unsigned licmVars        (Node *node);
+static unsigned licmAssigned    (Node *node);
+static Node    *licmCopy        (Node *node);
+
+
+int licmOptimize(Evaluator *eval, Node **root, LicmStats *stats)
+{
+    assert(eval);
+    assert(root);
+    CHECK_POISON_PTR(*root);
+
+    LicmPass pass = {};
+    pass.eval     = eval;
+
+    licmStatement(&pass, root, NULL);
+
+    LOG("%s: %d expressions hoisted, %d reused, %d loops guarded, error %d\n", __func__,
+        pass.stats.hoisted, pass.stats.reused, pass.stats.guarded, pass.error);
+
+    if (stats) *stats = pass.stats;
+
+    return pass.error;
+}
+
+// link: the INSTR_END item whose left is *slot, NULL if the statement is a bare body
+static int licmStatement(LicmPass *pass, Node **slot, Node **link)
+{
+    assert(pass);
+    assert(slot);
+
+    Node *stmt = *slot;
+    if (!stmt || stmt == PtrPoison || stmt->type != EXP_TREE_OPERATOR || pass->error) return pass->error;
+
+    switch (stmt->data.operatorNum)
+    {
+        case INSTR_END: return licmBlock(pass, slot);
+
+        case IF:        return licmStatement(pass, &stmt->right, NULL);
+
+        case WHILE:     return licmLoopStatement(pass, slot, link);
+
+        case NOT_OPER:  case ADD:       case SUB:       case MUL:
+        case DIV:       case LN:        case LOGAR:     case POW:
+        case SIN:       case COS:       case R_BRACKET: case L_BRACKET:
+        case ASSIGN:    case BELOW:     case ABOVE:     case OPEN_F:
+        case CLOSE_F:   case IN:        case OUT:       case THEN:
+        case EQUAL:     case NOT_EQUAL: case SQRT:      case NEW_VAR:
+        default:        return EXIT_SUCCESS;
+    }
+}
+
+static int licmBlock(LicmPass *pass, Node **link)
+{
+    assert(pass);
+    assert(link);
+
+    while (IS_OPER(*link, INSTR_END) && !pass->error)
+    {
+        Node *item = *link;
+
+        licmStatement(pass, &item->left, link);
+
+        // the temporaries went in before item
+        link = &item->right;
+    }
+
+    return licmStatement(pass, link, NULL);
+}
+
+static int licmLoopStatement(LicmPass *pass, Node **slot, Node **link)
+{
+    assert(pass);
+    assert(slot);
+
+    Node *stmt = *slot;
+
+    LicmLoop loop    = {};
+    loop.assigned    = licmAssigned(stmt);
+    loop.beforeTail  = &loop.before;
+    loop.guardedTail = &loop.guarded;
+
+    licmExpression(pass, &loop, &stmt->left, LICM_CONDITION);
+    licmBody      (pass, &loop, stmt->right, true);
+
+    if (pass->error) return pass->error;
+
+    Node *loopStmt = stmt;
+
+    if (loop.guarded)
+    {
+        licmAppend(pass, &loop.guardedTail, stmt);
+
+        loopStmt = createNode(EXP_TREE_OPERATOR, createNodeData(EXP_TREE_OPERATOR, IF), licmCopy(stmt->left), loop.guarded);
+        if (!loopStmt) return pass->error = MEMORY_ERROR;
+
+        loopStmt->line = stmt->line;
+        pass->stats.guarded++;
+
+        LOG("%s: the loop of line %d is guarded by its condition\n", __func__, stmt->line);
+    }
+
+    if (!loop.before)    *slot = loopStmt;
+    else if (link)
+    {
+        Node *item = *link;
+        assert(item->left == stmt);
+
+        item->left         = loopStmt;
+        *loop.beforeTail   = item;
+        *link              = loop.before;
+    }
+    else
+    {
+        licmAppend(pass, &loop.beforeTail, loopStmt);
+        *slot = loop.before;
+    }
+
+    if (pass->error) return pass->error;
+
+    return licmStatement(pass, &stmt->right, NULL);
+}
+
+static void licmBody(LicmPass *pass, LicmLoop *loop, Node *stmt, bool always)
+{
+    assert(pass);
+    assert(loop);
+
+    if (!stmt || stmt == PtrPoison || stmt->type != EXP_TREE_OPERATOR || pass->error) return;
+
+    if (IS_OPER(stmt, INSTR_END))
+    {
+        for (Node *item = stmt; item; item = item->right)
+        {
+            if (!IS_OPER(item, INSTR_END))
+            {
+                licmBody(pass, loop, item, always);
+                return;
+            }
+
+            licmBody(pass, loop, item->left, always);
+        }
+
+        return;
+    }
+
+    LicmPlace place = always && !loop->effects ? LICM_ALWAYS : LICM_MAYBE;
+
+    switch (stmt->data.operatorNum)
+    {
+        case ASSIGN:    licmExpression(pass, loop, &stmt->left, place);
+                        break;
+
+        case OUT:       licmExpression(pass, loop, &stmt->left,  place);
+                        licmExpression(pass, loop, &stmt->right, place);
+                        break;
+
+        case IF:
+        case WHILE:     licmExpression(pass, loop, &stmt->left, place);
+                        licmBody      (pass, loop, stmt->right, false);
+                        break;
+
+        case NOT_OPER:  case ADD:       case SUB:       case MUL:
+        case DIV:       case LN:        case LOGAR:     case POW:
+        case SIN:       case COS:       case R_BRACKET: case L_BRACKET:
+        case BELOW:     case ABOVE:     case INSTR_END: case OPEN_F:
+        case CLOSE_F:   case IN:        case THEN:      case EQUAL:
+        case NOT_EQUAL: case SQRT:      case NEW_VAR:
+        default:        break;
+    }
+
+    if (licmHasEffects(stmt)) loop->effects = true;
+}
+
+static void licmExpression(LicmPass *pass, LicmLoop *loop, Node **slot, LicmPlace place)
+{
+    assert(pass);
+    assert(loop);
+    assert(slot);
+
+    Node *node = *slot;
+    if (!node || node == PtrPoison || node->type != EXP_TREE_OPERATOR || pass->error) return;
+
+    unsigned vars = licmVars(node);
+
+    // a tree of numbers only is left as it is, folding it failed
+    if (licmIsArithmetic(node) && vars && !(vars & loop->assigned))
+    {
+        bool canFail = licmCanFail(node);
+
+        if ((!canFail || place != LICM_MAYBE) && licmHoist(pass, loop, slot, place, canFail)) return;
+    }
+
+    licmExpression(pass, loop, &node->left,  place);
+    licmExpression(pass, loop, &node->right, place);
+}
+
+static bool licmHoist(LicmPass *pass, LicmLoop *loop, Node **slot, LicmPlace place, bool canFail)
+{
+    assert(pass);
+    assert(loop);
+    assert(slot);
+
+    Node *node = *slot;
+    int   temp = IndexPoison;
+
+    for (int i = 0; i < loop->count; i++)
+    {
+        if (ruleTreesEqual(loop->hoisted[i].expr, node))
+        {
+            temp = loop->hoisted[i].temp;
+            break;
+        }
+    }
+
+    bool reused = temp != IndexPoison;
+
+    if (!reused)
+    {
+        if (loop->count == NamesNumber) return false;
+
+        temp = nameTableAddTemp(&pass->eval->names, LicmTempPrefix);
+        if (temp == IndexPoison) return false;     // no free names left, not an error
+    }
+
+    Node *use = createNode(EXP_TREE_VARIABLE, createNodeData(EXP_TREE_VARIABLE, temp), NULL, NULL);
+    if (!use)
+    {
+        pass->error = MEMORY_ERROR;
+        return false;
+    }
+
+    use->line = node->line;
+    *slot     = use;
+
+    if (reused)
+    {
+        subTreeDtor(node);
+        pass->stats.reused++;
+
+        return true;
+    }
+
+    Node *var    = createNode(EXP_TREE_VARIABLE, createNodeData(EXP_TREE_VARIABLE, temp), NULL, NULL);
+    Node *assign = createNode(EXP_TREE_OPERATOR, createNodeData(EXP_TREE_OPERATOR, ASSIGN), node, var);
+
+    if (!var || !assign)
+    {
+        *slot = node;
+
+        destroyNode(&use);
+        subTreeDtor(var);
+
+        pass->error = MEMORY_ERROR;
+        return false;
+    }
+
+    assign->line = node->line;
+
+    loop->hoisted[loop->count].expr = node;
+    loop->hoisted[loop->count].temp = temp;
+    loop->count++;
+
+    if (canFail && place == LICM_ALWAYS) licmAppend(pass, &loop->guardedTail, assign);
+    else                                 licmAppend(pass, &loop->beforeTail,  assign);
+
+    pass->stats.hoisted++;
+
+    LOG("%s: %s holds an invariant of line %d\n", __func__, pass->eval->names.table[temp].name, node->line);
+
+    return true;
+}
+
+// appends stmt to the chain that ends at *tail
+static Node *licmAppend(LicmPass *pass, Node ***tail, Node *stmt)
+{
+    assert(pass);
+    assert(tail);
+
+    Node *item = createNode(EXP_TREE_OPERATOR, createNodeData(EXP_TREE_OPERATOR, INSTR_END), stmt, NULL);
+    if (!item)
+    {
+        pass->error = MEMORY_ERROR;
+        return NULL;
+    }
+
+    **tail = item;
+    *tail  = &item->right;
+
+    return item;
+}
+
+static bool licmIsArithmetic(Node *node)
+{
+    if (!node || node->type != EXP_TREE_OPERATOR) return false;
+
+    switch (node->data.operatorNum)
+    {
+        case ADD:       case SUB:       case MUL:       case DIV:
+        case LN:        case LOGAR:     case POW:       case SIN:
+        case COS:       case SQRT:      return true;
+
+        case NOT_OPER:  case R_BRACKET: case L_BRACKET: case ASSIGN:
+        case BELOW:     case ABOVE:     case IF:        case INSTR_END:
+        case OPEN_F:    case CLOSE_F:   case WHILE:     case IN:
+        case OUT:       case THEN:      case EQUAL:     case NOT_EQUAL:
+        case NEW_VAR:
+        default:        return false;
+    }
+}
+
+// an operator that reports an error for some arguments
+static bool licmCanFail(Node *node)
+{
+    if (!node || node->type != EXP_TREE_OPERATOR) return false;
+
+    switch (node->data.operatorNum)
+    {
+        case DIV:   case LN:
+        case LOGAR: case POW:
+        case SQRT:  return true;
+
+        case NOT_OPER:  case ADD:
+        case SUB:       case MUL:
+        case SIN:       case COS:
+        case R_BRACKET: case L_BRACKET:
+        case ASSIGN:    case BELOW:
+        case ABOVE:     case IF:
+        case INSTR_END: case OPEN_F:
+        case CLOSE_F:   case WHILE:
+        case IN:        case OUT:
+        case THEN:      case EQUAL:
+        case NOT_EQUAL: case NEW_VAR:
+        default:        return licmCanFail(node->left) || licmCanFail(node->right);
+    }
+}
+
+static bool licmHasEffects(Node *node)
+{
+    if (!node || node == PtrPoison || node->type != EXP_TREE_OPERATOR) return false;
+
+    if (IS_OPER(node, IN) || IS_OPER(node, OUT)) return true;
+
+    return licmHasEffects(node->left) || licmHasEffects(node->right);
+}
+
+// bit mask of the variables node reads
+static unsigned licmVars(Node *node)
+{
+    if (!node || node == PtrPoison) return 0;
+
+    if (node->type == EXP_TREE_VARIABLE) return 1u << node->data.variableNum;
+
+    return licmVars(node->left) | licmVars(node->right);
+}
+
+// bit mask of the variables that the statements in node assign
+static unsigned licmAssigned(Node *node)
+{
+    if (!node || node == PtrPoison || node->type != EXP_TREE_OPERATOR) return 0;
+
+    if ((IS_OPER(node, ASSIGN) || IS_OPER(node, IN)) && node->right && node->right->type == EXP_TREE_VARIABLE)
+    {
+        return 1u << node->right->data.variableNum;
+    }
+
+    return licmAssigned(node->left) | licmAssigned(node->right);
+}
+
+static Node *licmCopy(Node *node)
+{
+    if (!node || node == PtrPoison) return NULL;
+
+    Node *copy = createNode(node->type, node->data, licmCopy(node->left), licmCopy(node->right));
+    if (copy) copy->line = node->line;
+
+    return copy;
+}
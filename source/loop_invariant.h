@@ -0,0 +1,52 @@
+#ifndef  __LOOP_INVARIANT_H__
+#define  __LOOP_INVARIANT_H__
+
+#include "tree_of_expressions.h"
+
+const char LicmTempPrefix[] = "_inv";
+
+enum LicmPlace
+{
+    LICM_CONDITION = 0,     // the loop condition, evaluated at least once
+    LICM_ALWAYS    = 1,     // runs in every iteration, before anything is read or written
+    LICM_MAYBE     = 2,     // under a koli or a nested pokuda, or after vvedi or vivedi
+};
+
+struct LicmHoisted
+{
+    Node *expr;             // a copy of the expression
+    int   temp;
+};
+
+// one pokuda being processed
+struct LicmLoop
+{
+    unsigned    assigned;   // bit mask of the variables the loop assigns
+    bool        effects;    // a statement of the body read or wrote something
+
+    LicmHoisted hoisted[NamesNumber];
+    int         count;
+
+    Node       *before;     // assignments of the temporaries, INSTR_END chains
+    Node      **beforeTail;
+    Node       *guarded;    // the ones that may fail, run only if the loop does
+    Node      **guardedTail;
+};
+
+struct LicmStats
+{
+    int hoisted;
+    int reused;
+    int guarded;
+};
+
+struct LicmPass
+{
+    Evaluator *eval;
+    LicmStats  stats;
+    int        error;
+};
+
+int licmOptimize(Evaluator *eval, Node **root, LicmStats *stats);
+
+#endif //__LOOP_INVARIANT_H__
@@ -0,0 +1,632 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "tree_of_expressions.h"
+#include "html_logfile.h"
+#include "assembler_code.h"
+#include "native_code.h"
+
+#define CHECK_POISON_PTR(ptr) \
+    if (ptr == PtrPoison)     \
+    {                         \
+        LOG("ERROR: PoisonPtr detected in %s(%d) %s\n", __FILE__, __LINE__, __func__);\
+        return BAD_NODE_TYPE;                                                            \
+    }
+
+//-------------------------------------------------------------------------------------------------
+// GNU assembler output for x86-64 Linux (SysV ABI), register usage matches jit_compiler.cpp:
+//   xmm0..xmm5 - expression temporaries, xmm6/xmm7 - scratch, xmm8..xmm15 - first variables.
+// All xmm registers are caller-saved in SysV, so variables are spilled to `vars` around calls.
+//-------------------------------------------------------------------------------------------------
+
+#define ASM(...) fprintf(w->f, __VA_ARGS__)
+
+const int NativeCallSaveBase = 0;
+const int NativeSpillBase    = NativeCallSaveBase + NativeTempRegs * (int)sizeof(double);
+const int NativeFrameSize    = NativeSpillBase    + NativeSpillSlots * (int)sizeof(double);
+
+static int  nativeNewLabel     (NativeWriter *w);
+static int  nativeAddConstant  (NativeWriter *w, double value);
+
+static void nativeVarOperand   (NativeWriter *w, int index);
+static void nativeLoadVar      (NativeWriter *w, int xmm, int index);
+static void nativeStoreVar     (NativeWriter *w, int index, int xmm);
+static void nativeSpillVars    (NativeWriter *w);
+static void nativeReloadVars   (NativeWriter *w);
+static void nativeMovXmm       (NativeWriter *w, int dst, int src);
+
+static int  nativeGenStatement (NativeWriter *w, Node *node);
+static int  nativeGenExpr      (NativeWriter *w, Node *node, int depth);
+static int  nativeGenOperands  (NativeWriter *w, Node *node, int depth, int *leftReg, int *rightReg);
+static int  nativeGenCall      (NativeWriter *w, const char *func, int depth, int leftReg, int rightReg);
+static int  nativeGenCondJump  (NativeWriter *w, Node *node, int depth, int falseLabel);
+
+static void nativeCheckNegative(NativeWriter *w, int xmm, ExpTreeErrors error);
+static void nativeCheckNearZero(NativeWriter *w, int xmm, ExpTreeErrors error);
+
+static void nativeWriteData    (NativeWriter *w);
+
+
+int createNativeExecutable(Evaluator *eval, const char *fileInName)
+{
+    assert(eval);
+    assert(fileInName);
+
+    char *asmName = getFileName(fileInName, "_x86_64.s");
+    char *objName = getFileName(fileInName, "_x86_64.o");
+    char *exeName = getFileName(fileInName, "_native");
+
+    FILE *f = fopen(asmName, "w");
+    if (!f) { free(asmName); free(objName); free(exeName); return MEMORY_ERROR; }
+
+    int error = convertToNativeAssembly(eval, eval->tree.root, f);
+    fclose(f);
+
+    if (!error)
+    {
+        char *command = NULL;
+
+        __mingw_asprintf(&command, "as -o %s %s", objName, asmName);
+        LOG("native: %s\n", command);
+        if (system(command) != 0) error = EXIT_FAILURE;
+        free(command);
+    }
+
+    if (!error)
+    {
+        char *command = NULL;
+
+        __mingw_asprintf(&command, "cc -o %s %s -lm", exeName, objName);
+        LOG("native: %s\n", command);
+        if (system(command) != 0) error = EXIT_FAILURE;
+        free(command);
+    }
+
+    if (error) printf("ERROR: couldn't build native executable from %s\n", asmName);
+    else       printf("native executable: %s\n", exeName);
+
+    free(asmName);
+    free(objName);
+    free(exeName);
+
+    return error;
+}
+
+int convertToNativeAssembly(Evaluator *eval, Node *root, FILE *f)
+{
+    assert(eval);
+    assert(f);
+
+    NativeWriter writer = {};
+    NativeWriter *w     = &writer;
+
+    w->f         = f;
+    w->varsCount = eval->names.count;
+
+    nativeAddConstant(w, PrecisionConst);
+    nativeAddConstant(w, 1);
+
+    ASM("# generated from the expression tree, x86-64 SysV\n\n");
+    ASM("\t.text\n");
+    ASM("\t.globl main\n");
+    ASM("\t.type  main, @function\n");
+    ASM("main:\n");
+    ASM("\tpushq  %%rbx\n");
+    ASM("\tsubq   $%d, %%rsp\n", NativeFrameSize);
+    nativeReloadVars(w);
+    ASM("\n");
+
+    int error = nativeGenStatement(w, root);
+
+    ASM("\n\txorl   %%eax, %%eax\n");
+    ASM(".Lexit:\n");
+    ASM("\taddq   $%d, %%rsp\n", NativeFrameSize);
+    ASM("\tpopq   %%rbx\n");
+    ASM("\tret\n\n");
+
+    for (int kind = 1; kind < NativeErrorKinds; kind++)
+    {
+        if (!w->errorUsed[kind]) continue;
+
+        ASM(".Lerror_%d:\n", kind);
+        ASM("\tleaq   .Lfmt_err(%%rip), %%rdi\n");
+        ASM("\tmovl   $%d, %%esi\n", -kind);
+        ASM("\txorl   %%eax, %%eax\n");
+        ASM("\tcall   printf@PLT\n");
+        ASM("\tmovl   $1, %%eax\n");
+        ASM("\tjmp    .Lexit\n\n");
+    }
+
+    ASM("\t.size  main, .-main\n\n");
+
+    // logar(base = xmm0, arg = xmm1) = ln(arg) / ln(base)
+    ASM(".Llogar:\n");
+    ASM("\tsubq   $24, %%rsp\n");
+    ASM("\tmovsd  %%xmm0, 8(%%rsp)\n");
+    ASM("\tmovapd %%xmm1, %%xmm0\n");
+    ASM("\tcall   log@PLT\n");
+    ASM("\tmovsd  %%xmm0, (%%rsp)\n");
+    ASM("\tmovsd  8(%%rsp), %%xmm0\n");
+    ASM("\tcall   log@PLT\n");
+    ASM("\tmovsd  (%%rsp), %%xmm1\n");
+    ASM("\tdivsd  %%xmm0, %%xmm1\n");
+    ASM("\tmovapd %%xmm1, %%xmm0\n");
+    ASM("\taddq   $24, %%rsp\n");
+    ASM("\tret\n\n");
+
+    nativeWriteData(w);
+
+    free(w->constants);
+
+    if (error) LOG("ERROR: %s: couldn't generate native code: %d\n", __func__, error);
+
+    return error;
+}
+
+static void nativeWriteData(NativeWriter *w)
+{
+    ASM("\t.section .rodata\n");
+    ASM(".Lfmt_in:\n\t.string \"%%lg\"\n");
+    ASM(".Lfmt_out:\n\t.string \"%%lg\\n\"\n");
+    ASM(".Lfmt_err:\n\t.string \"ERROR: program finished with error %%d\\n\"\n");
+
+    ASM("\t.align 16\n");
+    ASM(".Labs_mask:\n\t.quad 0x7fffffffffffffff, 0x7fffffffffffffff\n");
+
+    ASM("\t.align 8\n");
+    for (int i = 0; i < w->constantsCount; i++)
+    {
+        unsigned long long bits = 0;
+        memcpy(&bits, &w->constants[i], sizeof(bits));
+
+        ASM(".Lconst_%d:\n\t.quad 0x%016llx    # " ElemNumberFormat "\n", i, bits, w->constants[i]);
+    }
+
+    ASM("\n\t.bss\n");
+    ASM("\t.align 16\n");
+    ASM("vars:\n\t.zero %d\n", (w->varsCount + 1) * (int)sizeof(double));
+
+    ASM("\n\t.section .note.GNU-stack,\"\",@progbits\n");
+}
+
+static int nativeNewLabel(NativeWriter *w)
+{
+    return w->labelsCount++;
+}
+
+static int nativeAddConstant(NativeWriter *w, double value)
+{
+    for (int i = 0; i < w->constantsCount; i++)
+    {
+        if (memcmp(&w->constants[i], &value, sizeof(double)) == 0) return i;
+    }
+
+    if (w->constantsCount >= w->constantsCapacity)
+    {
+        int newCapacity = w->constantsCapacity ? 2 * w->constantsCapacity : 16;
+        double *newArr  = (double *)realloc(w->constants, newCapacity * sizeof(double));
+        if (!newArr) return 0;
+
+        w->constants         = newArr;
+        w->constantsCapacity = newCapacity;
+    }
+
+    w->constants[w->constantsCount] = value;
+    return w->constantsCount++;
+}
+
+static void nativeVarOperand(NativeWriter *w, int index)
+{
+    if (index < NativeVarRegs) ASM("%%xmm%d", NativeVarRegFirst + index);
+    else                       ASM("vars+%d(%%rip)", index * (int)sizeof(double));
+}
+
+static void nativeMovXmm(NativeWriter *w, int dst, int src)
+{
+    if (dst != src) ASM("\tmovapd %%xmm%d, %%xmm%d\n", src, dst);
+}
+
+static void nativeLoadVar(NativeWriter *w, int xmm, int index)
+{
+    if (index < NativeVarRegs) { nativeMovXmm(w, xmm, NativeVarRegFirst + index); return; }
+
+    ASM("\tmovsd  ");
+    nativeVarOperand(w, index);
+    ASM(", %%xmm%d\n", xmm);
+}
+
+static void nativeStoreVar(NativeWriter *w, int index, int xmm)
+{
+    if (index < NativeVarRegs) { nativeMovXmm(w, NativeVarRegFirst + index, xmm); return; }
+
+    ASM("\tmovsd  %%xmm%d, ", xmm);
+    nativeVarOperand(w, index);
+    ASM("\n");
+}
+
+static void nativeSpillVars(NativeWriter *w)
+{
+    for (int i = 0; i < w->varsCount && i < NativeVarRegs; i++)
+    {
+        ASM("\tmovsd  %%xmm%d, vars+%d(%%rip)\n", NativeVarRegFirst + i, i * (int)sizeof(double));
+    }
+}
+
+static void nativeReloadVars(NativeWriter *w)
+{
+    for (int i = 0; i < w->varsCount && i < NativeVarRegs; i++)
+    {
+        ASM("\tmovsd  vars+%d(%%rip), %%xmm%d\n", i * (int)sizeof(double), NativeVarRegFirst + i);
+    }
+}
+
+static int nativeGenStatement(NativeWriter *w, Node *node)
+{
+    CHECK_POISON_PTR(node);
+
+    if (!node) return EXIT_SUCCESS;
+    if (node->type != EXP_TREE_OPERATOR) return BAD_NODE_TYPE;
+
+    int error = EXIT_SUCCESS;
+
+    switch (node->data.operatorNum)
+    {
+        case INSTR_END:
+        {
+            for ( ; node && !error; node = node->right)
+            {
+                if (node->type != EXP_TREE_OPERATOR || node->data.operatorNum != INSTR_END)
+                {
+                    return nativeGenStatement(w, node);
+                }
+
+                error = nativeGenStatement(w, node->left);
+            }
+
+            return error;
+        }
+
+        case ASSIGN:
+        {
+            if (!node->right || node->right->type != EXP_TREE_VARIABLE) return BAD_NODE_TYPE;
+
+            error = nativeGenExpr(w, node->left, 0);
+            nativeStoreVar(w, node->right->data.variableNum, 0);
+            ASM("\n");
+
+            return error;
+        }
+
+        case IN:
+        {
+            if (!node->right || node->right->type != EXP_TREE_VARIABLE) return BAD_NODE_TYPE;
+
+            nativeSpillVars(w);
+            ASM("\tleaq   .Lfmt_in(%%rip), %%rdi\n");
+            ASM("\tleaq   vars+%d(%%rip), %%rsi\n", node->right->data.variableNum * (int)sizeof(double));
+            ASM("\txorl   %%eax, %%eax\n");
+            ASM("\tcall   scanf@PLT\n");
+            nativeReloadVars(w);
+            ASM("\n");
+
+            return EXIT_SUCCESS;
+        }
+
+        case OUT:
+        {
+            error = nativeGenExpr(w, node->right, 0);
+
+            nativeSpillVars(w);
+            ASM("\tleaq   .Lfmt_out(%%rip), %%rdi\n");
+            ASM("\tmovl   $1, %%eax\n");
+            ASM("\tcall   printf@PLT\n");
+            nativeReloadVars(w);
+            ASM("\n");
+
+            return error;
+        }
+
+        case IF:
+        {
+            int endLabel = nativeNewLabel(w);
+
+            error = nativeGenCondJump(w, node->left, 0, endLabel);
+            if (!error) error = nativeGenStatement(w, node->right);
+
+            ASM(".L%d:\n", endLabel);
+            return error;
+        }
+
+        case WHILE:
+        {
+            int beginLabel = nativeNewLabel(w);
+            int endLabel   = nativeNewLabel(w);
+
+            ASM(".L%d:\n", beginLabel);
+
+            error = nativeGenCondJump(w, node->left, 0, endLabel);
+            if (!error) error = nativeGenStatement(w, node->right);
+
+            ASM("\tjmp    .L%d\n", beginLabel);
+            ASM(".L%d:\n", endLabel);
+            return error;
+        }
+
+        case ADD:    case SUB:
+        case MUL:    case DIV:
+        case LN:     case LOGAR:
+        case POW:    case SIN:
+        case COS:    case SQRT:
+        case BELOW:  case ABOVE:
+        case EQUAL:  case NOT_EQUAL:
+        case OPEN_F: case CLOSE_F:
+        case THEN:   case NEW_VAR:
+        case L_BRACKET: case R_BRACKET:
+        case NOT_OPER:
+        default:     LOG("ERROR: %s: operator %d is not a statement\n", __func__, node->data.operatorNum);
+                     return UNKNOWN_OPERATOR;
+    }
+}
+
+static int nativeGenOperands(NativeWriter *w, Node *node, int depth, int *leftReg, int *rightReg)
+{
+    assert(leftReg);
+    assert(rightReg);
+
+    int error = nativeGenExpr(w, node->left, depth);
+    if (error) return error;
+
+    *leftReg = depth;
+
+    if (depth + 1 < NativeTempRegs)
+    {
+        *rightReg = depth + 1;
+        return nativeGenExpr(w, node->right, depth + 1);
+    }
+
+    if (w->spillDepth >= NativeSpillSlots) return MEMORY_ERROR;
+
+    int slot = NativeSpillBase + w->spillDepth * (int)sizeof(double);
+    w->spillDepth++;
+
+    ASM("\tmovsd  %%xmm%d, %d(%%rsp)\n", depth, slot);
+    error = nativeGenExpr(w, node->right, depth);
+
+    nativeMovXmm(w, NativeScratchReg, depth);
+    ASM("\tmovsd  %d(%%rsp), %%xmm%d\n", slot, depth);
+    w->spillDepth--;
+
+    *rightReg = NativeScratchReg;
+    return error;
+}
+
+static int nativeGenCall(NativeWriter *w, const char *func, int depth, int leftReg, int rightReg)
+{
+    for (int i = 0; i < depth; i++)
+    {
+        ASM("\tmovsd  %%xmm%d, %d(%%rsp)\n", i, NativeCallSaveBase + i * (int)sizeof(double));
+    }
+
+    if (leftReg  != IndexPoison) nativeMovXmm(w, 0, leftReg);
+    if (rightReg != IndexPoison) nativeMovXmm(w, leftReg == IndexPoison ? 0 : 1, rightReg);
+
+    nativeSpillVars (w);
+    ASM("\tcall   %s\n", func);
+    nativeReloadVars(w);
+
+    nativeMovXmm(w, depth, 0);
+
+    for (int i = 0; i < depth; i++)
+    {
+        ASM("\tmovsd  %d(%%rsp), %%xmm%d\n", NativeCallSaveBase + i * (int)sizeof(double), i);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static void nativeCheckNegative(NativeWriter *w, int xmm, ExpTreeErrors error)
+{
+    w->errorUsed[-error] = true;
+
+    ASM("\txorpd  %%xmm%d, %%xmm%d\n", NativeCheckReg, NativeCheckReg);
+    ASM("\tucomisd %%xmm%d, %%xmm%d\n", xmm, NativeCheckReg);
+    ASM("\tja     .Lerror_%d\n", -error);
+}
+
+static void nativeCheckNearZero(NativeWriter *w, int xmm, ExpTreeErrors error)
+{
+    w->errorUsed[-error] = true;
+
+    int skipLabel = nativeNewLabel(w);
+
+    nativeMovXmm(w, NativeCheckReg, xmm);
+    ASM("\tandpd  .Labs_mask(%%rip), %%xmm%d\n", NativeCheckReg);
+    ASM("\tucomisd .Lconst_0(%%rip), %%xmm%d\n", NativeCheckReg);
+    ASM("\tjp     .L%d\n", skipLabel);
+    ASM("\tjb     .Lerror_%d\n", -error);
+    ASM(".L%d:\n", skipLabel);
+}
+
+static int nativeGenExpr(NativeWriter *w, Node *node, int depth)
+{
+    CHECK_POISON_PTR(node);
+    if (!node) return BAD_NODE_TYPE;
+
+    assert(depth < NativeTempRegs);
+
+    switch (node->type)
+    {
+        case EXP_TREE_NUMBER:   ASM("\tmovsd  .Lconst_%d(%%rip), %%xmm%d\n",
+                                    nativeAddConstant(w, node->data.number), depth);
+                                return EXIT_SUCCESS;
+
+        case EXP_TREE_VARIABLE: nativeLoadVar(w, depth, node->data.variableNum);
+                                return EXIT_SUCCESS;
+
+        case EXP_TREE_OPERATOR: break;
+
+        case EXP_TREE_NOTHING:
+        case EXP_TREE_IDENTIF:
+        default:                return BAD_NODE_TYPE;
+    }
+
+    int error    = EXIT_SUCCESS;
+    int leftReg  = IndexPoison;
+    int rightReg = IndexPoison;
+
+    ExpTreeOperators oper = node->data.operatorNum;
+
+    switch (oper)
+    {
+        case ADD: case SUB:
+        case MUL: case DIV:
+        {
+            error = nativeGenOperands(w, node, depth, &leftReg, &rightReg);
+            if (error) return error;
+
+            const char *op = "addsd";
+            if (oper == SUB) op = "subsd";
+            if (oper == MUL) op = "mulsd";
+            if (oper == DIV) { op = "divsd"; nativeCheckNearZero(w, rightReg, DIVISION_BY_ZERO); }
+
+            ASM("\t%s  %%xmm%d, %%xmm%d\n", op, rightReg, leftReg);
+            return EXIT_SUCCESS;
+        }
+
+        case POW:
+        {
+            error = nativeGenOperands(w, node, depth, &leftReg, &rightReg);
+            if (error) return error;
+
+            return nativeGenCall(w, "pow@PLT", depth, leftReg, rightReg);
+        }
+
+        case LOGAR:
+        {
+            error = nativeGenOperands(w, node, depth, &leftReg, &rightReg);
+            if (error) return error;
+
+            nativeCheckNegative(w, rightReg, LOG_NEGATIVE_ARG);
+            nativeCheckNegative(w, leftReg,  LOG_BAD_BASE);
+
+            nativeMovXmm(w, NativeCheckReg, leftReg);
+            ASM("\tsubsd  .Lconst_1(%%rip), %%xmm%d\n", NativeCheckReg);
+            nativeCheckNearZero(w, NativeCheckReg, LOG_BAD_BASE);
+
+            return nativeGenCall(w, ".Llogar", depth, leftReg, rightReg);
+        }
+
+        case SQRT:
+        {
+            error = nativeGenExpr(w, node->right, depth);
+            ASM("\tsqrtsd %%xmm%d, %%xmm%d\n", depth, depth);
+            return error;
+        }
+
+        case LN:  case SIN:
+        case COS:
+        {
+            error = nativeGenExpr(w, node->right, depth);
+            if (error) return error;
+
+            const char *func = "log@PLT";
+            if (oper == SIN) func = "sin@PLT";
+            if (oper == COS) func = "cos@PLT";
+            if (oper == LN)  nativeCheckNegative(w, depth, LOG_NEGATIVE_ARG);
+
+            return nativeGenCall(w, func, depth, depth, IndexPoison);
+        }
+
+        case BELOW: case ABOVE:
+        case EQUAL: case NOT_EQUAL:
+        {
+            int falseLabel = nativeNewLabel(w);
+            int endLabel   = nativeNewLabel(w);
+
+            error = nativeGenCondJump(w, node, depth, falseLabel);
+
+            ASM("\tmovsd  .Lconst_1(%%rip), %%xmm%d\n", depth);
+            ASM("\tjmp    .L%d\n", endLabel);
+            ASM(".L%d:\n", falseLabel);
+            ASM("\txorpd  %%xmm%d, %%xmm%d\n", depth, depth);
+            ASM(".L%d:\n", endLabel);
+
+            return error;
+        }
+
+        case ASSIGN: case IF:
+        case WHILE:  case IN:
+        case OUT:    case INSTR_END:
+        case OPEN_F: case CLOSE_F:
+        case THEN:   case NEW_VAR:
+        case L_BRACKET: case R_BRACKET:
+        case NOT_OPER:
+        default:     LOG("ERROR: %s: operator %d is not an expression\n", __func__, oper);
+                     return UNKNOWN_OPERATOR;
+    }
+}
+
+static int nativeGenCondJump(NativeWriter *w, Node *node, int depth, int falseLabel)
+{
+    CHECK_POISON_PTR(node);
+    if (!node) return BAD_NODE_TYPE;
+
+    int leftReg  = IndexPoison;
+    int rightReg = IndexPoison;
+
+    ExpTreeOperators oper = NOT_OPER;
+    if (node->type == EXP_TREE_OPERATOR) oper = node->data.operatorNum;
+
+    if (oper != BELOW && oper != ABOVE && oper != EQUAL && oper != NOT_EQUAL)
+    {
+        int error = nativeGenExpr(w, node, depth);
+        if (error) return error;
+
+        leftReg = depth;
+        oper    = NOT_EQUAL;
+    }
+    else
+    {
+        int error = nativeGenOperands(w, node, depth, &leftReg, &rightReg);
+        if (error) return error;
+    }
+
+    if (oper == BELOW)
+    {
+        ASM("\tucomisd %%xmm%d, %%xmm%d\n", rightReg, leftReg);
+        ASM("\tjp     .L%d\n", falseLabel);
+        ASM("\tjae    .L%d\n\n", falseLabel);
+        return EXIT_SUCCESS;
+    }
+
+    if (oper == ABOVE)
+    {
+        ASM("\tucomisd %%xmm%d, %%xmm%d\n", rightReg, leftReg);
+        ASM("\tjbe    .L%d\n\n", falseLabel);
+        return EXIT_SUCCESS;
+    }
+
+    if (rightReg != IndexPoison) ASM("\tsubsd  %%xmm%d, %%xmm%d\n", rightReg, leftReg);
+
+    ASM("\tandpd  .Labs_mask(%%rip), %%xmm%d\n", leftReg);
+    ASM("\tucomisd .Lconst_0(%%rip), %%xmm%d\n", leftReg);
+
+    if (oper == EQUAL)
+    {
+        ASM("\tjp     .L%d\n", falseLabel);
+        ASM("\tjae    .L%d\n\n", falseLabel);
+        return EXIT_SUCCESS;
+    }
+
+    int trueLabel = nativeNewLabel(w);
+
+    ASM("\tjp     .L%d\n", trueLabel);
+    ASM("\tjb     .L%d\n", falseLabel);
+    ASM(".L%d:\n\n", trueLabel);
+
+    return EXIT_SUCCESS;
+}
+
+#undef ASM
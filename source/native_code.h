@@ -0,0 +1,35 @@
+#ifndef  __NATIVE_CODE_H__
+#define  __NATIVE_CODE_H__
+
+#include <stdio.h>
+
+#include "tree_of_expressions.h"
+
+const int NativeTempRegs    = 6;
+const int NativeScratchReg  = 6;
+const int NativeCheckReg    = 7;
+const int NativeVarRegFirst = 8;
+const int NativeVarRegs     = 8;
+const int NativeSpillSlots  = 64;
+const int NativeErrorKinds  = 9;
+
+struct NativeWriter
+{
+    FILE   *f;
+
+    double *constants;
+    int     constantsCount;
+    int     constantsCapacity;
+
+    int     labelsCount;
+    int     spillDepth;
+    int     varsCount;
+
+    bool    errorUsed[NativeErrorKinds];
+};
+
+int createNativeExecutable(Evaluator *eval, const char *fileInName);
+
+int convertToNativeAssembly(Evaluator *eval, Node *root, FILE *f);
+
+#endif //__NATIVE_CODE_H__
@@ -0,0 +1,337 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <time.h>
+
+#include "tree_of_expressions.h"
+#include "html_logfile.h"
+#include "thread_pool.h"
+#include "parallel_evaluate.h"
+
+#define CHECK_POISON_PTR(ptr) \
+    if (ptr == PtrPoison)     \
+    {                         \
+        LOG("ERROR: PoisonPtr detected in %s(%d) %s\n", __FILE__, __LINE__, __func__);\
+        return 0;                                                                     \
+    }
+
+//-------------------------------------------------------------------------------------------------
+// Fork-join evaluation of one huge expression. forkJoinPrepare counts the subtree sizes once and
+// turns every operator whose subtree is bigger than the cutoff into a task. When both children
+// of a task are tasks too, the bigger one is pushed to the pool (a thief takes the most work)
+// and the smaller one is evaluated by the same thread, which then helps the pool until the
+// pushed one is done. Everything below the cutoff is a plain recursive walk.
+// The plan keeps pointers into the tree: prepare again after the tree changes, variable values
+// may change freely between evaluations.
+//-------------------------------------------------------------------------------------------------
+
+static long long forkJoinSize(Node *node);
+static long long forkJoinPlan(ForkJoinEvaluator *fj, Node *node, int *task, ExpTreeErrors *error);
+static int       forkJoinAddTask(ForkJoinEvaluator *fj, Node *node, long long size, int left, int right);
+
+static void forkJoinTaskRun(void *arg);
+
+static Node  *forkJoinCopy     (Node *node);
+static Node  *forkJoinReplicate(Node *expression, long long copies);
+static double forkJoinTime(void);
+
+
+int forkJoinCtor(ForkJoinEvaluator *fj, Evaluator *eval, int workersCount)
+{
+    assert(fj);
+    assert(eval);
+
+    *fj = {};
+
+    fj->eval = eval;
+    fj->root = NULL;
+
+    return threadPoolCtor(&fj->pool, workersCount);
+}
+
+int forkJoinDtor(ForkJoinEvaluator *fj)
+{
+    assert(fj);
+
+    if (fj->pool.threads) threadPoolDtor(&fj->pool);
+
+    free(fj->tasks);
+
+    fj->tasks         = NULL;
+    fj->tasksCount    = 0;
+    fj->tasksCapacity = 0;
+    fj->root          = NULL;
+
+    return EXIT_SUCCESS;
+}
+
+int forkJoinPrepare(ForkJoinEvaluator *fj, Node *root, long long cutoff)
+{
+    assert(fj);
+    CHECK_POISON_PTR(root);
+
+    fj->root       = root;
+    fj->size       = forkJoinSize(root);
+    fj->tasksCount = 0;
+
+    if (fj->size < ForkJoinThreshold) return EXIT_SUCCESS;
+
+    // about ForkJoinTasksPerWorker tasks per worker: enough to even out the load,
+    // few enough for the pool overhead not to matter
+    if (cutoff <= 0) cutoff = fj->size / (fj->pool.workersCount * ForkJoinTasksPerWorker);
+    if (cutoff < ForkJoinCutoff) cutoff = ForkJoinCutoff;
+
+    fj->cutoff = cutoff;
+
+    ExpTreeErrors error = TREE_NO_ERROR;
+    int           task  = IndexPoison;
+
+    forkJoinPlan(fj, root, &task, &error);
+
+    if (error) fj->tasksCount = 0;
+
+    return error;
+}
+
+static long long forkJoinSize(Node *node)
+{
+    if (!node || node == PtrPoison) return 0;
+
+    return 1 + forkJoinSize(node->left) + forkJoinSize(node->right);
+}
+
+// post-order, so the root task is the last one
+static long long forkJoinPlan(ForkJoinEvaluator *fj, Node *node, int *task, ExpTreeErrors *error)
+{
+    assert(fj);
+    assert(task);
+    assert(error);
+
+    *task = IndexPoison;
+    if (!node || node == PtrPoison) return 0;
+
+    int leftTask  = IndexPoison;
+    int rightTask = IndexPoison;
+
+    long long size = 1 + forkJoinPlan(fj, node->left,  &leftTask,  error)
+                       + forkJoinPlan(fj, node->right, &rightTask, error);
+
+    if (*error || size < fj->cutoff || node->type == EXP_TREE_NUMBER || node->type == EXP_TREE_VARIABLE) return size;
+
+    *task = forkJoinAddTask(fj, node, size, leftTask, rightTask);
+    if (*task == IndexPoison) *error = MEMORY_ERROR;
+
+    return size;
+}
+
+static int forkJoinAddTask(ForkJoinEvaluator *fj, Node *node, long long size, int left, int right)
+{
+    assert(fj);
+    assert(node);
+
+    if (fj->tasksCount == fj->tasksCapacity)
+    {
+        int           capacity = fj->tasksCapacity ? fj->tasksCapacity * 2 : 64;
+        ForkJoinTask *tasks    = (ForkJoinTask *)realloc(fj->tasks, (size_t)capacity * sizeof(ForkJoinTask));
+        if (!tasks) return IndexPoison;
+
+        fj->tasks         = tasks;
+        fj->tasksCapacity = capacity;
+    }
+
+    ForkJoinTask task = {};
+    task.owner = fj;
+    task.node  = node;
+    task.size  = size;
+    task.left  = left;
+    task.right = right;
+
+    fj->tasks[fj->tasksCount] = task;
+
+    return fj->tasksCount++;
+}
+
+double forkJoinEvaluate(ForkJoinEvaluator *fj, ExpTreeErrors *error)
+{
+    assert(fj);
+    assert(error);
+
+    if (fj->tasksCount == 0) return forkJoinSequential(fj->eval, fj->root, error);
+
+    ForkJoinTask *root = &fj->tasks[fj->tasksCount - 1];
+    forkJoinTaskRun(root);
+
+    *error = root->error;
+    return root->value;
+}
+
+static void forkJoinTaskRun(void *arg)
+{
+    assert(arg);
+
+    ForkJoinTask      *task = (ForkJoinTask *)arg;
+    ForkJoinEvaluator *fj   = task->owner;
+    Node              *node = task->node;
+
+    ForkJoinTask *left  = task->left  == IndexPoison ? NULL : &fj->tasks[task->left];
+    ForkJoinTask *right = task->right == IndexPoison ? NULL : &fj->tasks[task->right];
+
+    ForkJoinTask *spawned = NULL;
+    int           pending = 0;
+
+    if (left && right)
+    {
+        spawned = left->size >= right->size ? left : right;
+        if (threadPoolSubmit(&fj->pool, forkJoinTaskRun, spawned, &pending)) spawned = NULL;
+    }
+
+    double        leftValue  = 0;
+    double        rightValue = 0;
+    ExpTreeErrors leftError  = TREE_NO_ERROR;
+    ExpTreeErrors rightError = TREE_NO_ERROR;
+
+    if      (!left)            leftValue = forkJoinSequential(fj->eval, node->left, &leftError);
+    else if (left != spawned)  forkJoinTaskRun(left);
+
+    if      (!right)           rightValue = forkJoinSequential(fj->eval, node->right, &rightError);
+    else if (right != spawned) forkJoinTaskRun(right);
+
+    if (spawned) threadPoolWait(&fj->pool, &pending);
+
+    if (left)  { leftValue  = left->value;  leftError  = left->error;  }
+    if (right) { rightValue = right->value; rightError = right->error; }
+
+    task->error = leftError ? leftError : rightError;
+    if (task->error)
+    {
+        task->value = DataPoison;
+        return;
+    }
+
+    task->value = NodeCalculate(leftValue, rightValue, node->data.operatorNum, &task->error);
+}
+
+// expTreeEvaluate without the per-node logging
+double forkJoinSequential(Evaluator *eval, Node *root, ExpTreeErrors *error)
+{
+    assert(eval);
+    assert(error);
+    CHECK_POISON_PTR(root);
+
+    if (!root)                           return 0;
+    if (root->type == EXP_TREE_NUMBER)   return root->data.number;
+    if (root->type == EXP_TREE_VARIABLE) return eval->names.table[root->data.variableNum].value;
+
+    double leftTree  = forkJoinSequential(eval, root->left,  error);
+    double rightTree = forkJoinSequential(eval, root->right, error);
+
+    if (*error) return DataPoison;
+
+    return NodeCalculate(leftTree, rightTree, root->data.operatorNum, error);
+}
+
+static Node *forkJoinCopy(Node *node)
+{
+    if (!node || node == PtrPoison) return NULL;
+
+    Node *copy = createNode(node->type, node->data, forkJoinCopy(node->left), forkJoinCopy(node->right));
+    if (copy) copy->line = node->line;
+
+    return copy;
+}
+
+// a balanced sum of copies, the shape of a big generated formula
+static Node *forkJoinReplicate(Node *expression, long long copies)
+{
+    if (copies <= 1) return forkJoinCopy(expression);
+
+    Node *left  = forkJoinReplicate(expression, copies / 2);
+    Node *right = forkJoinReplicate(expression, copies - copies / 2);
+
+    return createNode(EXP_TREE_OPERATOR, createNodeData(EXP_TREE_OPERATOR, ADD), left, right);
+}
+
+static double forkJoinTime(void)
+{
+    timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+int forkJoinBenchmark(Evaluator *eval, Node *expression, int nodes, FILE *f)
+{
+    assert(eval);
+    assert(f);
+    CHECK_POISON_PTR(expression);
+
+    long long expressionSize = forkJoinSize(expression);
+    if (expressionSize == 0) return EXIT_SUCCESS;
+
+    long long copies = nodes / (expressionSize + 1);
+    if (copies < 1) copies = 1;
+
+    Node *big = forkJoinReplicate(expression, copies);
+    if (!big) return MEMORY_ERROR;
+
+    ExpTreeErrors sequentialError = TREE_NO_ERROR;
+    double        sequentialValue = 0;
+    double        sequentialTime  = 0;
+
+    for (int run = 0; run < ForkJoinBenchmarkRuns; run++)
+    {
+        sequentialError = TREE_NO_ERROR;
+
+        double start = forkJoinTime();
+        sequentialValue = forkJoinSequential(eval, big, &sequentialError);
+        double time = forkJoinTime() - start;
+
+        if (run == 0 || time < sequentialTime) sequentialTime = time;
+    }
+
+    fprintf(f, "nodes:          %lld\n", forkJoinSize(big));
+    fprintf(f, "sequential:     %lg s\n", sequentialTime);
+
+    int cpus  = threadPoolCpuCount();
+    int error = EXIT_SUCCESS;
+
+    for (int workers = 1; !error; workers *= 2)
+    {
+        if (workers > cpus) workers = cpus;
+
+        ForkJoinEvaluator fj = {};
+        error = forkJoinCtor(&fj, eval, workers);
+        if (!error) error = forkJoinPrepare(&fj, big, 0);
+
+        ExpTreeErrors parallelError = TREE_NO_ERROR;
+        double        parallelValue = 0;
+        double        parallelTime  = 0;
+
+        for (int run = 0; !error && run < ForkJoinBenchmarkRuns; run++)
+        {
+            parallelError = TREE_NO_ERROR;
+
+            double start = forkJoinTime();
+            parallelValue = forkJoinEvaluate(&fj, &parallelError);
+            double time = forkJoinTime() - start;
+
+            if (run == 0 || time < parallelTime) parallelTime = time;
+        }
+
+        if (!error)
+        {
+            fprintf(f, "%3d workers:    %lg s, speedup %lg, %d tasks, cutoff %lld, check " ElemNumberFormat
+                       " vs " ElemNumberFormat " (errors %d, %d)\n",
+                       workers, parallelTime, parallelTime > 0 ? sequentialTime / parallelTime : 0,
+                       fj.tasksCount, fj.cutoff, parallelValue, sequentialValue, parallelError, sequentialError);
+        }
+
+        forkJoinDtor(&fj);
+
+        if (workers == cpus) break;
+    }
+
+    subTreeDtor(big);
+
+    return error;
+}
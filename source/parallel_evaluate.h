@@ -0,0 +1,53 @@
+#ifndef  __PARALLEL_EVALUATE_H__
+#define  __PARALLEL_EVALUATE_H__
+
+#include <stdio.h>
+
+#include "tree_of_expressions.h"
+#include "thread_pool.h"
+
+const int ForkJoinCutoff         = 4096;     // smaller subtrees are never split
+const int ForkJoinThreshold      = 65536;    // smaller trees are evaluated on one thread
+const int ForkJoinTasksPerWorker = 16;
+const int ForkJoinBenchmarkRuns  = 5;
+
+struct ForkJoinEvaluator;
+
+// a subtree big enough to be a task of its own, children below the cutoff are walked inline
+struct ForkJoinTask
+{
+    ForkJoinEvaluator *owner;
+    Node              *node;
+    long long          size;
+    int                left;     // task of the child, IndexPoison if it is evaluated inline
+    int                right;
+
+    double             value;
+    ExpTreeErrors      error;
+};
+
+struct ForkJoinEvaluator
+{
+    Evaluator    *eval;
+    Node         *root;
+    long long     size;
+    long long     cutoff;
+
+    ForkJoinTask *tasks;
+    int           tasksCount;
+    int           tasksCapacity;
+
+    ThreadPool    pool;
+};
+
+int forkJoinCtor(ForkJoinEvaluator *fj, Evaluator *eval, int workersCount);
+int forkJoinDtor(ForkJoinEvaluator *fj);
+
+int    forkJoinPrepare (ForkJoinEvaluator *fj, Node *root, long long cutoff);
+double forkJoinEvaluate(ForkJoinEvaluator *fj, ExpTreeErrors *error);
+
+double forkJoinSequential(Evaluator *eval, Node *root, ExpTreeErrors *error);
+
+int forkJoinBenchmark(Evaluator *eval, Node *expression, int nodes, FILE *f);
+
+#endif //__PARALLEL_EVALUATE_H__
@@ -0,0 +1,362 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <math.h>
+
+#include "tree_of_expressions.h"
+#include "html_logfile.h"
+#include "fast_math.h"
+#include "program_run.h"
+#include "program_dual.h"
+
+#define CHECK_POISON_PTR(ptr) \
+    if (ptr == PtrPoison)     \
+    {                         \
+        LOG("ERROR: PoisonPtr detected in %s(%d) %s\n", __FILE__, __LINE__, __func__);\
+        return BAD_NODE_TYPE;                                                            \
+    }
+
+//-------------------------------------------------------------------------------------------------
+// Forward-mode differentiation: every variable carries its value and a vector of DualTangents
+// partial derivatives, one per seeded vvedi read. Seeded reads start with a unit tangent, all
+// other values with zero, and every operator applies the chain rule while the value itself is
+// computed by NodeCalculate, so errors and branches match programRun. Conditions of koli and
+// pokuda only look at values: the derivative is the one of the path actually taken.
+// The tangent loops run over the whole fixed-size vector so the compiler can vectorise them.
+//-------------------------------------------------------------------------------------------------
+
+static void dualConstant  (DualNumber *result, double value);
+static void dualScale     (DualNumber *result, const DualNumber *from, double factor);
+static void dualAddScaled (DualNumber *result, const DualNumber *from, double factor);
+static bool dualHasTangent(const DualNumber *number);
+
+static void dualSeedInput  (DualRunner *runner, DualNumber *number);
+static int  dualSeededCount(DualRunner *runner);
+
+
+int dualRunnerCtor(DualRunner *runner, Evaluator *eval, ProgramIO *io, const int *selected, int tangents)
+{
+    assert(runner);
+    assert(eval);
+    assert(io);
+
+    if (tangents > DualTangents)
+    {
+        LOG("ERROR: %s: %d inputs selected, at most %d supported\n", __func__, tangents, DualTangents);
+        return BAD_VAR_INDEX;
+    }
+
+    runner->eval          = eval;
+    runner->io            = io;
+    runner->output        = dualStdOutput;
+    runner->outputContext = NULL;
+    runner->inputsRead    = 0;
+
+    runner->seedAll  = !selected || tangents <= 0;
+    runner->tangents = runner->seedAll ? DualTangents : tangents;
+
+    for (int i = 0; i < runner->tangents; i++) runner->selected[i] = runner->seedAll ? i : selected[i];
+
+    return EXIT_SUCCESS;
+}
+
+ExpTreeErrors dualRun(DualRunner *runner)
+{
+    assert(runner);
+
+    for (int i = 0; i < runner->eval->names.count; i++) dualConstant(&runner->vars[i], DefaultVarValue);
+
+    runner->inputsRead = 0;
+
+    return dualRunNode(runner, runner->eval->tree.root);
+}
+
+ExpTreeErrors dualRunNode(DualRunner *runner, Node *node)
+{
+    assert(runner);
+    CHECK_POISON_PTR(node);
+
+    if (!node) return TREE_NO_ERROR;
+
+    if (node->type != EXP_TREE_OPERATOR) return BAD_NODE_TYPE;
+
+    ExpTreeErrors error = TREE_NO_ERROR;
+    DualNumber    value = {};
+
+    switch (node->data.operatorNum)
+    {
+        case INSTR_END:
+        {
+            for ( ; node && !error; node = node->right)
+            {
+                if (node->type != EXP_TREE_OPERATOR || node->data.operatorNum != INSTR_END)
+                {
+                    return dualRunNode(runner, node);
+                }
+
+                error = dualRunNode(runner, node->left);
+            }
+
+            return error;
+        }
+
+        case ASSIGN:
+        {
+            if (!node->right || node->right->type != EXP_TREE_VARIABLE) return BAD_NODE_TYPE;
+
+            error = dualEvaluate(runner, node->left, &value);
+            if (error) return error;
+
+            runner->vars[node->right->data.variableNum] = value;
+            return TREE_NO_ERROR;
+        }
+
+        case IN:
+        {
+            if (!node->right || node->right->type != EXP_TREE_VARIABLE) return BAD_NODE_TYPE;
+
+            DualNumber *var = &runner->vars[node->right->data.variableNum];
+
+            dualConstant(var, runner->io->input(runner->io->context));
+            dualSeedInput(runner, var);
+
+            return TREE_NO_ERROR;
+        }
+
+        case OUT:
+        {
+            error = dualEvaluate(runner, node->right, &value);
+            if (error) return error;
+
+            runner->output(runner->outputContext, &value, dualSeededCount(runner));
+            return TREE_NO_ERROR;
+        }
+
+        case IF:
+        {
+            error = dualEvaluate(runner, node->left, &value);
+            if (error) return error;
+
+            if (programCondition(value.value)) return dualRunNode(runner, node->right);
+
+            return TREE_NO_ERROR;
+        }
+
+        case WHILE:
+        {
+            while (true)
+            {
+                error = dualEvaluate(runner, node->left, &value);
+                if (error) return error;
+
+                if (!programCondition(value.value)) return TREE_NO_ERROR;
+
+                error = dualRunNode(runner, node->right);
+                if (error) return error;
+            }
+        }
+
+        case ADD:    case SUB:
+        case MUL:    case DIV:
+        case LN:     case LOGAR:
+        case POW:    case SIN:
+        case COS:    case SQRT:
+        case BELOW:  case ABOVE:
+        case EQUAL:  case NOT_EQUAL:
+        case OPEN_F: case CLOSE_F:
+        case THEN:   case NEW_VAR:
+        case L_BRACKET: case R_BRACKET:
+        case NOT_OPER:
+        default:     LOG("ERROR: %s: operator %d is not a statement\n", __func__, node->data.operatorNum);
+                     return UNKNOWN_OPERATOR;
+    }
+}
+
+ExpTreeErrors dualEvaluate(DualRunner *runner, Node *node, DualNumber *result)
+{
+    assert(runner);
+    assert(result);
+    CHECK_POISON_PTR(node);
+
+    if (!node)
+    {
+        dualConstant(result, 0);
+        return TREE_NO_ERROR;
+    }
+
+    switch (node->type)
+    {
+        case EXP_TREE_NUMBER:   dualConstant(result, node->data.number);
+                                return TREE_NO_ERROR;
+
+        case EXP_TREE_VARIABLE: if (node->data.variableNum < 0 ||
+                                    node->data.variableNum >= runner->eval->names.count) return BAD_VAR_INDEX;
+
+                                *result = runner->vars[node->data.variableNum];
+                                return TREE_NO_ERROR;
+
+        case EXP_TREE_OPERATOR:
+        {
+            DualNumber left  = {};
+            DualNumber right = {};
+
+            ExpTreeErrors error = dualEvaluate(runner, node->left, &left);
+            if (!error)   error = dualEvaluate(runner, node->right, &right);
+            if (error) return error;
+
+            return dualCalculate(&left, &right, node->data.operatorNum, result);
+        }
+
+        case EXP_TREE_NOTHING:
+        case EXP_TREE_IDENTIF:
+        default:                return BAD_NODE_TYPE;
+    }
+}
+
+ExpTreeErrors dualCalculate(const DualNumber *left, const DualNumber *right,
+                            ExpTreeOperators oper, DualNumber *result)
+{
+    assert(left);
+    assert(right);
+    assert(result);
+
+    ExpTreeErrors error = TREE_NO_ERROR;
+
+    double a     = left->value;
+    double b     = right->value;
+    double value = NodeCalculate(a, b, oper, &error);
+    if (error) return error;
+
+    DualNumber derivative = {};
+    derivative.value = value;
+
+    switch (oper)
+    {
+        case ADD:       dualAddScaled(&derivative, left,   1);
+                        dualAddScaled(&derivative, right,  1);
+                        break;
+
+        case SUB:       dualAddScaled(&derivative, left,   1);
+                        dualAddScaled(&derivative, right, -1);
+                        break;
+
+        case MUL:       dualAddScaled(&derivative, left,  b);
+                        dualAddScaled(&derivative, right, a);
+                        break;
+
+        case DIV:       dualAddScaled(&derivative, left,  1 / b);
+                        dualAddScaled(&derivative, right, -value / b);
+                        break;
+
+        case LN:        dualScale(&derivative, right, 1 / b);
+                        break;
+
+        // log_a(b) = ln(b) / ln(a)
+        case LOGAR:     dualAddScaled(&derivative, right,  1 / (b * mathLn(a)));
+                        dualAddScaled(&derivative, left,  -value / (a * mathLn(a)));
+                        break;
+
+        // a constant exponent must not touch ln(a): (-2)^3 is fine
+        case POW:       dualAddScaled(&derivative, left, b * mathPow(a, b - 1));
+                        if (dualHasTangent(right)) dualAddScaled(&derivative, right, value * mathLn(a));
+                        break;
+
+        case SIN:       dualScale(&derivative, right,  mathCos(b));
+                        break;
+
+        case COS:       dualScale(&derivative, right, -mathSin(b));
+                        break;
+
+        case SQRT:      dualScale(&derivative, right, 0.5 / value);
+                        break;
+
+        // piecewise constant
+        case BELOW:     case ABOVE:
+        case EQUAL:     case NOT_EQUAL:
+                        break;
+
+        case L_BRACKET: case R_BRACKET:
+        case ASSIGN:    case IF:
+        case OPEN_F:    case CLOSE_F:
+        case INSTR_END: case WHILE:
+        case IN:        case OUT:
+        case THEN:      case NEW_VAR:
+        case NOT_OPER:
+        default:        return UNKNOWN_OPERATOR;
+    }
+
+    *result = derivative;
+
+    return TREE_NO_ERROR;
+}
+
+static void dualConstant(DualNumber *result, double value)
+{
+    assert(result);
+
+    result->value = value;
+    for (int i = 0; i < DualTangents; i++) result->tangent[i] = 0;
+}
+
+static void dualScale(DualNumber *result, const DualNumber *from, double factor)
+{
+    assert(result);
+    assert(from);
+
+    for (int i = 0; i < DualTangents; i++) result->tangent[i] = factor * from->tangent[i];
+}
+
+static void dualAddScaled(DualNumber *result, const DualNumber *from, double factor)
+{
+    assert(result);
+    assert(from);
+
+    for (int i = 0; i < DualTangents; i++) result->tangent[i] += factor * from->tangent[i];
+}
+
+static bool dualHasTangent(const DualNumber *number)
+{
+    assert(number);
+
+    for (int i = 0; i < DualTangents; i++)
+    {
+        if (fabs(number->tangent[i]) > 0) return true;
+    }
+
+    return false;
+}
+
+static void dualSeedInput(DualRunner *runner, DualNumber *number)
+{
+    assert(runner);
+    assert(number);
+
+    for (int i = 0; i < runner->tangents; i++)
+    {
+        if (runner->selected[i] == runner->inputsRead) number->tangent[i] = 1;
+    }
+
+    runner->inputsRead++;
+}
+
+// without an explicit selection only the inputs read so far get columns
+static int dualSeededCount(DualRunner *runner)
+{
+    assert(runner);
+
+    if (!runner->seedAll) return runner->tangents;
+
+    return runner->inputsRead < DualTangents ? runner->inputsRead : DualTangents;
+}
+
+void dualStdOutput(void *context, const DualNumber *value, int tangents)
+{
+    (void) context;
+    assert(value);
+
+    printf(ElemNumberFormat " |", value->value);
+
+    for (int i = 0; i < tangents; i++) printf(" " ElemNumberFormat, value->tangent[i]);
+
+    printf("\n");
+}
@@ -0,0 +1,46 @@
+#ifndef  __PROGRAM_DUAL_H__
+#define  __PROGRAM_DUAL_H__
+
+#include <stdio.h>
+
+#include "tree_of_expressions.h"
+#include "program_run.h"
+
+const int DualTangents = 8;
+
+struct DualNumber
+{
+    double value;
+    double tangent[DualTangents];
+};
+
+typedef void (*DualOutput)(void *context, const DualNumber *value, int tangents);
+
+struct DualRunner
+{
+    Evaluator  *eval;
+    ProgramIO  *io;
+
+    DualOutput  output;
+    void       *outputContext;
+
+    DualNumber  vars[NamesNumber];
+
+    int         selected[DualTangents];   // positions of the seeded vvedi reads
+    int         tangents;
+    bool        seedAll;                  // seed the first DualTangents reads
+    int         inputsRead;
+};
+
+int dualRunnerCtor(DualRunner *runner, Evaluator *eval, ProgramIO *io, const int *selected, int tangents);
+
+ExpTreeErrors dualRun     (DualRunner *runner);
+ExpTreeErrors dualRunNode (DualRunner *runner, Node *node);
+ExpTreeErrors dualEvaluate(DualRunner *runner, Node *node, DualNumber *result);
+
+ExpTreeErrors dualCalculate(const DualNumber *left, const DualNumber *right,
+                            ExpTreeOperators oper, DualNumber *result);
+
+void dualStdOutput(void *context, const DualNumber *value, int tangents);
+
+#endif //__PROGRAM_DUAL_H__
@@ -0,0 +1,389 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#include "tree_of_expressions.h"
+#include "html_logfile.h"
+#include "program_run.h"
+#include "jit_compiler.h"
+#include "thread_pool.h"
+#include "program_parallel.h"
+
+//-------------------------------------------------------------------------------------------------
+// The program is compiled once (jit, or the tree walker when jit isn't available), records are
+// read in windows of ParallelWindowRecords, every window is split into chunks that run as pool
+// tasks, and the chunk outputs are written back in input order before the next window is read.
+//-------------------------------------------------------------------------------------------------
+
+static int  parallelRunnerCtor(ParallelRunner *runner, Evaluator *eval, int workersCount);
+static int  parallelRunnerDtor(ParallelRunner *runner);
+
+static int  parallelReadWindow (ParallelRunner *runner, FILE *in, ParallelFormat format, int recordSize);
+static int  parallelAddRecord  (ParallelRunner *runner, const double *values, int count);
+static int  parallelRunWindow  (ParallelRunner *runner);
+static int  parallelWriteWindow(ParallelRunner *runner, FILE *out, ParallelFormat format, ParallelStats *stats);
+
+static void   parallelChunkRun(void *arg);
+static double parallelInput   (void *context);
+static void   parallelOutput  (void *context, double value);
+
+static double parallelTime(void);
+
+
+int programRunParallelFiles(Evaluator *eval, const char *inName, const char *outName,
+                            ParallelFormat format, int recordSize, int workersCount, ParallelStats *stats)
+{
+    assert(eval);
+    assert(inName);
+    assert(outName);
+
+    const char *inMode  = format == PARALLEL_BINARY ? "rb" : "r";
+    const char *outMode = format == PARALLEL_BINARY ? "wb" : "w";
+
+    FILE *in = fopen(inName, inMode);
+    if (!in) { printf("ERROR: couldn't open %s\n", inName); return EXIT_FAILURE; }
+
+    FILE *out = fopen(outName, outMode);
+    if (!out) { printf("ERROR: couldn't open %s\n", outName); fclose(in); return EXIT_FAILURE; }
+
+    int error = programRunParallel(eval, in, out, format, recordSize, workersCount, stats);
+
+    fclose(in);
+    fclose(out);
+
+    return error;
+}
+
+int programRunParallel(Evaluator *eval, FILE *in, FILE *out, ParallelFormat format,
+                       int recordSize, int workersCount, ParallelStats *stats)
+{
+    assert(eval);
+    assert(in);
+    assert(out);
+
+    if (format == PARALLEL_BINARY && recordSize <= 0) return EXIT_FAILURE;
+
+    ParallelStats  localStats = {};
+    if (!stats) stats = &localStats;
+    *stats = {};
+
+    double start = parallelTime();
+
+    ParallelRunner runner = {};
+    int error = parallelRunnerCtor(&runner, eval, workersCount);
+
+    while (!error)
+    {
+        error = parallelReadWindow(&runner, in, format, recordSize);
+        if (error || runner.recordsCount == 0) break;
+
+        error = parallelRunWindow(&runner);
+        if (!error) error = parallelWriteWindow(&runner, out, format, stats);
+    }
+
+    parallelRunnerDtor(&runner);
+
+    stats->seconds = parallelTime() - start;
+
+    LOG("parallel run: %d records (%d failed) in %lg s\n", stats->records, stats->failed, stats->seconds);
+    if (error) LOG("ERROR: %s: %d\n", __func__, error);
+
+    return error;
+}
+
+static int parallelRunnerCtor(ParallelRunner *runner, Evaluator *eval, int workersCount)
+{
+    assert(runner);
+    assert(eval);
+
+    runner->eval   = eval;
+    runner->useJit = jitCompile(eval, eval->tree.root, &runner->jit) == EXIT_SUCCESS;
+    if (!runner->useJit) LOG("parallel run: jit unavailable, using the tree evaluator\n");
+
+    int error = threadPoolCtor(&runner->pool, workersCount);
+    if (error) return error;
+
+    int storages = runner->pool.workersCount + 1;
+
+    runner->workerVars   = (double *)       calloc((size_t)storages * NamesNumber,    sizeof(double));
+    runner->workerEvals  = (Evaluator *)    calloc((size_t)storages,                  sizeof(Evaluator));
+    runner->recordStarts = (int *)          calloc((size_t)ParallelWindowRecords + 1, sizeof(int));
+    runner->chunks       = (ParallelChunk *)calloc((size_t)ParallelWindowRecords / ParallelChunkRecords + 1,
+                                                   sizeof(ParallelChunk));
+
+    if (!runner->workerVars || !runner->workerEvals || !runner->recordStarts || !runner->chunks) return MEMORY_ERROR;
+
+    for (int i = 0; i < storages && !runner->useJit; i++)
+    {
+        runner->workerEvals[i].tree.root = eval->tree.root;
+        nameTableCopy(&eval->names, &runner->workerEvals[i].names);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int parallelRunnerDtor(ParallelRunner *runner)
+{
+    assert(runner);
+
+    if (runner->pool.threads) threadPoolDtor(&runner->pool);
+    if (runner->useJit)       jitFunctionDtor(&runner->jit);
+
+    int storages = runner->pool.workersCount + 1;
+    for (int i = 0; runner->workerEvals && i < storages; i++) nameTableDtor(&runner->workerEvals[i].names);
+
+    int chunksCount = ParallelWindowRecords / ParallelChunkRecords + 1;
+    for (int i = 0; runner->chunks && i < chunksCount; i++)
+    {
+        free(runner->chunks[i].outputs);
+        free(runner->chunks[i].outputEnds);
+        free(runner->chunks[i].errors);
+    }
+
+    free(runner->workerVars);
+    free(runner->workerEvals);
+    free(runner->inputs);
+    free(runner->recordStarts);
+    free(runner->chunks);
+
+    *runner = {};
+
+    return EXIT_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+// reading
+//-------------------------------------------------------------------------------------------------
+
+static int parallelReadWindow(ParallelRunner *runner, FILE *in, ParallelFormat format, int recordSize)
+{
+    assert(runner);
+    assert(in);
+
+    runner->inputsCount  = 0;
+    runner->recordsCount = 0;
+
+    double values[ParallelRecordValues] = {};
+    char   line  [ParallelLineLength]   = "";
+
+    while (runner->recordsCount < ParallelWindowRecords)
+    {
+        int count = 0;
+
+        if (format == PARALLEL_BINARY)
+        {
+            if (recordSize > ParallelRecordValues) return EXIT_FAILURE;
+
+            count = (int)fread(values, sizeof(double), (size_t)recordSize, in);
+            if (count == 0) break;
+            if (count != recordSize) LOG("ERROR: %s: truncated last record\n", __func__);
+        }
+        else
+        {
+            if (!fgets(line, ParallelLineLength, in)) break;
+
+            char *position = line;
+            while (*position == ' ' || *position == '\t') position++;
+            if (*position == '#' || *position == '\n' || *position == '\r' || *position == '\0') continue;
+
+            while (count < ParallelRecordValues)
+            {
+                while (*position == ',' || *position == ';' || *position == ' ' || *position == '\t') position++;
+
+                char  *end   = NULL;
+                double value = strtod(position, &end);
+                if (end == position) break;
+
+                values[count++] = value;
+                position = end;
+            }
+        }
+
+        int error = parallelAddRecord(runner, values, count);
+        if (error) return error;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int parallelAddRecord(ParallelRunner *runner, const double *values, int count)
+{
+    assert(runner);
+    assert(values);
+
+    if (runner->inputsCount + count > runner->inputsCapacity)
+    {
+        int     capacity = (runner->inputsCapacity + count) * 2;
+        double *inputs   = (double *)realloc(runner->inputs, (size_t)capacity * sizeof(double));
+        if (!inputs) return MEMORY_ERROR;
+
+        runner->inputs         = inputs;
+        runner->inputsCapacity = capacity;
+    }
+
+    memcpy(runner->inputs + runner->inputsCount, values, (size_t)count * sizeof(double));
+
+    runner->recordStarts[runner->recordsCount] = runner->inputsCount;
+    runner->inputsCount += count;
+    runner->recordsCount++;
+    runner->recordStarts[runner->recordsCount] = runner->inputsCount;
+
+    return EXIT_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+// running
+//-------------------------------------------------------------------------------------------------
+
+static int parallelRunWindow(ParallelRunner *runner)
+{
+    assert(runner);
+
+    runner->chunksCount = 0;
+    int pending = 0;
+
+    for (int first = 0; first < runner->recordsCount; first += ParallelChunkRecords)
+    {
+        ParallelChunk *chunk = &runner->chunks[runner->chunksCount++];
+
+        chunk->runner       = runner;
+        chunk->first        = first;
+        chunk->count        = runner->recordsCount - first < ParallelChunkRecords ?
+                              runner->recordsCount - first : ParallelChunkRecords;
+        chunk->outputsCount = 0;
+
+        if (!chunk->outputEnds) chunk->outputEnds = (int *)calloc(ParallelChunkRecords, sizeof(int));
+        if (!chunk->errors)     chunk->errors     = (int *)calloc(ParallelChunkRecords, sizeof(int));
+        if (!chunk->outputEnds || !chunk->errors) return MEMORY_ERROR;
+
+        int error = threadPoolSubmit(&runner->pool, parallelChunkRun, chunk, &pending);
+        if (error) { threadPoolWait(&runner->pool, &pending); return error; }
+    }
+
+    return threadPoolWait(&runner->pool, &pending);
+}
+
+static void parallelChunkRun(void *arg)
+{
+    assert(arg);
+
+    ParallelChunk  *chunk  = (ParallelChunk *)arg;
+    ParallelRunner *runner = chunk->runner;
+
+    int        worker = threadPoolWorkerIndex(&runner->pool);
+    double    *vars   = runner->workerVars + worker * NamesNumber;
+    Evaluator *eval   = &runner->workerEvals[worker];
+
+    for (int i = 0; i < chunk->count; i++)
+    {
+        int record = chunk->first + i;
+
+        ParallelRecordIO recordIO = {};
+        recordIO.inputs      = runner->inputs + runner->recordStarts[record];
+        recordIO.inputsCount = runner->recordStarts[record + 1] - runner->recordStarts[record];
+        recordIO.chunk       = chunk;
+
+        ProgramIO io = {parallelInput, parallelOutput, &recordIO};
+
+        int error = EXIT_SUCCESS;
+
+        if (runner->useJit)
+        {
+            for (int j = 0; j < NamesNumber; j++) vars[j] = DefaultVarValue;
+
+            error = jitRun(&runner->jit, vars, &io);
+        }
+        else error = programRun(eval, &io);
+
+        chunk->errors[i]     = error ? error : recordIO.error;
+        chunk->outputEnds[i] = chunk->outputsCount;
+    }
+}
+
+static double parallelInput(void *context)
+{
+    assert(context);
+
+    ParallelRecordIO *recordIO = (ParallelRecordIO *)context;
+
+    if (recordIO->position >= recordIO->inputsCount) return DefaultVarValue;
+
+    return recordIO->inputs[recordIO->position++];
+}
+
+static void parallelOutput(void *context, double value)
+{
+    assert(context);
+
+    ParallelRecordIO *recordIO = (ParallelRecordIO *)context;
+    ParallelChunk    *chunk    = recordIO->chunk;
+
+    if (chunk->outputsCount == chunk->outputsCapacity)
+    {
+        int     capacity = chunk->outputsCapacity ? chunk->outputsCapacity * 2 : ParallelChunkRecords;
+        double *outputs  = (double *)realloc(chunk->outputs, (size_t)capacity * sizeof(double));
+        if (!outputs) { recordIO->error = MEMORY_ERROR; return; }
+
+        chunk->outputs         = outputs;
+        chunk->outputsCapacity = capacity;
+    }
+
+    chunk->outputs[chunk->outputsCount++] = value;
+}
+
+//-------------------------------------------------------------------------------------------------
+// writing
+//-------------------------------------------------------------------------------------------------
+
+static int parallelWriteWindow(ParallelRunner *runner, FILE *out, ParallelFormat format, ParallelStats *stats)
+{
+    assert(runner);
+    assert(out);
+    assert(stats);
+
+    for (int c = 0; c < runner->chunksCount; c++)
+    {
+        ParallelChunk *chunk = &runner->chunks[c];
+        int begin = 0;
+
+        for (int i = 0; i < chunk->count; i++)
+        {
+            int end   = chunk->outputEnds[i];
+            int error = chunk->errors[i];
+
+            stats->records++;
+            if (error) stats->failed++;
+
+            if (format == PARALLEL_BINARY)
+            {
+                double header = error ? error : end - begin;
+                fwrite(&header, sizeof(double), 1, out);
+                fwrite(chunk->outputs + begin, sizeof(double), (size_t)(end - begin), out);
+            }
+            else
+            {
+                for (int j = begin; j < end; j++)
+                {
+                    fprintf(out, j == begin ? ElemNumberFormat : "," ElemNumberFormat, chunk->outputs[j]);
+                }
+
+                if (error) fprintf(out, begin == end ? "ERROR %d" : ",ERROR %d", error);
+                fputc('\n', out);
+            }
+
+            begin = end;
+        }
+    }
+
+    return ferror(out) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static double parallelTime(void)
+{
+    timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
@@ -0,0 +1,91 @@
+#ifndef  __PROGRAM_PARALLEL_H__
+#define  __PROGRAM_PARALLEL_H__
+
+#include <stdio.h>
+
+#include "tree_of_expressions.h"
+#include "program_run.h"
+#include "jit_compiler.h"
+#include "thread_pool.h"
+
+//-------------------------------------------------------------------------------------------------
+// Input records:  csv    - one record per line, numbers separated by commas or spaces
+//                 binary - recordSize raw doubles per record
+// Output records: csv    - the record outputs separated by commas, "ERROR <code>" on failure
+//                 binary - a double with the outputs count (the error code if negative),
+//                          followed by the outputs
+//-------------------------------------------------------------------------------------------------
+
+enum ParallelFormat
+{
+    PARALLEL_CSV    = 0,
+    PARALLEL_BINARY = 1,
+};
+
+const int ParallelWindowRecords = 65536;
+const int ParallelChunkRecords  = 256;
+const int ParallelLineLength    = 4096;
+const int ParallelRecordValues  = 256;
+
+struct ParallelRunner;
+
+struct ParallelChunk
+{
+    ParallelRunner *runner;
+    int             first;
+    int             count;
+
+    double         *outputs;
+    int             outputsCount;
+    int             outputsCapacity;
+
+    int            *outputEnds;
+    int            *errors;
+};
+
+struct ParallelRecordIO
+{
+    const double  *inputs;
+    int            inputsCount;
+    int            position;
+
+    ParallelChunk *chunk;
+    int            error;
+};
+
+struct ParallelStats
+{
+    int    records;
+    int    failed;
+    double seconds;
+};
+
+struct ParallelRunner
+{
+    Evaluator     *eval;
+
+    JitFunction    jit;
+    bool           useJit;
+
+    ThreadPool     pool;
+    double        *workerVars;
+    Evaluator     *workerEvals;
+
+    double        *inputs;
+    int            inputsCount;
+    int            inputsCapacity;
+
+    int           *recordStarts;
+    int            recordsCount;
+
+    ParallelChunk *chunks;
+    int            chunksCount;
+};
+
+int programRunParallel(Evaluator *eval, FILE *in, FILE *out, ParallelFormat format,
+                       int recordSize, int workersCount, ParallelStats *stats);
+
+int programRunParallelFiles(Evaluator *eval, const char *inName, const char *outName,
+                            ParallelFormat format, int recordSize, int workersCount, ParallelStats *stats);
+
+#endif //__PROGRAM_PARALLEL_H__
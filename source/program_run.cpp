@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "tree_of_expressions.h"
+#include "html_logfile.h"
+#include "program_run.h"
+
+#define CHECK_POISON_PTR(ptr) \
+    if (ptr == PtrPoison)     \
+    {                         \
+        LOG("ERROR: PoisonPtr detected in %s(%d) %s\n", __FILE__, __LINE__, __func__);\
+        return BAD_NODE_TYPE;                                                            \
+    }
+
+static double programStdInput (void *context);
+static void   programStdOutput(void *context, double value);
+
+static double programFixedInput (void *context);
+static void   programFixedOutput(void *context, double value);
+
+
+int programIOStdCtor(ProgramIO *io)
+{
+    assert(io);
+
+    io->input   = programStdInput;
+    io->output  = programStdOutput;
+    io->context = NULL;
+
+    return EXIT_SUCCESS;
+}
+
+int programIOFixedCtor(ProgramIO *io, ProgramFixedInput *fixed, const double *values, int count)
+{
+    assert(io);
+    assert(fixed);
+
+    fixed->values      = values;
+    fixed->count       = count;
+    fixed->position    = 0;
+    fixed->outputSum   = 0;
+    fixed->outputCount = 0;
+
+    io->input   = programFixedInput;
+    io->output  = programFixedOutput;
+    io->context = fixed;
+
+    return EXIT_SUCCESS;
+}
+
+static double programStdInput(void *context)
+{
+    (void) context;
+
+    double value = DefaultVarValue;
+    if (scanf("%lg", &value) != 1) LOG("ERROR: couldn't read input value\n");
+
+    return value;
+}
+
+static void programStdOutput(void *context, double value)
+{
+    (void) context;
+
+    printf(ElemNumberFormat "\n", value);
+}
+
+static double programFixedInput(void *context)
+{
+    ProgramFixedInput *fixed = (ProgramFixedInput *)context;
+    assert(fixed);
+
+    if (fixed->count <= 0) return DefaultVarValue;
+
+    double value = fixed->values[fixed->position % fixed->count];
+    fixed->position++;
+
+    return value;
+}
+
+static void programFixedOutput(void *context, double value)
+{
+    ProgramFixedInput *fixed = (ProgramFixedInput *)context;
+    assert(fixed);
+
+    fixed->outputSum += value;
+    fixed->outputCount++;
+}
+
+ExpTreeErrors programRun(Evaluator *eval, ProgramIO *io)
+{
+    assert(eval);
+    assert(io);
+
+    double savedValues[NamesNumber] = {};
+
+    for (int i = 0; i < eval->names.count; i++)
+    {
+        savedValues[i] = eval->names.table[i].value;
+        eval->names.table[i].value = DefaultVarValue;
+    }
+
+    ExpTreeErrors error = programRunNode(eval, eval->tree.root, io);
+
+    for (int i = 0; i < eval->names.count; i++)
+    {
+        eval->names.table[i].value = savedValues[i];
+    }
+
+    return error;
+}
+
+ExpTreeErrors programRunNode(Evaluator *eval, Node *node, ProgramIO *io)
+{
+    assert(eval);
+    assert(io);
+    CHECK_POISON_PTR(node);
+
+    if (!node) return TREE_NO_ERROR;
+
+    if (node->type != EXP_TREE_OPERATOR) return BAD_NODE_TYPE;
+
+    ExpTreeErrors error = TREE_NO_ERROR;
+
+    switch (node->data.operatorNum)
+    {
+        case INSTR_END:
+        {
+            for ( ; node && !error; node = node->right)
+            {
+                if (node->type != EXP_TREE_OPERATOR || node->data.operatorNum != INSTR_END)
+                {
+                    return programRunNode(eval, node, io);
+                }
+
+                error = programRunNode(eval, node->left, io);
+            }
+
+            return error;
+        }
+
+        case ASSIGN:
+        {
+            if (!node->right || node->right->type != EXP_TREE_VARIABLE) return BAD_NODE_TYPE;
+
+            double value = expTreeEvaluate(eval, node->left, &error);
+            if (error) return error;
+
+            eval->names.table[node->right->data.variableNum].value = value;
+            return TREE_NO_ERROR;
+        }
+
+        case IN:
+        {
+            if (!node->right || node->right->type != EXP_TREE_VARIABLE) return BAD_NODE_TYPE;
+
+            eval->names.table[node->right->data.variableNum].value = io->input(io->context);
+            return TREE_NO_ERROR;
+        }
+
+        case OUT:
+        {
+            double value = expTreeEvaluate(eval, node->right, &error);
+            if (error) return error;
+
+            io->output(io->context, value);
+            return TREE_NO_ERROR;
+        }
+
+        case IF:
+        {
+            double condition = expTreeEvaluate(eval, node->left, &error);
+            if (error) return error;
+
+            if (programCondition(condition)) return programRunNode(eval, node->right, io);
+
+            return TREE_NO_ERROR;
+        }
+
+        case WHILE:
+        {
+            while (true)
+            {
+                double condition = expTreeEvaluate(eval, node->left, &error);
+                if (error) return error;
+
+                if (!programCondition(condition)) return TREE_NO_ERROR;
+
+                error = programRunNode(eval, node->right, io);
+                if (error) return error;
+            }
+        }
+
+        case ADD:    case SUB:
+        case MUL:    case DIV:
+        case LN:     case LOGAR:
+        case POW:    case SIN:
+        case COS:    case SQRT:
+        case BELOW:  case ABOVE:
+        case EQUAL:  case NOT_EQUAL:
+        case OPEN_F: case CLOSE_F:
+        case THEN:   case NEW_VAR:
+        case L_BRACKET: case R_BRACKET:
+        case NOT_OPER:
+        default:     LOG("ERROR: %s: operator %d is not a statement\n", __func__, node->data.operatorNum);
+                     return UNKNOWN_OPERATOR;
+    }
+}
+
+bool programCondition(double value)
+{
+    return !equalDouble(value, 0);
+}
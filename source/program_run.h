@@ -0,0 +1,36 @@
+#ifndef  __PROGRAM_RUN_H__
+#define  __PROGRAM_RUN_H__
+
+#include <stdio.h>
+
+#include "tree_of_expressions.h"
+
+typedef double (*ProgramInput) (void *context);
+typedef void   (*ProgramOutput)(void *context, double value);
+
+struct ProgramIO
+{
+    ProgramInput  input;
+    ProgramOutput output;
+    void         *context;
+};
+
+struct ProgramFixedInput
+{
+    const double *values;
+    int           count;
+    int           position;
+
+    double        outputSum;
+    int           outputCount;
+};
+
+int programIOStdCtor  (ProgramIO *io);
+int programIOFixedCtor(ProgramIO *io, ProgramFixedInput *fixed, const double *values, int count);
+
+ExpTreeErrors programRun    (Evaluator *eval, ProgramIO *io);
+ExpTreeErrors programRunNode(Evaluator *eval, Node *node, ProgramIO *io);
+
+bool programCondition(double value);
+
+#endif //__PROGRAM_RUN_H__
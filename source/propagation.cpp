@@ -0,0 +1,260 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "tree_of_expressions.h"
+#include "html_logfile.h"
+#include "program_run.h"
+#include "tree_simplify.h"
+#include "propagation.h"
+
+#define CHECK_POISON_PTR(ptr) \
+    if (ptr == PtrPoison)     \
+    {                         \
+        LOG("ERROR: PoisonPtr detected in %s(%d) %s\n", __FILE__, __LINE__, __func__);\
+        return 0;                                                                     \
+    }
+
+//-------------------------------------------------------------------------------------------------
+// Constant and copy propagation, a forward dataflow pass over the statements. Every variable
+// starts as the constant DefaultVarValue, as all the backends start it. An assignment of a
+// number makes its variable a constant, an assignment of another variable makes it a copy of
+// that one, anything else and vvedi make it unknown, and so do all the copies of a variable
+// that is assigned. Every expression gets the known values substituted and is folded again
+// before the statement is looked at, so constants carry on through computations.
+// koli: the state after it is the merge of the states with and without the body (unless the
+// condition is a known number now), what differs becomes unknown. pokuda: everything its loop
+// assigns is unknown from the condition on, through the body and after the loop.
+//-------------------------------------------------------------------------------------------------
+
+#define IS_OPER(node, oper) ((node) && (node)->type == EXP_TREE_OPERATOR && (node)->data.operatorNum == (oper))
+#define SAME_NUMBER(a, b)   (!((a) < (b)) && !((a) > (b)))
+
+static int  propagateStatement (Evaluator *eval, Node *stmt, PropagationState *state);
+static int  propagateExpression(Evaluator *eval, Node *node, PropagationState *state);
+static int  propagateSubstitute(Node *node, PropagationState *state);
+
+static void propagateKill (PropagationState *state, int var);
+static void propagateMerge(PropagationState *state, const PropagationState *other);
+
+static unsigned propagateAssigned(Node *node);
+
+
+int propagateConstants(Evaluator *eval, Node *root)
+{
+    assert(eval);
+    CHECK_POISON_PTR(root);
+
+    PropagationState state = {};
+
+    for (int i = 0; i < NamesNumber; i++)
+    {
+        state.vars[i].kind   = PROP_CONST;
+        state.vars[i].number = DefaultVarValue;
+    }
+
+    int substituted = propagateStatement(eval, root, &state);
+
+    LOG("%s: %d uses substituted\n", __func__, substituted);
+
+    return substituted;
+}
+
+static int propagateStatement(Evaluator *eval, Node *stmt, PropagationState *state)
+{
+    assert(eval);
+    assert(state);
+
+    if (!stmt || stmt->type != EXP_TREE_OPERATOR) return 0;
+
+    int count = 0;
+
+    switch (stmt->data.operatorNum)
+    {
+        case INSTR_END:
+        {
+            for (Node *item = stmt; item; item = item->right)
+            {
+                if (!IS_OPER(item, INSTR_END)) return count + propagateStatement(eval, item, state);
+
+                count += propagateStatement(eval, item->left, state);
+            }
+
+            return count;
+        }
+
+        case ASSIGN:
+        {
+            if (!stmt->right || stmt->right->type != EXP_TREE_VARIABLE) return 0;
+
+            count = propagateExpression(eval, stmt->left, state);
+
+            int   var   = stmt->right->data.variableNum;
+            Node *value = stmt->left;
+
+            if (var < 0 || var >= NamesNumber) return count;
+
+            // x = x changes nothing
+            if (value && value->type == EXP_TREE_VARIABLE && value->data.variableNum == var) return count;
+
+            propagateKill(state, var);
+
+            if (value && value->type == EXP_TREE_NUMBER)
+            {
+                state->vars[var].kind   = PROP_CONST;
+                state->vars[var].number = value->data.number;
+            }
+            else if (value && value->type == EXP_TREE_VARIABLE)
+            {
+                state->vars[var].kind   = PROP_COPY;
+                state->vars[var].copyOf = value->data.variableNum;
+            }
+
+            return count;
+        }
+
+        case IN:
+        {
+            if (stmt->right && stmt->right->type == EXP_TREE_VARIABLE &&
+                0 <= stmt->right->data.variableNum && stmt->right->data.variableNum < NamesNumber)
+            {
+                propagateKill(state, stmt->right->data.variableNum);
+            }
+
+            return 0;
+        }
+
+        case OUT:   return propagateExpression(eval, stmt->right, state);
+
+        case IF:
+        {
+            count = propagateExpression(eval, stmt->left, state);
+
+            if (stmt->left && stmt->left->type == EXP_TREE_NUMBER)
+            {
+                // the body is dead code, left for deadCodeEliminate
+                if (!programCondition(stmt->left->data.number)) return count;
+
+                return count + propagateStatement(eval, stmt->right, state);
+            }
+
+            PropagationState body = *state;
+            count += propagateStatement(eval, stmt->right, &body);
+
+            propagateMerge(state, &body);
+
+            return count;
+        }
+
+        case WHILE:
+        {
+            unsigned assigned = propagateAssigned(stmt);
+
+            for (int i = 0; i < NamesNumber; i++) if (assigned & (1u << i)) propagateKill(state, i);
+
+            count = propagateExpression(eval, stmt->left, state);
+
+            PropagationState body = *state;
+            count += propagateStatement(eval, stmt->right, &body);
+
+            return count;
+        }
+
+        case NOT_OPER:  case ADD:       case SUB:       case MUL:
+        case DIV:       case LN:        case LOGAR:     case POW:
+        case SIN:       case COS:       case R_BRACKET: case L_BRACKET:
+        case BELOW:     case ABOVE:     case OPEN_F:    case CLOSE_F:
+        case THEN:      case EQUAL:     case NOT_EQUAL: case SQRT:
+        case NEW_VAR:
+        default:    return 0;
+    }
+}
+
+// substitutes and folds node in place
+static int propagateExpression(Evaluator *eval, Node *node, PropagationState *state)
+{
+    assert(eval);
+    assert(state);
+
+    if (!node) return 0;
+
+    int count = propagateSubstitute(node, state);
+    if (count) expTreeSimplifyFold(eval, node);
+
+    return count;
+}
+
+static int propagateSubstitute(Node *node, PropagationState *state)
+{
+    assert(state);
+
+    if (!node || node == PtrPoison) return 0;
+
+    if (node->type == EXP_TREE_VARIABLE)
+    {
+        int var = node->data.variableNum;
+        if (var < 0 || var >= NamesNumber) return 0;
+
+        PropagationValue *value = &state->vars[var];
+
+        if (value->kind == PROP_CONST)
+        {
+            node->type = EXP_TREE_NUMBER;
+            node->data = createNodeData(EXP_TREE_NUMBER, value->number);
+            return 1;
+        }
+
+        if (value->kind == PROP_COPY)
+        {
+            node->data.variableNum = value->copyOf;
+            return 1;
+        }
+
+        return 0;
+    }
+
+    return propagateSubstitute(node->left, state) + propagateSubstitute(node->right, state);
+}
+
+static void propagateKill(PropagationState *state, int var)
+{
+    assert(state);
+
+    state->vars[var].kind = PROP_UNKNOWN;
+
+    for (int i = 0; i < NamesNumber; i++)
+    {
+        if (state->vars[i].kind == PROP_COPY && state->vars[i].copyOf == var) state->vars[i].kind = PROP_UNKNOWN;
+    }
+}
+
+static void propagateMerge(PropagationState *state, const PropagationState *other)
+{
+    assert(state);
+    assert(other);
+
+    for (int i = 0; i < NamesNumber; i++)
+    {
+        const PropagationValue *a = &state->vars[i];
+        const PropagationValue *b = &other->vars[i];
+
+        bool same = a->kind == b->kind &&
+                    (a->kind != PROP_CONST || SAME_NUMBER(a->number, b->number)) &&
+                    (a->kind != PROP_COPY  || a->copyOf == b->copyOf);
+
+        if (!same) state->vars[i].kind = PROP_UNKNOWN;
+    }
+}
+
+// variables that the statements in node assign
+static unsigned propagateAssigned(Node *node)
+{
+    if (!node || node == PtrPoison || node->type != EXP_TREE_OPERATOR) return 0;
+
+    if ((IS_OPER(node, ASSIGN) || IS_OPER(node, IN)) && node->right && node->right->type == EXP_TREE_VARIABLE)
+    {
+        return 1u << node->right->data.variableNum;
+    }
+
+    return propagateAssigned(node->left) | propagateAssigned(node->right);
+}
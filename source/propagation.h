@@ -0,0 +1,28 @@
+#ifndef  __PROPAGATION_H__
+#define  __PROPAGATION_H__
+
+#include "tree_of_expressions.h"
+
+enum PropagationKind
+{
+    PROP_UNKNOWN = 0,
+    PROP_CONST   = 1,
+    PROP_COPY    = 2,
+};
+
+struct PropagationValue
+{
+    PropagationKind kind;
+    double          number;     // PROP_CONST
+    int             copyOf;     // PROP_COPY: the variable it holds the value of
+};
+
+// what is known about every variable at one point of the program
+struct PropagationState
+{
+    PropagationValue vars[NamesNumber];
+};
+
+int propagateConstants(Evaluator *eval, Node *root);
+
+#endif //__PROPAGATION_H__
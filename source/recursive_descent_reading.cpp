@@ -14,7 +14,7 @@
 
 #define syntax_assert(exp) if (!(exp))                                 \
     {                                                                  \
-        printf("SYNTAX_ERROR: %s\n", #exp);                            \
+        fprintf(stderr, "SYNTAX_ERROR: %s\n", #exp);                   \
         fprintf(LogFile, "function throwing s_error: %s\n", __func__); \
         syntaxError(&tokenArray[*arrPosition], *arrPosition);          \
         return NULL;                                                   \
@@ -32,16 +32,6 @@
 
 #define NUM_NODE(value)  NEW_NODE(EXP_TREE_NUMBER, value, NULL, NULL)
 
-#define cL     copy      (eval, node->left)
-#define cR     copy      (eval, node->right)
-#define cN     copy      (eval, node)
-
-#define dL_W     derivative(eval, node->left,  writeToTex)
-#define dR_W     derivative(eval, node->right, writeToTex)
-
-#define dL       derivative(eval, node->left)
-#define dR       derivative(eval, node->right)
-
 #define _ADD(left, right) NEW_NODE(EXP_TREE_OPERATOR, ADD,  left, right)
 
 #define _SUB(left, right) NEW_NODE(EXP_TREE_OPERATOR, SUB,  left, right)
@@ -397,6 +387,58 @@ Node *getG(Evaluator *eval, const char *str)
     return val;
 }
 
+// the getters leave NULL for a missing operand and PtrPoison after an error
+static bool formulaIsComplete(Node *node)
+{
+    if (node == PtrPoison) return false;
+    if (!node)             return false;
+
+    if (node->type != EXP_TREE_OPERATOR) return true;
+
+    bool unary = expTreeOperatorPriority(node->data.operatorNum) == PR_UNARY && node->data.operatorNum != LOGAR;
+
+    if (!unary && !formulaIsComplete(node->left)) return false;
+
+    return formulaIsComplete(node->right);
+}
+
+// a single expression without perem: every identifier becomes a variable
+Node *getFormula(Evaluator *eval, const char *str)
+{
+    assert(eval);
+    assert(str);
+
+    Token *tokenArray = createTokenArray(eval, str);
+    if (!tokenArray) return PtrPoison;
+
+    for (int i = 0; tokenArray[i].type != EXP_TREE_NOTHING; i++)
+    {
+        if (tokenArray[i].type == EXP_TREE_IDENTIF && tokenArray[i].data.idNum == IndexPoison)
+        {
+            LOG("ERROR: %s: more than %d variables\n", __func__, NamesNumber);
+            free(tokenArray);
+            return PtrPoison;
+        }
+    }
+
+    for (int i = 0; i < eval->names.count; i++) eval->names.table[i].value = EXP_TREE_VARIABLE;
+
+    int arrPosition = 0;
+
+    Node *val = getB(eval, tokenArray, &arrPosition);
+
+    if (!formulaIsComplete(val) || tokenArray[arrPosition].type != EXP_TREE_NOTHING)
+    {
+        syntaxError(tokenArray + arrPosition, arrPosition);
+        subTreeDtor(val);
+        val = PtrPoison;
+    }
+
+    free(tokenArray);
+
+    return val;
+}
+
 #define SYNTAX_ERROR                                          \
     {                                                         \
         fprintf(LogFile, "function throwing s_error: %s\n", __func__); \
@@ -407,8 +449,9 @@ Node *getG(Evaluator *eval, const char *str)
 #define TOKEN_IS_NUM  (tokenArray[*arrPosition].type == EXP_TREE_NUMBER)
 #define TOKEN_IS_OPER (tokenArray[*arrPosition].type == EXP_TREE_OPERATOR)
 #define TOKEN_IS_NULL (tokenArray[*arrPosition].type == EXP_TREE_NOTHING)
-#define TOKEN_IS_VAR  ((int)eval->names.table[tokenArray[*arrPosition].data.variableNum].value == EXP_TREE_VARIABLE)
 #define TOKEN_IS_ID   (tokenArray[*arrPosition].type == EXP_TREE_IDENTIF)
+#define TOKEN_IS_VAR  (TOKEN_IS_ID && \
+                       (int)eval->names.table[tokenArray[*arrPosition].data.variableNum].value == EXP_TREE_VARIABLE)
 
 #define TOKEN_IS(oper) (tokenArray[*arrPosition].data.operatorNum == oper)
 
@@ -424,6 +467,8 @@ Node *getOp(Evaluator *eval, Token *tokenArray, int *arrPosition)
 
     Node *val = NULL;
 
+    int line = tokenArray[*arrPosition].line + 1;
+
     if (TOKEN_IS_OPER && TOKEN_IS(OPEN_F))
     {
         (*arrPosition)++;
@@ -439,12 +484,15 @@ Node *getOp(Evaluator *eval, Token *tokenArray, int *arrPosition)
     if (val) return val;
 
     val = getIfWhile(eval, tokenArray, arrPosition);
+    if (val && val != PtrPoison) val->line = line;
     if (val) return val;
 
     val = getInOut(eval, tokenArray, arrPosition);
+    if (val && val != PtrPoison) val->line = line;
     if (val) return val;
 
     val = getA(eval, tokenArray, arrPosition);
+    if (val && val != PtrPoison) val->line = line;
     if (val) return val;
 
     SYNTAX_ERROR;
@@ -40,6 +40,8 @@ int printTokenArray(Token *tokenArray, FILE *f);
 
 Node *getG(Evaluator *eval, const char *str);
 
+Node *getFormula(Evaluator *eval, const char *str);
+
 Node *getIfWhile(Evaluator *eval, Token *tokenArray, int *arrPosition);
 
 Node *getInOut  (Evaluator *eval, Token *tokenArray, int *arrPosition);
@@ -0,0 +1,510 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "tree_of_expressions.h"
+#include "html_logfile.h"
+#include "simplify_rules.h"
+
+//-------------------------------------------------------------------------------------------------
+// The patterns are compiled into a discrimination tree: every pattern is a path of keys in
+// prefix order, and the edges out of a trie node are indexed by operator, so a node is matched
+// against all the rules at once in a single walk over its top few levels. A wildcard edge skips
+// a whole subtree of the subject. Repeated letters and guards are checked only for the rules
+// that reach the end of their path; among those the one listed first in the table wins.
+//-------------------------------------------------------------------------------------------------
+
+const int RuleWordLength = 16;
+
+struct RuleOperatorName
+{
+    const char       *name;
+    ExpTreeOperators  oper;
+};
+
+static const RuleOperatorName RuleOperatorNames[] =
+{
+    {"+",  ADD}, {"-",   SUB},   {"*",   MUL}, {"/",   DIV},  {"^",    POW},
+    {"ln", LN},  {"log", LOGAR}, {"sin", SIN}, {"cos", COS},  {"sqrt", SQRT},
+};
+
+const int RuleOperatorNamesCount = (int)(sizeof(RuleOperatorNames) / sizeof(RuleOperatorNames[0]));
+
+struct RuleMatcher
+{
+    RuleSet *set;
+
+    Node   **pending[RuleMaxKeys];       // child slots still to match, the next one on top
+    int      pendingCount;
+
+    Node   **wildcards[RuleMaxKeys];     // slots the wildcards of the current path took
+    int      wildcardsCount;
+
+    int      best;
+    Node   **captures[RuleSlots];
+};
+
+static int ruleParse      (const char *text, RuleKey *keys, int *count);
+static int ruleOperator   (const char *word);
+static int ruleCompile    (RuleSet *set, int index);
+static int ruleTrieAdd    (RuleSet *set);
+static int ruleTrieFind   (RuleTrieNode *node, RuleKey *key);
+static int ruleTrieEdge   (RuleSet *set, int trie, RuleKey *key);
+
+static void ruleMatch     (RuleMatcher *matcher, int trie);
+static void ruleMatchEnd  (RuleMatcher *matcher, RuleTrieNode *trie);
+
+static Node *ruleBuild(CompiledRule *rule, int *position, Node **taken, bool *used);
+static Node *ruleCopy (Node *node);
+
+
+int ruleSetCtor(RuleSet *set, const SimplifyRule *rules, int rulesCount)
+{
+    assert(set);
+    assert(rules);
+
+    *set = {};
+
+    set->source     = rules;
+    set->rulesCount = rulesCount;
+    set->rules      = (CompiledRule *)calloc((size_t)rulesCount, sizeof(CompiledRule));
+    if (!set->rules) return MEMORY_ERROR;
+
+    if (ruleTrieAdd(set) == IndexPoison) return MEMORY_ERROR;
+
+    for (int i = 0; i < rulesCount; i++)
+    {
+        int error = ruleCompile(set, i);
+        if (error)
+        {
+            LOG("ERROR: %s: bad rule \"%s\" -> \"%s\"\n", __func__, rules[i].pattern, rules[i].result);
+            ruleSetDtor(set);
+            return error;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int ruleSetDtor(RuleSet *set)
+{
+    assert(set);
+
+    free(set->rules);
+    free(set->trie);
+
+    *set = {};
+
+    return EXIT_SUCCESS;
+}
+
+static int ruleOperator(const char *word)
+{
+    assert(word);
+
+    for (int i = 0; i < RuleOperatorNamesCount; i++)
+    {
+        if (strcmp(word, RuleOperatorNames[i].name) == 0) return RuleOperatorNames[i].oper;
+    }
+
+    return NOT_OPER;
+}
+
+static int ruleParse(const char *text, RuleKey *keys, int *count)
+{
+    assert(text);
+    assert(keys);
+    assert(count);
+
+    char word[RuleWordLength] = "";
+    int  shift  = 0;
+    int  needed = 1;      // subtrees still to read
+
+    *count = 0;
+
+    while (sscanf(text, "%15s%n", word, &shift) == 1)
+    {
+        text += shift;
+
+        if (*count == RuleMaxKeys || needed == 0) return EXIT_FAILURE;
+
+        RuleKey key = {};
+        int     oper = ruleOperator(word);
+
+        if (strcmp(word, "_") == 0)
+        {
+            key.type = RULE_KEY_EMPTY;
+        }
+        else if (word[1] == '\0' && 'x' <= word[0] && word[0] <= 'z')
+        {
+            key.type = RULE_KEY_ANY;
+            key.slot = word[0] - 'x';
+        }
+        else if (oper != NOT_OPER)
+        {
+            key.type = RULE_KEY_OPER;
+            key.oper = oper;
+            needed  += 2;
+        }
+        else
+        {
+            char *end = NULL;
+            key.type   = RULE_KEY_NUMBER;
+            key.number = strtod(word, &end);
+            if (*end != '\0') return EXIT_FAILURE;
+        }
+
+        needed--;
+        keys[(*count)++] = key;
+    }
+
+    return needed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int ruleCompile(RuleSet *set, int index)
+{
+    assert(set);
+
+    const SimplifyRule *source = &set->source[index];
+    CompiledRule       *rule   = &set->rules[index];
+
+    RuleKey pattern[RuleMaxKeys] = {};
+    int     patternCount = 0;
+
+    if (ruleParse(source->pattern, pattern,      &patternCount))      return EXIT_FAILURE;
+    if (ruleParse(source->result,  rule->result, &rule->resultCount)) return EXIT_FAILURE;
+
+    if (pattern[0].type != RULE_KEY_OPER) return EXIT_FAILURE;
+
+    rule->guard = source->guard;
+
+    bool bound[RuleSlots] = {};
+    int  trie = 0;
+
+    for (int i = 0; i < patternCount; i++)
+    {
+        if (pattern[i].type == RULE_KEY_ANY)
+        {
+            rule->wildcardSlots[rule->wildcardsCount++] = pattern[i].slot;
+            bound[pattern[i].slot] = true;
+        }
+
+        trie = ruleTrieEdge(set, trie, &pattern[i]);
+        if (trie == IndexPoison) return MEMORY_ERROR;
+    }
+
+    for (int i = 0; i < rule->resultCount; i++)
+    {
+        if (rule->result[i].type == RULE_KEY_ANY && !bound[rule->result[i].slot]) return EXIT_FAILURE;
+    }
+
+    if (rule->guard && !bound[0]) return EXIT_FAILURE;
+
+    RuleTrieNode *end = &set->trie[trie];
+    if (end->rulesCount == RuleTrieRules) return EXIT_FAILURE;
+
+    end->rules[end->rulesCount++] = index;
+
+    return EXIT_SUCCESS;
+}
+
+static int ruleTrieAdd(RuleSet *set)
+{
+    assert(set);
+
+    if (set->trieCount == set->trieCapacity)
+    {
+        int           capacity = set->trieCapacity ? set->trieCapacity * 2 : 32;
+        RuleTrieNode *trie     = (RuleTrieNode *)realloc(set->trie, (size_t)capacity * sizeof(RuleTrieNode));
+        if (!trie) return IndexPoison;
+
+        set->trie         = trie;
+        set->trieCapacity = capacity;
+    }
+
+    RuleTrieNode *node = &set->trie[set->trieCount];
+    *node = {};
+
+    for (int i = 0; i < RuleOperators;   i++) node->operEdges[i]   = IndexPoison;
+    for (int i = 0; i < RuleTrieNumbers; i++) node->numberEdges[i] = IndexPoison;
+
+    node->anyEdge   = IndexPoison;
+    node->emptyEdge = IndexPoison;
+
+    return set->trieCount++;
+}
+
+static int ruleTrieFind(RuleTrieNode *node, RuleKey *key)
+{
+    assert(node);
+    assert(key);
+
+    switch (key->type)
+    {
+        case RULE_KEY_OPER:     return node->operEdges[key->oper];
+        case RULE_KEY_ANY:      return node->anyEdge;
+        case RULE_KEY_EMPTY:    return node->emptyEdge;
+
+        case RULE_KEY_NUMBER:
+        {
+            for (int i = 0; i < node->numbersCount; i++)
+            {
+                if (equalDouble(node->numbers[i], key->number)) return node->numberEdges[i];
+            }
+
+            return IndexPoison;
+        }
+
+        default:                return IndexPoison;
+    }
+}
+
+// follows the edge for the key, adding it if needed
+static int ruleTrieEdge(RuleSet *set, int trie, RuleKey *key)
+{
+    assert(set);
+    assert(key);
+
+    int next = ruleTrieFind(&set->trie[trie], key);
+    if (next != IndexPoison) return next;
+
+    if (key->type == RULE_KEY_NUMBER && set->trie[trie].numbersCount == RuleTrieNumbers) return IndexPoison;
+
+    next = ruleTrieAdd(set);
+    if (next == IndexPoison) return IndexPoison;
+
+    RuleTrieNode *node = &set->trie[trie];
+
+    switch (key->type)
+    {
+        case RULE_KEY_OPER:     node->operEdges[key->oper] = next;
+                                break;
+
+        case RULE_KEY_ANY:      node->anyEdge = next;
+                                break;
+
+        case RULE_KEY_EMPTY:    node->emptyEdge = next;
+                                break;
+
+        case RULE_KEY_NUMBER:   node->numbers    [node->numbersCount] = key->number;
+                                node->numberEdges[node->numbersCount] = next;
+                                node->numbersCount++;
+                                break;
+
+        default:                return IndexPoison;
+    }
+
+    return next;
+}
+
+int ruleSetApply(RuleSet *set, Node *node)
+{
+    assert(set);
+
+    if (!node || node == PtrPoison || node->type != EXP_TREE_OPERATOR) return 0;
+
+    Node *root = node;
+
+    RuleMatcher matcher  = {};
+    matcher.set          = set;
+    matcher.best         = set->rulesCount;
+    matcher.pending[0]   = &root;
+    matcher.pendingCount = 1;
+
+    ruleMatch(&matcher, 0);
+
+    if (matcher.best == set->rulesCount) return 0;
+
+    CompiledRule *rule = &set->rules[matcher.best];
+
+    Node *taken[RuleSlots] = {};
+    bool  used [RuleSlots] = {};
+
+    for (int i = 0; i < RuleSlots; i++)
+    {
+        if (matcher.captures[i]) taken[i] = *matcher.captures[i];
+    }
+
+    int   position = 0;
+    Node *result   = ruleBuild(rule, &position, taken, used);
+    if (!result) return MEMORY_ERROR;
+
+    // what the result reuses is cut out before the rest of the old node goes
+    for (int i = 0; i < RuleSlots; i++)
+    {
+        if (used[i]) *matcher.captures[i] = NULL;
+    }
+
+    subTreeDtor(node->left);
+    subTreeDtor(node->right);
+
+    int line = node->line;
+    *node = *result;
+    node->line = line;
+
+    destroyNode(&result);
+
+    rule->applied++;
+
+    return 1;
+}
+
+static void ruleMatch(RuleMatcher *matcher, int trieIndex)
+{
+    assert(matcher);
+
+    RuleTrieNode *trie = &matcher->set->trie[trieIndex];
+
+    if (matcher->pendingCount == 0)
+    {
+        ruleMatchEnd(matcher, trie);
+        return;
+    }
+
+    Node **slot = matcher->pending[--matcher->pendingCount];
+    Node  *node = *slot;
+
+    if (!node)
+    {
+        if (trie->emptyEdge != IndexPoison) ruleMatch(matcher, trie->emptyEdge);
+    }
+    else
+    {
+        if (trie->anyEdge != IndexPoison)
+        {
+            matcher->wildcards[matcher->wildcardsCount++] = slot;
+            ruleMatch(matcher, trie->anyEdge);
+            matcher->wildcardsCount--;
+        }
+
+        if (node->type == EXP_TREE_OPERATOR && node->data.operatorNum < RuleOperators &&
+            trie->operEdges[node->data.operatorNum] != IndexPoison && matcher->pendingCount + 2 <= RuleMaxKeys)
+        {
+            matcher->pending[matcher->pendingCount++] = &node->right;
+            matcher->pending[matcher->pendingCount++] = &node->left;
+
+            ruleMatch(matcher, trie->operEdges[node->data.operatorNum]);
+
+            matcher->pendingCount -= 2;
+        }
+
+        if (node->type == EXP_TREE_NUMBER)
+        {
+            for (int i = 0; i < trie->numbersCount; i++)
+            {
+                if (equalDouble(trie->numbers[i], node->data.number)) ruleMatch(matcher, trie->numberEdges[i]);
+            }
+        }
+    }
+
+    matcher->pending[matcher->pendingCount++] = slot;
+}
+
+static void ruleMatchEnd(RuleMatcher *matcher, RuleTrieNode *trie)
+{
+    assert(matcher);
+    assert(trie);
+
+    for (int i = 0; i < trie->rulesCount; i++)
+    {
+        int index = trie->rules[i];
+        if (index >= matcher->best) continue;
+
+        CompiledRule *rule = &matcher->set->rules[index];
+
+        Node **captures[RuleSlots] = {};
+        bool   matched = true;
+
+        for (int k = 0; k < rule->wildcardsCount && matched; k++)
+        {
+            int slot = rule->wildcardSlots[k];
+
+            if (!captures[slot]) captures[slot] = matcher->wildcards[k];
+            else                 matched = ruleTreesEqual(*captures[slot], *matcher->wildcards[k]);
+        }
+
+        if (matched && rule->guard) matched = rule->guard(*captures[0]);
+        if (!matched) continue;
+
+        matcher->best = index;
+        for (int k = 0; k < RuleSlots; k++) matcher->captures[k] = captures[k];
+    }
+}
+
+static Node *ruleBuild(CompiledRule *rule, int *position, Node **taken, bool *used)
+{
+    assert(rule);
+    assert(position);
+
+    RuleKey *key = &rule->result[(*position)++];
+
+    switch (key->type)
+    {
+        case RULE_KEY_NUMBER:   return createNode(EXP_TREE_NUMBER, createNodeData(EXP_TREE_NUMBER, key->number), NULL, NULL);
+
+        case RULE_KEY_EMPTY:    return NULL;
+
+        case RULE_KEY_ANY:
+        {
+            if (used[key->slot]) return ruleCopy(taken[key->slot]);
+
+            used[key->slot] = true;
+            return taken[key->slot];
+        }
+
+        case RULE_KEY_OPER:
+        {
+            Node *left  = ruleBuild(rule, position, taken, used);
+            Node *right = ruleBuild(rule, position, taken, used);
+
+            return createNode(EXP_TREE_OPERATOR, createNodeData(EXP_TREE_OPERATOR, key->oper), left, right);
+        }
+
+        default:                return NULL;
+    }
+}
+
+static Node *ruleCopy(Node *node)
+{
+    if (!node || node == PtrPoison) return NULL;
+
+    return createNode(node->type, node->data, ruleCopy(node->left), ruleCopy(node->right));
+}
+
+bool ruleTreesEqual(Node *a, Node *b)
+{
+    if (!a || !b) return a == b;
+    if (a->type != b->type) return false;
+
+    switch (a->type)
+    {
+        case EXP_TREE_NUMBER:   return !(a->data.number < b->data.number) && !(a->data.number > b->data.number);
+
+        case EXP_TREE_OPERATOR: return a->data.operatorNum == b->data.operatorNum &&
+                                       ruleTreesEqual(a->left,  b->left) &&
+                                       ruleTreesEqual(a->right, b->right);
+
+        case EXP_TREE_NOTHING:
+        case EXP_TREE_VARIABLE:
+        case EXP_TREE_IDENTIF:
+        default:                return a->data.variableNum == b->data.variableNum;
+    }
+}
+
+int ruleSetStats(RuleSet *set, FILE *f)
+{
+    assert(set);
+    assert(f);
+
+    fprintf(f, "rules: %d, trie nodes: %d\n", set->rulesCount, set->trieCount);
+
+    for (int i = 0; i < set->rulesCount; i++)
+    {
+        if (set->rules[i].applied == 0) continue;
+
+        fprintf(f, "%-16s -> %-8s %lld\n", set->source[i].pattern, set->source[i].result, set->rules[i].applied);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,91 @@
+#ifndef  __SIMPLIFY_RULES_H__
+#define  __SIMPLIFY_RULES_H__
+
+#include <stdio.h>
+
+#include "tree_of_expressions.h"
+
+//-------------------------------------------------------------------------------------------------
+// Rules are written in prefix notation: "+ x 0", "^ sqrt _ x 2". Operators are + - * / ^ ln log
+// sin cos sqrt, "_" is the empty child of a unary operator, x y z match any subtree, and a
+// letter used twice matches equal subtrees only. The result uses the same notation.
+//-------------------------------------------------------------------------------------------------
+
+typedef bool (*RuleGuard)(Node *x);
+
+struct SimplifyRule
+{
+    const char *pattern;
+    const char *result;
+    RuleGuard   guard;     // checked on what x matched, NULL if the rule always holds
+};
+
+enum RuleKeyType
+{
+    RULE_KEY_OPER   = 0,
+    RULE_KEY_NUMBER = 1,
+    RULE_KEY_ANY    = 2,
+    RULE_KEY_EMPTY  = 3,
+};
+
+struct RuleKey
+{
+    RuleKeyType type;
+    int         oper;
+    double      number;
+    int         slot;
+};
+
+const int RuleMaxKeys     = 16;
+const int RuleSlots       = 3;      // x y z
+const int RuleOperators   = NEW_VAR + 1;
+const int RuleTrieNumbers = 4;
+const int RuleTrieRules   = 4;
+
+struct CompiledRule
+{
+    RuleKey    result[RuleMaxKeys];
+    int        resultCount;
+
+    int        wildcardSlots[RuleMaxKeys];   // slot of every wildcard, in pattern order
+    int        wildcardsCount;
+
+    RuleGuard  guard;
+    long long  applied;
+};
+
+// discrimination tree over the pattern keys in prefix order
+struct RuleTrieNode
+{
+    int    operEdges[RuleOperators];
+    double numbers    [RuleTrieNumbers];
+    int    numberEdges[RuleTrieNumbers];
+    int    numbersCount;
+    int    anyEdge;
+    int    emptyEdge;
+
+    int    rules[RuleTrieRules];             // rules whose pattern ends here
+    int    rulesCount;
+};
+
+struct RuleSet
+{
+    const SimplifyRule *source;
+
+    CompiledRule       *rules;
+    int                 rulesCount;
+
+    RuleTrieNode       *trie;
+    int                 trieCount;
+    int                 trieCapacity;
+};
+
+int ruleSetCtor(RuleSet *set, const SimplifyRule *rules, int rulesCount);
+int ruleSetDtor(RuleSet *set);
+
+int ruleSetApply(RuleSet *set, Node *node);
+int ruleSetStats(RuleSet *set, FILE *f);
+
+bool ruleTreesEqual(Node *a, Node *b);
+
+#endif //__SIMPLIFY_RULES_H__
@@ -0,0 +1,1398 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "tree_of_expressions.h"
+#include "html_logfile.h"
+#include "exp_tree_write.h"
+#include "assembler_code.h"
+#include "stack_machine.h"
+#include "ssa_ir.h"
+
+#define CHECK_POISON_PTR(ptr) \
+    if (ptr == PtrPoison)     \
+    {                         \
+        LOG("ERROR: PoisonPtr detected in %s(%d) %s\n", __FILE__, __LINE__, __func__);\
+        return 0;                                                                     \
+    }
+
+//-------------------------------------------------------------------------------------------------
+// A mid-level IR in SSA form. The program is lowered from the tree into basic blocks that end
+// in a jump, a branch or hlt; every value is defined once, and a phi at the top of a block picks
+// the value of a variable by the predecessor control came from. SSA is built on the fly while
+// lowering (Braun et al.): a read of a variable looks for its definition up the predecessors,
+// a block gets its phis completed once all of its predecessors are known (a pokuda header
+// after its body), and a phi that picks only one value is replaced by it.
+// koli makes a then block, an empty else block (so that no edge goes from a branch straight to
+// a join) and a join; pokuda makes a header with the condition, a body and an exit.
+// The dominator tree is the iterative one of Cooper, Harvey and Kennedy over reverse postorder.
+// Blocks and values live in one arena that is freed at once.
+//
+// Code generation: a value assigned to a variable lives in the register of that variable, so
+// the phis of code lowered from the tree need no copies. A temporary is computed where it is
+// used when that is its only use and in its own block, otherwise it gets a register of its own
+// after the variables. Phi copies are done at the end of the predecessor through the stack,
+// all the values are pushed first, so the copies happen at once. Empty blocks are jumped over.
+//-------------------------------------------------------------------------------------------------
+
+#define IS_OPER(node, oper)   ((node) && (node)->type == EXP_TREE_OPERATOR && (node)->data.operatorNum == (oper))
+#define IS_COMPARISON(value)  ((value)->opcode == SSA_OPER && ((value)->oper == BELOW || (value)->oper == ABOVE || \
+                                                               (value)->oper == EQUAL || (value)->oper == NOT_EQUAL))
+
+static SsaBlock *ssaNewBlock(SsaFunction *func);
+static SsaValue *ssaNewValue(SsaFunction *func, SsaOpcode opcode);
+static SsaValue *ssaNewPhi  (SsaFunction *func, SsaBlock *block, int var);
+static SsaValue *ssaInitial (SsaFunction *func, int var);
+static SsaValue *ssaAllocValue(SsaFunction *func, SsaBlock *block, SsaOpcode opcode);
+
+static void ssaAddPred(SsaBlock *block, SsaBlock *pred);
+static void ssaJump   (SsaBlock *block, SsaBlock *target);
+static void ssaBranch (SsaBlock *block, SsaValue *cond, SsaBlock *then, SsaBlock *other);
+static int  ssaSuccsCount(SsaBlock *block);
+
+static void      ssaLowerStatement (SsaFunction *func, Node *stmt);
+static void      ssaLowerIf        (SsaFunction *func, Node *stmt);
+static void      ssaLowerWhile     (SsaFunction *func, Node *stmt);
+static SsaValue *ssaLowerExpression(SsaFunction *func, Node *node);
+static int       ssaVariable       (SsaFunction *func, Node *node);
+
+static SsaValue *ssaReadVariable (SsaFunction *func, SsaBlock *block, int var);
+static SsaValue *ssaReadRecursive(SsaFunction *func, SsaBlock *block, int var);
+static SsaValue *ssaAddPhiOperands     (SsaFunction *func, SsaValue *phi);
+static SsaValue *ssaTryRemoveTrivialPhi(SsaFunction *func, SsaValue *phi);
+static SsaValue *ssaResolve(SsaValue *value);
+static void      ssaSealBlock(SsaFunction *func, SsaBlock *block);
+
+static int       ssaRemoveTrivialPhis(SsaFunction *func);
+static int       ssaComputeOrder     (SsaFunction *func);
+static int       ssaCountUses        (SsaFunction *func);
+static void      ssaUse              (SsaValue *value, SsaBlock *block, bool phi);
+static SsaBlock *ssaIntersect        (SsaBlock *a, SsaBlock *b);
+
+static int       ssaAssignRegisters(SsaFunction *func);
+static int       ssaAssignRegister (SsaFunction *func, SsaValue *value);
+static int       ssaEmitBlock    (SsaFunction *func, SsaBlock *block, SsaBlock *next, FILE *f);
+static int       ssaEmitStatement(SsaFunction *func, SsaValue *value, FILE *f);
+static int       ssaEmitValue    (SsaFunction *func, SsaValue *value, FILE *f);
+static int       ssaEmitOperation(SsaFunction *func, SsaValue *value, FILE *f);
+static int       ssaPhiCopies (SsaBlock *block, SsaValue **from, SsaValue **to);
+static bool      ssaEmitsCode (SsaValue *value);
+static bool      ssaIsForwarder(SsaFunction *func, SsaBlock *block);
+static SsaBlock *ssaJumpTarget (SsaFunction *func, SsaBlock *block);
+
+static void      ssaDumpValue(SsaFunction *func, SsaValue *value, FILE *f);
+
+
+void *ssaArenaAlloc(SsaArena *arena, size_t size)
+{
+    assert(arena);
+
+    size = (size + SsaArenaAlign - 1) & ~(SsaArenaAlign - 1);
+
+    if (!arena->chunk || arena->used + size > arena->size)
+    {
+        // the first word of a chunk links the chunk before it
+        size_t chunkSize = size + SsaArenaAlign > SsaArenaChunk ? size + SsaArenaAlign : SsaArenaChunk;
+
+        char *chunk = (char *)calloc(1, chunkSize);
+        if (!chunk) return NULL;
+
+        memcpy(chunk, &arena->chunk, sizeof(char *));
+
+        arena->chunk = chunk;
+        arena->used  = SsaArenaAlign;
+        arena->size  = chunkSize;
+    }
+
+    void *ptr = arena->chunk + arena->used;
+
+    arena->used  += size;
+    arena->total += size;
+
+    return ptr;
+}
+
+int ssaArenaFree(SsaArena *arena)
+{
+    assert(arena);
+
+    while (arena->chunk)
+    {
+        char *previous = NULL;
+        memcpy(&previous, arena->chunk, sizeof(char *));
+
+        free(arena->chunk);
+        arena->chunk = previous;
+    }
+
+    arena->used  = 0;
+    arena->size  = 0;
+    arena->total = 0;
+
+    return EXIT_SUCCESS;
+}
+
+int ssaFunctionCtor(SsaFunction *func, Evaluator *eval)
+{
+    assert(func);
+    assert(eval);
+
+    func->eval = eval;
+
+    SsaBlock *entry = ssaNewBlock(func);
+    if (!entry) return MEMORY_ERROR;
+
+    entry->sealed = true;
+    func->current = entry;
+
+    return EXIT_SUCCESS;
+}
+
+int ssaFunctionDtor(SsaFunction *func)
+{
+    assert(func);
+
+    ssaArenaFree(&func->arena);
+
+    func->entry      = NULL;
+    func->lastBlock  = NULL;
+    func->order      = NULL;
+    func->current    = NULL;
+    func->orderCount = 0;
+
+    for (int i = 0; i < NamesNumber; i++) func->initial[i] = NULL;
+
+    return EXIT_SUCCESS;
+}
+
+int ssaBuild(SsaFunction *func, Node *root)
+{
+    assert(func);
+    assert(func->entry);
+    CHECK_POISON_PTR(root);
+
+    func->current = func->entry;
+
+    ssaLowerStatement(func, root);
+
+    if (!func->error) ssaRemoveTrivialPhis(func);
+    if (!func->error) ssaDominators(func);
+    if (!func->error) ssaCountUses(func);
+
+    LOG("%s: %d blocks, %d values, %d phis, %lu bytes, error %d\n", __func__, func->blocksCount,
+        func->valuesCount, func->phisCount, (unsigned long)func->arena.total, func->error);
+
+    return func->error;
+}
+
+//-------------------------------------------------------------------------------------------------
+// construction
+//-------------------------------------------------------------------------------------------------
+
+static SsaBlock *ssaNewBlock(SsaFunction *func)
+{
+    assert(func);
+
+    SsaBlock  *block = (SsaBlock  *)ssaArenaAlloc(&func->arena, sizeof(SsaBlock));
+    SsaValue **defs  = (SsaValue **)ssaArenaAlloc(&func->arena, NamesNumber * sizeof(SsaValue *));
+
+    if (!block || !defs)
+    {
+        func->error = MEMORY_ERROR;
+        return NULL;
+    }
+
+    block->id    = ++func->blocksCount;
+    block->defs  = defs;
+    block->order = IndexPoison;
+
+    if (func->lastBlock) func->lastBlock->next = block;
+    else                 func->entry           = block;
+
+    func->lastBlock = block;
+
+    return block;
+}
+
+static SsaValue *ssaAllocValue(SsaFunction *func, SsaBlock *block, SsaOpcode opcode)
+{
+    assert(func);
+    assert(block);
+
+    SsaValue *value = (SsaValue *)ssaArenaAlloc(&func->arena, sizeof(SsaValue));
+    if (!value)
+    {
+        func->error = MEMORY_ERROR;
+        return NULL;
+    }
+
+    value->opcode = opcode;
+    value->id     = func->valuesCount++;
+    value->line   = func->line;
+    value->block  = block;
+    value->var    = IndexPoison;
+    value->reg    = IndexPoison;
+
+    return value;
+}
+
+// appended to the current block
+static SsaValue *ssaNewValue(SsaFunction *func, SsaOpcode opcode)
+{
+    assert(func);
+
+    SsaBlock *block = func->current;
+
+    SsaValue *value = ssaAllocValue(func, block, opcode);
+    if (!value) return NULL;
+
+    if (block->last) block->last->next = value;
+    else             block->first      = value;
+
+    block->last = value;
+
+    return value;
+}
+
+static SsaValue *ssaNewPhi(SsaFunction *func, SsaBlock *block, int var)
+{
+    assert(func);
+    assert(block);
+
+    SsaValue *phi = ssaAllocValue(func, block, SSA_PHI);
+    if (!phi) return NULL;
+
+    phi->var    = var;
+    phi->next   = block->phis;
+    block->phis = phi;
+
+    return phi;
+}
+
+// DefaultVarValue, in the register of the variable before anything is assigned to it
+static SsaValue *ssaInitial(SsaFunction *func, int var)
+{
+    assert(func);
+    assert(0 <= var && var < NamesNumber);
+
+    if (func->initial[var]) return func->initial[var];
+
+    SsaBlock *entry = func->entry;
+
+    SsaValue *value = ssaAllocValue(func, entry, SSA_INITIAL);
+    if (!value) return NULL;
+
+    value->var    = var;
+    value->number = DefaultVarValue;
+    value->line   = 0;
+
+    value->next  = entry->first;
+    entry->first = value;
+    if (!entry->last) entry->last = value;
+
+    func->initial[var] = value;
+
+    return value;
+}
+
+static void ssaAddPred(SsaBlock *block, SsaBlock *pred)
+{
+    assert(block);
+    assert(pred);
+    assert(block->predsCount < SsaMaxArgs);
+
+    block->preds[block->predsCount++] = pred;
+}
+
+static void ssaJump(SsaBlock *block, SsaBlock *target)
+{
+    assert(block);
+    assert(target);
+
+    block->terminator = SSA_JUMP;
+    block->succs[0]   = target;
+
+    ssaAddPred(target, block);
+}
+
+static void ssaBranch(SsaBlock *block, SsaValue *cond, SsaBlock *then, SsaBlock *other)
+{
+    assert(block);
+    assert(cond);
+
+    block->terminator = SSA_BRANCH;
+    block->cond       = cond;
+    block->succs[0]   = then;
+    block->succs[1]   = other;
+
+    ssaAddPred(then,  block);
+    ssaAddPred(other, block);
+}
+
+static int ssaSuccsCount(SsaBlock *block)
+{
+    assert(block);
+
+    switch (block->terminator)
+    {
+        case SSA_JUMP:   return 1;
+        case SSA_BRANCH: return 2;
+        case SSA_HALT:
+        default:         return 0;
+    }
+}
+
+static void ssaLowerStatement(SsaFunction *func, Node *stmt)
+{
+    assert(func);
+
+    if (!stmt || stmt == PtrPoison || func->error || stmt->type != EXP_TREE_OPERATOR) return;
+
+    if (stmt->line) func->line = stmt->line;
+
+    switch (stmt->data.operatorNum)
+    {
+        case INSTR_END:
+        {
+            for (Node *item = stmt; item; item = item->right)
+            {
+                if (!IS_OPER(item, INSTR_END))
+                {
+                    ssaLowerStatement(func, item);
+                    return;
+                }
+
+                ssaLowerStatement(func, item->left);
+            }
+
+            return;
+        }
+
+        case ASSIGN:
+        {
+            int var = ssaVariable(func, stmt->right);
+            if (var == IndexPoison) return;
+
+            SsaValue *value = ssaLowerExpression(func, stmt->left);
+            if (!value)
+            {
+                if (!func->error) func->error = BAD_NODE_TYPE;
+                return;
+            }
+
+            // a value that is already a variable's is copied, every assignment has its own
+            if (value->var != IndexPoison)
+            {
+                SsaValue *copy = ssaNewValue(func, SSA_COPY);
+                if (!copy) return;
+
+                copy->args[0] = value;
+                value         = copy;
+            }
+
+            value->var = var;
+            func->current->defs[var] = value;
+
+            return;
+        }
+
+        case IN:
+        {
+            int var = ssaVariable(func, stmt->right);
+            if (var == IndexPoison) return;
+
+            SsaValue *value = ssaNewValue(func, SSA_INPUT);
+            if (!value) return;
+
+            value->var = var;
+            func->current->defs[var] = value;
+
+            return;
+        }
+
+        case OUT:
+        {
+            SsaValue *arg = ssaLowerExpression(func, stmt->right ? stmt->right : stmt->left);
+            if (!arg)
+            {
+                if (!func->error) func->error = BAD_NODE_TYPE;
+                return;
+            }
+
+            SsaValue *value = ssaNewValue(func, SSA_OUTPUT);
+            if (value) value->args[0] = arg;
+
+            return;
+        }
+
+        case IF:        ssaLowerIf   (func, stmt);
+                        return;
+
+        case WHILE:     ssaLowerWhile(func, stmt);
+                        return;
+
+        case NOT_OPER:  case ADD:       case SUB:       case MUL:
+        case DIV:       case LN:        case LOGAR:     case POW:
+        case SIN:       case COS:       case R_BRACKET: case L_BRACKET:
+        case BELOW:     case ABOVE:     case OPEN_F:    case CLOSE_F:
+        case THEN:      case EQUAL:     case NOT_EQUAL: case SQRT:
+        case NEW_VAR:
+        default:        return;
+    }
+}
+
+static void ssaLowerIf(SsaFunction *func, Node *stmt)
+{
+    assert(func);
+    assert(stmt);
+
+    SsaValue *cond = ssaLowerExpression(func, stmt->left);
+    if (!cond)
+    {
+        if (!func->error) func->error = BAD_NODE_TYPE;
+        return;
+    }
+
+    SsaBlock *then  = ssaNewBlock(func);
+    SsaBlock *other = ssaNewBlock(func);
+    SsaBlock *join  = ssaNewBlock(func);
+    if (func->error) return;
+
+    ssaBranch(func->current, cond, then, other);
+    ssaSealBlock(func, then);
+    ssaSealBlock(func, other);
+
+    func->current = then;
+    ssaLowerStatement(func, stmt->right);
+    if (func->error) return;
+
+    ssaJump(func->current, join);
+    ssaJump(other,         join);
+    ssaSealBlock(func, join);
+
+    func->current = join;
+}
+
+static void ssaLowerWhile(SsaFunction *func, Node *stmt)
+{
+    assert(func);
+    assert(stmt);
+
+    SsaBlock *header = ssaNewBlock(func);
+    if (!header) return;
+
+    // sealed after the body, when the back edge is known
+    ssaJump(func->current, header);
+    func->current = header;
+
+    SsaValue *cond = ssaLowerExpression(func, stmt->left);
+    if (!cond)
+    {
+        if (!func->error) func->error = BAD_NODE_TYPE;
+        return;
+    }
+
+    SsaBlock *body = ssaNewBlock(func);
+    SsaBlock *exit = ssaNewBlock(func);
+    if (func->error) return;
+
+    ssaBranch(func->current, cond, body, exit);
+    ssaSealBlock(func, body);
+    ssaSealBlock(func, exit);
+
+    func->current = body;
+    ssaLowerStatement(func, stmt->right);
+    if (func->error) return;
+
+    ssaJump(func->current, header);
+    ssaSealBlock(func, header);
+
+    func->current = exit;
+}
+
+static SsaValue *ssaLowerExpression(SsaFunction *func, Node *node)
+{
+    assert(func);
+
+    if (!node || node == PtrPoison || func->error) return NULL;
+
+    switch (node->type)
+    {
+        case EXP_TREE_NUMBER:
+        {
+            SsaValue *value = ssaNewValue(func, SSA_CONST);
+            if (value) value->number = node->data.number;
+
+            return value;
+        }
+
+        case EXP_TREE_VARIABLE:
+        {
+            int var = ssaVariable(func, node);
+            if (var == IndexPoison) return NULL;
+
+            return ssaReadVariable(func, func->current, var);
+        }
+
+        case EXP_TREE_OPERATOR: break;
+
+        case EXP_TREE_NOTHING:
+        case EXP_TREE_IDENTIF:
+        default:                func->error = BAD_NODE_TYPE;
+                                return NULL;
+    }
+
+    switch (node->data.operatorNum)
+    {
+        case ADD:       case SUB:       case MUL:       case DIV:
+        case LN:        case LOGAR:     case POW:       case SIN:
+        case COS:       case SQRT:      case BELOW:     case ABOVE:
+        case EQUAL:     case NOT_EQUAL: break;
+
+        case NOT_OPER:  case R_BRACKET: case L_BRACKET: case ASSIGN:
+        case IF:        case INSTR_END: case OPEN_F:    case CLOSE_F:
+        case WHILE:     case IN:        case OUT:       case THEN:
+        case NEW_VAR:
+        default:        LOG("ERROR: %s: unsupported operator %d in an expression\n", __func__, node->data.operatorNum);
+                        func->error = BAD_NODE_TYPE;
+                        return NULL;
+    }
+
+    SsaValue *left  = ssaLowerExpression(func, node->left);
+    SsaValue *right = ssaLowerExpression(func, node->right);
+    if (func->error) return NULL;
+
+    SsaValue *value = ssaNewValue(func, SSA_OPER);
+    if (!value) return NULL;
+
+    value->oper    = node->data.operatorNum;
+    value->args[0] = left;
+    value->args[1] = right;
+
+    return value;
+}
+
+static int ssaVariable(SsaFunction *func, Node *node)
+{
+    assert(func);
+
+    if (!node || node == PtrPoison || node->type != EXP_TREE_VARIABLE ||
+        node->data.variableNum < 0 || node->data.variableNum >= NamesNumber)
+    {
+        func->error = BAD_VAR_INDEX;
+        return IndexPoison;
+    }
+
+    return node->data.variableNum;
+}
+
+static SsaValue *ssaReadVariable(SsaFunction *func, SsaBlock *block, int var)
+{
+    assert(func);
+    assert(block);
+
+    if (block->defs[var]) return block->defs[var] = ssaResolve(block->defs[var]);
+
+    return ssaReadRecursive(func, block, var);
+}
+
+static SsaValue *ssaReadRecursive(SsaFunction *func, SsaBlock *block, int var)
+{
+    assert(func);
+    assert(block);
+
+    SsaValue *value = NULL;
+
+    // an incomplete phi, its operands come when the block is sealed
+    if (!block->sealed)              value = ssaNewPhi(func, block, var);
+    else if (block->predsCount == 0) value = ssaInitial(func, var);
+    else if (block->predsCount == 1) value = ssaReadVariable(func, block->preds[0], var);
+    else
+    {
+        value = ssaNewPhi(func, block, var);
+        if (!value) return NULL;
+
+        // a loop gets back to the phi itself
+        block->defs[var] = value;
+        value = ssaAddPhiOperands(func, value);
+    }
+
+    if (!value) return NULL;
+
+    block->defs[var] = value;
+
+    return value;
+}
+
+static SsaValue *ssaAddPhiOperands(SsaFunction *func, SsaValue *phi)
+{
+    assert(func);
+    assert(phi);
+
+    SsaBlock *block = phi->block;
+
+    for (int i = 0; i < block->predsCount; i++)
+    {
+        phi->args[i] = ssaReadVariable(func, block->preds[i], phi->var);
+        if (!phi->args[i]) return NULL;
+    }
+
+    return ssaTryRemoveTrivialPhi(func, phi);
+}
+
+static SsaValue *ssaTryRemoveTrivialPhi(SsaFunction *func, SsaValue *phi)
+{
+    assert(func);
+    assert(phi);
+
+    SsaValue *same = NULL;
+
+    for (int i = 0; i < phi->block->predsCount; i++)
+    {
+        SsaValue *arg = ssaResolve(phi->args[i]);
+
+        if (arg == same || arg == phi) continue;
+        if (same) return phi;
+
+        same = arg;
+    }
+
+    // only reached from itself, the variable was never assigned on the way in
+    if (!same) same = ssaInitial(func, phi->var);
+    if (!same) return NULL;
+
+    phi->replacedBy = same;
+
+    return same;
+}
+
+static SsaValue *ssaResolve(SsaValue *value)
+{
+    if (!value) return NULL;
+
+    SsaValue *root = value;
+    while (root->replacedBy) root = root->replacedBy;
+
+    while (value->replacedBy)
+    {
+        SsaValue *next = value->replacedBy;
+        value->replacedBy = root;
+        value = next;
+    }
+
+    return root;
+}
+
+static void ssaSealBlock(SsaFunction *func, SsaBlock *block)
+{
+    assert(func);
+    assert(block);
+
+    if (func->error) return;
+
+    for (SsaValue *phi = block->phis; phi; phi = phi->next)
+    {
+        if (!phi->replacedBy && !ssaAddPhiOperands(func, phi)) return;
+    }
+
+    block->sealed = true;
+}
+
+// a phi can become trivial after the phis it uses are removed
+static int ssaRemoveTrivialPhis(SsaFunction *func)
+{
+    assert(func);
+
+    bool changed = true;
+
+    while (changed)
+    {
+        changed = false;
+
+        for (SsaBlock *block = func->entry; block; block = block->next)
+        {
+            for (SsaValue *phi = block->phis; phi; phi = phi->next)
+            {
+                if (phi->replacedBy) continue;
+
+                if (ssaTryRemoveTrivialPhi(func, phi) != phi) changed = true;
+                if (func->error) return func->error;
+            }
+        }
+    }
+
+    func->phisCount = 0;
+
+    for (SsaBlock *block = func->entry; block; block = block->next)
+    {
+        for (SsaValue *phi = block->phis; phi; phi = phi->next)
+        {
+            if (phi->replacedBy) continue;
+
+            for (int i = 0; i < block->predsCount; i++) phi->args[i] = ssaResolve(phi->args[i]);
+            func->phisCount++;
+        }
+
+        for (SsaValue *value = block->first; value; value = value->next)
+        {
+            for (int i = 0; i < SsaMaxArgs; i++) value->args[i] = ssaResolve(value->args[i]);
+        }
+
+        block->cond = ssaResolve(block->cond);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+// order, dominators and uses
+//-------------------------------------------------------------------------------------------------
+
+// depth first without recursion, the last successor is visited first,
+// so that the first one (the then block, the loop body) comes first in reverse postorder
+static int ssaComputeOrder(SsaFunction *func)
+{
+    assert(func);
+    assert(func->entry);
+
+    size_t count = (size_t)func->blocksCount;
+
+    SsaBlock **order = (SsaBlock **)ssaArenaAlloc(&func->arena, count * sizeof(SsaBlock *));
+    SsaBlock **stack = (SsaBlock **)ssaArenaAlloc(&func->arena, count * sizeof(SsaBlock *));
+    int       *edge  = (int       *)ssaArenaAlloc(&func->arena, count * sizeof(int));
+
+    if (!order || !stack || !edge) return func->error = MEMORY_ERROR;
+
+    for (SsaBlock *block = func->entry; block; block = block->next) block->order = IndexPoison;
+
+    int visited = 0;
+    int depth   = 1;
+
+    stack[0] = func->entry;
+    edge [0] = 0;
+    func->entry->order = 0;
+
+    while (depth)
+    {
+        SsaBlock *block = stack[depth - 1];
+        int       succs = ssaSuccsCount(block);
+
+        if (edge[depth - 1] < succs)
+        {
+            SsaBlock *succ = block->succs[succs - 1 - edge[depth - 1]++];
+
+            if (succ->order == IndexPoison)
+            {
+                succ->order  = 0;
+                stack[depth] = succ;
+                edge [depth] = 0;
+                depth++;
+            }
+
+            continue;
+        }
+
+        order[visited++] = block;
+        depth--;
+    }
+
+    for (int i = 0; i < visited / 2; i++)
+    {
+        SsaBlock *temp = order[i];
+        order[i] = order[visited - 1 - i];
+        order[visited - 1 - i] = temp;
+    }
+
+    for (int i = 0; i < visited; i++) order[i]->order = i;
+
+    func->order      = order;
+    func->orderCount = visited;
+
+    return EXIT_SUCCESS;
+}
+
+int ssaDominators(SsaFunction *func)
+{
+    assert(func);
+
+    if (ssaComputeOrder(func)) return func->error;
+
+    for (SsaBlock *block = func->entry; block; block = block->next) block->idom = NULL;
+
+    func->entry->idom = func->entry;
+
+    bool changed = true;
+
+    while (changed)
+    {
+        changed = false;
+
+        for (int i = 1; i < func->orderCount; i++)
+        {
+            SsaBlock *block = func->order[i];
+            SsaBlock *idom  = NULL;
+
+            for (int p = 0; p < block->predsCount; p++)
+            {
+                SsaBlock *pred = block->preds[p];
+                if (pred->order == IndexPoison || !pred->idom) continue;
+
+                idom = idom ? ssaIntersect(pred, idom) : pred;
+            }
+
+            if (idom != block->idom)
+            {
+                block->idom = idom;
+                changed     = true;
+            }
+        }
+    }
+
+    func->entry->idom = NULL;
+
+    for (int i = 0; i < func->orderCount; i++)
+    {
+        SsaBlock *block = func->order[i];
+        block->domDepth = block->idom ? block->idom->domDepth + 1 : 0;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static SsaBlock *ssaIntersect(SsaBlock *a, SsaBlock *b)
+{
+    assert(a);
+    assert(b);
+
+    while (a != b)
+    {
+        while (a->order > b->order) a = a->idom;
+        while (b->order > a->order) b = b->idom;
+    }
+
+    return a;
+}
+
+bool ssaDominates(SsaBlock *a, SsaBlock *b)
+{
+    if (!a || !b) return false;
+
+    while (b && b->domDepth > a->domDepth) b = b->idom;
+
+    return a == b;
+}
+
+static int ssaCountUses(SsaFunction *func)
+{
+    assert(func);
+
+    for (int i = 0; i < func->orderCount; i++)
+    {
+        SsaBlock *block = func->order[i];
+
+        for (SsaValue *phi = block->phis; phi; phi = phi->next)
+        {
+            if (phi->replacedBy) continue;
+
+            for (int p = 0; p < block->predsCount; p++) ssaUse(phi->args[p], block->preds[p], true);
+        }
+
+        for (SsaValue *value = block->first; value; value = value->next)
+        {
+            for (int a = 0; a < SsaMaxArgs; a++) ssaUse(value->args[a], block, false);
+        }
+
+        ssaUse(block->cond, block, false);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// a phi uses its operands at the end of their predecessors
+static void ssaUse(SsaValue *value, SsaBlock *block, bool phi)
+{
+    if (!value) return;
+
+    value->uses++;
+    value->useBlock = block;
+    value->phiUse   = value->phiUse || phi;
+}
+
+//-------------------------------------------------------------------------------------------------
+// code generation
+//-------------------------------------------------------------------------------------------------
+
+int ssaConvertToAssembly(SsaFunction *func, FILE *f)
+{
+    assert(func);
+    assert(f);
+
+    if (func->error) return func->error;
+    if (ssaAssignRegisters(func)) return func->error;
+
+    SsaBlock **emitted = (SsaBlock **)ssaArenaAlloc(&func->arena, (size_t)func->orderCount * sizeof(SsaBlock *));
+    if (!emitted) return func->error = MEMORY_ERROR;
+
+    int count = 0;
+
+    for (int i = 0; i < func->orderCount; i++)
+    {
+        SsaBlock *block = func->order[i];
+        if (block == func->entry || !ssaIsForwarder(func, block)) emitted[count++] = block;
+    }
+
+    for (int i = 0; i < count && !func->error; i++)
+    {
+        ssaEmitBlock(func, emitted[i], i + 1 < count ? emitted[i + 1] : NULL, f);
+    }
+
+    return func->error;
+}
+
+static int ssaAssignRegisters(SsaFunction *func)
+{
+    assert(func);
+
+    func->temps = 0;
+
+    for (int i = 0; i < func->orderCount; i++)
+    {
+        SsaBlock *block = func->order[i];
+
+        for (SsaValue *phi = block->phis; phi; phi = phi->next)
+        {
+            if (!phi->replacedBy && ssaAssignRegister(func, phi)) return func->error;
+        }
+
+        for (SsaValue *value = block->first; value; value = value->next)
+        {
+            if (ssaAssignRegister(func, value)) return func->error;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int ssaAssignRegister(SsaFunction *func, SsaValue *value)
+{
+    assert(func);
+    assert(value);
+
+    value->reg = IndexPoison;
+
+    if (value->var != IndexPoison)
+    {
+        value->reg = value->var;
+        return EXIT_SUCCESS;
+    }
+
+    if (value->opcode == SSA_CONST || value->opcode == SSA_OUTPUT || !value->uses) return EXIT_SUCCESS;
+
+    if (value->uses == 1 && !value->phiUse && value->useBlock == value->block) return EXIT_SUCCESS;
+
+    int reg = func->eval->names.count + func->temps;
+
+    if (reg >= StackRegisters)
+    {
+        LOG("ERROR: %s: out of registers for v%d\n", __func__, value->id);
+        return func->error = BAD_VAR_INDEX;
+    }
+
+    value->reg = reg;
+    func->temps++;
+
+    return EXIT_SUCCESS;
+}
+
+static int ssaEmitBlock(SsaFunction *func, SsaBlock *block, SsaBlock *next, FILE *f)
+{
+    assert(func);
+    assert(block);
+    assert(f);
+
+    fprintf(f, ":block_%d\n", block->id);
+
+    for (SsaValue *value = block->first; value && !func->error; value = value->next)
+    {
+        ssaEmitStatement(func, value, f);
+    }
+
+    SsaValue *from[NamesNumber] = {};
+    SsaValue *to  [NamesNumber] = {};
+
+    int copies = ssaPhiCopies(block, from, to);
+
+    for (int i = 0; i < copies; i++) ssaEmitValue(func, from[i], f);
+    for (int i = copies - 1; i >= 0; i--) fprintf(f, "pop r%cx\n", 'a' + to[i]->reg);
+
+    switch (block->terminator)
+    {
+        case SSA_HALT:
+        {
+            fprintf(f, "hlt\n\n");
+            break;
+        }
+
+        case SSA_JUMP:
+        {
+            SsaBlock *target = ssaJumpTarget(func, block->succs[0]);
+            if (target != next) fprintf(f, "jmp :block_%d\n", target->id);
+
+            fprintf(f, "\n");
+            break;
+        }
+
+        case SSA_BRANCH:
+        {
+            SsaBlock *then  = ssaJumpTarget(func, block->succs[0]);
+            SsaBlock *other = ssaJumpTarget(func, block->succs[1]);
+            SsaValue *cond  = block->cond;
+
+            if (cond->reg == IndexPoison && IS_COMPARISON(cond))
+            {
+                ssaEmitValue(func, cond->args[0], f);
+                ssaEmitValue(func, cond->args[1], f);
+                fprintf(f, "sub\n\npush 0\n");
+
+                printJmpOperator(cond->oper, "block_", other->id, f);
+            }
+            else
+            {
+                ssaEmitValue(func, cond, f);
+                fprintf(f, "push 0\n");
+                fprintf(f, "je :block_%d\n\n", other->id);
+            }
+
+            if (then != next) fprintf(f, "jmp :block_%d\n\n", then->id);
+            break;
+        }
+
+        default:
+        {
+            LOG("ERROR: %s: unknown terminator %d\n", __func__, block->terminator);
+            return func->error = BAD_NODE_TYPE;
+        }
+    }
+
+    return func->error;
+}
+
+static int ssaEmitStatement(SsaFunction *func, SsaValue *value, FILE *f)
+{
+    assert(func);
+    assert(value);
+    assert(f);
+
+    if (!ssaEmitsCode(value)) return EXIT_SUCCESS;
+
+    switch (value->opcode)
+    {
+        case SSA_CONST:     fprintf(f, "push %lg\n", value->number);
+                            break;
+
+        case SSA_OPER:      ssaEmitOperation(func, value, f);
+                            break;
+
+        case SSA_COPY:      ssaEmitValue(func, value->args[0], f);
+                            break;
+
+        case SSA_INPUT:     fprintf(f, "in\n");
+                            break;
+
+        case SSA_OUTPUT:    ssaEmitValue(func, value->args[0], f);
+                            fprintf(f, "out\n\n");
+                            return func->error;
+
+        case SSA_INITIAL:
+        case SSA_PHI:
+        default:            return EXIT_SUCCESS;
+    }
+
+    fprintf(f, "pop r%cx\n\n", 'a' + value->reg);
+
+    return func->error;
+}
+
+// pushes the value
+static int ssaEmitValue(SsaFunction *func, SsaValue *value, FILE *f)
+{
+    assert(func);
+    assert(value);
+    assert(f);
+
+    if (value->reg != IndexPoison)
+    {
+        fprintf(f, "push r%cx\n", 'a' + value->reg);
+        return EXIT_SUCCESS;
+    }
+
+    switch (value->opcode)
+    {
+        case SSA_CONST:     fprintf(f, "push %lg\n", value->number);
+                            return EXIT_SUCCESS;
+
+        case SSA_OPER:      return ssaEmitOperation(func, value, f);
+
+        case SSA_INITIAL:   case SSA_COPY:
+        case SSA_INPUT:     case SSA_OUTPUT:
+        case SSA_PHI:
+        default:            LOG("ERROR: %s: v%d has no register\n", __func__, value->id);
+                            return func->error = BAD_NODE_TYPE;
+    }
+}
+
+static int ssaEmitOperation(SsaFunction *func, SsaValue *value, FILE *f)
+{
+    assert(func);
+    assert(value);
+    assert(f);
+
+    // the stack machine has no comparisons, only the jumps after them
+    if (IS_COMPARISON(value))
+    {
+        LOG("ERROR: %s: the comparison v%d is not a condition\n", __func__, value->id);
+        return func->error = BAD_NODE_TYPE;
+    }
+
+    if (value->args[0]) ssaEmitValue(func, value->args[0], f);
+    if (value->args[1]) ssaEmitValue(func, value->args[1], f);
+
+    printTreeOperator(value->oper, f);
+    fprintf(f, "\n");
+
+    return func->error;
+}
+
+// the copies into the phis of the successor, their values are in from[] and go to to[]
+static int ssaPhiCopies(SsaBlock *block, SsaValue **from, SsaValue **to)
+{
+    assert(block);
+    assert(from);
+    assert(to);
+
+    if (block->terminator != SSA_JUMP) return 0;
+
+    SsaBlock *succ = block->succs[0];
+
+    int pred = 0;
+    while (pred < succ->predsCount && succ->preds[pred] != block) pred++;
+
+    assert(pred < succ->predsCount);
+
+    int count = 0;
+
+    for (SsaValue *phi = succ->phis; phi; phi = phi->next)
+    {
+        if (phi->replacedBy || phi->args[pred]->reg == phi->reg) continue;
+
+        assert(count < NamesNumber);
+
+        from[count] = phi->args[pred];
+        to  [count] = phi;
+        count++;
+    }
+
+    return count;
+}
+
+static bool ssaEmitsCode(SsaValue *value)
+{
+    assert(value);
+
+    switch (value->opcode)
+    {
+        case SSA_CONST:
+        case SSA_OPER:      return value->reg != IndexPoison;
+
+        case SSA_COPY:      return value->args[0]->reg != value->reg;
+
+        case SSA_INPUT:
+        case SSA_OUTPUT:    return true;
+
+        case SSA_INITIAL:
+        case SSA_PHI:
+        default:            return false;
+    }
+}
+
+// a block with no code that only jumps on
+static bool ssaIsForwarder(SsaFunction *func, SsaBlock *block)
+{
+    assert(func);
+    assert(block);
+
+    if (block == func->entry || block->terminator != SSA_JUMP || block->succs[0] == block) return false;
+
+    for (SsaValue *value = block->first; value; value = value->next)
+    {
+        if (ssaEmitsCode(value)) return false;
+    }
+
+    SsaValue *from[NamesNumber] = {};
+    SsaValue *to  [NamesNumber] = {};
+
+    return ssaPhiCopies(block, from, to) == 0;
+}
+
+static SsaBlock *ssaJumpTarget(SsaFunction *func, SsaBlock *block)
+{
+    assert(func);
+    assert(block);
+
+    for (int steps = 0; steps < func->blocksCount && ssaIsForwarder(func, block); steps++)
+    {
+        block = block->succs[0];
+    }
+
+    return block;
+}
+
+//-------------------------------------------------------------------------------------------------
+// files
+//-------------------------------------------------------------------------------------------------
+
+int ssaDump(SsaFunction *func, FILE *f)
+{
+    assert(func);
+    assert(f);
+
+    fprintf(f, "; %d blocks, %d values, %d phis, %lu bytes\n\n", func->blocksCount, func->valuesCount,
+               func->phisCount, (unsigned long)func->arena.total);
+
+    for (SsaBlock *block = func->entry; block; block = block->next)
+    {
+        fprintf(f, "block_%d:", block->id);
+
+        if (block->order == IndexPoison) fprintf(f, "    ; unreachable");
+        else
+        {
+            fprintf(f, "    ; preds");
+            if (!block->predsCount) fprintf(f, " -");
+            for (int i = 0; i < block->predsCount; i++) fprintf(f, " block_%d", block->preds[i]->id);
+
+            if (block->idom) fprintf(f, ", idom block_%d", block->idom->id);
+            else             fprintf(f, ", idom -");
+        }
+
+        fprintf(f, "\n");
+
+        for (SsaValue *phi   = block->phis;  phi;   phi   = phi->next)   ssaDumpValue(func, phi,   f);
+        for (SsaValue *value = block->first; value; value = value->next) ssaDumpValue(func, value, f);
+
+        switch (block->terminator)
+        {
+            case SSA_JUMP:      fprintf(f, "    jump block_%d\n\n", block->succs[0]->id);
+                                break;
+
+            case SSA_BRANCH:    fprintf(f, "    branch v%d block_%d block_%d\n\n", block->cond->id,
+                                           block->succs[0]->id, block->succs[1]->id);
+                                break;
+
+            case SSA_HALT:
+            default:            fprintf(f, "    halt\n\n");
+                                break;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static void ssaDumpValue(SsaFunction *func, SsaValue *value, FILE *f)
+{
+    assert(func);
+    assert(value);
+    assert(f);
+
+    if (value->replacedBy) return;
+
+    fprintf(f, "    ");
+
+    if (value->opcode != SSA_OUTPUT)
+    {
+        fprintf(f, "v%d", value->id);
+        if (value->var != IndexPoison) fprintf(f, " %s", func->eval->names.table[value->var].name);
+        fprintf(f, " = ");
+    }
+
+    switch (value->opcode)
+    {
+        case SSA_INITIAL:   fprintf(f, "initial %lg", value->number);
+                            break;
+
+        case SSA_CONST:     fprintf(f, "const %lg", value->number);
+                            break;
+
+        case SSA_OPER:      printTreeOperator(value->oper, f);
+                            for (int i = 0; i < SsaMaxArgs; i++)
+                            {
+                                if (value->args[i]) fprintf(f, " v%d", value->args[i]->id);
+                            }
+                            break;
+
+        case SSA_COPY:      fprintf(f, "copy v%d", value->args[0]->id);
+                            break;
+
+        case SSA_INPUT:     fprintf(f, "in");
+                            break;
+
+        case SSA_OUTPUT:    fprintf(f, "out v%d", value->args[0]->id);
+                            break;
+
+        case SSA_PHI:       fprintf(f, "phi");
+                            for (int i = 0; i < value->block->predsCount; i++)
+                            {
+                                fprintf(f, " [v%d block_%d]", value->args[i]->id, value->block->preds[i]->id);
+                            }
+                            break;
+
+        default:            fprintf(f, "?");
+                            break;
+    }
+
+    if (value->line) fprintf(f, "    ; line %d", value->line);
+
+    fprintf(f, "\n");
+}
+
+int createSsaAssemblerFile(Evaluator *eval, const char *fileInName)
+{
+    assert(eval);
+    assert(fileInName);
+
+    SsaFunction func = {};
+
+    int error = ssaFunctionCtor(&func, eval);
+    if (!error) error = ssaBuild(&func, eval->tree.root);
+
+    char *assemblyName = getFileName(fileInName, "_ssa_assembler.txt");
+    char *dumpName     = getFileName(fileInName, "_ssa.txt");
+
+    if (!error)
+    {
+        FILE *f = fopen(assemblyName, "w");
+
+        if (f)
+        {
+            error = ssaConvertToAssembly(&func, f);
+            fclose(f);
+        }
+        else error = MEMORY_ERROR;
+    }
+
+    FILE *dump = fopen(dumpName, "w");
+    if (dump)
+    {
+        ssaDump(&func, dump);
+        fclose(dump);
+    }
+
+    if (error) printf("ERROR: SSA code generation failed: %d\n", error);
+
+    ssaFunctionDtor(&func);
+
+    free(assemblyName);
+    free(dumpName);
+
+    return error;
+}
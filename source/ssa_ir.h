@@ -0,0 +1,121 @@
+#ifndef  __SSA_IR_H__
+#define  __SSA_IR_H__
+
+#include <stdio.h>
+
+#include "tree_of_expressions.h"
+
+const size_t SsaArenaChunk = 64 * 1024;
+const size_t SsaArenaAlign = 8;
+const int    SsaMaxArgs    = 2;       // two operands, or one per predecessor: a join or a loop header has two
+
+enum SsaOpcode
+{
+    SSA_INITIAL = 0,    // the value of a variable before it is assigned
+    SSA_CONST   = 1,
+    SSA_OPER    = 2,    // an operator of the tree on args[0] and args[1]
+    SSA_COPY    = 3,
+    SSA_INPUT   = 4,    // vvedi
+    SSA_OUTPUT  = 5,    // vivedi, has no value
+    SSA_PHI     = 6,
+};
+
+enum SsaTerminator
+{
+    SSA_HALT   = 0,
+    SSA_JUMP   = 1,     // to succs[0]
+    SSA_BRANCH = 2,     // to succs[0] if cond is true, else to succs[1]
+};
+
+struct SsaBlock;
+
+struct SsaValue
+{
+    SsaOpcode         opcode;
+    ExpTreeOperators  oper;                 // SSA_OPER
+    double            number;               // SSA_CONST, SSA_INITIAL
+    SsaValue         *args[SsaMaxArgs];     // a phi has the value from preds[i] in args[i]
+    int               var;                  // the variable it is assigned to, IndexPoison for a temporary
+
+    int               id;
+    int               line;
+    SsaBlock         *block;
+    SsaValue         *next;                 // in the block
+    SsaValue         *replacedBy;           // a phi that turned out trivial
+
+    int               uses;
+    SsaBlock         *useBlock;             // where the last use is
+    bool              phiUse;
+    int               reg;                  // code generation: IndexPoison if it is computed where it is used
+};
+
+struct SsaBlock
+{
+    int            id;
+    SsaValue      *phis;
+    SsaValue      *first;                   // the other values, in order
+    SsaValue      *last;
+
+    SsaBlock      *preds[SsaMaxArgs];
+    int            predsCount;
+    SsaBlock      *succs[2];
+    SsaTerminator  terminator;
+    SsaValue      *cond;                    // SSA_BRANCH
+
+    SsaValue     **defs;                    // construction: the current value of every variable
+    bool           sealed;                  // construction: all the predecessors are known
+
+    int            order;                   // index in reverse postorder, IndexPoison if unreachable
+    SsaBlock      *idom;                    // NULL for the entry
+    int            domDepth;
+
+    SsaBlock      *next;                    // all the blocks, in the order they were made
+};
+
+// chunks linked by their first word
+struct SsaArena
+{
+    char  *chunk;
+    size_t used;
+    size_t size;
+    size_t total;
+};
+
+struct SsaFunction
+{
+    Evaluator  *eval;
+    SsaArena    arena;
+
+    SsaBlock   *entry;
+    SsaBlock   *lastBlock;
+    int         blocksCount;
+    int         valuesCount;
+    int         phisCount;
+
+    SsaBlock  **order;                      // the reachable blocks in reverse postorder
+    int         orderCount;
+
+    SsaValue   *initial[NamesNumber];
+    SsaBlock   *current;                    // construction: where the code goes
+    int         line;
+    int         temps;                      // code generation: registers taken after the variables
+
+    int         error;
+};
+
+void *ssaArenaAlloc(SsaArena *arena, size_t size);
+int   ssaArenaFree (SsaArena *arena);
+
+int  ssaFunctionCtor(SsaFunction *func, Evaluator *eval);
+int  ssaFunctionDtor(SsaFunction *func);
+
+int  ssaBuild     (SsaFunction *func, Node *root);
+int  ssaDominators(SsaFunction *func);
+bool ssaDominates (SsaBlock *a, SsaBlock *b);
+
+int  ssaDump             (SsaFunction *func, FILE *f);
+int  ssaConvertToAssembly(SsaFunction *func, FILE *f);
+
+int  createSsaAssemblerFile(Evaluator *eval, const char *fileInName);
+
+#endif //__SSA_IR_H__
@@ -0,0 +1,738 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "tree_of_expressions.h"
+#include "html_logfile.h"
+#include "program_run.h"
+#include "stack_machine.h"
+
+//-------------------------------------------------------------------------------------------------
+// Emulator for the _assembler.txt instruction set. Binary instructions pop b, then a, and push
+// a op b; jumps pop b and a the same way and compare a with b, so "push x push 0 jbe :l" jumps
+// when x <= 0. Labels are kept as instructions of their own: reaching one (by a jump or by
+// falling through) counts as a hit of its block, but not as an executed instruction.
+// Every instruction remembers its line in the assembly file, and _lines.txt maps those lines
+// back to the source, so the profile can be summed per source line.
+//-------------------------------------------------------------------------------------------------
+
+const int StackLineLength   = 256;
+const int StackStartSize    = 64;
+const int HtmlBarWidth      = 400;
+
+// indexed by StackOpcode, the "reg" forms share the mnemonic of the plain ones
+static const char *StackOpcodeNames[StackOpcodesCount] =
+{
+    "label", "push", "push reg", "pop", "pop reg", "dup",
+    "add",   "sub",  "mul",      "div", "pow",
+    "ln",    "log",  "sin",      "cos", "sqrt",
+    "in",    "out",
+    "jmp",   "ja",   "jae",      "jb",  "jbe",  "je", "jn",
+    "hlt",
+};
+
+static int stackAddInstruction(StackMachine *machine, StackOpcode opcode, double value, int arg, int assemblyLine);
+static int stackFindLabel     (StackMachine *machine, const char *name);
+static int stackParseLine     (StackMachine *machine, char *line, int assemblyLine);
+static int stackParseRegister (const char *word);
+static int stackResolveLabels (StackMachine *machine);
+
+static int stackPush(StackMachine *machine, double value);
+static int stackPop (StackMachine *machine, double *value);
+
+static ExpTreeOperators stackOperator(StackOpcode opcode);
+
+static bool stackJumpTaken(StackOpcode opcode, double a, double b);
+
+static int stackPrintHtmlEscaped(const char *text, FILE *f);
+
+
+int stackMachineCtor(StackMachine *machine)
+{
+    assert(machine);
+
+    *machine = {};
+
+    machine->codeCapacity   = StackStartSize;
+    machine->labelsCapacity = StackStartSize;
+    machine->stackCapacity  = StackStartSize;
+    machine->stepLimit      = StackStepLimit;
+
+    machine->code   = (StackInstruction *)calloc((size_t)machine->codeCapacity,   sizeof(StackInstruction));
+    machine->labels = (StackLabel *)      calloc((size_t)machine->labelsCapacity, sizeof(StackLabel));
+    machine->stack  = (double *)          calloc((size_t)machine->stackCapacity,  sizeof(double));
+
+    if (!machine->code || !machine->labels || !machine->stack)
+    {
+        stackMachineDtor(machine);
+        return MEMORY_ERROR;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int stackMachineDtor(StackMachine *machine)
+{
+    assert(machine);
+
+    for (int i = 0; i < machine->labelsCount; i++) free(machine->labels[i].name);
+
+    free(machine->code);
+    free(machine->labels);
+    free(machine->stack);
+
+    *machine = {};
+
+    return EXIT_SUCCESS;
+}
+
+const char *stackOpcodeName(StackOpcode opcode)
+{
+    if (opcode < 0 || opcode >= StackOpcodesCount) return "unknown";
+
+    return StackOpcodeNames[opcode];
+}
+
+int stackMachineLoad(StackMachine *machine, const char *assemblyName)
+{
+    assert(machine);
+    assert(assemblyName);
+
+    FILE *f = fopen(assemblyName, "r");
+    if (!f) return SM_FILE_ERROR;
+
+    char line[StackLineLength] = "";
+    int  assemblyLine = 0;
+    int  error        = EXIT_SUCCESS;
+
+    while (!error && fgets(line, StackLineLength, f))
+    {
+        assemblyLine++;
+        error = stackParseLine(machine, line, assemblyLine);
+
+        if (error) LOG("ERROR: %s: %s(%d): can't parse \"%s\"\n", __func__, assemblyName, assemblyLine, line);
+    }
+
+    fclose(f);
+
+    if (!error) error = stackResolveLabels(machine);
+
+    return error;
+}
+
+static int stackParseLine(StackMachine *machine, char *line, int assemblyLine)
+{
+    assert(machine);
+    assert(line);
+
+    char word   [StackLineLength] = "";
+    char operand[StackLineLength] = "";
+
+    int words = sscanf(line, "%255s %255s", word, operand);
+    if (words <= 0) return EXIT_SUCCESS;
+
+    if (word[0] == ':')
+    {
+        int label = stackFindLabel(machine, word + 1);
+        if (label == IndexPoison) return MEMORY_ERROR;
+        if (machine->labels[label].instruction != IndexPoison) return SM_UNKNOWN_LABEL;
+
+        machine->labels[label].instruction = machine->codeCount;
+
+        return stackAddInstruction(machine, SM_LABEL, 0, label, assemblyLine);
+    }
+
+    StackOpcode opcode = SM_LABEL;
+
+    for (int i = 1; i < StackOpcodesCount; i++)
+    {
+        if (strcmp(word, StackOpcodeNames[i]) == 0)
+        {
+            opcode = (StackOpcode)i;
+            break;
+        }
+    }
+
+    switch (opcode)
+    {
+        case SM_PUSH:
+        case SM_PUSH_REG:
+        {
+            if (words < 2) return SM_UNKNOWN_INSTRUCTION;
+
+            int reg = stackParseRegister(operand);
+            if (reg != IndexPoison) return stackAddInstruction(machine, SM_PUSH_REG, 0, reg, assemblyLine);
+
+            char  *end   = operand;
+            double value = strtod(operand, &end);
+            if (end == operand) return SM_BAD_REGISTER;
+
+            return stackAddInstruction(machine, SM_PUSH, value, 0, assemblyLine);
+        }
+
+        case SM_POP:
+        case SM_POP_REG:
+        {
+            if (words < 2) return stackAddInstruction(machine, SM_POP, 0, 0, assemblyLine);
+
+            int reg = stackParseRegister(operand);
+            if (reg == IndexPoison) return SM_BAD_REGISTER;
+
+            return stackAddInstruction(machine, SM_POP_REG, 0, reg, assemblyLine);
+        }
+
+        case SM_JMP: case SM_JA:
+        case SM_JAE: case SM_JB:
+        case SM_JBE: case SM_JE:
+        case SM_JN:
+        {
+            if (words < 2) return SM_UNKNOWN_LABEL;
+
+            int label = stackFindLabel(machine, operand[0] == ':' ? operand + 1 : operand);
+            if (label == IndexPoison) return MEMORY_ERROR;
+
+            return stackAddInstruction(machine, opcode, 0, label, assemblyLine);
+        }
+
+        case SM_ADD:  case SM_SUB:
+        case SM_MUL:  case SM_DIV:
+        case SM_POW:  case SM_LN:
+        case SM_LOG:  case SM_SIN:
+        case SM_COS:  case SM_SQRT:
+        case SM_IN:   case SM_OUT:
+        case SM_DUP:
+        case SM_HLT:  return stackAddInstruction(machine, opcode, 0, 0, assemblyLine);
+
+        case SM_LABEL:
+        default:      return SM_UNKNOWN_INSTRUCTION;
+    }
+}
+
+static int stackParseRegister(const char *word)
+{
+    assert(word);
+
+    if (strlen(word) == 3 && word[0] == 'r' && word[2] == 'x' && 'a' <= word[1] && word[1] <= 'z')
+    {
+        return word[1] - 'a';
+    }
+
+    return IndexPoison;
+}
+
+static int stackAddInstruction(StackMachine *machine, StackOpcode opcode, double value, int arg, int assemblyLine)
+{
+    assert(machine);
+
+    if (machine->codeCount == machine->codeCapacity)
+    {
+        StackInstruction *code = (StackInstruction *)realloc(machine->code, (size_t)machine->codeCapacity * 2 *
+                                                                            sizeof(StackInstruction));
+        if (!code) return MEMORY_ERROR;
+
+        machine->code          = code;
+        machine->codeCapacity *= 2;
+    }
+
+    StackInstruction instruction = {};
+    instruction.opcode       = opcode;
+    instruction.value        = value;
+    instruction.arg          = arg;
+    instruction.assemblyLine = assemblyLine;
+
+    machine->code[machine->codeCount++] = instruction;
+
+    return EXIT_SUCCESS;
+}
+
+// finds or adds the label, a new one is not defined yet
+static int stackFindLabel(StackMachine *machine, const char *name)
+{
+    assert(machine);
+    assert(name);
+
+    for (int i = 0; i < machine->labelsCount; i++)
+    {
+        if (strcmp(machine->labels[i].name, name) == 0) return i;
+    }
+
+    if (machine->labelsCount == machine->labelsCapacity)
+    {
+        StackLabel *labels = (StackLabel *)realloc(machine->labels, (size_t)machine->labelsCapacity * 2 *
+                                                                    sizeof(StackLabel));
+        if (!labels) return IndexPoison;
+
+        machine->labels          = labels;
+        machine->labelsCapacity *= 2;
+    }
+
+    char *copy = strdup(name);
+    if (!copy) return IndexPoison;
+
+    machine->labels[machine->labelsCount].name        = copy;
+    machine->labels[machine->labelsCount].instruction = IndexPoison;
+
+    return machine->labelsCount++;
+}
+
+static int stackResolveLabels(StackMachine *machine)
+{
+    assert(machine);
+
+    for (int i = 0; i < machine->codeCount; i++)
+    {
+        StackInstruction *instruction = &machine->code[i];
+
+        switch (instruction->opcode)
+        {
+            case SM_JMP: case SM_JA:
+            case SM_JAE: case SM_JB:
+            case SM_JBE: case SM_JE:
+            case SM_JN:
+            {
+                int target = machine->labels[instruction->arg].instruction;
+
+                if (target == IndexPoison)
+                {
+                    LOG("ERROR: %s: label %s is not defined\n", __func__, machine->labels[instruction->arg].name);
+                    return SM_UNKNOWN_LABEL;
+                }
+
+                instruction->arg = target;
+                break;
+            }
+
+            case SM_LABEL: case SM_PUSH:
+            case SM_PUSH_REG: case SM_POP:
+            case SM_POP_REG: case SM_ADD:
+            case SM_SUB:  case SM_MUL:
+            case SM_DIV:  case SM_POW:
+            case SM_LN:   case SM_LOG:
+            case SM_SIN:  case SM_COS:
+            case SM_SQRT: case SM_IN:
+            case SM_OUT:  case SM_HLT:
+            case SM_DUP:
+            default:      break;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int stackMachineLoadLines(StackMachine *machine, const char *tableName)
+{
+    assert(machine);
+    assert(tableName);
+
+    FILE *f = fopen(tableName, "r");
+    if (!f) return SM_FILE_ERROR;
+
+    char line[StackLineLength] = "";
+    int  current = 0;
+
+    int assemblyLine = 0;
+    int sourceLine   = 0;
+
+    bool haveNext = false;
+    int  nextAssembly = 0;
+    int  nextSource   = 0;
+
+    while (fgets(line, StackLineLength, f))
+    {
+        if (sscanf(line, "%d %d", &nextAssembly, &nextSource) != 2) continue;
+        haveNext = true;
+
+        // the entries go in assembly order, and so do the instructions
+        for ( ; current < machine->codeCount && machine->code[current].assemblyLine < nextAssembly; current++)
+        {
+            machine->code[current].sourceLine = sourceLine;
+        }
+
+        assemblyLine = nextAssembly;
+        sourceLine   = nextSource;
+
+        if (sourceLine > machine->sourceLines) machine->sourceLines = sourceLine;
+    }
+
+    for ( ; haveNext && current < machine->codeCount; current++) machine->code[current].sourceLine = sourceLine;
+
+    (void) assemblyLine;
+
+    fclose(f);
+
+    return EXIT_SUCCESS;
+}
+
+static int stackPush(StackMachine *machine, double value)
+{
+    assert(machine);
+
+    if (machine->stackSize == machine->stackCapacity)
+    {
+        double *stack = (double *)realloc(machine->stack, (size_t)machine->stackCapacity * 2 * sizeof(double));
+        if (!stack) return MEMORY_ERROR;
+
+        machine->stack          = stack;
+        machine->stackCapacity *= 2;
+    }
+
+    machine->stack[machine->stackSize++] = value;
+
+    if (machine->stackSize > machine->maxDepth) machine->maxDepth = machine->stackSize;
+
+    return EXIT_SUCCESS;
+}
+
+static int stackPop(StackMachine *machine, double *value)
+{
+    assert(machine);
+    assert(value);
+
+    if (machine->stackSize == 0) return SM_STACK_UNDERFLOW;
+
+    *value = machine->stack[--machine->stackSize];
+
+    return EXIT_SUCCESS;
+}
+
+static ExpTreeOperators stackOperator(StackOpcode opcode)
+{
+    switch (opcode)
+    {
+        case SM_ADD:  return ADD;
+        case SM_SUB:  return SUB;
+        case SM_MUL:  return MUL;
+        case SM_DIV:  return DIV;
+        case SM_POW:  return POW;
+        case SM_LN:   return LN;
+        case SM_LOG:  return LOGAR;
+        case SM_SIN:  return SIN;
+        case SM_COS:  return COS;
+        case SM_SQRT: return SQRT;
+
+        case SM_LABEL:    case SM_PUSH:
+        case SM_PUSH_REG: case SM_POP:
+        case SM_POP_REG:  case SM_DUP:
+        case SM_IN:
+        case SM_OUT:      case SM_JMP:
+        case SM_JA:       case SM_JAE:
+        case SM_JB:       case SM_JBE:
+        case SM_JE:       case SM_JN:
+        case SM_HLT:
+        default:      return NOT_OPER;
+    }
+}
+
+static bool stackJumpTaken(StackOpcode opcode, double a, double b)
+{
+    switch (opcode)
+    {
+        case SM_JMP: return true;
+        case SM_JA:  return a >  b;
+        case SM_JAE: return a >= b;
+        case SM_JB:  return a <  b;
+        case SM_JBE: return a <= b;
+        case SM_JE:  return  equalDouble(a, b);
+        case SM_JN:  return !equalDouble(a, b);
+
+        case SM_LABEL:    case SM_PUSH:
+        case SM_PUSH_REG: case SM_POP:
+        case SM_POP_REG:  case SM_ADD:
+        case SM_SUB:      case SM_MUL:
+        case SM_DIV:      case SM_POW:
+        case SM_LN:       case SM_LOG:
+        case SM_SIN:      case SM_COS:
+        case SM_SQRT:     case SM_IN:
+        case SM_OUT:      case SM_HLT:
+        case SM_DUP:
+        default:     return false;
+    }
+}
+
+int stackMachineRun(StackMachine *machine, ProgramIO *io)
+{
+    assert(machine);
+    assert(io);
+
+    for (int i = 0; i < StackRegisters;    i++) machine->registers[i]    = DefaultVarValue;
+    for (int i = 0; i < StackOpcodesCount; i++) machine->opcodeCounts[i] = 0;
+    for (int i = 0; i < machine->codeCount; i++) machine->code[i].hits   = 0;
+
+    machine->stackSize = 0;
+    machine->maxDepth  = 0;
+    machine->executed  = 0;
+
+    int error = EXIT_SUCCESS;
+    int pc    = 0;
+
+    while (!error && pc < machine->codeCount)
+    {
+        StackInstruction *instruction = &machine->code[pc++];
+
+        instruction->hits++;
+        machine->opcodeCounts[instruction->opcode]++;
+
+        if (instruction->opcode != SM_LABEL && ++machine->executed > machine->stepLimit)
+        {
+            error = SM_STEP_LIMIT;
+            break;
+        }
+
+        double a = 0;
+        double b = 0;
+
+        switch (instruction->opcode)
+        {
+            case SM_LABEL:    break;
+
+            case SM_PUSH:     error = stackPush(machine, instruction->value);
+                              break;
+
+            case SM_PUSH_REG: error = stackPush(machine, machine->registers[instruction->arg]);
+                              break;
+
+            case SM_POP:      error = stackPop(machine, &a);
+                              break;
+
+            case SM_POP_REG:  error = stackPop(machine, &machine->registers[instruction->arg]);
+                              break;
+
+            case SM_DUP:      if (machine->stackSize == 0) error = SM_STACK_UNDERFLOW;
+                              else error = stackPush(machine, machine->stack[machine->stackSize - 1]);
+                              break;
+
+            case SM_ADD: case SM_SUB:
+            case SM_MUL: case SM_DIV:
+            case SM_POW: case SM_LOG:
+            {
+                error = stackPop(machine, &b);
+                if (!error) error = stackPop(machine, &a);
+                if (error) break;
+
+                ExpTreeErrors calcError = TREE_NO_ERROR;
+                double value = NodeCalculate(a, b, stackOperator(instruction->opcode), &calcError);
+
+                error = calcError ? calcError : stackPush(machine, value);
+                break;
+            }
+
+            case SM_LN:  case SM_SIN:
+            case SM_COS: case SM_SQRT:
+            {
+                error = stackPop(machine, &b);
+                if (error) break;
+
+                ExpTreeErrors calcError = TREE_NO_ERROR;
+                double value = NodeCalculate(0, b, stackOperator(instruction->opcode), &calcError);
+
+                error = calcError ? calcError : stackPush(machine, value);
+                break;
+            }
+
+            case SM_IN:       error = stackPush(machine, io->input(io->context));
+                              break;
+
+            case SM_OUT:      error = stackPop(machine, &a);
+                              if (!error) io->output(io->context, a);
+                              break;
+
+            case SM_JMP:      pc = instruction->arg;
+                              break;
+
+            case SM_JA:  case SM_JAE:
+            case SM_JB:  case SM_JBE:
+            case SM_JE:  case SM_JN:
+            {
+                error = stackPop(machine, &b);
+                if (!error) error = stackPop(machine, &a);
+
+                if (!error && stackJumpTaken(instruction->opcode, a, b)) pc = instruction->arg;
+                break;
+            }
+
+            case SM_HLT:      pc = machine->codeCount;
+                              break;
+
+            default:          error = SM_UNKNOWN_INSTRUCTION;
+                              break;
+        }
+    }
+
+    if (error) LOG("ERROR: %s: stopped at instruction %d (assembly line %d): %d\n", __func__,
+                   pc - 1, pc > 0 ? machine->code[pc - 1].assemblyLine : 0, error);
+
+    return error;
+}
+
+int stackMachineReport(StackMachine *machine, FILE *f)
+{
+    assert(machine);
+    assert(f);
+
+    fprintf(f, "instructions executed: %lld\n", machine->executed);
+    fprintf(f, "max stack depth:       %d\n",   machine->maxDepth);
+
+    fprintf(f, "\nopcode      count\n");
+    for (int i = 1; i < StackOpcodesCount; i++)
+    {
+        if (machine->opcodeCounts[i] == 0) continue;
+
+        fprintf(f, "%-8s %12lld\n", stackOpcodeName((StackOpcode)i), machine->opcodeCounts[i]);
+    }
+
+    fprintf(f, "\nlabel                  hits\n");
+    for (int i = 0; i < machine->labelsCount; i++)
+    {
+        int instruction = machine->labels[i].instruction;
+
+        fprintf(f, "%-16s %10lld\n", machine->labels[i].name, machine->code[instruction].hits);
+    }
+
+    if (machine->sourceLines == 0) return EXIT_SUCCESS;
+
+    fprintf(f, "\nsource line  instructions\n");
+    for (int line = 0; line <= machine->sourceLines; line++)
+    {
+        long long count = 0;
+
+        for (int i = 0; i < machine->codeCount; i++)
+        {
+            if (machine->code[i].sourceLine == line && machine->code[i].opcode != SM_LABEL) count += machine->code[i].hits;
+        }
+
+        if (count) fprintf(f, "%11d  %12lld\n", line, count);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int stackMachineHtmlProfile(StackMachine *machine, const char *sourceName, const char *htmlName)
+{
+    assert(machine);
+    assert(sourceName);
+    assert(htmlName);
+
+    long long *lineCounts = (long long *)calloc((size_t)machine->sourceLines + 1, sizeof(long long));
+    if (!lineCounts) return MEMORY_ERROR;
+
+    long long maxCount = 0;
+
+    for (int i = 0; i < machine->codeCount; i++)
+    {
+        if (machine->code[i].opcode == SM_LABEL) continue;
+
+        int line = machine->code[i].sourceLine;
+
+        lineCounts[line] += machine->code[i].hits;
+        if (line > 0 && lineCounts[line] > maxCount) maxCount = lineCounts[line];
+    }
+
+    FILE *source = fopen(sourceName, "r");
+    FILE *html   = fopen(htmlName,   "w");
+
+    if (!source || !html)
+    {
+        if (source) fclose(source);
+        if (html)   fclose(html);
+        free(lineCounts);
+
+        return SM_FILE_ERROR;
+    }
+
+    fprintf(html, "<html>\n<head>\n<meta charset=\"utf-8\">\n<title>profile of ");
+    stackPrintHtmlEscaped(sourceName, html);
+    fprintf(html, "</title>\n<style>\n"
+                  "body  { font-family: monospace; }\n"
+                  "td    { padding: 0 8px; white-space: pre; }\n"
+                  ".num  { text-align: right; }\n"
+                  ".bar  { background: #e05050; height: 12px; }\n"
+                  "</style>\n</head>\n<body>\n");
+
+    fprintf(html, "<h2>");
+    stackPrintHtmlEscaped(sourceName, html);
+    fprintf(html, "</h2>\n<p>instructions executed: %lld, max stack depth: %d</p>\n",
+                  machine->executed, machine->maxDepth);
+
+    fprintf(html, "<table>\n<tr><th>line</th><th>instructions</th><th>%%</th><th></th><th>source</th></tr>\n");
+
+    char text[StackLineLength] = "";
+    int  line = 0;
+
+    while (fgets(text, StackLineLength, source))
+    {
+        size_t length = strlen(text);
+        bool   whole  = length > 0 && text[length - 1] == '\n';
+
+        while (length > 0 && (text[length - 1] == '\n' || text[length - 1] == '\r')) text[--length] = '\0';
+
+        line++;
+
+        long long count   = line <= machine->sourceLines ? lineCounts[line] : 0;
+        double    percent = machine->executed ? 100.0 * (double)count / (double)machine->executed : 0;
+        int       width   = maxCount ? (int)((double)HtmlBarWidth * (double)count / (double)maxCount) : 0;
+
+        fprintf(html, "<tr><td class=\"num\">%d</td>", line);
+
+        if (count) fprintf(html, "<td class=\"num\">%lld</td><td class=\"num\">%.1f</td>", count, percent);
+        else       fprintf(html, "<td></td><td></td>");
+
+        fprintf(html, "<td><div class=\"bar\" style=\"width: %dpx\"></div></td><td>", width);
+        stackPrintHtmlEscaped(text, html);
+        fprintf(html, "</td></tr>\n");
+
+        // the rest of a long line is not a new line
+        while (!whole && fgets(text, StackLineLength, source))
+        {
+            length = strlen(text);
+            whole  = length > 0 && text[length - 1] == '\n';
+        }
+    }
+
+    fprintf(html, "</table>\n<h3>opcodes</h3>\n<table>\n");
+
+    for (int i = 1; i < StackOpcodesCount; i++)
+    {
+        if (machine->opcodeCounts[i] == 0) continue;
+
+        fprintf(html, "<tr><td>%s</td><td class=\"num\">%lld</td></tr>\n", stackOpcodeName((StackOpcode)i),
+                                                                           machine->opcodeCounts[i]);
+    }
+
+    fprintf(html, "</table>\n<h3>labels</h3>\n<table>\n");
+
+    for (int i = 0; i < machine->labelsCount; i++)
+    {
+        fprintf(html, "<tr><td>");
+        stackPrintHtmlEscaped(machine->labels[i].name, html);
+        fprintf(html, "</td><td class=\"num\">%lld</td></tr>\n", machine->code[machine->labels[i].instruction].hits);
+    }
+
+    fprintf(html, "</table>\n</body>\n</html>\n");
+
+    fclose(source);
+    fclose(html);
+    free(lineCounts);
+
+    return EXIT_SUCCESS;
+}
+
+static int stackPrintHtmlEscaped(const char *text, FILE *f)
+{
+    assert(text);
+    assert(f);
+
+    for ( ; *text; text++)
+    {
+        switch (*text)
+        {
+            case '<':   fputs("&lt;",  f); break;
+            case '>':   fputs("&gt;",  f); break;
+            case '&':   fputs("&amp;", f); break;
+            case '"':   fputs("&quot;", f); break;
+            default:    putc(*text, f);    break;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,109 @@
+#ifndef  __STACK_MACHINE_H__
+#define  __STACK_MACHINE_H__
+
+#include <stdio.h>
+
+#include "tree_of_expressions.h"
+#include "program_run.h"
+
+enum StackOpcode
+{
+    SM_LABEL    = 0,
+    SM_PUSH     = 1,
+    SM_PUSH_REG = 2,
+    SM_POP      = 3,
+    SM_POP_REG  = 4,
+    SM_DUP      = 5,
+    SM_ADD      = 6,
+    SM_SUB      = 7,
+    SM_MUL      = 8,
+    SM_DIV      = 9,
+    SM_POW      = 10,
+    SM_LN       = 11,
+    SM_LOG      = 12,
+    SM_SIN      = 13,
+    SM_COS      = 14,
+    SM_SQRT     = 15,
+    SM_IN       = 16,
+    SM_OUT      = 17,
+    SM_JMP      = 18,
+    SM_JA       = 19,
+    SM_JAE      = 20,
+    SM_JB       = 21,
+    SM_JBE      = 22,
+    SM_JE       = 23,
+    SM_JN       = 24,
+    SM_HLT      = 25,
+};
+
+const int StackOpcodesCount = SM_HLT + 1;
+
+enum StackMachineErrors
+{
+    SM_NO_ERROR            = 0,
+    SM_STACK_UNDERFLOW     = -20,
+    SM_UNKNOWN_INSTRUCTION = -21,
+    SM_UNKNOWN_LABEL       = -22,
+    SM_BAD_REGISTER        = -23,
+    SM_STEP_LIMIT          = -24,
+    SM_FILE_ERROR          = -25,
+};
+
+const int       StackRegisters     = 26;    // rax ... rzx
+const long long StackStepLimit     = 1000000000;
+
+struct StackInstruction
+{
+    StackOpcode opcode;
+    double      value;
+    int         arg;          // register, label index or jump target
+
+    int         assemblyLine;
+    int         sourceLine;
+    long long   hits;
+};
+
+struct StackLabel
+{
+    char     *name;
+    int       instruction;
+};
+
+struct StackMachine
+{
+    StackInstruction *code;
+    int               codeCount;
+    int               codeCapacity;
+
+    StackLabel       *labels;
+    int               labelsCount;
+    int               labelsCapacity;
+
+    double            registers[StackRegisters];
+
+    double           *stack;
+    int               stackSize;
+    int               stackCapacity;
+    int               maxDepth;
+
+    long long         opcodeCounts[StackOpcodesCount];
+    long long         executed;
+    long long         stepLimit;
+
+    int               sourceLines;
+};
+
+int stackMachineCtor(StackMachine *machine);
+int stackMachineDtor(StackMachine *machine);
+
+int stackMachineLoad     (StackMachine *machine, const char *assemblyName);
+int stackMachineLoadLines(StackMachine *machine, const char *tableName);
+
+int stackMachineRun(StackMachine *machine, ProgramIO *io);
+
+int stackMachineReport     (StackMachine *machine, FILE *f);
+int stackMachineHtmlProfile(StackMachine *machine, const char *sourceName, const char *htmlName);
+
+const char *stackOpcodeName(StackOpcode opcode);
+
+#endif //__STACK_MACHINE_H__
@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "tree_of_expressions.h"
 #include "exp_tree_write.h"
@@ -6,9 +8,47 @@
 #include "recursive_descent_reading.h"
 #include "tree_simplify.h"
 #include "assembler_code.h"
+#include "program_run.h"
+#include "jit_compiler.h"
+#include "native_code.h"
+#include "c_code.h"
+#include "batch_evaluate.h"
+#include "program_parallel.h"
+#include "incremental_evaluate.h"
+#include "closure_evaluate.h"
+#include "fast_math.h"
+#include "program_dual.h"
+#include "tree_derivative.h"
+#include "formula_service.h"
+#include "stack_machine.h"
+#include "parallel_evaluate.h"
+#include "egraph.h"
+#include "cse.h"
+#include "dead_code.h"
+#include "propagation.h"
+#include "ssa_ir.h"
+#include "loop_invariant.h"
+#include "induction.h"
+#include "unroll.h"
+#include "liveness.h"
 
 //const char *fileName = "factorial_while.txt";
 
+const int BenchmarkRuns = 1000;
+const int BatchRows     = 100000;
+const int BatchRuns     = 10;
+const int Updates       = 100000;
+const int MathSamples   = 1000000;
+const int DiffOrder     = 1;
+const int ForkJoinNodes = 4000000;
+
+typedef int (*ExpressionBenchmark)(Evaluator *eval, Node *expression, int size, FILE *f);
+
+static int runProgramMode(Evaluator *eval, const char *mode, int argc, const char *argv[]);
+static int emulateAssembly(const char *fileInName, const char *assemblyPostfix, const char *linesPostfix);
+static int benchmarkStatements(Evaluator *eval, Node *node, ExpressionBenchmark benchmark, int size);
+static int batchBenchmarkRows  (Evaluator *eval, Node *expression, int rows, FILE *f);
+
 int main(int argc, const char *argv[])
 {
     const char *fileInName  = NULL;
@@ -21,6 +61,16 @@ int main(int argc, const char *argv[])
 
     fileInName = argv[1];
 
+    int modeArg = 2;
+
+    FastMathMode fastMode = FAST_MATH_OFF;
+    if (argc > modeArg && strncmp(argv[modeArg], "fast=", 5) == 0)
+    {
+        if (fastMathParseMode(argv[modeArg] + 5, &fastMode)) printf("ERROR: unknown fast math mode %s\n", argv[modeArg] + 5);
+        fastMathSetMode(fastMode);
+        modeArg++;
+    }
+
     Evaluator eval = {};
     
     readTreeFromFileRecursive(&eval, fileInName);
@@ -31,13 +81,265 @@ int main(int argc, const char *argv[])
         return 0;
     }
 
-    expTreeSimplify(&eval, eval.tree.root);
-    treeGraphicDump(&eval, eval.tree.root);
+    expTreeSimplify   (&eval, eval.tree.root);
+    propagateConstants(&eval, eval.tree.root);
+    deadCodeEliminate (&eval, &eval.tree.root);
+    licmOptimize      (&eval, &eval.tree.root, NULL);
+    inductionOptimize (&eval, &eval.tree.root, NULL);
+    unrollLoops       (&eval, &eval.tree.root, UnrollDefaultFactor, NULL);
+    propagateConstants(&eval, eval.tree.root);
+    deadStoreEliminate(&eval, &eval.tree.root, NULL);
+    deadCodeEliminate (&eval, &eval.tree.root);
+    egraphOptimize    (&eval, eval.tree.root);
+    cseOptimize       (&eval, &eval.tree.root, NULL);
+    treeGraphicDump   (&eval, eval.tree.root);
 
     createAssemblerCodeFile(&eval, fileInName);
 
+    if (argc > modeArg && strcmp(argv[modeArg], "native") == 0) createNativeExecutable(&eval, fileInName);
+    else if (argc > modeArg && strcmp(argv[modeArg], "c") == 0) createCCodeFile(&eval, fileInName, true);
+    else if (argc > modeArg && strcmp(argv[modeArg], "emulate") == 0) emulateAssembly(fileInName, "_assembler.txt", "_lines.txt");
+    else if (argc > modeArg && strcmp(argv[modeArg], "ssa") == 0)
+    {
+        if (!createSsaAssemblerFile(&eval, fileInName)) emulateAssembly(fileInName, "_ssa_assembler.txt", NULL);
+    }
+    else if (argc > modeArg) runProgramMode(&eval, argv[modeArg], argc - modeArg - 1, argv + modeArg + 1);
+
     evaluatorDtor(&eval);
+    expTreeSimplifyDtor();
+}
+
+static int runProgramMode(Evaluator *eval, const char *mode, int argc, const char *argv[])
+{
+    ProgramIO io = {};
+    programIOStdCtor(&io);
+
+    if (strcmp(mode, "run") == 0)
+    {
+        ExpTreeErrors error = programRun(eval, &io);
+        if (error) printf("ERROR: program finished with error %d\n", error);
+
+        return error;
+    }
+
+    if (strcmp(mode, "jit") == 0)
+    {
+        JitFunction func = {};
+        int error = jitCompile(eval, eval->tree.root, &func);
+        if (error) { printf("ERROR: jit compilation failed: %d\n", error); return error; }
+
+        double vars[NamesNumber] = {};
+        error = jitRun(&func, vars, &io);
+        if (error) printf("ERROR: program finished with error %d\n", error);
+
+        jitFunctionDtor(&func);
+        return error;
+    }
+
+    if (strcmp(mode, "gradient") == 0)
+    {
+        int selected[DualTangents] = {};
+        int tangents = argc < DualTangents ? argc : DualTangents;
+
+        for (int i = 0; i < tangents; i++) selected[i] = atoi(argv[i]);
+
+        DualRunner runner = {};
+        int error = dualRunnerCtor(&runner, eval, &io, selected, tangents);
+        if (!error) error = dualRun(&runner);
+        if (error) printf("ERROR: program finished with error %d\n", error);
+
+        return error;
+    }
+
+    if (strcmp(mode, "bench") == 0)
+    {
+        double *inputs = (double *)calloc(argc + 1, sizeof(double));
+        if (!inputs) return MEMORY_ERROR;
+
+        for (int i = 0; i < argc; i++) inputs[i] = strtod(argv[i], NULL);
+
+        int error = jitBenchmark(eval, inputs, argc, BenchmarkRuns, stdout);
+
+        free(inputs);
+        return error;
+    }
+
+    if (strcmp(mode, "batch") == 0)
+    {
+        int rows = argc > 0 ? atoi(argv[0]) : BatchRows;
+        if (rows <= 0) rows = BatchRows;
+
+        return benchmarkStatements(eval, eval->tree.root, batchBenchmarkRows, rows);
+    }
+
+    if (strcmp(mode, "incremental") == 0)
+    {
+        int updates = argc > 0 ? atoi(argv[0]) : Updates;
+        if (updates <= 0) updates = Updates;
+
+        return benchmarkStatements(eval, eval->tree.root, incrementalBenchmark, updates);
+    }
+
+    if (strcmp(mode, "accuracy") == 0)
+    {
+        int samples = argc > 0 ? atoi(argv[0]) : MathSamples;
+        if (samples <= 0) samples = MathSamples;
+
+        return fastMathAccuracy(samples, stdout);
+    }
+
+    if (strcmp(mode, "derivative") == 0)
+    {
+        int order = argc > 0 ? atoi(argv[0]) : DiffOrder;
+        if (order <= 0) order = DiffOrder;
+
+        return benchmarkStatements(eval, eval->tree.root, diffReport, order);
+    }
+
+    if (strcmp(mode, "serve") == 0)
+    {
+        FormulaService service = {};
+        int error = formulaServiceCtor(&service, ServiceCacheSize);
+        if (error) return error;
+
+        if (argc > 0) error = formulaServiceListen(&service, argv[0]);
+        else          error = formulaServiceRun   (&service, fileno(stdin), stdout);
+
+        formulaServiceDtor(&service);
+        return error;
+    }
+
+    if (strcmp(mode, "check") == 0)
+    {
+        return closureCheck(stdout) + formulaServiceCheck(stdout);
+    }
+
+    if (strcmp(mode, "closure") == 0)
+    {
+        int runs = argc > 0 ? atoi(argv[0]) : BenchmarkRuns;
+        if (runs <= 0) runs = BenchmarkRuns;
+
+        return benchmarkStatements(eval, eval->tree.root, closureBenchmark, runs);
+    }
+
+    if (strcmp(mode, "forkjoin") == 0)
+    {
+        int nodes = argc > 0 ? atoi(argv[0]) : ForkJoinNodes;
+        if (nodes <= 0) nodes = ForkJoinNodes;
+
+        return benchmarkStatements(eval, eval->tree.root, forkJoinBenchmark, nodes);
+    }
+
+    if (strcmp(mode, "parallel") == 0)
+    {
+        if (argc < 3) { printf("ERROR: usage: parallel csv|bin <input> <output> [workers] [record size]\n"); return EXIT_FAILURE; }
+
+        ParallelFormat format     = strcmp(argv[0], "bin") == 0 ? PARALLEL_BINARY : PARALLEL_CSV;
+        int            workers    = argc > 3 ? atoi(argv[3]) : 0;
+        int            recordSize = argc > 4 ? atoi(argv[4]) : 0;
+
+        ParallelStats stats = {};
+        int error = programRunParallelFiles(eval, argv[1], argv[2], format, recordSize, workers, &stats);
+        if (error) printf("ERROR: parallel run failed: %d\n", error);
+
+        printf("records: %d (%d failed), %lg s, %lg records/s\n", stats.records, stats.failed, stats.seconds,
+                                                                 stats.seconds > 0 ? stats.records / stats.seconds : 0);
+        return error;
+    }
+
+    printf("ERROR: unknown mode: %s\n", mode);
+    return EXIT_FAILURE;
+}
+
+static int emulateAssembly(const char *fileInName, const char *assemblyPostfix, const char *linesPostfix)
+{
+    char *assemblyName = getFileName(fileInName, assemblyPostfix);
+    char *tableName    = linesPostfix ? getFileName(fileInName, linesPostfix) : NULL;
+    char *htmlName     = getFileName(fileInName, "_profile.html");
+
+    ProgramIO io = {};
+    programIOStdCtor(&io);
+
+    StackMachine machine = {};
+    int error = stackMachineCtor(&machine);
+
+    if (!error) error = stackMachineLoad(&machine, assemblyName);
+    if (!error && tableName && stackMachineLoadLines(&machine, tableName)) printf("WARNING: no line table %s\n", tableName);
+    if (!error)
+    {
+        error = stackMachineRun(&machine, &io);
+        if (error) printf("ERROR: program finished with error %d\n", error);
+
+        printf("\n");
+        stackMachineReport(&machine, stdout);
+        stackMachineHtmlProfile(&machine, fileInName, htmlName);
+    }
+    else printf("ERROR: can't load %s: %d\n", assemblyName, error);
+
+    stackMachineDtor(&machine);
+
+    free(assemblyName);
+    free(tableName);
+    free(htmlName);
+
+    return error;
+}
+
+static int batchBenchmarkRows(Evaluator *eval, Node *expression, int rows, FILE *f)
+{
+    return batchBenchmark(eval, expression, rows, BatchRuns, f);
+}
+
+static int benchmarkStatements(Evaluator *eval, Node *node, ExpressionBenchmark benchmark, int size)
+{
+    if (!node || node->type != EXP_TREE_OPERATOR) return EXIT_SUCCESS;
+
+    switch (node->data.operatorNum)
+    {
+        case INSTR_END: case IF:
+        case WHILE:     return benchmarkStatements(eval, node->left,  benchmark, size) ||
+                               benchmarkStatements(eval, node->right, benchmark, size);
+
+        case ASSIGN:    printf("\nassignment:\n");
+                        return benchmark(eval, node->left, size, stdout);
+
+        case OUT:       printf("\noutput:\n");
+                        return benchmark(eval, node->right, size, stdout);
+
+        case NOT_OPER:  case ADD:
+        case SUB:       case MUL:
+        case DIV:       case LN:
+        case LOGAR:     case POW:
+        case SIN:       case COS:
+        case R_BRACKET: case L_BRACKET:
+        case BELOW:     case ABOVE:
+        case OPEN_F:    case CLOSE_F:
+        case IN:        case THEN:
+        case EQUAL:     case NOT_EQUAL:
+        case SQRT:      case NEW_VAR:
+        default:        return EXIT_SUCCESS;
+    }
 }
 
 //.\test_compiler.exe factorial_while.txt
 //.\test_compiler.exe square_solver.txt
+//.\test_compiler.exe square_solver.txt jit
+//.\test_compiler.exe factorial_while.txt bench 10
+//./test_compiler square_solver.txt native
+//./test_compiler square_solver.txt c
+//./test_compiler square_solver.txt batch 100000
+//./test_compiler t.txt incremental 100000
+//./test_compiler t.txt closure 1000
+//./test_compiler t.txt fast=1e-7 run
+//./test_compiler t.txt fast=1e-12 c
+//./test_compiler t.txt accuracy 1000000
+//./test_compiler square_solver.txt gradient
+//./test_compiler square_solver.txt gradient 0 2
+//./test_compiler t.txt derivative 3
+//./test_compiler t.txt serve < requests.txt
+//./test_compiler t.txt serve /tmp/formulas.sock
+//./test_compiler t.txt check
+//./test_compiler square_solver.txt parallel csv coefficients.csv roots.csv
+//./test_compiler square_solver.txt parallel bin coefficients.bin roots.bin 8 3
+//./test_compiler factorial_while.txt emulate
+//./test_compiler t.txt forkjoin 4000000
@@ -0,0 +1,335 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sched.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "tree_of_expressions.h"
+#include "html_logfile.h"
+#include "thread_pool.h"
+
+//-------------------------------------------------------------------------------------------------
+// Work stealing: every worker pushes and pops its own deque at the bottom (newest task first),
+// idle workers steal from the top of the other deques (oldest, usually the biggest task).
+// Threads that are not workers push into the extra deque and help while they wait.
+//-------------------------------------------------------------------------------------------------
+
+struct ThreadWorkerArg
+{
+    ThreadPool *pool;
+    int         index;
+};
+
+static __thread ThreadPool *CurrentPool        = NULL;
+static __thread int         CurrentWorkerIndex = -1;
+
+static void *threadPoolWorker(void *arg);
+static bool  threadPoolTake  (ThreadPool *pool, int index, ThreadTask *task);
+static void  threadTaskExecute(ThreadTask *task);
+
+static int  threadDequeCtor(ThreadDeque *deque);
+static int  threadDequeDtor(ThreadDeque *deque);
+static int  threadDequePush(ThreadDeque *deque, ThreadTask *task);
+static bool threadDequePop  (ThreadDeque *deque, ThreadTask *task);
+static bool threadDequeSteal(ThreadDeque *deque, ThreadTask *task);
+
+
+int threadPoolCpuCount(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info = {};
+    GetSystemInfo(&info);
+    int count = (int)info.dwNumberOfProcessors;
+#else
+    int count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    return count > 0 ? count : 1;
+}
+
+int threadPoolCtor(ThreadPool *pool, int workersCount)
+{
+    assert(pool);
+
+    if (workersCount <= 0) workersCount = threadPoolCpuCount();
+
+    pool->workersCount = workersCount;
+    pool->queued       = 0;
+    pool->stop         = false;
+
+    pool->threads = (pthread_t *)  calloc((size_t)workersCount,     sizeof(pthread_t));
+    pool->deques  = (ThreadDeque *)calloc((size_t)workersCount + 1, sizeof(ThreadDeque));
+    if (!pool->threads || !pool->deques)
+    {
+        free(pool->threads);
+        free(pool->deques);
+        return MEMORY_ERROR;
+    }
+
+    for (int i = 0; i <= workersCount; i++)
+    {
+        if (threadDequeCtor(&pool->deques[i])) return MEMORY_ERROR;
+    }
+
+    pthread_mutex_init(&pool->sleepLock, NULL);
+    pthread_cond_init (&pool->wakeUp,    NULL);
+
+    for (int i = 0; i < workersCount; i++)
+    {
+        ThreadWorkerArg *arg = (ThreadWorkerArg *)calloc(1, sizeof(ThreadWorkerArg));
+        if (!arg) return MEMORY_ERROR;
+
+        arg->pool  = pool;
+        arg->index = i;
+
+        if (pthread_create(&pool->threads[i], NULL, threadPoolWorker, arg) != 0)
+        {
+            LOG("ERROR: %s: couldn't start worker %d\n", __func__, i);
+            free(arg);
+            pool->workersCount = i;
+            threadPoolDtor(pool);
+            return EXIT_FAILURE;
+        }
+    }
+
+    LOG("thread pool: %d workers\n", workersCount);
+
+    return EXIT_SUCCESS;
+}
+
+int threadPoolDtor(ThreadPool *pool)
+{
+    assert(pool);
+
+    pthread_mutex_lock(&pool->sleepLock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->wakeUp);
+    pthread_mutex_unlock(&pool->sleepLock);
+
+    for (int i = 0; i < pool->workersCount; i++) pthread_join(pool->threads[i], NULL);
+
+    for (int i = 0; i <= pool->workersCount; i++) threadDequeDtor(&pool->deques[i]);
+
+    pthread_mutex_destroy(&pool->sleepLock);
+    pthread_cond_destroy (&pool->wakeUp);
+
+    free(pool->threads);
+    free(pool->deques);
+
+    pool->threads      = NULL;
+    pool->deques       = NULL;
+    pool->workersCount = 0;
+
+    return EXIT_SUCCESS;
+}
+
+int threadPoolWorkerIndex(ThreadPool *pool)
+{
+    assert(pool);
+
+    return CurrentPool == pool ? CurrentWorkerIndex : pool->workersCount;
+}
+
+int threadPoolSubmit(ThreadPool *pool, ThreadTaskFunction function, void *arg, int *pending)
+{
+    assert(pool);
+    assert(function);
+
+    ThreadTask task = {function, arg, pending};
+
+    if (pending) __atomic_add_fetch(pending, 1, __ATOMIC_SEQ_CST);
+
+    int error = threadDequePush(&pool->deques[threadPoolWorkerIndex(pool)], &task);
+    if (error)
+    {
+        if (pending) __atomic_sub_fetch(pending, 1, __ATOMIC_SEQ_CST);
+        return error;
+    }
+
+    __atomic_add_fetch(&pool->queued, 1, __ATOMIC_SEQ_CST);
+
+    pthread_mutex_lock(&pool->sleepLock);
+    pthread_cond_signal(&pool->wakeUp);
+    pthread_mutex_unlock(&pool->sleepLock);
+
+    return EXIT_SUCCESS;
+}
+
+int threadPoolWait(ThreadPool *pool, int *pending)
+{
+    assert(pool);
+    assert(pending);
+
+    int index = threadPoolWorkerIndex(pool);
+
+    while (__atomic_load_n(pending, __ATOMIC_SEQ_CST) > 0)
+    {
+        ThreadTask task = {};
+
+        if (threadPoolTake(pool, index, &task)) threadTaskExecute(&task);
+        else                                    sched_yield();
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static void *threadPoolWorker(void *arg)
+{
+    assert(arg);
+
+    ThreadWorkerArg *workerArg = (ThreadWorkerArg *)arg;
+    ThreadPool      *pool      = workerArg->pool;
+
+    CurrentPool        = pool;
+    CurrentWorkerIndex = workerArg->index;
+    free(workerArg);
+
+    while (true)
+    {
+        ThreadTask task = {};
+
+        if (threadPoolTake(pool, CurrentWorkerIndex, &task))
+        {
+            threadTaskExecute(&task);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->sleepLock);
+
+        while (!pool->stop && __atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST) == 0)
+        {
+            pthread_cond_wait(&pool->wakeUp, &pool->sleepLock);
+        }
+
+        bool finish = pool->stop && __atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST) == 0;
+        pthread_mutex_unlock(&pool->sleepLock);
+
+        if (finish) break;
+    }
+
+    return NULL;
+}
+
+static bool threadPoolTake(ThreadPool *pool, int index, ThreadTask *task)
+{
+    assert(pool);
+    assert(task);
+
+    int dequesCount = pool->workersCount + 1;
+
+    bool found = threadDequePop(&pool->deques[index], task);
+
+    for (int i = 1; i < dequesCount && !found; i++)
+    {
+        found = threadDequeSteal(&pool->deques[(index + i) % dequesCount], task);
+    }
+
+    if (found) __atomic_sub_fetch(&pool->queued, 1, __ATOMIC_SEQ_CST);
+
+    return found;
+}
+
+static void threadTaskExecute(ThreadTask *task)
+{
+    assert(task);
+
+    task->function(task->arg);
+
+    if (task->pending) __atomic_sub_fetch(task->pending, 1, __ATOMIC_SEQ_CST);
+}
+
+static int threadDequeCtor(ThreadDeque *deque)
+{
+    assert(deque);
+
+    deque->tasks = (ThreadTask *)calloc(ThreadDequeStartCapacity, sizeof(ThreadTask));
+    if (!deque->tasks) return MEMORY_ERROR;
+
+    deque->top      = 0;
+    deque->bottom   = 0;
+    deque->capacity = ThreadDequeStartCapacity;
+
+    pthread_mutex_init(&deque->lock, NULL);
+
+    return EXIT_SUCCESS;
+}
+
+static int threadDequeDtor(ThreadDeque *deque)
+{
+    assert(deque);
+
+    free(deque->tasks);
+    deque->tasks = NULL;
+
+    pthread_mutex_destroy(&deque->lock);
+
+    return EXIT_SUCCESS;
+}
+
+static int threadDequePush(ThreadDeque *deque, ThreadTask *task)
+{
+    assert(deque);
+    assert(task);
+
+    pthread_mutex_lock(&deque->lock);
+
+    if (deque->bottom == deque->capacity)
+    {
+        int size = deque->bottom - deque->top;
+        memmove(deque->tasks, deque->tasks + deque->top, (size_t)size * sizeof(ThreadTask));
+
+        deque->top    = 0;
+        deque->bottom = size;
+
+        if (size * 2 > deque->capacity)
+        {
+            ThreadTask *tasks = (ThreadTask *)realloc(deque->tasks, (size_t)deque->capacity * 2 * sizeof(ThreadTask));
+            if (!tasks) { pthread_mutex_unlock(&deque->lock); return MEMORY_ERROR; }
+
+            deque->tasks     = tasks;
+            deque->capacity *= 2;
+        }
+    }
+
+    deque->tasks[deque->bottom++] = *task;
+
+    pthread_mutex_unlock(&deque->lock);
+
+    return EXIT_SUCCESS;
+}
+
+static bool threadDequePop(ThreadDeque *deque, ThreadTask *task)
+{
+    assert(deque);
+    assert(task);
+
+    pthread_mutex_lock(&deque->lock);
+
+    bool found = deque->bottom > deque->top;
+    if (found) *task = deque->tasks[--deque->bottom];
+
+    pthread_mutex_unlock(&deque->lock);
+
+    return found;
+}
+
+static bool threadDequeSteal(ThreadDeque *deque, ThreadTask *task)
+{
+    assert(deque);
+    assert(task);
+
+    pthread_mutex_lock(&deque->lock);
+
+    bool found = deque->bottom > deque->top;
+    if (found) *task = deque->tasks[deque->top++];
+
+    pthread_mutex_unlock(&deque->lock);
+
+    return found;
+}
@@ -0,0 +1,49 @@
+#ifndef  __THREAD_POOL_H__
+#define  __THREAD_POOL_H__
+
+#include <pthread.h>
+
+typedef void (*ThreadTaskFunction)(void *arg);
+
+struct ThreadTask
+{
+    ThreadTaskFunction function;
+    void              *arg;
+    int               *pending;
+};
+
+struct ThreadDeque
+{
+    ThreadTask     *tasks;
+    int             top;
+    int             bottom;
+    int             capacity;
+
+    pthread_mutex_t lock;
+};
+
+struct ThreadPool
+{
+    pthread_t      *threads;
+    int             workersCount;
+
+    ThreadDeque    *deques;          // workersCount + 1, the last one takes outside submissions
+
+    pthread_mutex_t sleepLock;
+    pthread_cond_t  wakeUp;
+    int             queued;
+    bool            stop;
+};
+
+const int ThreadDequeStartCapacity = 64;
+
+int threadPoolCtor(ThreadPool *pool, int workersCount);
+int threadPoolDtor(ThreadPool *pool);
+
+int threadPoolSubmit(ThreadPool *pool, ThreadTaskFunction function, void *arg, int *pending);
+int threadPoolWait  (ThreadPool *pool, int *pending);
+
+int threadPoolWorkerIndex(ThreadPool *pool);
+int threadPoolCpuCount(void);
+
+#endif //__THREAD_POOL_H__
@@ -0,0 +1,666 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+#include "tree_of_expressions.h"
+#include "html_logfile.h"
+#include "exp_tree_write.h"
+#include "tree_derivative.h"
+
+#define CHECK_POISON_PTR(ptr) \
+    if (ptr == PtrPoison)     \
+    {                         \
+        LOG("ERROR: PoisonPtr detected in %s(%d) %s\n", __FILE__, __LINE__, __func__);\
+        return 0;                                                                     \
+    }
+
+//-------------------------------------------------------------------------------------------------
+// Derivatives are built as a DAG: every node is hash-consed, so equal subexpressions are one node,
+// and a derivative points to the subtrees of the function instead of copying them. Each node
+// remembers its derivative, so a subtree shared by several parents is differentiated once.
+// diffMake() simplifies while building (constant folding and neutral elements), so every DAG is
+// already simplified bottom-up and the next derivative starts from the small form.
+// All nodes belong to the DiffDag and are freed together with it.
+//-------------------------------------------------------------------------------------------------
+
+const int DiffPrintLimit = 64;
+
+#define cL      node->left      // shared, never copied
+#define cR      node->right
+#define cN      node
+
+#define dL      diffDerivative(dag, node->left,  varIndex)
+#define dR      diffDerivative(dag, node->right, varIndex)
+
+#define NUM(value) diffNumber(dag, value)
+
+#define DIFF_OP(oper, left, right) diffMake(dag, EXP_TREE_OPERATOR, diffOperatorData(oper), left, right)
+
+#define _ADD(left, right) DIFF_OP(ADD,  left, right)
+#define _SUB(left, right) DIFF_OP(SUB,  left, right)
+#define _MUL(left, right) DIFF_OP(MUL,  left, right)
+#define _DIV(left, right) DIFF_OP(DIV,  left, right)
+#define _LN(       right) DIFF_OP(LN,   NULL, right)
+#define _POW(left, right) DIFF_OP(POW,  left, right)
+#define _SIN(      right) DIFF_OP(SIN,  NULL, right)
+#define _COS(      right) DIFF_OP(COS,  NULL, right)
+
+static DiffNode *diffAllocate   (DiffDag *dag);
+static Node    **diffTableFind  (DiffDag *dag, ExpTreeNodeType type, ExpTreeData data, Node *left, Node *right);
+static int       diffTableGrow  (DiffDag *dag);
+static DiffNode *diffNodeByIndex(DiffDag *dag, int index);
+
+static unsigned long long diffDataKey(ExpTreeNodeType type, ExpTreeData data);
+static unsigned long long diffHash   (ExpTreeNodeType type, ExpTreeData data, Node *left, Node *right);
+
+static Node *diffSimplify      (DiffDag *dag, ExpTreeOperators oper, Node *left, Node *right);
+static Node *diffDerivativeNode(DiffDag *dag, Node *node, int varIndex);
+static Node *diffNumber        (DiffDag *dag, double value);
+
+static ExpTreeData diffOperatorData(ExpTreeOperators oper);
+
+static bool diffIsNumber   (Node *node, double value);
+static bool diffCanCalculate(ExpTreeOperators oper);
+
+static double diffEvaluateNode(DiffDag *dag, Node *node, ExpTreeErrors *error);
+static int    diffCountNodes  (DiffDag *dag, Node *node);
+static double diffCountTree   (DiffDag *dag, Node *node);
+
+
+int diffDagCtor(DiffDag *dag, Evaluator *eval)
+{
+    assert(dag);
+    assert(eval);
+
+    dag->eval           = eval;
+    dag->blocks         = NULL;
+    dag->blocksCount    = 0;
+    dag->blocksCapacity = 0;
+    dag->nodesCount     = 0;
+    dag->mark           = 0;
+    dag->error          = TREE_NO_ERROR;
+
+    dag->tableSize = DiffStartTableSize;
+    dag->table     = (Node **)calloc((size_t)dag->tableSize, sizeof(Node *));
+    if (!dag->table) return MEMORY_ERROR;
+
+    return EXIT_SUCCESS;
+}
+
+int diffDagDtor(DiffDag *dag)
+{
+    assert(dag);
+
+    for (int i = 0; i < dag->blocksCount; i++) free(dag->blocks[i]);
+
+    free(dag->blocks);
+    free(dag->table);
+
+    dag->blocks         = NULL;
+    dag->table          = NULL;
+    dag->blocksCount    = 0;
+    dag->blocksCapacity = 0;
+    dag->nodesCount     = 0;
+    dag->tableSize      = 0;
+
+    return EXIT_SUCCESS;
+}
+
+static DiffNode *diffAllocate(DiffDag *dag)
+{
+    assert(dag);
+
+    if (dag->nodesCount == dag->blocksCount * DiffBlockNodes)
+    {
+        if (dag->blocksCount == dag->blocksCapacity)
+        {
+            int        capacity = dag->blocksCapacity ? dag->blocksCapacity * 2 : 16;
+            DiffNode **blocks   = (DiffNode **)realloc(dag->blocks, (size_t)capacity * sizeof(DiffNode *));
+            if (!blocks) return NULL;
+
+            dag->blocks         = blocks;
+            dag->blocksCapacity = capacity;
+        }
+
+        DiffNode *block = (DiffNode *)calloc((size_t)DiffBlockNodes, sizeof(DiffNode));
+        if (!block) return NULL;
+
+        dag->blocks[dag->blocksCount++] = block;
+    }
+
+    return diffNodeByIndex(dag, dag->nodesCount++);
+}
+
+static DiffNode *diffNodeByIndex(DiffDag *dag, int index)
+{
+    assert(dag);
+    assert(0 <= index && index < dag->nodesCount);
+
+    return &dag->blocks[index / DiffBlockNodes][index % DiffBlockNodes];
+}
+
+static unsigned long long diffDataKey(ExpTreeNodeType type, ExpTreeData data)
+{
+    unsigned long long key = 0;
+
+    switch (type)
+    {
+        case EXP_TREE_NUMBER:   memcpy(&key, &data.number, sizeof(double));
+                                return key;
+
+        case EXP_TREE_OPERATOR: return (unsigned long long)data.operatorNum;
+        case EXP_TREE_VARIABLE: return (unsigned long long)data.variableNum;
+        case EXP_TREE_IDENTIF:  return (unsigned long long)data.idNum;
+
+        case EXP_TREE_NOTHING:
+        default:                return 0;
+    }
+}
+
+static unsigned long long diffHash(ExpTreeNodeType type, ExpTreeData data, Node *left, Node *right)
+{
+    unsigned long long hash = diffDataKey(type, data) * 0x9E3779B97F4A7C15ull + (unsigned long long)type;
+
+    hash ^= (unsigned long long)left  + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2);
+    hash ^= (unsigned long long)right + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2);
+
+    return hash ^ (hash >> 29);
+}
+
+// returns the slot holding the equal node or the empty slot where it belongs
+static Node **diffTableFind(DiffDag *dag, ExpTreeNodeType type, ExpTreeData data, Node *left, Node *right)
+{
+    assert(dag);
+
+    unsigned long long key  = diffDataKey(type, data);
+    unsigned long long mask = (unsigned long long)dag->tableSize - 1;
+    unsigned long long slot = diffHash(type, data, left, right) & mask;
+
+    while (dag->table[slot])
+    {
+        Node *node = dag->table[slot];
+
+        if (node->type == type && node->left == left && node->right == right &&
+            diffDataKey(node->type, node->data) == key) return &dag->table[slot];
+
+        slot = (slot + 1) & mask;
+    }
+
+    return &dag->table[slot];
+}
+
+static int diffTableGrow(DiffDag *dag)
+{
+    assert(dag);
+
+    Node **table = (Node **)calloc((size_t)dag->tableSize * 2, sizeof(Node *));
+    if (!table) return MEMORY_ERROR;
+
+    free(dag->table);
+    dag->table      = table;
+    dag->tableSize *= 2;
+
+    for (int i = 0; i < dag->nodesCount; i++)
+    {
+        Node *node = &diffNodeByIndex(dag, i)->node;
+
+        *diffTableFind(dag, node->type, node->data, node->left, node->right) = node;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+Node *diffMake(DiffDag *dag, ExpTreeNodeType type, ExpTreeData data, Node *left, Node *right)
+{
+    assert(dag);
+
+    if (dag->error) return NULL;
+
+    if (type == EXP_TREE_OPERATOR)
+    {
+        Node *simple = diffSimplify(dag, data.operatorNum, left, right);
+        if (simple || dag->error) return simple;
+    }
+
+    Node **slot = diffTableFind(dag, type, data, left, right);
+    if (*slot) return *slot;
+
+    DiffNode *fresh = diffAllocate(dag);
+    if (!fresh)
+    {
+        dag->error = MEMORY_ERROR;
+        return NULL;
+    }
+
+    fresh->node.type     = type;
+    fresh->node.data     = data;
+    fresh->node.left     = left;
+    fresh->node.right    = right;
+    fresh->derivative    = NULL;
+    fresh->derivativeVar = IndexPoison;
+
+    *slot = &fresh->node;
+
+    if (dag->nodesCount * 2 >= dag->tableSize && diffTableGrow(dag))
+    {
+        dag->error = MEMORY_ERROR;
+        return NULL;
+    }
+
+    return &fresh->node;
+}
+
+static Node *diffNumber(DiffDag *dag, double value)
+{
+    return diffMake(dag, EXP_TREE_NUMBER, createNodeData(EXP_TREE_NUMBER, value), NULL, NULL);
+}
+
+static ExpTreeData diffOperatorData(ExpTreeOperators oper)
+{
+    return createNodeData(EXP_TREE_OPERATOR, oper);
+}
+
+static bool diffIsNumber(Node *node, double value)
+{
+    return node && node->type == EXP_TREE_NUMBER && !(fabs(node->data.number - value) > 0);
+}
+
+static bool diffCanCalculate(ExpTreeOperators oper)
+{
+    switch (oper)
+    {
+        case ADD:       case SUB:
+        case MUL:       case DIV:
+        case LN:        case LOGAR:
+        case POW:       case SIN:
+        case COS:       case SQRT:
+        case BELOW:     case ABOVE:
+        case EQUAL:     case NOT_EQUAL:
+                        return true;
+
+        case L_BRACKET: case R_BRACKET:
+        case ASSIGN:    case IF:
+        case OPEN_F:    case CLOSE_F:
+        case INSTR_END: case WHILE:
+        case IN:        case OUT:
+        case THEN:      case NEW_VAR:
+        case NOT_OPER:
+        default:        return false;
+    }
+}
+
+// NULL if no rule applies
+static Node *diffSimplify(DiffDag *dag, ExpTreeOperators oper, Node *left, Node *right)
+{
+    assert(dag);
+
+    if (!diffCanCalculate(oper) || !right) return NULL;
+
+    bool leftNumber  = !left || left->type == EXP_TREE_NUMBER;
+    bool rightNumber = right->type == EXP_TREE_NUMBER;
+
+    if (leftNumber && rightNumber)
+    {
+        ExpTreeErrors error = TREE_NO_ERROR;
+        double value = NodeCalculate(left ? left->data.number : 0, right->data.number, oper, &error);
+
+        // ln(-1) stays in the formula to fail at evaluation
+        if (!error) return NUM(value);
+    }
+
+    switch (oper)
+    {
+        case ADD:       if (diffIsNumber(left,  0)) return right;
+                        if (diffIsNumber(right, 0)) return left;
+                        return NULL;
+
+        case SUB:       if (diffIsNumber(right, 0)) return left;
+                        if (left == right)          return NUM(0);
+
+                        // -(-x) = x, unary minus is 0 - x
+                        if (diffIsNumber(left, 0) && right->type == EXP_TREE_OPERATOR &&
+                            right->data.operatorNum == SUB && diffIsNumber(right->left, 0)) return right->right;
+                        return NULL;
+
+        case MUL:       if (diffIsNumber(left,  0) || diffIsNumber(right, 0)) return NUM(0);
+                        if (diffIsNumber(left,  1)) return right;
+                        if (diffIsNumber(right, 1)) return left;
+                        return NULL;
+
+        case DIV:       if (diffIsNumber(left,  0)) return NUM(0);
+                        if (diffIsNumber(right, 1)) return left;
+                        return NULL;
+
+        case POW:       if (diffIsNumber(right, 1)) return left;
+                        if (diffIsNumber(right, 0)) return NUM(1);
+                        return NULL;
+
+        case LN:        case LOGAR:
+        case SIN:       case COS:
+        case SQRT:      case BELOW:
+        case ABOVE:     case EQUAL:
+        case NOT_EQUAL:
+                        return NULL;
+
+        case L_BRACKET: case R_BRACKET:
+        case ASSIGN:    case IF:
+        case OPEN_F:    case CLOSE_F:
+        case INSTR_END: case WHILE:
+        case IN:        case OUT:
+        case THEN:      case NEW_VAR:
+        case NOT_OPER:
+        default:        return NULL;
+    }
+}
+
+Node *diffImport(DiffDag *dag, Node *root)
+{
+    assert(dag);
+    CHECK_POISON_PTR(root);
+
+    if (!root) return NULL;
+
+    Node *left  = diffImport(dag, root->left);
+    Node *right = diffImport(dag, root->right);
+
+    return diffMake(dag, root->type, root->data, left, right);
+}
+
+// a plain tree for the old tools; it is as big as the DAG unfolded
+Node *diffExport(DiffDag *dag, Node *node)
+{
+    assert(dag);
+    CHECK_POISON_PTR(node);
+
+    if (!node) return NULL;
+
+    Node *left = diffExport(dag, node->left);
+    if (node->left && !left) return NULL;
+
+    Node *right = diffExport(dag, node->right);
+    if (node->right && !right)
+    {
+        subTreeDtor(left);
+        return NULL;
+    }
+
+    Node *copy = createNode(node->type, node->data, left, right);
+    if (!copy)
+    {
+        subTreeDtor(left);
+        subTreeDtor(right);
+    }
+
+    return copy;
+}
+
+// node has to belong to dag (see diffImport)
+Node *diffDerivative(DiffDag *dag, Node *node, int varIndex)
+{
+    assert(dag);
+    CHECK_POISON_PTR(node);
+
+    if (!node || dag->error) return NULL;
+
+    DiffNode *cached = (DiffNode *)node;
+    if (cached->derivative && cached->derivativeVar == varIndex) return cached->derivative;
+
+    Node *derivative = diffDerivativeNode(dag, node, varIndex);
+
+    if (derivative)
+    {
+        cached->derivative    = derivative;
+        cached->derivativeVar = varIndex;
+    }
+
+    return derivative;
+}
+
+Node *diffDerivativeOrder(DiffDag *dag, Node *node, int varIndex, int order)
+{
+    assert(dag);
+
+    for (int i = 0; i < order && node; i++) node = diffDerivative(dag, node, varIndex);
+
+    return node;
+}
+
+static Node *diffDerivativeNode(DiffDag *dag, Node *node, int varIndex)
+{
+    assert(dag);
+    assert(node);
+
+    switch (node->type)
+    {
+        case EXP_TREE_NUMBER:   return NUM(0);
+
+        case EXP_TREE_VARIABLE: return NUM(node->data.variableNum == varIndex ? 1 : 0);
+
+        case EXP_TREE_OPERATOR: break;
+
+        case EXP_TREE_NOTHING:
+        case EXP_TREE_IDENTIF:
+        default:                dag->error = BAD_NODE_TYPE;
+                                return NULL;
+    }
+
+    switch (node->data.operatorNum)
+    {
+        case ADD:       return _ADD(dL, dR);
+
+        case SUB:       return _SUB(dL, dR);
+
+        case MUL:       return _ADD(_MUL(dL, cR), _MUL(cL, dR));
+
+        // (u/v)' = (u' - (u/v) v') / v, squaring v would double the power with every order
+        case DIV:       return _DIV(_SUB(dL, _MUL(cN, dR)), cR);
+
+        case LN:        return _DIV(dR, cR);
+
+        // log_a(b) = ln(b) / ln(a)
+        case LOGAR:     return _DIV(_SUB(_DIV(dR, cR), _MUL(cN, _DIV(dL, cL))), _LN(cL));
+
+        case POW:
+        {
+            Node *exponentDerivative = dR;
+
+            // a constant exponent keeps (-2)^x-free formulas away from ln of the base
+            if (diffIsNumber(exponentDerivative, 0))
+            {
+                return _MUL(_MUL(cR, _POW(cL, _SUB(cR, NUM(1)))), dL);
+            }
+
+            return _MUL(cN, _ADD(_MUL(exponentDerivative, _LN(cL)), _DIV(_MUL(cR, dL), cL)));
+        }
+
+        case SIN:       return _MUL(_COS(cR), dR);
+
+        case COS:       return _MUL(_SUB(NUM(0), _SIN(cR)), dR);
+
+        case SQRT:      return _DIV(dR, _MUL(NUM(2), cN));
+
+        // piecewise constant
+        case BELOW:     case ABOVE:
+        case EQUAL:     case NOT_EQUAL:
+                        return NUM(0);
+
+        case L_BRACKET: case R_BRACKET:
+        case ASSIGN:    case IF:
+        case OPEN_F:    case CLOSE_F:
+        case INSTR_END: case WHILE:
+        case IN:        case OUT:
+        case THEN:      case NEW_VAR:
+        case NOT_OPER:
+        default:        LOG("ERROR: %s: can't differentiate operator %d\n", __func__, node->data.operatorNum);
+                        dag->error = UNKNOWN_OPERATOR;
+                        return NULL;
+    }
+}
+
+double diffEvaluate(DiffDag *dag, Node *node, ExpTreeErrors *error)
+{
+    assert(dag);
+    assert(error);
+
+    dag->mark++;
+
+    return diffEvaluateNode(dag, node, error);
+}
+
+static double diffEvaluateNode(DiffDag *dag, Node *node, ExpTreeErrors *error)
+{
+    assert(dag);
+    assert(error);
+
+    if (!node) return 0;
+
+    DiffNode *cached = (DiffNode *)node;
+
+    if (cached->mark != dag->mark)
+    {
+        ExpTreeErrors nodeError = TREE_NO_ERROR;
+        double        value     = DataPoison;
+
+        switch (node->type)
+        {
+            case EXP_TREE_NUMBER:   value = node->data.number;
+                                    break;
+
+            case EXP_TREE_VARIABLE: if (node->data.variableNum < 0 || node->data.variableNum >= dag->eval->names.count)
+                                    {
+                                        nodeError = BAD_VAR_INDEX;
+                                        break;
+                                    }
+
+                                    value = dag->eval->names.table[node->data.variableNum].value;
+                                    break;
+
+            case EXP_TREE_OPERATOR:
+            {
+                double left  = diffEvaluateNode(dag, node->left,  &nodeError);
+                double right = diffEvaluateNode(dag, node->right, &nodeError);
+
+                if (!nodeError) value = NodeCalculate(left, right, node->data.operatorNum, &nodeError);
+                break;
+            }
+
+            case EXP_TREE_NOTHING:
+            case EXP_TREE_IDENTIF:
+            default:                nodeError = BAD_NODE_TYPE;
+                                    break;
+        }
+
+        cached->value      = value;
+        cached->valueError = nodeError;
+        cached->mark       = dag->mark;
+    }
+
+    if (cached->valueError) *error = cached->valueError;
+
+    return cached->value;
+}
+
+int diffDagSize(DiffDag *dag, Node *node)
+{
+    assert(dag);
+
+    dag->mark++;
+
+    return diffCountNodes(dag, node);
+}
+
+static int diffCountNodes(DiffDag *dag, Node *node)
+{
+    assert(dag);
+
+    if (!node) return 0;
+
+    DiffNode *cached = (DiffNode *)node;
+    if (cached->mark == dag->mark) return 0;
+
+    cached->mark = dag->mark;
+
+    return 1 + diffCountNodes(dag, node->left) + diffCountNodes(dag, node->right);
+}
+
+// size of the same formula as a tree, may not fit into int
+double diffTreeSize(DiffDag *dag, Node *node)
+{
+    assert(dag);
+
+    dag->mark++;
+
+    return diffCountTree(dag, node);
+}
+
+static double diffCountTree(DiffDag *dag, Node *node)
+{
+    assert(dag);
+
+    if (!node) return 0;
+
+    DiffNode *cached = (DiffNode *)node;
+
+    if (cached->mark != dag->mark)
+    {
+        cached->value      = 1 + diffCountTree(dag, node->left) + diffCountTree(dag, node->right);
+        cached->valueError = TREE_NO_ERROR;
+        cached->mark       = dag->mark;
+    }
+
+    return cached->value;
+}
+
+int diffReport(Evaluator *eval, Node *expression, int order, FILE *f)
+{
+    assert(eval);
+    assert(f);
+    CHECK_POISON_PTR(expression);
+
+    DiffDag dag = {};
+    int error = diffDagCtor(&dag, eval);
+    if (error) return error;
+
+    Node *function = diffImport(&dag, expression);
+
+    fprintf(f, "function:       %d DAG nodes, %lg tree nodes\n", diffDagSize(&dag, function),
+                                                                 diffTreeSize(&dag, function));
+
+    for (int var = 0; var < eval->names.count && !dag.error; var++)
+    {
+        Node *derivative = function;
+
+        for (int k = 1; k <= order && derivative; k++)
+        {
+            derivative = diffDerivative(&dag, derivative, var);
+            if (!derivative) break;
+
+            if (k == 1 && diffIsNumber(derivative, 0)) break;
+
+            ExpTreeErrors evalError = TREE_NO_ERROR;
+            double value    = diffEvaluate(&dag, derivative, &evalError);
+            double treeSize = diffTreeSize(&dag, derivative);
+
+            fprintf(f, "d^%d/d%s^%d:  %8d DAG nodes, %12lg tree nodes, value " ElemNumberFormat " (error %d)\n",
+                       k, eval->names.table[var].name, k, diffDagSize(&dag, derivative), treeSize, value, evalError);
+
+            if (treeSize <= DiffPrintLimit)
+            {
+                fprintf(f, "                ");
+                printTreeInfix(eval, derivative, f);
+                fprintf(f, "\n");
+            }
+        }
+    }
+
+    fprintf(f, "total:          %d nodes in the DAG\n", dag.nodesCount);
+
+    error = dag.error;
+    if (error) LOG("ERROR: %s: differentiation failed: %d\n", __func__, error);
+
+    diffDagDtor(&dag);
+
+    return error;
+}
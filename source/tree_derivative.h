@@ -0,0 +1,57 @@
+#ifndef  __TREE_DERIVATIVE_H__
+#define  __TREE_DERIVATIVE_H__
+
+#include <stdio.h>
+
+#include "tree_of_expressions.h"
+
+const int DiffBlockNodes      = 1024;
+const int DiffStartTableSize  = 1024;
+
+// node must stay the first member: DAG functions get Node * and cast back
+struct DiffNode
+{
+    Node           node;
+
+    Node          *derivative;
+    int            derivativeVar;
+
+    double         value;
+    ExpTreeErrors  valueError;
+    int            mark;
+};
+
+struct DiffDag
+{
+    Evaluator  *eval;
+
+    DiffNode  **blocks;
+    int         blocksCount;
+    int         blocksCapacity;
+    int         nodesCount;
+
+    Node      **table;
+    int         tableSize;
+
+    int         mark;
+    int         error;
+};
+
+int diffDagCtor(DiffDag *dag, Evaluator *eval);
+int diffDagDtor(DiffDag *dag);
+
+Node *diffMake  (DiffDag *dag, ExpTreeNodeType type, ExpTreeData data, Node *left, Node *right);
+Node *diffImport(DiffDag *dag, Node *root);
+Node *diffExport(DiffDag *dag, Node *node);
+
+Node *diffDerivative     (DiffDag *dag, Node *node, int varIndex);
+Node *diffDerivativeOrder(DiffDag *dag, Node *node, int varIndex, int order);
+
+double diffEvaluate(DiffDag *dag, Node *node, ExpTreeErrors *error);
+
+int    diffDagSize (DiffDag *dag, Node *node);
+double diffTreeSize(DiffDag *dag, Node *node);
+
+int diffReport(Evaluator *eval, Node *expression, int order, FILE *f);
+
+#endif //__TREE_DERIVATIVE_H__
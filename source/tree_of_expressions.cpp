@@ -9,6 +9,7 @@
 #include "html_logfile.h"
 
 #include "exp_tree_write.h"
+#include "fast_math.h"
 
 #define CHECK_POISON_PTR(ptr) \
     assert(ptr != PtrPoison)
@@ -141,6 +142,26 @@ int nameTableFind(NameTable *names, const char *name)
     return IndexPoison;
 }
 
+// a new variable for the optimisations, the first of prefix0, prefix1, ... that is not taken,
+// IndexPoison if the table is full
+int nameTableAddTemp(NameTable *names, const char *prefix)
+{
+    assert(names);
+    assert(prefix);
+
+    if (names->count >= NamesNumber) return IndexPoison;
+
+    char name[WordLength] = "";
+
+    for (int i = 0; ; i++)
+    {
+        snprintf(name, sizeof(name), "%s%d", prefix, i);
+        if (nameTableFind(names, name) == IndexPoison) break;
+    }
+
+    return nameTableAdd(names, name, DefaultVarValue);
+}
+
 int nameTableSetValue(NameTable *names, const char *name, double value)
 {
     assert(names);
@@ -293,19 +314,19 @@ double NodeCalculate(double leftTree, double rightTree,
                         return leftTree / rightTree;
             
         case LN:        CHECK_ERROR(rightTree < 0, LOG_NEGATIVE_ARG);
-                        return log(rightTree);
+                        return mathLn(rightTree);
             
         case LOGAR:     CHECK_ERROR(rightTree < 0, LOG_NEGATIVE_ARG);
                         CHECK_ERROR(leftTree  < 0, LOG_BAD_BASE);
                         CHECK_ERROR(equalDouble(leftTree, 1), LOG_BAD_BASE);
 
-                        return log(rightTree) / log(leftTree);
+                        return mathLn(rightTree) / mathLn(leftTree);
 
-        case POW:       return pow(leftTree, rightTree);
+        case POW:       return mathPow(leftTree, rightTree);
 
-        case SIN:       return sin(rightTree);
+        case SIN:       return mathSin(rightTree);
 
-        case COS:       return cos(rightTree);
+        case COS:       return mathCos(rightTree);
 
         case SQRT:      return sqrt(rightTree);
 
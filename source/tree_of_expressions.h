@@ -58,6 +58,8 @@ struct Node
     
     Node *left;
     Node *right;
+
+    int   line;     // source line of a statement, 0 if unknown
 };
 
 const int NamesNumber = 10;
@@ -134,6 +136,7 @@ int nameTableAdd     (NameTable *names, const char *name, double value);
 int nameTableSetValue(NameTable *names, const char *name, double value);
 int nameTableDump    (NameTable *names, FILE *f);
 int nameTableFind    (NameTable *names, const char *name);
+int nameTableAddTemp (NameTable *names, const char *prefix);
 
 int nameTableCopy(NameTable *from, NameTable *to);
 
@@ -0,0 +1,338 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "tree_of_expressions.h"
+#include "html_logfile.h"
+#include "exp_tree_write.h"
+#include "tree_reassociate.h"
+
+#define CHECK_POISON_PTR(ptr) \
+    if (ptr == PtrPoison)     \
+    {                         \
+        LOG("ERROR: PoisonPtr detected in %s(%d) %s\n", __FILE__, __LINE__, __func__);\
+        return 0;                                                                     \
+    }
+
+//-------------------------------------------------------------------------------------------------
+// Reassociation. A chain of + and - (or of * and /) is flattened into its operands, each either
+// added or subtracted (multiplied or divided by), all the numbers of the chain are folded into
+// one, the other operands are sorted into a canonical order (variables by index, then operator
+// subtrees), and the chain is rebuilt as a balanced tree: "2 * x * 3" becomes "x * 6", and
+// "b + 1 + a - c + 2" becomes "(a + b) + 3 - c" whatever order it was written in.
+// Only a division at the top of the chain is flattened, never one inside a divisor: a / (b / c)
+// stays as it is, flattening it would lose the error of c = 0. A number divisor is folded only
+// when it is not (nearly) zero, which NodeCalculate reports, and the divisors that are not
+// numbers are not multiplied together: the product of two small divisors may be "zero" when
+// neither of them is, so they divide the rest one after another, "a / b / c" stays that way.
+//-------------------------------------------------------------------------------------------------
+
+#define IS_OPER(node, oper) ((node) && (node)->type == EXP_TREE_OPERATOR && (node)->data.operatorNum == (oper))
+
+// exact, x + 1e-9 is not x, and false for nan, so a nan constant is neither 0 nor neutral
+#define SAME_NUMBER(a, b)   ((a) <= (b) && (a) >= (b))
+
+static int  reassociate    (Node **slot);
+static int  chainCollect   (Chain *chain, Node *node, bool inverse);
+static void chainFreeShells(Chain *chain);
+static int  chainAdd       (Chain *chain, Node *node, bool inverse);
+static Node *chainBuild    (Chain *chain);
+static Node *chainBalanced (Chain *chain, int begin, int end);
+static Node *chainNode     (ExpTreeOperators oper, Node *left, Node *right);
+static Node *chainNumber   (double value);
+
+static int  chainCompare   (const void *a, const void *b);
+static int  treeCompare    (Node *a, Node *b);
+static int  treeRank       (Node *node);
+
+
+int expTreeReassociate(Evaluator *eval, Node *node)
+{
+    assert(eval);
+    CHECK_POISON_PTR(node);
+
+    if (!node) return 0;
+
+    // the caller keeps pointing to node, so it is not given to the chain, which frees the old
+    // operator nodes: a copy of it is, and what the copy became is moved back into node
+    Node *root = createNode(node->type, node->data, node->left, node->right);
+    if (!root) return 0;
+
+    root->line = node->line;
+
+    int chains = reassociate(&root);
+    int line   = node->line;
+
+    *node = *root;
+    node->line = line;
+
+    destroyNode(&root);
+
+    LOG("%s: %d chains rebuilt\n", __func__, chains);
+
+    return chains;
+}
+
+static int reassociate(Node **slot)
+{
+    assert(slot);
+
+    Node *node = *slot;
+    if (!node || node == PtrPoison || node->type != EXP_TREE_OPERATOR) return 0;
+
+    // - and / belong to the chains of the commutative + and *
+    ExpTreeOperators oper = node->data.operatorNum;
+
+    if (!isCommutative(node)) oper = oper == SUB ? ADD :
+                                     oper == DIV ? MUL : NOT_OPER;
+
+    if (oper == NOT_OPER) return reassociate(&node->left) + reassociate(&node->right);
+
+    Chain chain = {};
+    chain.oper     = oper;
+    chain.constant = oper == ADD ? 0 : 1;
+    chain.operands = (ChainOperand *)calloc(ChainStartOperands, sizeof(ChainOperand));
+    chain.capacity = ChainStartOperands;
+
+    if (!chain.operands) return 0;
+
+    int chains = 1 + chainCollect(&chain, node, false);
+
+    Node *result = chain.error ? NULL : chainBuild(&chain);
+
+    // the operator nodes of the old chain, the operands are in the new one
+    if (result)
+    {
+        *slot = result;
+        chainFreeShells(&chain);
+    }
+
+    free(chain.operands);
+
+    return result ? chains : chains - 1;
+}
+
+// moves the operands of the chain under node into chain, reassociating each of them
+static int chainCollect(Chain *chain, Node *node, bool inverse)
+{
+    assert(chain);
+    assert(node);
+
+    bool same = (chain->oper == ADD && (IS_OPER(node, ADD) || IS_OPER(node, SUB))) ||
+                (chain->oper == MUL && (IS_OPER(node, MUL) || (IS_OPER(node, DIV) && !inverse)));
+
+    if (!same)
+    {
+        if (node->type == EXP_TREE_NUMBER)
+        {
+            double value = node->data.number;
+
+            if (chain->oper == ADD)
+            {
+                chain->constant += inverse ? -value : value;
+                chain->numbers++;
+
+                destroyNode(&node);
+                return 0;
+            }
+
+            if (!inverse || !equalDouble(value, 0))
+            {
+                chain->constant = inverse ? chain->constant / value : chain->constant * value;
+                chain->numbers++;
+
+                destroyNode(&node);
+                return 0;
+            }
+        }
+
+        int chains = reassociate(&node);
+        chainAdd(chain, node, inverse);
+
+        return chains;
+    }
+
+    Node *left  = node->left;
+    Node *right = node->right;
+    bool  flip  = IS_OPER(node, SUB) || IS_OPER(node, DIV);
+
+    node->left    = chain->shells;
+    node->right   = NULL;
+    chain->shells = node;
+
+    int chains = 0;
+    if (left)  chains += chainCollect(chain, left,  inverse);
+    if (right) chains += chainCollect(chain, right, flip ? !inverse : inverse);
+
+    return chains;
+}
+
+static void chainFreeShells(Chain *chain)
+{
+    assert(chain);
+
+    while (chain->shells)
+    {
+        Node *next = chain->shells->left;
+        destroyNode(&chain->shells);
+        chain->shells = next;
+    }
+}
+
+static int chainAdd(Chain *chain, Node *node, bool inverse)
+{
+    assert(chain);
+    assert(node);
+
+    if (chain->count == chain->capacity)
+    {
+        int           capacity = chain->capacity * 2;
+        ChainOperand *operands = (ChainOperand *)realloc(chain->operands, (size_t)capacity * sizeof(ChainOperand));
+        if (!operands)
+        {
+            chain->error = MEMORY_ERROR;
+            return MEMORY_ERROR;
+        }
+
+        chain->operands = operands;
+        chain->capacity = capacity;
+    }
+
+    chain->operands[chain->count].node    = node;
+    chain->operands[chain->count].inverse = inverse;
+    chain->count++;
+
+    return EXIT_SUCCESS;
+}
+
+static Node *chainBuild(Chain *chain)
+{
+    assert(chain);
+
+    bool isAdd = chain->oper == ADD;
+
+    // x * 0 is 0, the same as the rule of the simplifier
+    if (!isAdd && chain->numbers && SAME_NUMBER(chain->constant, 0))
+    {
+        for (int i = 0; i < chain->count; i++) subTreeDtor(chain->operands[i].node);
+        chain->count = 0;
+
+        return chainNumber(0);
+    }
+
+    // the folded number goes last, to the side it does not need a sign on
+    double neutral = isAdd ? 0 : 1;
+
+    if (!SAME_NUMBER(chain->constant, neutral))
+    {
+        bool   inverse = isAdd && chain->constant < 0;
+        Node  *number  = chainNumber(inverse ? -chain->constant : chain->constant);
+
+        if (!number || chainAdd(chain, number, inverse))
+        {
+            subTreeDtor(number);
+            return NULL;
+        }
+    }
+
+    int direct = 0;
+    for (int i = 0; i < chain->count; i++) if (!chain->operands[i].inverse) direct++;
+
+    // numbers sort last, so the folded one stays at the end
+    qsort(chain->operands, (size_t)chain->count, sizeof(ChainOperand), chainCompare);
+
+    Node *plus  = chainBalanced(chain, 0, direct);
+
+    if (!plus && direct == chain->count) return chainNumber(neutral);
+    if (direct == chain->count)          return plus;
+
+    if (!plus) plus = chainNumber(neutral);
+
+    if (isAdd) return chainNode(SUB, plus, chainBalanced(chain, direct, chain->count));
+
+    // every divisor is checked for zero on its own
+    for (int i = direct; i < chain->count && plus; i++) plus = chainNode(DIV, plus, chain->operands[i].node);
+
+    return plus;
+}
+
+// the subtracted operands are a sum too
+static Node *chainBalanced(Chain *chain, int begin, int end)
+{
+    assert(chain);
+
+    if (begin >= end)     return NULL;
+    if (begin + 1 == end) return chain->operands[begin].node;
+
+    int middle = begin + (end - begin) / 2;
+
+    Node *left  = chainBalanced(chain, begin,  middle);
+    Node *right = chainBalanced(chain, middle, end);
+
+    return chainNode(chain->oper, left, right);
+}
+
+static Node *chainNode(ExpTreeOperators oper, Node *left, Node *right)
+{
+    return createNode(EXP_TREE_OPERATOR, createNodeData(EXP_TREE_OPERATOR, oper), left, right);
+}
+
+static Node *chainNumber(double value)
+{
+    return createNode(EXP_TREE_NUMBER, createNodeData(EXP_TREE_NUMBER, value), NULL, NULL);
+}
+
+// direct operands before inverse ones, inside each: variables by index, operators, numbers
+static int chainCompare(const void *a, const void *b)
+{
+    const ChainOperand *x = (const ChainOperand *)a;
+    const ChainOperand *y = (const ChainOperand *)b;
+
+    if (x->inverse != y->inverse) return x->inverse ? 1 : -1;
+
+    return treeCompare(x->node, y->node);
+}
+
+static int treeCompare(Node *a, Node *b)
+{
+    if (!a || !b) return (a != NULL) - (b != NULL);
+
+    if (a->type != b->type) return treeRank(a) - treeRank(b);
+
+    switch (a->type)
+    {
+        case EXP_TREE_VARIABLE: return a->data.variableNum - b->data.variableNum;
+
+        case EXP_TREE_NUMBER:   return (a->data.number > b->data.number) - (a->data.number < b->data.number);
+
+        case EXP_TREE_OPERATOR:
+        {
+            if (a->data.operatorNum != b->data.operatorNum) return (int)a->data.operatorNum - (int)b->data.operatorNum;
+
+            int order = treeCompare(a->left, b->left);
+
+            return order ? order : treeCompare(a->right, b->right);
+        }
+
+        case EXP_TREE_IDENTIF:  return a->data.idNum - b->data.idNum;
+
+        case EXP_TREE_NOTHING:
+        default:                return 0;
+    }
+}
+
+static int treeRank(Node *node)
+{
+    assert(node);
+
+    switch (node->type)
+    {
+        case EXP_TREE_VARIABLE: return 0;
+        case EXP_TREE_OPERATOR: return 1;
+        case EXP_TREE_NUMBER:   return 2;
+
+        case EXP_TREE_IDENTIF:
+        case EXP_TREE_NOTHING:
+        default:                return 3;
+    }
+}
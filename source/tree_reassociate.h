@@ -0,0 +1,32 @@
+#ifndef  __TREE_REASSOCIATE_H__
+#define  __TREE_REASSOCIATE_H__
+
+#include "tree_of_expressions.h"
+
+const int ChainStartOperands = 16;
+
+struct ChainOperand
+{
+    Node *node;
+    bool  inverse;         // subtracted or divided by
+};
+
+// a flattened + - or * / chain
+struct Chain
+{
+    ExpTreeOperators  oper;         // ADD or MUL
+    ChainOperand     *operands;
+    int               count;
+    int               capacity;
+
+    double            constant;     // all the numbers of the chain folded together
+    int               numbers;
+
+    Node             *shells;       // its old operator nodes, linked by left
+
+    int               error;
+};
+
+int expTreeReassociate(Evaluator *eval, Node *node);
+
+#endif //__TREE_REASSOCIATE_H__
@@ -1,10 +1,13 @@
 #include <assert.h>
 #include <stdio.h>
+#include <math.h>
 
 #include "tree_of_expressions.h"
 #include "html_logfile.h"
 #include "exp_tree_write.h"
 #include "tree_simplify.h"
+#include "simplify_rules.h"
+#include "tree_reassociate.h"
 
 
 
@@ -15,100 +18,134 @@
         return 0;                                                                     \
     }
 
-#define EV_L canBeEvaluated(node->left)
-#define EV_R canBeEvaluated(node->right)
+//-------------------------------------------------------------------------------------------------
+// One post-order sweep: the children are folded before their parent, so a constant child is
+// already a number node by the time the parent looks at it, and neither constness nor values
+// are ever recomputed. The algebraic rules run in the same sweep. A rule leaves a number, an
+// already simplified child or a small node over them, which is folded and matched again on the
+// spot, so there is nothing left for a second pass to do. Folding that fails (1 / 0) is left
+// for the program to report at run time.
+//-------------------------------------------------------------------------------------------------
 
-#define VALUE_0(node) (canBeEvaluated(node) && equalDouble(expTreeEvaluate(eval, node, &error), 0))
-#define VALUE_1(node) (canBeEvaluated(node) && equalDouble(expTreeEvaluate(eval, node, &error), 1))
+#define IS_CONST(node)         (!(node) || (node)->type == EXP_TREE_NUMBER)
+#define CONST_VALUE(node)      ((node) ? (node)->data.number : 0)
+
+#define CHANGED 1
+
+static bool ruleIsLeaf       (Node *x);
+static bool ruleIsNonZero    (Node *x);
+static bool ruleIsNonNegative(Node *x);
+
+static int simplifyNode(Evaluator *eval, Node *node);
+
+// the first matching rule wins
+static const SimplifyRule SimplifyRules[] =
+{
+    //  pattern             result      guard
+    {"+ x 0",               "x",        NULL},
+    {"+ 0 x",               "x",        NULL},
+    {"- x 0",               "x",        NULL},
+    {"- x x",               "0",        NULL},
+    {"- 0 - 0 x",           "x",        NULL},
+    {"* x 0",               "0",        NULL},
+    {"* 0 x",               "0",        NULL},
+    {"* x 1",               "x",        NULL},
+    {"* 1 x",               "x",        NULL},
+    {"* x 2",               "+ x x",    ruleIsLeaf},
+    {"* 2 x",               "+ x x",    ruleIsLeaf},
+    {"/ 0 x",               "0",        NULL},
+    {"/ x 1",               "x",        NULL},
+    {"/ x x",               "1",        ruleIsNonZero},
+    {"^ x 1",               "x",        NULL},
+    {"^ x 0",               "1",        NULL},
+    {"ln _ 1",              "0",        NULL},
+    {"^ sqrt _ x 2",        "x",        ruleIsNonNegative},
+};
+
+const int SimplifyRulesCount = (int)(sizeof(SimplifyRules) / sizeof(SimplifyRules[0]));
+
+static RuleSet SimplifyRuleSet   = {};
+static bool    SimplifyRulesReady = false;
 
 
 int expTreeSimplify(Evaluator *eval, Node *node)
 {
     assert(eval);
 
-    int changeCount = 0;
-    int prevCount   = -1;
+    int changeCount = expTreeSimplifyFold(eval, node);
 
-    while (changeCount > prevCount)
-    {
-        prevCount = changeCount;
+    // numbers apart in a chain ("2 * x * 3") are folded by reassociation, the rebuilt chains
+    // go through the rules once more
+    if (expTreeReassociate(eval, node)) changeCount += expTreeSimplifyFold(eval, node);
 
-        changeCount += expTreeSimplifyConsts     (eval, node);
-        changeCount += expTreeSimplifyNeutralElem(eval, node);
-    }
+    LOG("%s: %d changes\n", __func__, changeCount);
+
+    if (SimplifyRulesReady) ruleSetStats(&SimplifyRuleSet, LogFile);
 
     return EXIT_SUCCESS;
 }
 
-#define CHANGED 1
-
-int expTreeSimplifyConsts(Evaluator *eval, Node *node)
+int expTreeSimplifyFold(Evaluator *eval, Node *node)
 {
+    assert(eval);
     CHECK_POISON_PTR(node);
-    
-    if (!node)  return EXIT_SUCCESS;
-
-    /*LOG("I'm simplify consts\n");
-    dumpNode(eval, node, LogFile);
-    LOG("EV_L = %d\n", EV_L);
-    LOG("EV_R = %d\n", EV_R);
-    LOG("EV_L && EV_R = %d\n\n", EV_L && EV_R);*/
 
-    if (node->type == EXP_TREE_NUMBER)   return EXIT_SUCCESS;
-    if (node->type == EXP_TREE_VARIABLE) return EXIT_SUCCESS;
-    if (node->type == EXP_TREE_NOTHING)  return EXIT_FAILURE;
+    if (!node || node->type != EXP_TREE_OPERATOR) return 0;
 
     int count = 0;
-    count += expTreeSimplifyConsts(eval, node->left);
-    count += expTreeSimplifyConsts(eval, node->right);
+    count += expTreeSimplifyFold(eval, node->left);
+    count += expTreeSimplifyFold(eval, node->right);
 
-    if (node->type == EXP_TREE_OPERATOR)
+    int oper = node->data.operatorNum;
+
+    if (oper == IF  || oper == WHILE ||
+        oper == OUT || oper == INSTR_END) return count;
+
+    while (node->type == EXP_TREE_OPERATOR)
     {
-        int oper = node->data.operatorNum;
+        int changed = simplifyNode(eval, node);
+        if (changed <= 0) break;
 
-        if (oper == IF  || oper == WHILE ||
-            oper == OUT || oper == INSTR_END) return EXIT_SUCCESS;
+        count += changed;
     }
 
-    if (EV_L && EV_R)
+    return count;
+}
+
+// folds the node or applies one rule to it, the children are simplified already
+static int simplifyNode(Evaluator *eval, Node *node)
+{
+    assert(eval);
+    assert(node);
+
+    if (IS_CONST(node->left) && IS_CONST(node->right))
     {
         ExpTreeErrors error = TREE_NO_ERROR;
-        double left  = expTreeEvaluate(eval, node->left,  &error);
-        double right = expTreeEvaluate(eval, node->right, &error);
-        if (error) return error;
+        double value = NodeCalculate(CONST_VALUE(node->left), CONST_VALUE(node->right), node->data.operatorNum, &error);
+        if (error) return EXIT_SUCCESS;
 
         subTreeDtor(node->left);
         subTreeDtor(node->right);
-        node->data.number  = NodeCalculate(left, right, node->data.operatorNum, &error);
-        if (error) return error;
 
-        node->type = EXP_TREE_NUMBER;
-        node->left  = NULL;
-        node->right = NULL;
+        node->type        = EXP_TREE_NUMBER;
+        node->data.number = value;
+        node->left        = NULL;
+        node->right       = NULL;
 
-        return 1;
+        return CHANGED;
     }
-    return EXIT_SUCCESS;
+
+    return tryNodeSimplify(eval, node);
 }
 
-int expTreeSimplifyNeutralElem(Evaluator *eval, Node *node)
+int expTreeSimplifyDtor(void)
 {
-    CHECK_POISON_PTR(node);
-    
-    if (!node)  return EXIT_SUCCESS;
-
-    if (node->type == EXP_TREE_NUMBER)   return EXIT_SUCCESS;
-    if (node->type == EXP_TREE_VARIABLE) return EXIT_SUCCESS;
-    if (node->type == EXP_TREE_NOTHING)  return NODE_TYPE_NOTHING;
-
-    int count = 0;
-
-    count += tryNodeSimplify(eval, node);
+    if (!SimplifyRulesReady) return EXIT_SUCCESS;
 
-    count += expTreeSimplifyNeutralElem(eval, node->left);
-    count += expTreeSimplifyNeutralElem(eval, node->right);
+    ruleSetDtor(&SimplifyRuleSet);
+    SimplifyRulesReady = false;
 
-    return count;
+    return EXIT_SUCCESS;
 }
 
 int tryNodeSimplify(Evaluator *eval, Node *node)
@@ -116,114 +153,85 @@ int tryNodeSimplify(Evaluator *eval, Node *node)
     assert(eval);
     CHECK_POISON_PTR(node);
 
-    switch (node->data.operatorNum)
+    if (!SimplifyRulesReady)
     {
-        case ADD:
-        {
-            if (casePlus0(eval, node, node->left,  node->right))  return CHANGED;
-            if (casePlus0(eval, node, node->right, node->left))   return CHANGED;
-
-            return EXIT_SUCCESS;
-        }
-        case SUB:
-        {
-            if (casePlus0(eval, node, node->right, node->left))   return CHANGED;
-
-            return EXIT_SUCCESS;
-        }
-        case MUL:
-        {
-            if (caseTimes0(eval, node, node->left))               return CHANGED;
-            if (caseTimes0(eval, node, node->right))              return CHANGED;
-            if (caseTimes1(eval, node, node->left,  node->right)) return CHANGED;
-            if (caseTimes1(eval, node, node->right, node->left))  return CHANGED;
-
-            return EXIT_SUCCESS;
-        }
-        case DIV:
-        {
-            if (caseTimes0(eval, node, node->left)) return CHANGED;
-            return EXIT_SUCCESS;
-        }
-        case POW:
-            return EXIT_SUCCESS;
-
-        case LN:     case LOGAR:
-        case SIN:    case COS:
-        case ASSIGN: case WHILE:
-        case BELOW:  case ABOVE:
-        case IF:     case INSTR_END:
-        case OPEN_F: case CLOSE_F:
-        case OUT:    case IN:
-        case EQUAL:  case NOT_EQUAL:
-        case THEN:   case SQRT:
-        case NEW_VAR:
-        
-            return EXIT_SUCCESS;
-
-        case L_BRACKET: case R_BRACKET: case NOT_OPER:
-        default:
-            printf("ERROR: unknown operator: %d\n", node->data.operatorNum);
-            return UNKNOWN_OPERATOR;
+        int error = ruleSetCtor(&SimplifyRuleSet, SimplifyRules, SimplifyRulesCount);
+        if (error) return error;
+
+        SimplifyRulesReady = true;
     }
+
+    return ruleSetApply(&SimplifyRuleSet, node);
 }
 
-int casePlus0(Evaluator *eval, Node *node, Node *zero, Node *savedNode) 
+static bool ruleIsLeaf(Node *x)
 {
-    CHECK_POISON_PTR(zero);
-    CHECK_POISON_PTR(savedNode);
-
-    ExpTreeErrors error = TREE_NO_ERROR;
+    assert(x);
 
-    if (VALUE_0(zero))                           
-    {   
-        if (error) return error;                                       
-        subTreeDtor(zero);               
-        *node = *savedNode;               
-        destroyNode(&savedNode);
+    return x->type == EXP_TREE_VARIABLE || x->type == EXP_TREE_NUMBER;
+}
 
-        return CHANGED;         
-    }
+static bool ruleIsNonZero(Node *x)
+{
+    if (!x) return false;
 
-    return EXIT_SUCCESS;
-}
+    if (x->type == EXP_TREE_NUMBER) return !equalDouble(x->data.number, 0);
+    if (x->type != EXP_TREE_OPERATOR) return false;
 
-int caseTimes0(Evaluator *eval, Node *node, Node *zero)
-{   
-    ExpTreeErrors error = TREE_NO_ERROR;
-
-    if (VALUE_0(zero)) 
-    {   if (error) return error;                                             
-        subTreeDtor(node->left);                     
-        subTreeDtor(node->right);                    
-                                                     
-        node->type = EXP_TREE_NUMBER;                
-        node->data.number = 0;                       
-        node->left  = NULL;                          
-        node->right = NULL;
-
-        return CHANGED;                        
+    switch (x->data.operatorNum)
+    {
+        case MUL:   case DIV:   return ruleIsNonZero(x->left) && ruleIsNonZero(x->right);
+
+        case SUB:   return IS_CONST(x->left) && equalDouble(CONST_VALUE(x->left), 0) && ruleIsNonZero(x->right);
+
+        case POW:   return ruleIsNonZero(x->left) && IS_CONST(x->right);
+
+        case ADD:   return ruleIsNonNegative(x->left) && ruleIsNonNegative(x->right) &&
+                          (ruleIsNonZero(x->left) || ruleIsNonZero(x->right));
+
+        case NOT_OPER:  case LN:
+        case LOGAR:     case SIN:
+        case COS:       case R_BRACKET:
+        case L_BRACKET: case ASSIGN:
+        case BELOW:     case ABOVE:
+        case IF:        case INSTR_END:
+        case OPEN_F:    case CLOSE_F:
+        case WHILE:     case IN:
+        case OUT:       case THEN:
+        case EQUAL:     case NOT_EQUAL:
+        case SQRT:      case NEW_VAR:
+        default:        return false;
     }
-
-    return EXIT_SUCCESS;
 }
 
-int caseTimes1(Evaluator *eval, Node *node, Node *one, Node *savedNode) 
+static bool ruleIsNonNegative(Node *x)
 {
-    CHECK_POISON_PTR(one);
-    CHECK_POISON_PTR(savedNode);
-
-    ExpTreeErrors error = TREE_NO_ERROR;
+    if (!x) return false;
 
-    if (VALUE_1(one))                           
-    {   
-        if (error) return error;                                       
-        subTreeDtor(one);               
-        *node = *savedNode;               
-        destroyNode(&savedNode);
+    if (x->type == EXP_TREE_NUMBER) return x->data.number >= 0;
+    if (x->type != EXP_TREE_OPERATOR) return false;
 
-        return CHANGED;       
+    switch (x->data.operatorNum)
+    {
+        case SQRT:  return true;
+
+        case ADD:   case MUL:
+        case DIV:   return (ruleIsNonNegative(x->left) && ruleIsNonNegative(x->right)) ||
+                           (x->data.operatorNum == MUL && ruleTreesEqual(x->left, x->right));
+
+        case POW:   return IS_CONST(x->right) && equalDouble(fmod(CONST_VALUE(x->right), 2), 0);
+
+        case NOT_OPER:  case SUB:
+        case LN:        case LOGAR:
+        case SIN:       case COS:
+        case R_BRACKET: case L_BRACKET:
+        case ASSIGN:    case BELOW:
+        case ABOVE:     case IF:
+        case INSTR_END: case OPEN_F:
+        case CLOSE_F:   case WHILE:
+        case IN:        case OUT:
+        case THEN:      case EQUAL:
+        case NOT_EQUAL: case NEW_VAR:
+        default:        return false;
     }
-
-    return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
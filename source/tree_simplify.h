@@ -5,14 +5,12 @@
 
 int expTreeSimplify           (Evaluator *eval, Node *node);
 
-int expTreeSimplifyConsts     (Evaluator *eval, Node *node);
-int expTreeSimplifyNeutralElem(Evaluator *eval, Node *node);
+int expTreeSimplifyFold       (Evaluator *eval, Node *node);
 
 int tryNodeSimplify           (Evaluator *eval, Node *node);
 
-int casePlus0 (Evaluator *eval, Node *node, Node *zero, Node *savedNode);
-int caseTimes1(Evaluator *eval, Node *node, Node *one,  Node *savedNode);
-int caseTimes0(Evaluator *eval, Node *node, Node *zero);
+// the rules are compiled on the first use and kept for the whole program, this frees them
+int expTreeSimplifyDtor       (void);
 
 
 #endif //__TREE_SIMPLIFY_H__
\ No newline at end of file
@@ -0,0 +1,418 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <assert.h>
+
+#include "tree_of_expressions.h"
+#include "html_logfile.h"
+#include "unroll.h"
+
+#define CHECK_POISON_PTR(ptr) \
+    if (ptr == PtrPoison)     \
+    {                         \
+        LOG("ERROR: PoisonPtr detected in %s(%d) %s\n", __FILE__, __LINE__, __func__);\
+        return 0;                                                                     \
+    }
+
+//-------------------------------------------------------------------------------------------------
+// Unrolling of counting pokuda loops. A counting loop compares its counter i to a bound, pokuda
+// i menshe B (or i bolshe B), assigns i exactly once by a statement of the body itself, i = i + c
+// with c moving i towards B, and i holds a known integer when the loop starts. B is a number or
+// a variable the loop does not assign.
+// With a number B the number of iterations is known: a loop that never runs is removed, and one
+// that runs at most UnrollMaxTrips times is replaced by that many copies of its body. Any other
+// counting loop is unrolled by factor:
+//     pokuda i + (factor - 1) * c menshe B togda { body  body ... body }
+//     pokuda i menshe B togda body
+// the first loop runs while factor more iterations are left, the second one does the rest and
+// is dropped when the number of iterations is known to be a multiple of factor. i only takes
+// integer values, so i + (factor - 1) * c is exactly the value it has factor - 1 iterations
+// later. Inner loops are unrolled first and no loop grows beyond UnrollMaxNodes nodes.
+// The copies still count with i, propagateConstants turns that into numbers where it can.
+//-------------------------------------------------------------------------------------------------
+
+#define IS_OPER(node, oper) ((node) && (node)->type == EXP_TREE_OPERATOR && (node)->data.operatorNum == (oper))
+#define IS_VAR(node, var)   ((node) && (node)->type == EXP_TREE_VARIABLE && (node)->data.variableNum == (var))
+#define IS_NUMBER(node)     ((node) && (node)->type == EXP_TREE_NUMBER)
+
+static int  unrollStatement(UnrollPass *pass, Node **slot, InductionKnown *known);
+static int  unrollBlock    (UnrollPass *pass, Node **link, InductionKnown *known);
+static int  unrollLoop     (UnrollPass *pass, Node **slot, InductionKnown *known);
+
+static bool unrollFindCounter(Node *loop, InductionKnown *known, UnrollCounter *counter);
+static bool unrollTryCounter (Node *loop, Node *var, Node *bound, ExpTreeOperators oper,
+                              InductionKnown *known, UnrollCounter *counter);
+static long long unrollTrips (UnrollCounter *counter);
+
+static Node    *unrollCopies   (Node *body, int count);
+static Node    *unrollCopy     (Node *node);
+static int      unrollSize     (Node *node);
+static bool     unrollIsInteger(double number);
+static bool     unrollRuns     (ExpTreeOperators oper, double counter, double bound);
+static void     unrollKill     (InductionKnown *known, unsigned vars);
+static unsigned unrollAssigned (Node *node);
+static int      unrollAssigns  (Node *node, int var);
+
+
+int unrollLoops(Evaluator *eval, Node **root, int factor, UnrollStats *stats)
+{
+    assert(eval);
+    assert(root);
+    CHECK_POISON_PTR(*root);
+
+    UnrollPass pass = {};
+    pass.eval   = eval;
+    pass.factor = factor;
+
+    // every variable starts as DefaultVarValue
+    InductionKnown known = {};
+    known.mask = (1u << NamesNumber) - 1;
+
+    for (int i = 0; i < NamesNumber; i++) known.values[i] = DefaultVarValue;
+
+    unrollStatement(&pass, root, &known);
+
+    LOG("%s: %d loops unrolled fully, %d by %d, %d removed, error %d\n",
+        __func__, pass.stats.full, pass.stats.partial, factor, pass.stats.removed, pass.error);
+
+    if (stats) *stats = pass.stats;
+
+    return pass.error;
+}
+
+static int unrollStatement(UnrollPass *pass, Node **slot, InductionKnown *known)
+{
+    assert(pass);
+    assert(slot);
+    assert(known);
+
+    Node *stmt = *slot;
+    if (!stmt || stmt == PtrPoison || stmt->type != EXP_TREE_OPERATOR || pass->error) return pass->error;
+
+    switch (stmt->data.operatorNum)
+    {
+        case INSTR_END: return unrollBlock(pass, slot, known);
+
+        case ASSIGN:
+        {
+            if (!stmt->right || stmt->right->type != EXP_TREE_VARIABLE) return EXIT_SUCCESS;
+
+            int var = stmt->right->data.variableNum;
+            unrollKill(known, 1u << var);
+
+            if (IS_NUMBER(stmt->left))
+            {
+                known->values[var] = stmt->left->data.number;
+                known->mask       |= 1u << var;
+            }
+
+            return EXIT_SUCCESS;
+        }
+
+        case IN:        unrollKill(known, unrollAssigned(stmt));
+                        return EXIT_SUCCESS;
+
+        case IF:
+        {
+            InductionKnown body = *known;
+            unrollStatement(pass, &stmt->right, &body);
+
+            unrollKill(known, unrollAssigned(stmt));
+            return pass->error;
+        }
+
+        case WHILE:
+        {
+            // the unrolled code assigns the same variables
+            unsigned assigned = unrollAssigned(stmt);
+
+            unrollLoop(pass, slot, known);
+
+            unrollKill(known, assigned);
+            return pass->error;
+        }
+
+        case NOT_OPER:  case ADD:       case SUB:       case MUL:
+        case DIV:       case LN:        case LOGAR:     case POW:
+        case SIN:       case COS:       case R_BRACKET: case L_BRACKET:
+        case BELOW:     case ABOVE:     case OPEN_F:    case CLOSE_F:
+        case OUT:       case THEN:      case EQUAL:     case NOT_EQUAL:
+        case SQRT:      case NEW_VAR:
+        default:        return EXIT_SUCCESS;
+    }
+}
+
+static int unrollBlock(UnrollPass *pass, Node **link, InductionKnown *known)
+{
+    assert(pass);
+    assert(link);
+    assert(known);
+
+    while (IS_OPER(*link, INSTR_END) && !pass->error)
+    {
+        Node *item = *link;
+
+        unrollStatement(pass, &item->left, known);
+        link = &item->right;
+    }
+
+    return unrollStatement(pass, link, known);
+}
+
+// *slot becomes the unrolled code, a block of its own if there is more than one statement
+static int unrollLoop(UnrollPass *pass, Node **slot, InductionKnown *known)
+{
+    assert(pass);
+    assert(slot);
+    assert(known);
+
+    Node *loop = *slot;
+
+    InductionKnown inner = *known;
+    unrollKill(&inner, unrollAssigned(loop));
+
+    // inner loops first, the copies are made of the unrolled ones
+    unrollStatement(pass, &loop->right, &inner);
+    if (pass->error) return pass->error;
+
+    UnrollCounter counter = {};
+    if (!unrollFindCounter(loop, known, &counter)) return EXIT_SUCCESS;
+
+    int size = unrollSize(loop->right);
+
+    if (counter.trips == 0)
+    {
+        LOG("%s: the loop of line %d never runs\n", __func__, loop->line);
+
+        subTreeDtor(loop);
+        *slot = NULL;
+
+        pass->stats.removed++;
+        return EXIT_SUCCESS;
+    }
+
+    if (counter.trips > 0 && counter.trips <= UnrollMaxTrips && counter.trips * size <= UnrollMaxNodes)
+    {
+        Node *copies = unrollCopies(loop->right, (int) counter.trips);
+        if (!copies) return pass->error = MEMORY_ERROR;
+
+        LOG("%s: the loop of line %d runs %lld times, unrolled fully\n", __func__, loop->line, counter.trips);
+
+        subTreeDtor(loop);
+        *slot = copies;
+
+        pass->stats.full++;
+        return EXIT_SUCCESS;
+    }
+
+    int factor = pass->factor;
+    if (factor < 2 || size * factor > UnrollMaxNodes) return EXIT_SUCCESS;
+
+    int   line   = loop->line;
+    Node *ahead  = createNode(EXP_TREE_OPERATOR, createNodeData(EXP_TREE_OPERATOR, ADD),
+                              createNode(EXP_TREE_VARIABLE, createNodeData(EXP_TREE_VARIABLE, counter.var), NULL, NULL),
+                              createNode(EXP_TREE_NUMBER,   createNodeData(EXP_TREE_NUMBER, (factor - 1) * counter.step),
+                                         NULL, NULL));
+    Node *cond   = createNode(EXP_TREE_OPERATOR, createNodeData(EXP_TREE_OPERATOR, counter.oper), ahead,
+                              unrollCopy(counter.bound));
+    Node *copies = unrollCopies(loop->right, factor);
+    Node *first  = createNode(EXP_TREE_OPERATOR, createNodeData(EXP_TREE_OPERATOR, WHILE), cond, copies);
+
+    if (!ahead || !ahead->left || !ahead->right || !cond || !cond->right || !copies || !first)
+    {
+        return pass->error = MEMORY_ERROR;
+    }
+
+    ahead->line = ahead->left->line = ahead->right->line = cond->line = first->line = line;
+
+    // the rest of the iterations, none if their number is a multiple of factor
+    bool  rest  = counter.trips < 0 || counter.trips % factor != 0;
+    Node *block = createNode(EXP_TREE_OPERATOR, createNodeData(EXP_TREE_OPERATOR, INSTR_END), first,
+                             rest ? createNode(EXP_TREE_OPERATOR, createNodeData(EXP_TREE_OPERATOR, INSTR_END), loop, NULL)
+                                  : NULL);
+    if (!block || (rest && !block->right)) return pass->error = MEMORY_ERROR;
+
+    if (!rest) subTreeDtor(loop);
+    *slot = block;
+
+    LOG("%s: the loop of line %d unrolled by %d%s\n", __func__, line, factor, rest ? "" : ", no iterations left");
+
+    pass->stats.partial++;
+    return EXIT_SUCCESS;
+}
+
+static bool unrollFindCounter(Node *loop, InductionKnown *known, UnrollCounter *counter)
+{
+    assert(loop);
+    assert(known);
+    assert(counter);
+
+    Node *cond = loop->left;
+    if (!IS_OPER(cond, BELOW) && !IS_OPER(cond, ABOVE)) return false;
+
+    ExpTreeOperators oper    = (ExpTreeOperators) cond->data.operatorNum;
+    ExpTreeOperators flipped = oper == BELOW ? ABOVE : BELOW;
+
+    // i menshe n and n bolshe i are the same loop
+    return unrollTryCounter(loop, cond->left,  cond->right, oper,    known, counter) ||
+           unrollTryCounter(loop, cond->right, cond->left,  flipped, known, counter);
+}
+
+static bool unrollTryCounter(Node *loop, Node *var, Node *bound, ExpTreeOperators oper,
+                             InductionKnown *known, UnrollCounter *counter)
+{
+    assert(loop);
+    assert(known);
+    assert(counter);
+
+    if (!var || var->type != EXP_TREE_VARIABLE || !bound) return false;
+
+    int i = var->data.variableNum;
+
+    if (!IS_NUMBER(bound) && !(bound->type == EXP_TREE_VARIABLE && !(unrollAssigned(loop) & (1u << bound->data.variableNum))))
+    {
+        return false;
+    }
+
+    if (!(known->mask & (1u << i)) || !unrollIsInteger(known->values[i])) return false;
+    if (unrollAssigns(loop->right, i) != 1) return false;
+
+    // the assignment is a statement of the body itself, so it runs once in every iteration
+    for (Node *item = loop->right; item; item = IS_OPER(item, INSTR_END) ? item->right : NULL)
+    {
+        Node *stmt = IS_OPER(item, INSTR_END) ? item->left : item;
+        if (!IS_OPER(stmt, ASSIGN) || !IS_VAR(stmt->right, i)) continue;
+
+        Node *value = stmt->left;
+        if (!IS_OPER(value, ADD) && !IS_OPER(value, SUB)) return false;
+
+        double step = 0;
+
+        if (IS_VAR(value->left, i) && IS_NUMBER(value->right))
+        {
+            step = IS_OPER(value, ADD) ? value->right->data.number : -value->right->data.number;
+        }
+        else if (IS_OPER(value, ADD) && IS_VAR(value->right, i) && IS_NUMBER(value->left))
+        {
+            step = value->left->data.number;
+        }
+        else return false;
+
+        if (!unrollIsInteger(step) || !(oper == BELOW ? step > 0 : step < 0)) return false;
+
+        counter->var   = i;
+        counter->init  = known->values[i];
+        counter->step  = step;
+        counter->oper  = oper;
+        counter->bound = bound;
+        counter->trips = IS_NUMBER(bound) ? unrollTrips(counter) : -1;
+
+        return true;
+    }
+
+    return false;
+}
+
+// how many times the body runs, -1 if too many to count exactly
+static long long unrollTrips(UnrollCounter *counter)
+{
+    assert(counter);
+    assert(IS_NUMBER(counter->bound));
+
+    double bound = counter->bound->data.number;
+    double trips = ceil((bound - counter->init) / counter->step);
+
+    if (!(trips > 0))                 return 0;
+    if (!(trips <= InductionMaxExact)) return -1;
+
+    long long count = (long long) trips;
+
+    // the division rounds, the comparisons of the loop decide
+    while (count > 0 && !unrollRuns(counter->oper, counter->init + (double) (count - 1) * counter->step, bound)) count--;
+    while (unrollRuns(counter->oper, counter->init + (double) count * counter->step, bound))                     count++;
+
+    return count;
+}
+
+// count copies of body in an INSTR_END chain
+static Node *unrollCopies(Node *body, int count)
+{
+    assert(count > 0);
+
+    Node  *first = NULL;
+    Node **tail  = &first;
+
+    for (int i = 0; i < count; i++)
+    {
+        Node *item = createNode(EXP_TREE_OPERATOR, createNodeData(EXP_TREE_OPERATOR, INSTR_END), unrollCopy(body), NULL);
+        if (!item || (body && !item->left))
+        {
+            subTreeDtor(item);
+            subTreeDtor(first);
+            return NULL;
+        }
+
+        *tail = item;
+        tail  = &item->right;
+    }
+
+    return first;
+}
+
+static Node *unrollCopy(Node *node)
+{
+    if (!node || node == PtrPoison) return NULL;
+
+    Node *copy = createNode(node->type, node->data, unrollCopy(node->left), unrollCopy(node->right));
+    if (copy) copy->line = node->line;
+
+    return copy;
+}
+
+static int unrollSize(Node *node)
+{
+    if (!node || node == PtrPoison) return 0;
+
+    return 1 + unrollSize(node->left) + unrollSize(node->right);
+}
+
+static bool unrollIsInteger(double number)
+{
+    return fabs(number) <= InductionMaxExact && !(floor(number) < number);
+}
+
+static bool unrollRuns(ExpTreeOperators oper, double counter, double bound)
+{
+    return oper == BELOW ? counter < bound : counter > bound;
+}
+
+static void unrollKill(InductionKnown *known, unsigned vars)
+{
+    assert(known);
+
+    known->mask &= ~vars;
+}
+
+// bit mask of the variables that the statements in node assign
+static unsigned unrollAssigned(Node *node)
+{
+    if (!node || node == PtrPoison || node->type != EXP_TREE_OPERATOR) return 0;
+
+    if ((IS_OPER(node, ASSIGN) || IS_OPER(node, IN)) && node->right && node->right->type == EXP_TREE_VARIABLE)
+    {
+        return 1u << node->right->data.variableNum;
+    }
+
+    return unrollAssigned(node->left) | unrollAssigned(node->right);
+}
+
+// how many statements in node assign var, vvedi counts as many as there are
+static int unrollAssigns(Node *node, int var)
+{
+    if (!node || node == PtrPoison || node->type != EXP_TREE_OPERATOR) return 0;
+
+    if (IS_OPER(node, IN) && IS_VAR(node->right, var)) return NamesNumber;
+    if (IS_OPER(node, ASSIGN)) return IS_VAR(node->right, var) ? 1 : 0;
+
+    return unrollAssigns(node->left, var) + unrollAssigns(node->right, var);
+}
@@ -0,0 +1,39 @@
+#ifndef  __UNROLL_H__
+#define  __UNROLL_H__
+
+#include "tree_of_expressions.h"
+#include "induction.h"
+
+const int UnrollDefaultFactor = 4;
+const int UnrollMaxTrips      = 16;     // loops with more iterations are not unrolled fully
+const int UnrollMaxNodes      = 256;    // nodes of the unrolled code
+
+// pokuda i < bound (or i > bound) whose body does i = i + step once in every iteration
+struct UnrollCounter
+{
+    int               var;
+    double            init;
+    double            step;
+    ExpTreeOperators  oper;     // BELOW or ABOVE, with the counter on the left
+    Node             *bound;
+    long long         trips;    // -1 if it is not known
+};
+
+struct UnrollStats
+{
+    int full;
+    int partial;
+    int removed;
+};
+
+struct UnrollPass
+{
+    Evaluator   *eval;
+    int          factor;
+    UnrollStats  stats;
+    int          error;
+};
+
+int unrollLoops(Evaluator *eval, Node **root, int factor, UnrollStats *stats);
+
+#endif //__UNROLL_H__